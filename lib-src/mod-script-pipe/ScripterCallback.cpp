@@ -14,6 +14,8 @@
 // security risk.  Use at your own risk.
 
 #include <wx/wx.h>
+#include <mutex>
+#include <string>
 #include "ScripterCallback.h"
 //#include "../lib_widget_extra/ShuttleGuiBase.h"
 #include "../../src/Audacity.h"
@@ -59,9 +61,32 @@ typedef enum
 
 
 extern void PipeServer();
+#if !defined(WIN32)
+extern void StartSocketServer();
+#endif
 typedef SCRIPT_PIPE_DLL_IMPORT int (*tpExecScriptServerFunc)( wxString * pIn, wxString * pOut);
 static tpExecScriptServerFunc pScriptServerFn=NULL;
 
+// The fifo and socket servers run on different threads, but Audacity
+// can only obey one command at a time.
+static std::mutex srvMutex;
+
+// Send one command to Audacity and return its whole response: the
+// response lines, each ending in a newline, then an empty line.
+void DoSrvCommand(const std::string &in, std::string &out)
+{
+   wxString Str1(in.c_str(), wxConvISO8859_1);
+   Str1.Replace( wxT("\r"), wxT(""));
+   Str1.Replace( wxT("\n"), wxT(""));
+   wxString response;
+   {
+      std::lock_guard<std::mutex> locker(srvMutex);
+      (*pScriptServerFn)( &Str1, &response);
+   }
+   out = (const char *)response.mb_str();
+   out += '\n';
+}
+
 
 extern "C" {
 
@@ -105,6 +130,9 @@ int SCRIPT_PIPE_DLL_API RegScriptServerFunc( tpExecScriptServerFunc pFn )
    if( pFn )
    {
       pScriptServerFn = pFn;
+#if !defined(WIN32)
+      StartSocketServer();
+#endif
       PipeServer();
    }
 
@@ -125,7 +153,10 @@ int DoSrv(char *pIn)
    Str1.Replace( wxT("\r"), wxT(""));
    Str1.Replace( wxT("\n"), wxT(""));
    Str2 = wxEmptyString;
-   (*pScriptServerFn)( &Str1 , &Str2);
+   {
+      std::lock_guard<std::mutex> locker(srvMutex);
+      (*pScriptServerFn)( &Str1 , &Str2);
+   }
 
    Str2 += wxT('\n');
    size_t outputLength = Str2.Length();
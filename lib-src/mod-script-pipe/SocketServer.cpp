@@ -0,0 +1,580 @@
+// SocketServer.cpp :
+//
+// A Unix-domain socket (and optionally TCP loopback) server for
+// mod-script-pipe.  Unlike the fifo server in PipeServer.cpp it does not
+// wait for the response to one command before reading the next: clients
+// may write as many commands as they like, one per line, and responses
+// are streamed back in the same order as soon as each one is ready.
+//
+// Each response is the same text the fifo server sends: the lines the
+// command produced, then an empty line.
+//
+// The socket is /tmp/audacity_script_pipe.sock.<uid>, or the path in
+// AUDACITY_SCRIPT_SOCKET.  If AUDACITY_SCRIPT_PORT is set, the server also
+// listens on that TCP port of 127.0.0.1.
+//
+// Lines beginning "ScriptServer:" are handled here and not passed on:
+//    ScriptServer: Latency=1    append a Latency line to each response
+//    ScriptServer: Latency=0    stop doing so
+//    ScriptServer: Stats        count and latency of commands so far
+//
+// Threads: one thread does all the socket I/O, and one more runs the
+// commands, one at a time, in the order they arrived.
+
+#if !defined(WIN32)
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const char socktmpl[] = "/tmp/audacity_script_pipe.sock.%d";
+
+// A client that sends this much without a newline is dropped.
+const size_t nMaxLine = 1 << 20;
+
+// Defined in ScripterCallback.cpp
+extern void DoSrvCommand(const std::string &in, std::string &out);
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double Milliseconds(Clock::duration d)
+{
+   return std::chrono::duration<double, std::milli>(d).count();
+}
+
+struct Connection
+{
+   explicit Connection(int fd_)
+      : fd(fd_), eof(false), queued(0), reportLatency(false), closed(false)
+   {}
+
+   int fd;
+
+   // Touched only by the I/O thread
+   std::string received;   // bytes not yet split into commands
+   std::string sending;    // bytes taken from pending, not yet written
+   bool eof;               // the client has stopped writing
+
+   // Guarded by the server mutex
+   std::string pending;    // responses not yet taken by the I/O thread
+   int queued;             // commands without a response yet
+
+   // Touched only by the command thread
+   bool reportLatency;
+
+   std::atomic<bool> closed;
+};
+
+typedef std::shared_ptr<Connection> ConnectionPtr;
+
+struct Request
+{
+   ConnectionPtr conn;
+   std::string command;
+   Clock::time_point received;
+};
+
+class SocketServer
+{
+public:
+   SocketServer() : mCommands(0), mTotalLatency(0), mMaxLatency(0)
+   {
+      mWake[0] = mWake[1] = -1;
+   }
+
+   bool Start();
+
+private:
+   bool ListenUnix();
+   bool ListenTCP();
+
+   void IOLoop();
+   void Accept(int listener);
+   bool Receive(const ConnectionPtr &conn);
+   bool Send(Connection &conn);
+   bool Finished(Connection &conn);
+   void Close(const ConnectionPtr &conn);
+
+   void CommandLoop();
+   bool ServerCommand(Connection &conn, const std::string &command,
+                      std::string &response);
+   void Wake();
+
+   std::vector<int> mListeners;
+   int mWake[2];
+
+   // I/O thread only
+   std::vector<ConnectionPtr> mConnections;
+
+   std::mutex mMutex;
+   std::condition_variable mAvailable;
+   std::deque<Request> mRequests;
+
+   // Command thread only
+   unsigned long mCommands;
+   double mTotalLatency;
+   double mMaxLatency;
+};
+
+bool SetNonBlocking(int fd)
+{
+   int flags = fcntl(fd, F_GETFL, 0);
+   return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool SocketServer::Start()
+{
+   if (pipe(mWake) != 0 || !SetNonBlocking(mWake[0]) ||
+       !SetNonBlocking(mWake[1]))
+   {
+      perror("Unable to create socket server wake pipe");
+      return false;
+   }
+
+   ListenUnix();
+   ListenTCP();
+   if (mListeners.empty())
+      return false;
+
+   std::thread(&SocketServer::IOLoop, this).detach();
+   std::thread(&SocketServer::CommandLoop, this).detach();
+   return true;
+}
+
+bool SocketServer::ListenUnix()
+{
+   struct sockaddr_un addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+
+   const char *path = getenv("AUDACITY_SCRIPT_SOCKET");
+   if (path && *path)
+      snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+   else
+      snprintf(addr.sun_path, sizeof(addr.sun_path), socktmpl, (int)getuid());
+
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0)
+   {
+      perror("Unable to create script socket");
+      return false;
+   }
+
+   // Only a socket may be replaced, never a file of some other kind.
+   struct stat st;
+   if (lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(addr.sun_path);
+
+   // Make the socket private to this user from the start.
+   mode_t oldMask = umask(0077);
+   int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+   umask(oldMask);
+
+   if (rc != 0 || listen(fd, SOMAXCONN) != 0 || !SetNonBlocking(fd))
+   {
+      perror("Unable to listen on script socket");
+      close(fd);
+      return false;
+   }
+
+   printf("Script server listening on %s\n", addr.sun_path);
+   mListeners.push_back(fd);
+   return true;
+}
+
+bool SocketServer::ListenTCP()
+{
+   const char *port = getenv("AUDACITY_SCRIPT_PORT");
+   if (!port || !*port)
+      return false;
+
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd < 0)
+   {
+      perror("Unable to create script TCP socket");
+      return false;
+   }
+
+   int one = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = htons((unsigned short)atoi(port));
+
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+       listen(fd, SOMAXCONN) != 0 || !SetNonBlocking(fd))
+   {
+      perror("Unable to listen on script TCP port");
+      close(fd);
+      return false;
+   }
+
+   printf("Script server listening on 127.0.0.1:%s\n", port);
+   mListeners.push_back(fd);
+   return true;
+}
+
+void SocketServer::IOLoop()
+{
+   std::vector<struct pollfd> fds;
+
+   for (;;)
+   {
+      fds.clear();
+
+      struct pollfd pfd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      pfd.fd = mWake[0];
+      fds.push_back(pfd);
+      for (size_t i = 0; i < mListeners.size(); i++)
+      {
+         pfd.fd = mListeners[i];
+         fds.push_back(pfd);
+      }
+
+      {
+         std::lock_guard<std::mutex> locker(mMutex);
+         for (size_t i = 0; i < mConnections.size(); i++)
+         {
+            Connection &conn = *mConnections[i];
+            pfd.fd = conn.fd;
+            pfd.events = conn.eof ? 0 : POLLIN;
+            if (!conn.sending.empty() || !conn.pending.empty())
+               pfd.events |= POLLOUT;
+            fds.push_back(pfd);
+         }
+      }
+
+      if (poll(&fds[0], fds.size(), -1) < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         perror("Script server poll failed, quitting");
+         return;
+      }
+
+      if (fds[0].revents)
+      {
+         char buf[64];
+         while (read(mWake[0], buf, sizeof(buf)) > 0)
+            ;
+      }
+
+      size_t first = 1 + mListeners.size();
+
+      // Connections first, since Accept() adds to mConnections.
+      std::vector<ConnectionPtr> dropped;
+      for (size_t i = first; i < fds.size(); i++)
+      {
+         const ConnectionPtr &conn = mConnections[i - first];
+         short revents = fds[i].revents;
+         bool ok = true;
+         // Once the client has closed both ways, nothing more can reach it.
+         if ((revents & POLLERR) || (conn->eof && (revents & POLLHUP)))
+            ok = false;
+         else if (!conn->eof && (revents & (POLLIN | POLLHUP)))
+            ok = Receive(conn);
+         // Always try, in case responses arrived since the poll started.
+         if (ok)
+            ok = Send(*conn) && !Finished(*conn);
+         if (!ok)
+            dropped.push_back(conn);
+      }
+      for (size_t i = 0; i < dropped.size(); i++)
+         Close(dropped[i]);
+
+      for (size_t i = 1; i < first; i++)
+         if (fds[i].revents & POLLIN)
+            Accept(fds[i].fd);
+   }
+}
+
+void SocketServer::Accept(int listener)
+{
+   for (;;)
+   {
+      int fd = accept(listener, NULL, NULL);
+      if (fd < 0)
+         return;
+
+      if (!SetNonBlocking(fd))
+      {
+         close(fd);
+         continue;
+      }
+#if defined(SO_NOSIGPIPE)
+      int one = 1;
+      setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+      mConnections.push_back(std::make_shared<Connection>(fd));
+   }
+}
+
+// A client that has stopped writing is closed once it has all of its
+// responses.
+bool SocketServer::Finished(Connection &conn)
+{
+   if (!conn.eof || !conn.sending.empty())
+      return false;
+   std::lock_guard<std::mutex> locker(mMutex);
+   return conn.queued == 0 && conn.pending.empty();
+}
+
+// Read what the client has sent, and queue every complete line as a
+// command.  Returns false if the connection should be closed.
+bool SocketServer::Receive(const ConnectionPtr &conn)
+{
+   char buf[16384];
+
+   for (;;)
+   {
+      ssize_t n = read(conn->fd, buf, sizeof(buf));
+      if (n > 0)
+      {
+         conn->received.append(buf, n);
+         continue;
+      }
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+         return false;
+      // A client may shut down its writing side and still wait for the
+      // responses.
+      if (n == 0)
+         conn->eof = true;
+      break;
+   }
+
+   std::vector<std::string> commands;
+   size_t start = 0;
+   size_t end;
+   while ((end = conn->received.find('\n', start)) != std::string::npos)
+   {
+      size_t len = end - start;
+      if (len > 0 && conn->received[end - 1] == '\r')
+         len--;
+      if (len > 0)
+         commands.push_back(conn->received.substr(start, len));
+      start = end + 1;
+   }
+   conn->received.erase(0, start);
+
+   if (conn->received.size() > nMaxLine)
+      return false;
+
+   if (!commands.empty())
+   {
+      // Queue the whole batch at once, so that the command thread runs it
+      // without waiting on us again.
+      Clock::time_point now = Clock::now();
+      {
+         std::lock_guard<std::mutex> locker(mMutex);
+         for (size_t i = 0; i < commands.size(); i++)
+         {
+            Request request;
+            request.conn = conn;
+            request.command.swap(commands[i]);
+            request.received = now;
+            mRequests.push_back(request);
+         }
+         conn->queued += commands.size();
+      }
+      mAvailable.notify_one();
+   }
+
+   return true;
+}
+
+// Write as many of the ready responses as the socket will take.
+// Returns false if the connection should be closed.
+bool SocketServer::Send(Connection &conn)
+{
+   if (conn.sending.empty())
+   {
+      std::lock_guard<std::mutex> locker(mMutex);
+      conn.sending.swap(conn.pending);
+   }
+
+   size_t written = 0;
+   while (written < conn.sending.size())
+   {
+#if defined(MSG_NOSIGNAL)
+      ssize_t n = send(conn.fd, conn.sending.data() + written,
+                       conn.sending.size() - written, MSG_NOSIGNAL);
+#else
+      ssize_t n = send(conn.fd, conn.sending.data() + written,
+                       conn.sending.size() - written, 0);
+#endif
+      if (n > 0)
+         written += n;
+      else if (n < 0 && errno == EINTR)
+         continue;
+      else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+      else
+         return false;
+   }
+   conn.sending.erase(0, written);
+   return true;
+}
+
+void SocketServer::Close(const ConnectionPtr &conn)
+{
+   // Commands still queued for this client are dropped by the command
+   // thread when it sees this flag.
+   conn->closed = true;
+   close(conn->fd);
+
+   for (size_t i = 0; i < mConnections.size(); i++)
+      if (mConnections[i] == conn)
+      {
+         mConnections.erase(mConnections.begin() + i);
+         break;
+      }
+}
+
+void SocketServer::Wake()
+{
+   char c = 0;
+   // If the pipe is full the I/O thread is going to wake anyway.
+   ssize_t rc = write(mWake[1], &c, 1);
+   (void)rc;
+}
+
+void SocketServer::CommandLoop()
+{
+   for (;;)
+   {
+      Request request;
+      {
+         std::unique_lock<std::mutex> locker(mMutex);
+         while (mRequests.empty())
+            mAvailable.wait(locker);
+         request = mRequests.front();
+         mRequests.pop_front();
+      }
+
+      Connection &conn = *request.conn;
+      if (conn.closed)
+      {
+         std::lock_guard<std::mutex> locker(mMutex);
+         conn.queued--;
+         continue;
+      }
+
+      Clock::time_point started = Clock::now();
+
+      std::string response;
+      if (!ServerCommand(conn, request.command, response))
+         DoSrvCommand(request.command, response);
+
+      Clock::time_point finished = Clock::now();
+      double latency = Milliseconds(finished - request.received);
+      mCommands++;
+      mTotalLatency += latency;
+      if (latency > mMaxLatency)
+         mMaxLatency = latency;
+
+      if (conn.reportLatency)
+      {
+         char line[128];
+         snprintf(line, sizeof(line), "Latency: queued=%.3fms run=%.3fms\n",
+                  Milliseconds(started - request.received),
+                  Milliseconds(finished - started));
+         // Before the empty line that ends the response
+         response.insert(response.empty() ? 0 : response.size() - 1, line);
+      }
+
+      bool wake;
+      {
+         std::lock_guard<std::mutex> locker(mMutex);
+         // Once there are responses waiting the I/O thread has been woken
+         // already, and takes these as well.
+         wake = conn.pending.empty();
+         conn.pending += response;
+         conn.queued--;
+      }
+      if (wake)
+         Wake();
+   }
+}
+
+// Handle the commands that are meant for this server rather than for
+// Audacity.  Returns false if the command is not one of them.
+bool SocketServer::ServerCommand(Connection &conn, const std::string &command,
+                                 std::string &response)
+{
+   const std::string name = "ScriptServer:";
+   if (command.compare(0, name.size(), name) != 0)
+      return false;
+
+   std::string param = command.substr(name.size());
+   param.erase(0, param.find_first_not_of(" \t"));
+   param.erase(param.find_last_not_of(" \t") + 1);
+
+   bool ok = true;
+   if (param == "Latency=1")
+      conn.reportLatency = true;
+   else if (param == "Latency=0")
+      conn.reportLatency = false;
+   else if (param == "Stats")
+   {
+      char lines[256];
+      snprintf(lines, sizeof(lines),
+               "Commands: %lu\nMeanLatency: %.3fms\nMaxLatency: %.3fms\n",
+               mCommands,
+               mCommands ? mTotalLatency / mCommands : 0.0,
+               mMaxLatency);
+      response += lines;
+   }
+   else
+      ok = false;
+
+   // These strings are deliberately not localised, like the responses of
+   // Audacity's own commands.
+   response += ok ? "ScriptServer finished: OK\n" : "ScriptServer finished: Failed!\n";
+   response += "\n";
+   return true;
+}
+
+} // namespace
+
+void StartSocketServer()
+{
+   static std::once_flag started;
+   std::call_once(started, [] {
+      // Lives as long as the process, like its threads.
+      SocketServer *server = new SocketServer;
+      if (!server->Start())
+         printf("Script socket server not started\n");
+   });
+}
+
+#endif
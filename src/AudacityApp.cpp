@@ -89,6 +89,7 @@ It handles initialization and termination by subclassing wxApp.
 #include "SplashDialog.h"
 #include "FFT.h"
 #include "BlockFile.h"
+#include "MappedFile.h"
 #include "ondemand/ODManager.h"
 #include "commands/Keyboard.h"
 #include "widgets/ErrorDialog.h"
@@ -678,6 +679,9 @@ int main(int argc, char *argv[])
 
    wxDISABLE_DEBUG_SUPPORT();
 
+   if (IsBenchmarkCommandLine(argc, argv))
+      return RunBenchmarkCommandLine(argc, argv);
+
    return wxEntry(argc, argv);
 }
 
@@ -704,6 +708,21 @@ extern "C" int WINAPI WinMain(HINSTANCE hInstance,
    return wxEntry(hInstance, hPrevInstance, NULL, nCmdShow);
 }
 
+#elif !defined(__WXMSW__)
+IMPLEMENT_APP_NO_MAIN(AudacityApp)
+IMPLEMENT_WX_THEME_SUPPORT
+
+int main(int argc, char *argv[])
+{
+   wxDISABLE_DEBUG_SUPPORT();
+
+   // Benchmarks run instead of the GUI, so that they need no display
+   if (IsBenchmarkCommandLine(argc, argv))
+      return RunBenchmarkCommandLine(argc, argv);
+
+   return wxEntry(argc, argv);
+}
+
 #else
 IMPLEMENT_APP(AudacityApp)
 #endif
@@ -1300,6 +1319,13 @@ bool AudacityApp::OnInit()
    // Initialize preferences and language
    InitPreferences();
 
+   // How many block files to keep memory-mapped; 0 reads them the old way
+   MappedFilePool::Instance().SetCapacity(
+      gPrefs->Read(wxT("/Directories/MappedBlockFiles"), 0L));
+
+   // Frames of each waveform summary level per frame of the next
+   BlockFile::SetSummaryFactor(gPrefs->Read(wxT("/GUI/SummaryFactor"), 16L));
+
 #if defined(__WXMSW__) && !defined(__WXUNIVERSAL__) && !defined(__CYGWIN__)
    this->AssociateFileTypes();
 #endif
@@ -1992,6 +2018,8 @@ int AudacityApp::OnExit()
 
    DeinitFFT();
 
+   SpecCache::ReleaseWorkerPool();
+
    DeinitAudioIO();
 
    // Terminate the PluginManager (must be done before deleting the locale)
@@ -804,6 +804,13 @@ class AudioThread /* not final */ : public wxThread {
 
 #endif
 
+// Writes recorded audio to the capture tracks, apart from the AudioThread,
+// which only refills the playback buffers
+class CaptureThread final : public AudioThread {
+ public:
+   ExitCode Entry() override;
+};
+
 #ifdef EXPERIMENTAL_MIDI_OUT
 class MidiThread final : public AudioThread {
  public:
@@ -822,6 +829,7 @@ void InitAudioIO()
 {
    gAudioIO = new AudioIO();
    gAudioIO->mThread->Run();
+   gAudioIO->mCaptureThread->Run();
 #ifdef EXPERIMENTAL_MIDI_OUT
    gAudioIO->mMidiThread->Run();
 #endif
@@ -887,6 +895,13 @@ AudioIO::AudioIO()
    mAudioThreadShouldCallFillBuffersOnce = false;
    mAudioThreadFillBuffersLoopRunning = false;
    mAudioThreadFillBuffersLoopActive = false;
+   mAudioThreadWake = false;
+   mCaptureThreadShouldDrainOnce = false;
+   mCaptureThreadDrainLoopRunning = false;
+   mCaptureThreadDrainLoopActive = false;
+   mCaptureWake = false;
+   mCaptureHighWater = 0;
+   mLostSamples = 0;
    mPortStreamV19 = NULL;
 
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -963,6 +978,8 @@ AudioIO::AudioIO()
    // Start thread
    mThread = new AudioThread();
    mThread->Create();
+   mCaptureThread = new CaptureThread();
+   mCaptureThread->Create();
 
 #if defined(USE_PORTMIXER)
    mPortMixer = NULL;
@@ -975,6 +992,9 @@ AudioIO::AudioIO()
 #endif
 
    mLastPlaybackTimeMillis = 0;
+   mFastStart = false;
+   mPlaybackSamplesToPrime = 0;
+   mLastStartLatencyMillis = 0;
 
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
    mScrubQueue = NULL;
@@ -1011,8 +1031,10 @@ AudioIO::~AudioIO()
    // wxTheApp->Yield();
 
    mThread->Delete();
+   mCaptureThread->Delete();
 
    delete mThread;
+   delete mCaptureThread;
 
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
    delete mScrubQueue;
@@ -1524,6 +1546,8 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
    if( IsBusy() )
       return 0;
 
+   const wxLongLong startMillis = ::wxGetLocalTimeMillis();
+
    // We just want to set mStreamToken to -1 - this way avoids
    // an extremely rare but possible race condition, if two functions
    // somehow called StartStream at the same time...
@@ -1640,19 +1664,41 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
    // mouse input, so make fillings more and shorter.
    // What Audio thread produces for playback is then consumed by the PortAudio
    // thread, in many smaller pieces.
-   double playbackTime = 4.0;
+   double playbackTime = 1.0;
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
    if (scrubbing)
       playbackTime = scrubDelay;
 #endif
    mPlaybackSamplesToCopy = playbackTime * mRate;
 
-   // Capacity of the playback buffer.
-   mPlaybackRingBufferSecs = 10.0;
+   // Fast start: prime the playback buffers with just enough to cover the
+   // device latency twice over, and fill the rest after the stream starts
+   gPrefs->Read(wxT("/AudioIO/FastStart"), &mFastStart, true);
+#ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
+   if (scrubbing)
+      mFastStart = false;
+#endif
+   double latencyDuration = DEFAULT_LATENCY_DURATION;
+   gPrefs->Read(wxT("/AudioIO/LatencyDuration"), &latencyDuration);
+   mPlaybackSamplesToPrime = std::min(mPlaybackSamplesToCopy,
+      (long)lrint(std::max(0.2, 2.0 * latencyDuration / 1000.0) * mRate));
+
+   // Capacity of the playback buffer.  The callback wakes the Audio thread
+   // as soon as there is room for a filling, so what remains in the buffer
+   // need only outlast the mixing of one filling, with a good margin.
+   mPlaybackRingBufferSecs = 4.0;
 
    mCaptureRingBufferSecs = 4.5 + 0.5 * std::min(size_t(16), mCaptureTracks->size());
    mMinCaptureSecsToCopy = 0.2 + 0.2 * std::min(size_t(16), mCaptureTracks->size());
 
+   // If the capture buffers came near to filling in the last recording,
+   // allow twice what it needed, up to a minute
+   double captureHighWaterSecs = 0.0;
+   gPrefs->Read(wxT("/AudioIO/CaptureHighWaterSecs"), &captureHighWaterSecs, 0.0);
+   mCaptureRingBufferSecs = std::max(mCaptureRingBufferSecs,
+                                     std::min(60.0, 2.0 * captureHighWaterSecs));
+   mCaptureHighWater = 0;
+
    unsigned int playbackChannels = 0;
    unsigned int captureChannels = 0;
    sampleFormat captureFormat = floatSample;
@@ -1784,6 +1830,11 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
                                                     captureBufferSize );
                mResample[i] = new Resample(true, mFactor, mFactor); // constant rate resampling
             }
+
+            // The capture thread never drains more than a buffer's worth
+            mCaptureScratch.Resize(captureBufferSize, floatSample);
+            mResampleScratch.Resize(lrint(captureBufferSize * mFactor),
+                                    floatSample);
          }
       }
       catch(std::bad_alloc&)
@@ -1873,11 +1924,21 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
    // audio thread call FillBuffers here makes the code more predictable, since
    // FillBuffers will ALWAYS get called from the Audio thread.
    mAudioThreadShouldCallFillBuffersOnce = true;
+   WakeAudioThread();
 
    while( mAudioThreadShouldCallFillBuffersOnce == true ) {
       if (mScrubQueue)
          mScrubQueue->Nudge();
-      wxMilliSleep( 50 );
+      // Priming is quick in fast-start mode, so look more often
+      wxMilliSleep( mFastStart ? 1 : 50 );
+   }
+
+   // In fast-start mode the buffers hold only a little, so keep filling
+   // them while the stream starts
+   if (mFastStart)
+   {
+      mAudioThreadFillBuffersLoopRunning = true;
+      WakeAudioThread();
    }
 
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -1896,6 +1957,14 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
 
       if( err != paNoError )
       {
+         // Let the audio and capture threads finish with the buffers
+         // before they go
+         mAudioThreadFillBuffersLoopRunning = false;
+         mCaptureThreadDrainLoopRunning = false;
+         while( mAudioThreadFillBuffersLoopActive == true ||
+                mCaptureThreadDrainLoopActive == true )
+            wxMilliSleep( 1 );
+
          if (mListener && mNumCaptureChannels > 0)
             mListener->OnAudioIOStopRecording();
          StartStreamCleanup();
@@ -1904,6 +1973,10 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
       }
    }
 
+   mLastStartLatencyMillis = (::wxGetLocalTimeMillis() - startMillis).ToLong();
+   wxLogMessage(wxT("Stream started %ld ms after the request"),
+                mLastStartLatencyMillis);
+
    if (mNumPlaybackChannels > 0)
    {
       wxCommandEvent e(EVT_AUDIOIO_PLAYBACK);
@@ -1921,6 +1994,8 @@ int AudioIO::StartStream(const WaveTrackArray &playbackTracks,
    }
 
    mAudioThreadFillBuffersLoopRunning = true;
+   mCaptureThreadDrainLoopRunning = true;
+   WakeAudioThread();
 #ifdef EXPERIMENTAL_MIDI_OUT
    // If audio is not running, mNumFrames will not be incremented and
    // MIDI will hang waiting for it unless we do it here.
@@ -2091,7 +2166,9 @@ bool AudioIO::StartPortMidiStream()
       // data for MidiTime().
       Pm_Synchronize(mMidiStream); // start using timestamps
       // start midi output flowing (pending first audio callback)
+      wxMutexLocker locker(mMidiThreadMutex);
       mMidiThreadFillBuffersLoopRunning = true;
+      mMidiThreadStart.Signal();
    }
    return (mLastPmError == pmNoError);
 }
@@ -2191,6 +2268,7 @@ void AudioIO::StopStream()
    //
 
    mAudioThreadFillBuffersLoopRunning = false;
+   mCaptureThreadDrainLoopRunning = false;
    if (mScrubQueue)
       mScrubQueue->Nudge();
 
@@ -2285,12 +2363,13 @@ void AudioIO::StopStream()
    if (mStreamToken > 0) {
       // In either of the above cases, we want to make sure that any
       // capture data that made it into the PortAudio callback makes it
-      // to the target WaveTrack.  To do this, we ask the audio thread to
-      // call FillBuffers one last time (it normally would not do so since
-      // Pa_GetStreamActive() would now return false
-      mAudioThreadShouldCallFillBuffersOnce = true;
+      // to the target WaveTrack.  To do this, we ask the capture thread to
+      // call DrainRecordBuffers one last time (it normally would not do so
+      // since Pa_GetStreamActive() would now return false
+      mCaptureThreadShouldDrainOnce = true;
+      mCaptureAvailable.Signal();
 
-      while( mAudioThreadShouldCallFillBuffersOnce == true )
+      while( mCaptureThreadShouldDrainOnce == true )
       {
          // LLL:  Experienced recursive yield here...once.
          wxGetApp().Yield(true); // Pass true for onlyIfNeeded to avoid recursive call error.
@@ -2299,6 +2378,11 @@ void AudioIO::StopStream()
          wxMilliSleep( 50 );
       }
 
+      // The capture thread clears the flag just before it leaves the
+      // drain, so let it get out before its buffers go
+      while( mCaptureThreadDrainLoopActive == true )
+         wxMilliSleep( 1 );
+
       //
       // Everything is taken care of.  Now, just free all the resources
       // we allocated in StartStream()
@@ -2387,6 +2471,14 @@ void AudioIO::StopStream()
 
          delete[] mCaptureBuffers;
          delete[] mResample;
+
+         // Say how near the capture buffers came to overflowing, and
+         // remember it for sizing them next time
+         double highWaterSecs = mCaptureHighWater / mRate;
+         wxLogMessage(wxT("Capture buffers held at most %.2f of %.2f seconds; %d samples lost"),
+                      highWaterSecs, mCaptureRingBufferSecs, mLostSamples);
+         gPrefs->Write(wxT("/AudioIO/CaptureHighWaterSecs"), highWaterSecs);
+         gPrefs->Flush();
       }
    }
 
@@ -2854,15 +2946,69 @@ AudioThread::ExitCode AudioThread::Entry()
          // playback becoming intermittent.
       }
       else {
-         // Perhaps this too could use a condition variable, for available space in the
-         // ring buffer, instead of a polling loop?  But no harm in doing it this way.
-         Sleep(10);
+         gAudioIO->WaitForAudioThreadWork();
+      }
+   }
+
+   return 0;
+}
+
+// Wake the audio thread to look at its flags now.  Takes the mutex, so
+// the wakeup is never lost; the PortAudio callback, which must not block,
+// signals without it instead.
+void AudioIO::WakeAudioThread()
+{
+   wxMutexLocker locker(mAudioThreadMutex);
+   mAudioThreadWake = true;
+   mAudioThreadWork.Signal();
+}
+
+// Sleep until there is room in the playback buffers, or a flag has
+// changed.  The timeout covers a signal from the callback that came just
+// before the wait, and lets the thread see TestDestroy().
+void AudioIO::WaitForAudioThreadWork()
+{
+   wxMutexLocker locker(mAudioThreadMutex);
+   if (!mAudioThreadWake)
+      mAudioThreadWork.WaitTimeout(100);
+   mAudioThreadWake = false;
+}
+
+CaptureThread::ExitCode CaptureThread::Entry()
+{
+   while( !TestDestroy() )
+   {
+      // Set LoopActive outside the tests to avoid race condition
+      gAudioIO->mCaptureThreadDrainLoopActive = true;
+      if( gAudioIO->mCaptureThreadShouldDrainOnce )
+      {
+         gAudioIO->DrainRecordBuffers();
+         gAudioIO->mCaptureThreadShouldDrainOnce = false;
       }
+      else if( gAudioIO->mCaptureThreadDrainLoopRunning )
+      {
+         gAudioIO->DrainRecordBuffers();
+      }
+      gAudioIO->mCaptureThreadDrainLoopActive = false;
+
+      gAudioIO->WaitForCapture();
    }
 
    return 0;
 }
 
+// Sleep until the PortAudio callback has put enough in the capture buffers
+// to be worth a drain.  The callback signals without the mutex, so a signal
+// can come just before we wait and be missed; the timeout bounds the delay,
+// and lets the thread see drain-once requests and TestDestroy().
+void AudioIO::WaitForCapture()
+{
+   wxMutexLocker locker(mCaptureMutex);
+   if (!mCaptureWake)
+      mCaptureAvailable.WaitTimeout(50);
+   mCaptureWake = false;
+}
+
 
 #ifdef EXPERIMENTAL_MIDI_OUT
 MidiThread::ExitCode MidiThread::Entry()
@@ -2918,12 +3064,41 @@ MidiThread::ExitCode MidiThread::Entry()
          }
       }
       gAudioIO->mMidiThreadFillBuffersLoopActive = false;
-      Sleep(MIDI_SLEEP);
+      if (gAudioIO->mMidiThreadFillBuffersLoopRunning)
+         // Events are timed on the assumption that we look every MIDI_SLEEP
+         Sleep(MIDI_SLEEP);
+      else {
+         // Nothing to do until a stream starts
+         wxMutexLocker locker(gAudioIO->mMidiThreadMutex);
+         if (!gAudioIO->mMidiThreadFillBuffersLoopRunning)
+            gAudioIO->mMidiThreadStart.WaitTimeout(100);
+      }
    }
    return 0;
 }
 #endif
 
+// If a seek lands in the audio the playback buffers already hold, drop
+// what comes before it, and leave the mixers and the audio thread alone.
+// Only a seek forward in straight playback can: the buffers keep nothing
+// that has been played, and the mixers could have wrapped around a loop.
+bool AudioIO::SkipBufferedPlayback(double seek)
+{
+   if (seek <= 0.0 || mPlayMode != PLAY_STRAIGHT ||
+       mTimeTrack || ReversedTime())
+      return false;
+
+   int frames = lrint(seek * mRate);
+   for (unsigned int i = 0; i < mPlaybackTracks->size(); i++)
+      if (mPlaybackBuffers[i]->AvailForGet() < frames)
+         return false;
+
+   for (unsigned int i = 0; i < mPlaybackTracks->size(); i++)
+      mPlaybackBuffers[i]->Discard(frames);
+   mTime = LimitStreamTime(mTime + seek);
+   return true;
+}
+
 int AudioIO::GetCommonlyAvailPlayback()
 {
    int commonlyAvail = mPlaybackBuffers[0]->AvailForPut();
@@ -3334,6 +3509,16 @@ void AudioIO::FillBuffers()
       // MB: subtract a few samples because the code below has rounding errors
       int available = GetCommonlyAvailPlayback() - 10;
 
+      // In fast-start mode, mix no more at once than is already buffered,
+      // so that mixing a filling takes less time than playing what is
+      // there.  The fillings grow from mPlaybackSamplesToPrime to the
+      // full mPlaybackSamplesToCopy.
+      long samplesToCopy = mPlaybackSamplesToCopy;
+      if (mFastStart)
+         samplesToCopy = std::min(samplesToCopy,
+            std::max(mPlaybackSamplesToPrime,
+                     (long)mPlaybackBuffers[0]->AvailForGet()));
+
       //
       // Don't fill the buffers at all unless we can do the
       // full mMaxPlaybackSecsToCopy.  This improves performance
@@ -3343,14 +3528,14 @@ void AudioIO::FillBuffers()
       // The exception is if we're at the end of the selected
       // region - then we should just fill the buffer.
       //
-      if (available >= mPlaybackSamplesToCopy ||
+      if (available >= samplesToCopy ||
           (mPlayMode == PLAY_STRAIGHT &&
            available > 0 &&
            mWarpedTime+(available/mRate) >= mWarpedLength))
       {
          // Limit maximum buffer size (increases performance)
-         if (available > mPlaybackSamplesToCopy)
-            available = mPlaybackSamplesToCopy;
+         if (available > samplesToCopy)
+            available = samplesToCopy;
 
          // msmeyer: When playing a very short selection in looped
          // mode, the selection must be copied to the buffer multiple
@@ -3479,6 +3664,13 @@ void AudioIO::FillBuffers()
          } while (!done);
       }
    }  // end of playback buffering
+}
+
+// Called by the capture thread, never by the audio thread, so that the
+// time taken to write the recording to disk delays only the next drain.
+void AudioIO::DrainRecordBuffers()
+{
+   unsigned int i;
 
    if (mCaptureTracks->size() > 0) // start record buffering
    {
@@ -3489,7 +3681,7 @@ void AudioIO::FillBuffers()
       //
       double deltat = commonlyAvail / mRate;
 
-      if (mAudioThreadShouldCallFillBuffersOnce ||
+      if (mCaptureThreadShouldDrainOnce ||
           deltat >= mMinCaptureSecsToCopy)
       {
          // Append captured samples to the end of the WaveTracks.
@@ -3504,26 +3696,28 @@ void AudioIO::FillBuffers()
 
             AutoSaveFile appendLog;
 
+            // The scratch buffers were made big enough in StartStream(),
+            // so these Resize calls do not allocate
             if( mFactor == 1.0 )
             {
-               SampleBuffer temp(avail, trackFormat);
-               mCaptureBuffers[i]->Get   (temp.ptr(), trackFormat, avail);
-               (*mCaptureTracks)[i]-> Append(temp.ptr(), trackFormat, avail, 1,
+               samplePtr temp = mCaptureScratch.Resize(avail, floatSample).ptr();
+               mCaptureBuffers[i]->Get   (temp, trackFormat, avail);
+               (*mCaptureTracks)[i]-> Append(temp, trackFormat, avail, 1,
                                           &appendLog);
             }
             else
             {
                int size = lrint(avail * mFactor);
-               SampleBuffer temp1(avail, floatSample);
-               SampleBuffer temp2(size, floatSample);
-               mCaptureBuffers[i]->Get(temp1.ptr(), floatSample, avail);
+               samplePtr temp1 = mCaptureScratch.Resize(avail, floatSample).ptr();
+               samplePtr temp2 = mResampleScratch.Resize(size, floatSample).ptr();
+               mCaptureBuffers[i]->Get(temp1, floatSample, avail);
                /* we are re-sampling on the fly. The last resampling call
                 * must flush any samples left in the rate conversion buffer
                 * so that they get recorded
                 */
-               size = mResample[i]->Process(mFactor, (float *)temp1.ptr(), avail, !IsStreamActive(),
-                                            &size, (float *)temp2.ptr(), size);
-               (*mCaptureTracks)[i]-> Append(temp2.ptr(), floatSample, size, 1,
+               size = mResample[i]->Process(mFactor, (float *)temp1, avail, !IsStreamActive(),
+                                            &size, (float *)temp2, size);
+               (*mCaptureTracks)[i]-> Append(temp2, floatSample, size, 1,
                                           &appendLog);
             }
 
@@ -4143,7 +4337,11 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
             gAudioIO->mSeek = 0.0;
          else
 #endif
-         if (gAudioIO->mSeek)
+         // A seek into the audio already mixed just skips to it
+         if (gAudioIO->mSeek &&
+             gAudioIO->SkipBufferedPlayback(gAudioIO->mSeek))
+            gAudioIO->mSeek = 0.0;
+         else if (gAudioIO->mSeek)
          {
             int token = gAudioIO->mStreamToken;
             wxMutexLocker locker(gAudioIO->mSuspendAudioThread);
@@ -4182,6 +4380,7 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
 
             // Reload the ring buffers
             gAudioIO->mAudioThreadShouldCallFillBuffersOnce = true;
+            gAudioIO->WakeAudioThread();
             while( gAudioIO->mAudioThreadShouldCallFillBuffersOnce == true )
             {
                wxMilliSleep( 50 );
@@ -4189,6 +4388,7 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
 
             // Reenable the audio thread
             gAudioIO->mAudioThreadFillBuffersLoopRunning = true;
+            gAudioIO->WakeAudioThread();
 
             return paContinue;
          }
@@ -4384,6 +4584,16 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
 
          em.RealtimeProcessEnd();
 
+         // Wake the audio thread as soon as FillBuffers() has room to mix
+         // a whole chunk.  No mutex here; see WaitForAudioThreadWork().
+         if (!gAudioIO->mAudioThreadWake &&
+             gAudioIO->GetCommonlyAvailPlayback() - 10 >=
+                gAudioIO->mPlaybackSamplesToCopy)
+         {
+            gAudioIO->mAudioThreadWake = true;
+            gAudioIO->mAudioThreadWork.Signal();
+         }
+
          gAudioIO->mLastPlaybackTimeMillis = ::wxGetLocalTimeMillis();
 
          //
@@ -4474,6 +4684,18 @@ int audacityAudioCallback(const void *inputBuffer, void *outputBuffer,
                                                  len);
             }
          }
+
+         // Note how full the buffers get, and wake the capture thread
+         // once there is enough to write
+         int filled = (int)gAudioIO->mCaptureBuffers[0]->AvailForGet();
+         if (filled > gAudioIO->mCaptureHighWater)
+            gAudioIO->mCaptureHighWater = filled;
+         if (!gAudioIO->mCaptureWake &&
+             filled >= gAudioIO->mMinCaptureSecsToCopy * gAudioIO->mRate)
+         {
+            gAudioIO->mCaptureWake = true;
+            gAudioIO->mCaptureAvailable.Signal();
+         }
       }
 
       // Update the current time position if not scrubbing
@@ -230,6 +230,9 @@ class AUDACITY_DLL_API AudioIO final {
    bool IsStreamActive(int token);
 
    wxLongLong GetLastPlaybackTime() const { return mLastPlaybackTimeMillis; }
+   /** \brief How long the last StartStream() took, from the request to
+    * the running stream, in milliseconds */
+   long GetLastStartLatency() const { return mLastStartLatencyMillis; }
    AudacityProject *GetOwningProject() const { return mOwningProject; }
 
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -451,6 +454,11 @@ private:
                              unsigned int numCaptureChannels,
                              sampleFormat captureFormat);
    void FillBuffers();
+   bool SkipBufferedPlayback(double seek);
+   void WakeAudioThread();
+   void WaitForAudioThreadWork();
+   void DrainRecordBuffers();
+   void WaitForCapture();
 
 #ifdef EXPERIMENTAL_MIDI_OUT
    void PrepareMidiIterator(bool send = true, double offset = 0);
@@ -582,6 +590,7 @@ private:
 #endif
 
    AudioThread        *mThread;
+   AudioThread        *mCaptureThread;
 #ifdef EXPERIMENTAL_MIDI_OUT
    AudioThread         *mMidiThread;
 #endif
@@ -605,6 +614,12 @@ private:
    double              mPlaybackRingBufferSecs;
    double              mCaptureRingBufferSecs;
    long                mPlaybackSamplesToCopy;
+   // In fast-start mode StartStream() primes the playback buffers with
+   // only mPlaybackSamplesToPrime, and FillBuffers() mixes no more at once
+   // than is already buffered, until that reaches mPlaybackSamplesToCopy
+   bool                mFastStart;
+   long                mPlaybackSamplesToPrime;
+   long                mLastStartLatencyMillis;
    double              mMinCaptureSecsToCopy;
    bool                mPaused;
    PaStream           *mPortStreamV19;
@@ -618,12 +633,37 @@ private:
    volatile bool       mAudioThreadShouldCallFillBuffersOnce;
    volatile bool       mAudioThreadFillBuffersLoopRunning;
    volatile bool       mAudioThreadFillBuffersLoopActive;
+   // The PortAudio callback wakes the audio thread when the playback
+   // buffers have room for mPlaybackSamplesToCopy, and so does anything
+   // that sets the flags above
+   volatile bool       mAudioThreadWake;
+   wxMutex             mAudioThreadMutex;
+   wxCondition         mAudioThreadWork { mAudioThreadMutex };
+
+   // The capture thread writes recorded audio to disk, so that a slow
+   // disk never holds up the refilling of the playback buffers.  The
+   // PortAudio callback wakes it when the capture buffers fill past
+   // mMinCaptureSecsToCopy.
+   volatile bool       mCaptureThreadShouldDrainOnce;
+   volatile bool       mCaptureThreadDrainLoopRunning;
+   volatile bool       mCaptureThreadDrainLoopActive;
+   volatile bool       mCaptureWake;
+   wxMutex             mCaptureMutex;
+   wxCondition         mCaptureAvailable { mCaptureMutex };
+   // The most samples the capture buffers held at once in this recording
+   volatile int        mCaptureHighWater;
+   // Scratch space for the capture thread, allocated before recording
+   GrowableSampleBuffer mCaptureScratch;
+   GrowableSampleBuffer mResampleScratch;
 
    wxLongLong          mLastPlaybackTimeMillis;
 
 #ifdef EXPERIMENTAL_MIDI_OUT
    volatile bool       mMidiThreadFillBuffersLoopRunning;
    volatile bool       mMidiThreadFillBuffersLoopActive;
+   // The MIDI thread waits on this while it has no stream to fill
+   wxMutex             mMidiThreadMutex;
+   wxCondition         mMidiThreadStart { mMidiThreadMutex };
 #endif
 
    volatile double     mLastRecordingOffset;
@@ -666,6 +706,7 @@ private:
    AudioIOListener*    mListener;
 
    friend class AudioThread;
+   friend class CaptureThread;
 #ifdef EXPERIMENTAL_MIDI_OUT
    friend class MidiThread;
 #endif
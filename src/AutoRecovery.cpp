@@ -306,7 +306,8 @@ int RecordingRecoveryHandler::FindTrack() const
 bool RecordingRecoveryHandler::HandleXMLTag(const wxChar *tag,
                                             const wxChar **attrs)
 {
-   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0)
+   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0 ||
+       wxStrcmp(tag, wxT("packedblockfile")) == 0)
    {
       // Check if we have a valid channel and numchannels
       if (mChannel < 0 || mNumChannels < 0 || mChannel >= mNumChannels)
@@ -335,8 +336,7 @@ bool RecordingRecoveryHandler::HandleXMLTag(const wxChar *tag,
       DirManager* dirManager = mProject->GetDirManager();
       dirManager->SetLoadingFormat(seq->GetSampleFormat());
 
-      BlockArray array;
-      array.resize(1);
+      std::vector<SeqBlock> array(1);
       dirManager->SetLoadingTarget(&array, 0);
       BlockFile *& blockFile = array[0].f;
 
@@ -399,7 +399,8 @@ bool RecordingRecoveryHandler::HandleXMLTag(const wxChar *tag,
 
 void RecordingRecoveryHandler::HandleXMLEndTag(const wxChar *tag)
 {
-   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0)
+   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0 ||
+       wxStrcmp(tag, wxT("packedblockfile")) == 0)
       // Still in inner looop
       return;
 
@@ -422,8 +423,9 @@ void RecordingRecoveryHandler::HandleXMLEndTag(const wxChar *tag)
 
 XMLTagHandler* RecordingRecoveryHandler::HandleXMLChild(const wxChar *tag)
 {
-   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0)
-      return this; // HandleXMLTag also handles <simpleblockfile>
+   if (wxStrcmp(tag, wxT("simpleblockfile")) == 0 ||
+       wxStrcmp(tag, wxT("packedblockfile")) == 0)
+      return this; // HandleXMLTag also handles <simpleblockfile> and <packedblockfile>
 
    return NULL;
 }
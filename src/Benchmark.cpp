@@ -25,6 +25,7 @@ of the BlockFile system.
 #include <wx/choice.h>
 #include <wx/dialog.h>
 #include <wx/filedlg.h>
+#include <wx/filename.h>
 #include <wx/msgdlg.h>
 #include <wx/sizer.h>
 #include <wx/stattext.h>
@@ -34,11 +35,41 @@ of the BlockFile system.
 #include <wx/valtext.h>
 #include <wx/intl.h>
 
+#include <wx/app.h>
+#include <wx/cmdline.h>
+#include <wx/fileconf.h>
+#include <wx/ffile.h>
+#include <wx/file.h>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+
 #include "ShuttleGui.h"
+#include "DirManager.h"
 #include "Project.h"
+#include "Mix.h"
 #include "WaveTrack.h"
+#include "WaveClip.h"
+#include "prefs/SpectrogramSettings.h"
 #include "Sequence.h"
 #include "Prefs.h"
+#include "WorkerPool.h"
+#include "FFT.h"
+#include "MappedFile.h"
+#include "RealFFTf.h"
+#include "Resample.h"
+#include "effects/Echo.h"
+#include "FileFormats.h"
+#include "import/ImportPCM.h"
+#include "widgets/ProgressDialog.h"
+#include "xml/XMLFileReader.h"
+#include "xml/XMLWriter.h"
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
 
 #include "FileDialog.h"
 
@@ -57,6 +88,9 @@ private:
    void OnClear( wxCommandEvent &event );
    void OnClose( wxCommandEvent &event );
 
+   void BenchmarkMixer(TrackFactory factory);
+   void BenchmarkBlockStorage(long dataSize);
+
    void Printf(const wxChar *format, ...);
    void HoldPrint(bool hold);
    void FlushPrint();
@@ -266,6 +300,132 @@ void BenchmarkDialog::OnClear(wxCommandEvent & WXUNUSED(event))
    mText->Clear();
 }
 
+// Mixes the same set of tracks with an increasing number of worker
+// threads, and checks that every run gives exactly the same samples.
+void BenchmarkDialog::BenchmarkMixer(TrackFactory factory)
+{
+   const int numTracks = 32;
+   const double rate = 44100.0;
+   const int trackLen = (int)rate * 20;
+   const int chunkSize = 65536;
+
+   Printf(wxT("Mixing %d tracks of %.0f seconds...\n"), numTracks, trackLen / rate);
+   wxTheApp->Yield();
+   FlushPrint();
+
+   // Every fourth track has a different rate, so that the resampler
+   // takes part too
+   std::vector<std::unique_ptr<WaveTrack>> tracks;
+   WaveTrackConstArray inputs;
+   std::vector<float> chunk(chunkSize);
+   for (int t = 0; t < numTracks; t++) {
+      tracks.push_back(factory.NewWaveTrack(floatSample, (t % 4 == 3) ? 48000.0 : rate));
+      WaveTrack *track = tracks.back().get();
+      track->SetPan((t % 3 - 1) * 0.5f);
+      for (int pos = 0; pos < trackLen; pos += chunkSize) {
+         int len = std::min(chunkSize, trackLen - pos);
+         for (int i = 0; i < len; i++)
+            chunk[i] = (rand() / (float)RAND_MAX - 0.5f) / numTracks;
+         track->Append((samplePtr)&chunk[0], floatSample, len);
+      }
+      track->Flush();
+      inputs.push_back(track);
+   }
+
+   std::vector<float> reference;
+   long serialTime = 0;
+   int maxThreads = WorkerPool::GetDefaultThreadCount();
+   for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+      Mixer mixer(inputs, Mixer::WarpOptions(NULL), 0.0, trackLen / rate,
+                  2, chunkSize, true, rate, floatSample);
+      mixer.SetWorkerThreads(threads);
+
+      std::vector<float> output;
+      wxStopWatch timer;
+      sampleCount len;
+      while ((len = mixer.Process(chunkSize)) > 0) {
+         float *buffer = (float *)mixer.GetBuffer();
+         output.insert(output.end(), buffer, buffer + 2 * len);
+      }
+      long elapsed = timer.Time();
+
+      if (threads == 1) {
+         reference.swap(output);
+         serialTime = elapsed;
+         Printf(wxT("Mix with %d thread: %ld ms\n"), threads, elapsed);
+      }
+      else
+         Printf(wxT("Mix with %d threads: %ld ms, speedup %.2f%s\n"),
+                threads, elapsed,
+                elapsed > 0 ? serialTime / (double)elapsed : 0.0,
+                output == reference ? wxT("") : wxT(" (OUTPUT DIFFERS!)"));
+      wxTheApp->Yield();
+      FlushPrint();
+
+      if (threads >= maxThreads)
+         break;
+   }
+}
+
+// Writes, saves, checks and reads the same data stored as one file per
+// block and as packed block files.
+void BenchmarkDialog::BenchmarkBlockStorage(long dataSize)
+{
+   const int chunkSize = 65536;
+   const int nChunks = std::max(1L, dataSize * 1048576 / (chunkSize * (long)sizeof(float)));
+
+   Printf(wxT("Storing %d MB of blocks of %d KB...\n"),
+          (int)dataSize, (int)(Sequence::GetMaxDiskBlockSize() / 1024));
+   wxTheApp->Yield();
+   FlushPrint();
+
+   std::vector<float> chunk(chunkSize);
+   for (int i = 0; i < chunkSize; i++)
+      chunk[i] = rand() / (float)RAND_MAX - 0.5f;
+
+   for (int packed = 0; packed < 2; packed++) {
+      const wxChar *layout = packed ? wxT("packed") : wxT("one file per block");
+      ZoomInfo zoomInfo(0.0, ZoomInfo::GetDefaultZoom());
+      DirManager *dm = new DirManager();
+      dm->SetPackBlockFiles(packed != 0);
+      TrackFactory factory{ dm, &zoomInfo };
+
+      std::unique_ptr<WaveTrack> track = factory.NewWaveTrack(floatSample);
+      wxStopWatch timer;
+      for (int i = 0; i < nChunks; i++)
+         track->Append((samplePtr)&chunk[0], floatSample, chunkSize);
+      track->Flush();
+      long writeTime = timer.Time();
+
+      wxString projPath = wxFileName::GetTempDir();
+      wxString projName = wxString::Format(wxT("benchmark%d_data"), rand());
+      timer.Start();
+      bool saved = dm->SetProject(projPath, projName, true);
+      long saveTime = timer.Time();
+
+      timer.Start();
+      int fsck = saved ? dm->ProjectFSCK(false, true) : 0;
+      long checkTime = timer.Time();
+
+      timer.Start();
+      for (int i = 0; i < nChunks; i++)
+         track->Get((samplePtr)&chunk[0], floatSample, (sampleCount)i * chunkSize, chunkSize);
+      long readTime = timer.Time();
+
+      Printf(wxT("%s: write %ld ms, save %ld ms, check %ld ms, read %ld ms%s\n"),
+             layout, writeTime, saveTime, checkTime, readTime,
+             !saved ? wxT(" (SAVE FAILED!)") :
+             (fsck & FSCKstatus_CHANGED) ? wxT(" (CHECK FAILED!)") : wxT(""));
+      wxTheApp->Yield();
+      FlushPrint();
+
+      track.reset();
+      dm->Deref();
+      if (saved)
+         wxFileName::Rmdir(projPath + wxFILE_SEP_PATH + projName, wxPATH_RMDIR_RECURSIVE);
+   }
+}
+
 void BenchmarkDialog::Printf(const wxChar *format, ...)
 {
    va_list argptr;
@@ -523,6 +683,9 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
           wxT("simultaneous tracks that could be played at once: %.1f\n"),
           (nChunks*chunkSize/44100.0)/(elapsed/1000.0));
 
+   BenchmarkMixer(TrackFactory{ d, &zoomInfo });
+   BenchmarkBlockStorage(dataSize);
+
    goto success;
 
  fail:
@@ -542,3 +705,851 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    gPrefs->Write(wxT("/GUI/EditClipCanMove"), editClipCanMove);
    gPrefs->Flush();
 }
+
+//
+// Headless benchmarks
+//
+// These run from the command line before any GUI exists, so they need
+// no display.  Each suite sets up its data, then times the same work a
+// number of times; the results go out as JSON, with percentiles of the
+// run times, so that builds can be compared.
+//
+
+namespace {
+
+struct BenchmarkOptions {
+   long dataSize{ 32 };    // MB of float samples in each track
+   long numTracks{ 4 };
+   long blockSize{ 1024 }; // KB
+   long numEdits{ 100 };
+   long repeat{ 5 };
+   long seed{ 234657 };
+   long threads{ 0 };      // 0 for one per processor
+   long mapped{ 0 };       // block files to keep memory-mapped
+   bool packed{ false };
+};
+
+using WaveTrackArray = std::vector< std::unique_ptr<WaveTrack> >;
+
+// The root of a project file holding only wave tracks
+class BenchmarkProject final : public XMLTagHandler
+{
+public:
+   BenchmarkProject(TrackFactory factory, WaveTrackArray &tracks)
+      : mFactory(factory), mTracks(tracks) {}
+
+   bool HandleXMLTag(const wxChar *tag, const wxChar **WXUNUSED(attrs)) override
+   { return !wxStrcmp(tag, wxT("project")); }
+
+   XMLTagHandler *HandleXMLChild(const wxChar *tag) override
+   {
+      if (wxStrcmp(tag, wxT("wavetrack")))
+         return NULL;
+      mTracks.push_back(mFactory.NewWaveTrack());
+      return mTracks.back().get();
+   }
+
+private:
+   TrackFactory mFactory;
+   WaveTrackArray &mTracks;
+};
+
+struct BenchmarkResult {
+   wxString name;
+   wxString unit;
+   double work{ 0 };          // units done by each run
+   bool ok{ true };
+   std::vector<double> times; // of the runs, in ms
+};
+
+class HeadlessBenchmark
+{
+public:
+   HeadlessBenchmark(const BenchmarkOptions &options);
+   ~HeadlessBenchmark();
+
+   static wxArrayString GetSuiteNames();
+   bool Run(const wxString &name, BenchmarkResult &result);
+
+private:
+   void SequenceEdit(BenchmarkResult &result);
+   void BlockRead(BenchmarkResult &result);
+   void Summary(BenchmarkResult &result);
+   void Spectrogram(BenchmarkResult &result);
+   void Mix(BenchmarkResult &result);
+   void Resampling(BenchmarkResult &result);
+   // The channels of all the tracks together, at each quality preset
+   void ResampleChannels(BenchmarkResult &result, int method);
+   void ResampleLow(BenchmarkResult &result) { ResampleChannels(result, 0); }
+   void ResampleMedium(BenchmarkResult &result) { ResampleChannels(result, 1); }
+   void ResampleHigh(BenchmarkResult &result) { ResampleChannels(result, 2); }
+   void ResampleBest(BenchmarkResult &result) { ResampleChannels(result, 3); }
+   void FFT(BenchmarkResult &result);
+   void EffectProcessing(BenchmarkResult &result);
+   void ProjectSave(BenchmarkResult &result);
+   void ProjectLoad(BenchmarkResult &result);
+   void PCMImport(BenchmarkResult &result);
+
+   // Calls fn once per repetition, timing each call; fn returns false
+   // on failure
+   template<typename Function>
+   void Measure(BenchmarkResult &result, const Function &fn)
+   {
+      for (long r = 0; r < mOptions.repeat && result.ok; r++) {
+         wxStopWatch timer;
+         result.ok = fn();
+         result.times.push_back(timer.TimeInMicro().ToDouble() / 1000.0);
+      }
+   }
+
+   sampleCount GetTrackLength() const;
+   // The same samples for the same seed and number
+   std::unique_ptr<WaveTrack> MakeTrack(DirManager *dm, int number, double rate);
+   // Saves tracks as a project in a new directory of the temp dir
+   bool SaveProject(DirManager *dm, const WaveTrackArray &tracks,
+                    wxString &xmlFile);
+
+   BenchmarkOptions mOptions;
+   ZoomInfo mZoomInfo;
+   DirManager *mDirManager;
+   wxArrayString mProjectDirs;
+};
+
+HeadlessBenchmark::HeadlessBenchmark(const BenchmarkOptions &options)
+   : mOptions(options)
+   , mZoomInfo(0.0, ZoomInfo::GetDefaultZoom())
+{
+   Sequence::SetMaxDiskBlockSize(mOptions.blockSize * 1024);
+   MappedFilePool::Instance().SetCapacity(mOptions.mapped);
+   if (mOptions.threads <= 0)
+      mOptions.threads = WorkerPool::GetDefaultThreadCount();
+
+   mDirManager = new DirManager();
+   mDirManager->SetPackBlockFiles(mOptions.packed);
+}
+
+HeadlessBenchmark::~HeadlessBenchmark()
+{
+   mDirManager->Deref();
+   for (size_t i = 0; i < mProjectDirs.size(); i++)
+      wxFileName::Rmdir(mProjectDirs[i], wxPATH_RMDIR_RECURSIVE);
+}
+
+// In the order of the functions in Run()
+static const wxChar *const sSuiteNames[] = {
+   wxT("sequence-edit"), wxT("block-read"), wxT("summary"),
+   wxT("spectrogram"), wxT("mix"), wxT("resample"),
+   wxT("resample-low"), wxT("resample-medium"), wxT("resample-high"),
+   wxT("resample-best"), wxT("fft"), wxT("effect"),
+   wxT("project-save"), wxT("project-load"), wxT("pcm-import")
+};
+
+wxArrayString HeadlessBenchmark::GetSuiteNames()
+{
+   wxArrayString names;
+   for (size_t i = 0; i < sizeof(sSuiteNames) / sizeof(sSuiteNames[0]); i++)
+      names.Add(sSuiteNames[i]);
+   return names;
+}
+
+bool HeadlessBenchmark::Run(const wxString &name, BenchmarkResult &result)
+{
+   typedef void (HeadlessBenchmark::*SuiteFunction)(BenchmarkResult &);
+   static const SuiteFunction functions[] = {
+      &HeadlessBenchmark::SequenceEdit, &HeadlessBenchmark::BlockRead,
+      &HeadlessBenchmark::Summary, &HeadlessBenchmark::Spectrogram,
+      &HeadlessBenchmark::Mix,
+      &HeadlessBenchmark::Resampling,
+      &HeadlessBenchmark::ResampleLow, &HeadlessBenchmark::ResampleMedium,
+      &HeadlessBenchmark::ResampleHigh, &HeadlessBenchmark::ResampleBest,
+      &HeadlessBenchmark::FFT,
+      &HeadlessBenchmark::EffectProcessing,
+      &HeadlessBenchmark::ProjectSave, &HeadlessBenchmark::ProjectLoad,
+      &HeadlessBenchmark::PCMImport
+   };
+
+   for (size_t i = 0; i < sizeof(sSuiteNames) / sizeof(sSuiteNames[0]); i++) {
+      if (name == sSuiteNames[i]) {
+         result.name = name;
+         (this->*functions[i])(result);
+         return true;
+      }
+   }
+   return false;
+}
+
+sampleCount HeadlessBenchmark::GetTrackLength() const
+{
+   return std::max(1L, mOptions.dataSize) * (1048576 / sizeof(float));
+}
+
+std::unique_ptr<WaveTrack> HeadlessBenchmark::MakeTrack
+   (DirManager *dm, int number, double rate)
+{
+   const int chunkSize = 65536;
+   const sampleCount len = GetTrackLength();
+   std::minstd_rand random(mOptions.seed + number);
+   std::vector<float> chunk(chunkSize);
+
+   auto track = TrackFactory{ dm, &mZoomInfo }.NewWaveTrack(floatSample, rate);
+   for (sampleCount pos = 0; pos < len; pos += chunkSize) {
+      const int count = (int)std::min<sampleCount>(chunkSize, len - pos);
+      for (int i = 0; i < count; i++) {
+         // A tone that differs in each track, and some noise
+         const double t = (pos + i) / 44100.0;
+         chunk[i] = 0.5f * sin(2 * M_PI * 110 * (number + 1) * t) +
+            0.1f * (random() / (float)random.max() - 0.5f);
+      }
+      track->Append((samplePtr)&chunk[0], floatSample, count);
+   }
+   track->Flush();
+   return track;
+}
+
+void HeadlessBenchmark::SequenceEdit(BenchmarkResult &result)
+{
+   result.unit = wxT("edits");
+   result.work = mOptions.numEdits;
+
+   // At a rate of 1, times are sample positions
+   const auto track = MakeTrack(mDirManager, 0, 1.0);
+   const sampleCount len = GetTrackLength();
+   std::minstd_rand random(mOptions.seed);
+
+   Measure(result, [&] {
+      for (long z = 0; z < mOptions.numEdits; z++) {
+         const sampleCount x0 = random() % len;
+         const sampleCount xlen = 1 + random() % (len - x0);
+         auto tmp = track->Cut((double)x0, (double)(x0 + xlen));
+         if (!tmp)
+            return false;
+         const sampleCount y0 = random() % (len - xlen + 1);
+         if (!track->Paste((double)y0, tmp.get()))
+            return false;
+      }
+
+      sampleCount total = 0;
+      for (int i = 0; i < track->GetNumClips(); i++)
+         total += track->GetClipByIndex(i)->GetNumSamples();
+      return total == len;
+   });
+}
+
+void HeadlessBenchmark::BlockRead(BenchmarkResult &result)
+{
+   const int chunkSize = 65536;
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("samples");
+   result.work = len;
+
+   const auto track = MakeTrack(mDirManager, 0, 44100.0);
+   std::vector<float> chunk(chunkSize);
+
+   Measure(result, [&] {
+      for (sampleCount pos = 0; pos < len; pos += chunkSize) {
+         if (!track->Get((samplePtr)&chunk[0], floatSample, pos,
+                         std::min<sampleCount>(chunkSize, len - pos)))
+            return false;
+      }
+      return true;
+   });
+}
+
+void HeadlessBenchmark::Summary(BenchmarkResult &result)
+{
+   // Waveform columns for a view of the whole track, and for views
+   // zoomed in 16 and 256 times
+   const int width = 2048;
+   const int zooms[] = { 1, 16, 256 };
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("columns");
+   result.work = width * (sizeof(zooms) / sizeof(zooms[0]));
+
+   const auto track = MakeTrack(mDirManager, 0, 44100.0);
+   Sequence *sequence = track->GetClipByIndex(0)->GetSequence();
+   std::vector<float> min(width), max(width), rms(width);
+   std::vector<int> bl(width);
+   std::vector<sampleCount> where(width + 1);
+
+   Measure(result, [&] {
+      for (size_t z = 0; z < sizeof(zooms) / sizeof(zooms[0]); z++) {
+         const sampleCount span = len / zooms[z];
+         for (int i = 0; i <= width; i++)
+            where[i] = (len - span) / 2 + span * i / width;
+         if (!sequence->GetWaveDisplay(&min[0], &max[0], &rms[0], &bl[0],
+                                       width, &where[0]))
+            return false;
+      }
+      return true;
+   });
+}
+
+void HeadlessBenchmark::Spectrogram(BenchmarkResult &result)
+{
+   // A view of the whole track, with the standard algorithm and with
+   // reassignment, which also computes columns beyond the view
+   const int width = 2048;
+   const double rate = 44100.0;
+   const SpectrogramSettings::Algorithm algorithms[] =
+      { SpectrogramSettings::algSTFT, SpectrogramSettings::algReassignment };
+   const int nAlgorithms = sizeof(algorithms) / sizeof(algorithms[0]);
+   result.unit = wxT("columns");
+   result.work = width * nAlgorithms;
+
+   WaveTrackArray tracks;
+   for (int a = 0; a < nAlgorithms; a++) {
+      tracks.push_back(MakeTrack(mDirManager, 0, rate));
+      auto settings = safenew SpectrogramSettings(SpectrogramSettings::defaults());
+      settings->algorithm = algorithms[a];
+      tracks.back()->SetSpectrogramSettings(settings);
+   }
+   const double pixelsPerSecond = width * rate / GetTrackLength();
+
+   SpecCache::SetWorkerThreads(mOptions.threads);
+   Measure(result, [&] {
+      for (const auto &track : tracks) {
+         WaveTrackCache cache(track.get());
+         WaveClip *clip = track->GetClipByIndex(0);
+         // Make the clip compute every column again
+         clip->MarkChanged();
+         const float *spectrogram;
+         const sampleCount *where;
+         if (!clip->GetSpectrogram(cache, spectrogram, where, width,
+                                   0.0, pixelsPerSecond))
+            return false;
+      }
+      return true;
+   });
+   SpecCache::SetWorkerThreads(0);
+}
+
+void HeadlessBenchmark::Mix(BenchmarkResult &result)
+{
+   const int chunkSize = 65536;
+   const double rate = 44100.0;
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("samples");
+   result.work = (double)len * mOptions.numTracks;
+
+   // Every fourth track has another rate, so that the resampler takes
+   // part too
+   std::vector<std::unique_ptr<WaveTrack>> tracks;
+   WaveTrackConstArray inputs;
+   for (long t = 0; t < mOptions.numTracks; t++) {
+      tracks.push_back(MakeTrack(mDirManager, t, (t % 4 == 3) ? 48000.0 : rate));
+      tracks.back()->SetPan((t % 3 - 1) * 0.5f);
+      inputs.push_back(tracks.back().get());
+   }
+
+   Measure(result, [&] {
+      Mixer mixer(inputs, Mixer::WarpOptions(NULL), 0.0, len / rate,
+                  2, chunkSize, true, rate, floatSample);
+      mixer.SetWorkerThreads(mOptions.threads);
+      sampleCount total = 0, count;
+      while ((count = mixer.Process(chunkSize)) > 0)
+         total += count;
+      return total > 0;
+   });
+}
+
+void HeadlessBenchmark::Resampling(BenchmarkResult &result)
+{
+   const int chunkSize = 65536;
+   const double factor = 48000.0 / 44100.0;
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("samples");
+   result.work = len;
+
+   const auto track = MakeTrack(mDirManager, 0, 44100.0);
+   std::vector<float> input(len);
+   if (!track->Get((samplePtr)&input[0], floatSample, 0, len)) {
+      result.ok = false;
+      return;
+   }
+   std::vector<float> output(2 * chunkSize);
+
+   Measure(result, [&] {
+      Resample resample(false, factor, factor);
+      sampleCount pos = 0;
+      while (pos < len) {
+         const int count = (int)std::min<sampleCount>(chunkSize, len - pos);
+         int used = 0;
+         const int made = resample.Process(factor, &input[pos], count,
+                                           pos + count == len, &used,
+                                           &output[0], output.size());
+         if (made < 0)
+            return false;
+         pos += used;
+         if (used == 0 && made == 0)
+            return false;
+      }
+      return true;
+   });
+}
+
+void HeadlessBenchmark::ResampleChannels(BenchmarkResult &result, int method)
+{
+   // As an export of a surround project does it: every track is a
+   // channel, and all of them go through one resampler
+   const int chunkSize = 65536;
+   const double factor = 48000.0 / 44100.0;
+   const sampleCount len = GetTrackLength();
+   const int nChannels = mOptions.numTracks;
+   result.unit = wxT("samples");
+   result.work = (double)len * nChannels;
+
+   std::vector<std::vector<float>> input(nChannels);
+   std::vector<std::vector<float>> output(nChannels);
+   for (int c = 0; c < nChannels; c++) {
+      const auto track = MakeTrack(mDirManager, c, 44100.0);
+      input[c].resize(len);
+      output[c].resize(2 * chunkSize);
+      if (!track->Get((samplePtr)&input[c][0], floatSample, 0, len)) {
+         result.ok = false;
+         return;
+      }
+   }
+   std::vector<float *> in(nChannels), out(nChannels);
+   for (int c = 0; c < nChannels; c++)
+      out[c] = &output[c][0];
+
+   gPrefs->Write(Resample::GetBestMethodKey(), method);
+   Measure(result, [&] {
+      Resample resample(true, factor, factor, nChannels, true, mOptions.threads);
+      sampleCount pos = 0;
+      while (pos < len) {
+         const int count = (int)std::min<sampleCount>(chunkSize, len - pos);
+         for (int c = 0; c < nChannels; c++)
+            in[c] = &input[c][pos];
+         int used = 0;
+         const int made = resample.Process(factor, &in[0], count,
+                                           pos + count == len, &used,
+                                           &out[0], 2 * chunkSize);
+         if (made < 0)
+            return false;
+         pos += used;
+         if (used == 0 && made == 0)
+            return false;
+      }
+      return true;
+   });
+   gPrefs->DeleteEntry(Resample::GetBestMethodKey());
+}
+
+void HeadlessBenchmark::FFT(BenchmarkResult &result)
+{
+   // Frames as the spectrogram takes them
+   const int windowSize = 2048;
+   const int hop = windowSize / 2;
+   const sampleCount len = GetTrackLength();
+   const sampleCount frames = (len - windowSize) / hop + 1;
+   result.unit = wxT("frames");
+   result.work = frames;
+
+   const auto track = MakeTrack(mDirManager, 0, 44100.0);
+   std::vector<float> input(len);
+   if (len < windowSize ||
+       !track->Get((samplePtr)&input[0], floatSample, 0, len)) {
+      result.ok = false;
+      return;
+   }
+   std::vector<float> window(windowSize), buffer(windowSize);
+   std::fill(window.begin(), window.end(), 1.0f);
+   NewWindowFunc(eWinFuncHanning, windowSize, false, &window[0]);
+
+   Measure(result, [&] {
+      HFFT hFFT = GetFFT(windowSize);
+      double sum = 0;
+      for (sampleCount f = 0; f < frames; f++) {
+         const float *frame = &input[f * hop];
+         for (int i = 0; i < windowSize; i++)
+            buffer[i] = frame[i] * window[i];
+         RealFFTf(&buffer[0], hFFT);
+         sum += buffer[hFFT->BitReversed[1]];
+      }
+      ReleaseFFT(hFFT);
+      return sum == sum;
+   });
+}
+
+void HeadlessBenchmark::EffectProcessing(BenchmarkResult &result)
+{
+   // As Effect::ProcessTrack does it: read blocks of the track, process
+   // them and append them to a new track
+   const int blockSize = 8192;
+   const double rate = 44100.0;
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("samples");
+   result.work = len;
+
+   const auto track = MakeTrack(mDirManager, 0, rate);
+   std::vector<float> in(blockSize), out(blockSize);
+   float *inBlock[] = { &in[0] };
+   float *outBlock[] = { &out[0] };
+
+   Measure(result, [&] {
+      EffectEcho echo;
+      echo.SetSampleRate((sampleCount)rate);
+      echo.SetBlockSize(blockSize);
+      if (!echo.ProcessInitialize(len))
+         return false;
+
+      auto output = TrackFactory{ mDirManager, &mZoomInfo }
+         .NewWaveTrack(floatSample, rate);
+      bool ok = true;
+      for (sampleCount pos = 0; ok && pos < len; pos += blockSize) {
+         const sampleCount count = std::min<sampleCount>(blockSize, len - pos);
+         ok = track->Get((samplePtr)&in[0], floatSample, pos, count) &&
+            echo.ProcessBlock(inBlock, outBlock, count) == count &&
+            output->Append((samplePtr)&out[0], floatSample, count);
+      }
+      echo.ProcessFinalize();
+      return ok && output->Flush();
+   });
+}
+
+bool HeadlessBenchmark::SaveProject
+   (DirManager *dm, const WaveTrackArray &tracks, wxString &xmlFile)
+{
+   wxString projPath = wxFileName::GetTempDir();
+   wxString projName = wxString::Format(wxT("benchmark%d_data"), rand());
+   mProjectDirs.Add(projPath + wxFILE_SEP_PATH + projName);
+   xmlFile = mProjectDirs.Last() + wxT(".xml");
+
+   // This moves the block files out of the temp directory
+   if (!dm->SetProject(projPath, projName, true))
+      return false;
+
+   try {
+      XMLFileWriter writer;
+      writer.Open(xmlFile, wxT("wb"));
+      writer.StartTag(wxT("project"));
+      for (const auto &track : tracks)
+         track->WriteXML(writer);
+      writer.EndTag(wxT("project"));
+      writer.Close();
+   }
+   catch (const XMLFileWriterException &) {
+      return false;
+   }
+   return true;
+}
+
+void HeadlessBenchmark::ProjectSave(BenchmarkResult &result)
+{
+   result.unit = wxT("samples");
+   result.work = (double)GetTrackLength() * mOptions.numTracks;
+
+   for (long r = 0; r < mOptions.repeat && result.ok; r++) {
+      DirManager *dm = new DirManager();
+      dm->SetPackBlockFiles(mOptions.packed);
+      WaveTrackArray tracks;
+      for (long t = 0; t < mOptions.numTracks; t++)
+         tracks.push_back(MakeTrack(dm, t, 44100.0));
+
+      wxStopWatch timer;
+      wxString xmlFile;
+      result.ok = SaveProject(dm, tracks, xmlFile);
+      result.times.push_back(timer.TimeInMicro().ToDouble() / 1000.0);
+
+      wxRemoveFile(xmlFile);
+      tracks.clear();
+      dm->Deref();
+   }
+}
+
+void HeadlessBenchmark::ProjectLoad(BenchmarkResult &result)
+{
+   const sampleCount len = GetTrackLength();
+   result.unit = wxT("samples");
+   result.work = (double)len * mOptions.numTracks;
+
+   wxString xmlFile;
+   {
+      DirManager *dm = new DirManager();
+      dm->SetPackBlockFiles(mOptions.packed);
+      WaveTrackArray tracks;
+      for (long t = 0; t < mOptions.numTracks; t++)
+         tracks.push_back(MakeTrack(dm, t, 44100.0));
+      result.ok = SaveProject(dm, tracks, xmlFile);
+      // Keep the saved files, as closing a project does
+      for (const auto &track : tracks)
+         track->CloseLock();
+      tracks.clear();
+      dm->Deref();
+   }
+   if (!result.ok)
+      return;
+
+   wxFileName fn(mProjectDirs.Last());
+   wxString projPath = fn.GetPath();
+   wxString projName = fn.GetFullName();
+   std::vector<float> chunk(65536);
+
+   // Each run opens the project in a new DirManager and reads all of it
+   Measure(result, [&] {
+      DirManager *dm = new DirManager();
+      WaveTrackArray tracks;
+      bool ok = dm->SetProject(projPath, projName, false);
+      if (ok) {
+         BenchmarkProject project(TrackFactory{ dm, &mZoomInfo }, tracks);
+         XMLFileReader reader;
+         ok = reader.Parse(&project, xmlFile) &&
+            tracks.size() == (size_t)mOptions.numTracks;
+      }
+
+      for (size_t t = 0; ok && t < tracks.size(); t++)
+         for (sampleCount pos = 0; ok && pos < len; pos += chunk.size())
+            ok = tracks[t]->Get((samplePtr)&chunk[0], floatSample, pos,
+                                std::min<sampleCount>(chunk.size(), len - pos));
+
+      for (const auto &track : tracks)
+         track->CloseLock();
+      tracks.clear();
+      dm->Deref();
+      return ok;
+   });
+
+   wxRemoveFile(xmlFile);
+}
+
+void HeadlessBenchmark::PCMImport(BenchmarkResult &result)
+{
+   // A 24-bit WAV file with a channel for each track, imported as a full
+   // copy into float tracks, on as many threads as the options say
+   const sampleCount len = GetTrackLength();
+   const int nChannels = (int)std::max(1L, mOptions.numTracks);
+   result.unit = wxT("MB");
+   result.work = (double)len * nChannels * 3 / 1048576.0;
+
+   wxString fileName = wxFileName::CreateTempFileName(wxT("benchmark"));
+   {
+      WaveTrackArray tracks;
+      for (int c = 0; c < nChannels; c++)
+         tracks.push_back(MakeTrack(mDirManager, c, 44100.0));
+
+      SF_INFO info;
+      memset(&info, 0, sizeof(info));
+      info.samplerate = 44100;
+      info.channels = nChannels;
+      info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+
+      wxFile f;
+      SFFile sf;
+      if (f.Open(fileName, wxFile::write))
+         sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
+      result.ok = !!sf;
+
+      const int chunkSize = 65536;
+      std::vector<float> chunk(chunkSize), frames(chunkSize * nChannels);
+      for (sampleCount pos = 0; result.ok && pos < len; pos += chunkSize) {
+         const int count = (int)std::min<sampleCount>(chunkSize, len - pos);
+         for (int c = 0; result.ok && c < nChannels; c++) {
+            result.ok = tracks[c]->Get((samplePtr)&chunk[0], floatSample, pos, count);
+            for (int i = 0; i < count; i++)
+               frames[i * nChannels + c] = chunk[i];
+         }
+         if (result.ok)
+            result.ok = SFCall<sf_count_t>(sf_writef_float, sf.get(), &frames[0],
+                                           (sf_count_t)count) == count;
+      }
+   }
+
+   if (result.ok) {
+      Measure(result, [&] {
+         wxFile f;
+         SF_INFO info;
+         memset(&info, 0, sizeof(info));
+         SFFile sf;
+         if (f.Open(fileName))
+            sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_READ, &info, FALSE));
+         if (!sf || info.frames != len)
+            return false;
+
+         TrackHolders tracks(nChannels);
+         for (auto &track : tracks)
+            track = TrackFactory{ mDirManager, &mZoomInfo }
+               .NewWaveTrack(floatSample, info.samplerate);
+         const int updateResult = ImportPCMSamples(sf.get(), info, tracks,
+            mOptions.threads,
+            [](sampleCount, sampleCount) { return (int)eProgressSuccess; });
+         return updateResult == eProgressSuccess &&
+            tracks[0]->TimeToLongSamples(tracks[0]->GetEndTime()) == len;
+      });
+   }
+
+   wxRemoveFile(fileName);
+}
+
+// Nearest-rank percentile of sorted times
+double Percentile(const std::vector<double> &sorted, double p)
+{
+   if (sorted.empty())
+      return 0;
+   size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+   return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+wxString FormatResult(const BenchmarkResult &result)
+{
+   std::vector<double> sorted(result.times);
+   std::sort(sorted.begin(), sorted.end());
+   double mean = 0;
+   for (size_t i = 0; i < sorted.size(); i++)
+      mean += sorted[i] / sorted.size();
+   const double median = Percentile(sorted, 50);
+
+   wxString json;
+   json += wxString::Format(wxT("    {\"name\": \"%s\", \"ok\": %s, \"unit\": \"%s\", \"work\": %.0f, \"runs\": %d,\n"),
+                            result.name.c_str(), result.ok ? wxT("true") : wxT("false"),
+                            result.unit.c_str(), result.work, (int)sorted.size());
+   json += wxString::Format(wxT("     \"ms\": {\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n"),
+                            sorted.empty() ? 0.0 : sorted.front(), mean, median,
+                            Percentile(sorted, 90), Percentile(sorted, 99),
+                            sorted.empty() ? 0.0 : sorted.back());
+   json += wxString::Format(wxT("     \"per_second_p50\": %.1f}"),
+                            median > 0 ? result.work * 1000.0 / median : 0.0);
+   return json;
+}
+
+} // namespace
+
+bool IsBenchmarkCommandLine(int argc, char *argv[])
+{
+   for (int i = 1; i < argc; i++)
+      if (!strcmp(argv[i], "--benchmark"))
+         return true;
+   return false;
+}
+
+int RunBenchmarkCommandLine(int argc, char *argv[])
+{
+   // With no GUI application object, wxWidgets starts only its base
+   // library, which needs no display
+   wxApp::SetInitializerFunction(NULL);
+   wxInitializer initializer(argc, argv);
+   if (!initializer.IsOk()) {
+      fprintf(stderr, "Failed to initialize wxWidgets.\n");
+      return 1;
+   }
+
+   BenchmarkOptions options;
+   wxString suiteList, outputFile;
+   {
+      wxCmdLineParser parser(argc, argv);
+      parser.AddSwitch(wxEmptyString, wxT("benchmark"), wxT("run the benchmarks"));
+      parser.AddSwitch(wxT("h"), wxT("help"), wxT("this help message"),
+                       wxCMD_LINE_OPTION_HELP);
+      parser.AddOption(wxEmptyString, wxT("suites"),
+                       wxT("comma-separated suites to run (default all): ") +
+                       wxJoin(HeadlessBenchmark::GetSuiteNames(), wxT(',')));
+      parser.AddOption(wxEmptyString, wxT("size"), wxT("MB of samples in each track (default 32)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("tracks"), wxT("tracks to mix and save, or channels to resample (default 4)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("blocksize"), wxT("max disk block size in KB (default 1024)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("edits"), wxT("cut and paste pairs in each edit run (default 100)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("repeat"), wxT("timed runs of each suite (default 5)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("seed"), wxT("random seed (default 234657)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("threads"), wxT("threads for mixing, resampling and spectrograms (default one per processor)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddOption(wxEmptyString, wxT("mapped"), wxT("block files to keep memory-mapped (default 0)"),
+                       wxCMD_LINE_VAL_NUMBER);
+      parser.AddSwitch(wxEmptyString, wxT("packed"), wxT("pack block files into large files"));
+      parser.AddOption(wxT("o"), wxT("output"), wxT("write the JSON here instead of to standard output"));
+
+      if (parser.Parse() != 0)
+         return 1;
+
+      parser.Found(wxT("suites"), &suiteList);
+      parser.Found(wxT("output"), &outputFile);
+      parser.Found(wxT("size"), &options.dataSize);
+      parser.Found(wxT("tracks"), &options.numTracks);
+      parser.Found(wxT("blocksize"), &options.blockSize);
+      parser.Found(wxT("edits"), &options.numEdits);
+      parser.Found(wxT("repeat"), &options.repeat);
+      parser.Found(wxT("seed"), &options.seed);
+      parser.Found(wxT("threads"), &options.threads);
+      parser.Found(wxT("mapped"), &options.mapped);
+      options.packed = parser.Found(wxT("packed"));
+   }
+
+   // The same limits as the dialog
+   if (options.blockSize < 1 || options.blockSize > 1024 ||
+       options.dataSize < 1 || options.dataSize > 2000 ||
+       options.numEdits < 1 || options.numEdits > 10000 ||
+       options.numTracks < 1 || options.repeat < 1) {
+      fprintf(stderr, "Benchmark options out of range; see --help.\n");
+      return 1;
+   }
+
+   wxArrayString suites;
+   if (suiteList.empty())
+      suites = HeadlessBenchmark::GetSuiteNames();
+   else
+      suites = wxSplit(suiteList, wxT(','));
+
+   // Default preferences, in a file of their own, so that results do not
+   // depend on the user's settings
+   const wxString configPath = wxFileName::CreateTempFileName(wxT("audacity-benchmark"));
+   gPrefs = new wxFileConfig(wxT("Audacity"), wxEmptyString, configPath,
+                             wxEmptyString, wxCONFIG_USE_LOCAL_FILE);
+   wxConfigBase::Set(gPrefs);
+   gPrefs->Write(wxT("/GUI/EditClipCanMove"), false);
+
+   const wxString tempDir = wxFileName::GetTempDir() + wxFILE_SEP_PATH +
+      wxString::Format(wxT("audacity-benchmark-%lu"), wxGetProcessId());
+   wxMkdir(tempDir);
+   DirManager::SetTempDir(tempDir);
+
+   wxString json;
+   json += wxT("{\n");
+   json += wxString::Format(wxT("  \"version\": \"%s\",\n"), AUDACITY_VERSION_STRING);
+   json += wxString::Format(wxT("  \"options\": {\"size_mb\": %ld, \"tracks\": %ld, \"blocksize_kb\": %ld, \"edits\": %ld, \"repeat\": %ld, \"seed\": %ld, \"threads\": %ld, \"mapped\": %ld, \"packed\": %s},\n"),
+                            options.dataSize, options.numTracks, options.blockSize,
+                            options.numEdits, options.repeat, options.seed,
+                            options.threads > 0 ? options.threads : (long)WorkerPool::GetDefaultThreadCount(),
+                            options.mapped, options.packed ? wxT("true") : wxT("false"));
+   json += wxT("  \"suites\": [\n");
+
+   bool ok = true;
+   wxArrayString entries;
+   {
+      HeadlessBenchmark benchmark(options);
+      for (size_t i = 0; i < suites.size(); i++) {
+         BenchmarkResult result;
+         if (!benchmark.Run(suites[i], result)) {
+            fprintf(stderr, "Unknown benchmark suite %s\n",
+                    (const char *)suites[i].mb_str());
+            ok = false;
+            continue;
+         }
+         ok = ok && result.ok;
+         entries.Add(FormatResult(result));
+      }
+   }
+
+   for (size_t i = 0; i < entries.size(); i++)
+      json += entries[i] + ((i + 1 < entries.size()) ? wxT(",\n") : wxT("\n"));
+   json += wxT("  ]\n}\n");
+
+   wxFileName::Rmdir(tempDir, wxPATH_RMDIR_RECURSIVE);
+   wxConfigBase::Set(NULL);
+   delete gPrefs;
+   gPrefs = NULL;
+   wxRemoveFile(configPath);
+
+   if (outputFile.empty())
+      fputs(json.mb_str(wxConvUTF8), stdout);
+   else {
+      wxFFile file(outputFile, wxT("w"));
+      if (!file.IsOpened() || !file.Write(json, wxConvUTF8))
+         return 1;
+   }
+
+   return ok ? 0 : 1;
+}
@@ -13,4 +13,10 @@
 
 void RunBenchmark(wxWindow *parent);
 
+// True if the command line asks for RunBenchmarkCommandLine()
+bool IsBenchmarkCommandLine(int argc, char *argv[]);
+// Runs benchmark suites with no display, before and instead of the
+// GUI, and writes the results as JSON.  Returns the exit code.
+int RunBenchmarkCommandLine(int argc, char *argv[]);
+
 #endif // define __AUDACITY_BENCHMARK__
@@ -0,0 +1,408 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  BlockArray.cpp
+
+*******************************************************************//**
+
+\class BlockArray
+\brief The blocks of a Sequence in a persistent, randomized binary
+search tree, with the starts of blocks kept relative to their subtrees.
+
+  The tree is a randomized binary search tree in the form of Martinez
+  and Roura: Join() makes the root of the larger tree the root of the
+  joined one with probability in proportion to its size, and Split() is
+  the plain split.  Whatever the order of edits, the expected depth is
+  O(log n).
+
+  A node may be in the trees of several arrays.  Before an edit changes
+  a node, Unshare() copies it if anything else holds it, so the other
+  arrays never see the change.  A node no one else holds is changed in
+  place, so an array that shares nothing, such as one being appended to
+  while recording, does not allocate on every edit.
+
+  Lookups by index go through a vector of all the blocks, laid out when
+  first needed after an edit, so that the loops over blocks[i] that
+  Sequence has always had still take O(1) a block.  Code that edits
+  between lookups uses Lookup() instead, which descends the tree.
+
+*//*******************************************************************/
+
+#include "BlockArray.h"
+
+#include <atomic>
+#include <wx/debug.h>
+
+#include "BlockFile.h"
+#include "DirManager.h"
+
+struct BlockArray::Node {
+   Node(BlockFile *f_, DirManager *owner_)
+      : f(f_)
+      , owner(owner_)
+      , length(f_ ? f_->GetLength() : 0)
+      , total(length)
+      , count(1)
+   {}
+
+   ~Node()
+   {
+      if (owner && f)
+         owner->Deref(f);
+   }
+
+   NodePtr left, right;
+   BlockFile *f;
+   DirManager *owner;
+   sampleCount length; // of this block
+   sampleCount total;  // of the blocks in this subtree
+   size_t count;       // of the blocks in this subtree
+};
+
+namespace {
+   template<typename Ptr> size_t CountOf(const Ptr &node)
+   {
+      return node ? node->count : 0;
+   }
+
+   template<typename Ptr> sampleCount TotalOf(const Ptr &node)
+   {
+      return node ? node->total : 0;
+   }
+
+   template<typename N> void Update(N &node)
+   {
+      node.count = 1 + CountOf(node.left) + CountOf(node.right);
+      node.total = node.length + TotalOf(node.left) + TotalOf(node.right);
+   }
+
+   // True with probability nLeft / (nLeft + nRight).  Edits of different
+   // sequences may run on different threads, hence the atomic.
+   bool ChooseLeft(size_t nLeft, size_t nRight)
+   {
+      static std::atomic<unsigned> sCounter(0);
+      unsigned x =
+         sCounter.fetch_add(0x9e3779b9u, std::memory_order_relaxed);
+      x ^= x >> 16;
+      x *= 0x7feb352du;
+      x ^= x >> 15;
+      x *= 0x846ca68bu;
+      x ^= x >> 16;
+      return (unsigned long long)x * (nLeft + nRight) >> 32 < nLeft;
+   }
+}
+
+BlockArray::BlockArray(DirManager *owner)
+   : mOwner(owner)
+{
+}
+
+BlockArray::BlockArray(DirManager *owner, const std::vector<SeqBlock> &blocks)
+   : mOwner(owner)
+{
+   if (!blocks.empty())
+      mRoot = Build(&blocks[0], blocks.size());
+}
+
+BlockArray::BlockArray(const BlockArray &other)
+   : mOwner(other.mOwner)
+   , mRoot(other.mRoot)
+   , mIndex(std::atomic_load(&other.mIndex))
+{
+}
+
+BlockArray::BlockArray(BlockArray &&other)
+   : mOwner(other.mOwner)
+   , mRoot(std::move(other.mRoot))
+   , mIndex(std::atomic_load(&other.mIndex))
+{
+   other.Invalidate();
+}
+
+BlockArray &BlockArray::operator= (const BlockArray &other)
+{
+   mOwner = other.mOwner;
+   mRoot = other.mRoot;
+   std::atomic_store(&mIndex, std::atomic_load(&other.mIndex));
+   return *this;
+}
+
+BlockArray &BlockArray::operator= (BlockArray &&other)
+{
+   mOwner = other.mOwner;
+   mRoot = std::move(other.mRoot);
+   std::atomic_store(&mIndex, std::atomic_load(&other.mIndex));
+   other.Invalidate();
+   return *this;
+}
+
+BlockArray::~BlockArray()
+{
+}
+
+size_t BlockArray::size() const
+{
+   return CountOf(mRoot);
+}
+
+sampleCount BlockArray::GetNumSamples() const
+{
+   return TotalOf(mRoot);
+}
+
+const SeqBlock &BlockArray::operator[] (size_t i) const
+{
+   wxASSERT(i < size());
+   return GetIndex()[i];
+}
+
+SeqBlock BlockArray::Lookup(size_t i) const
+{
+   wxASSERT(i < size());
+
+   sampleCount start = 0;
+   const Node *node = mRoot.get();
+   while (node) {
+      const size_t leftCount = CountOf(node->left);
+      if (i < leftCount) {
+         node = node->left.get();
+         continue;
+      }
+      start += TotalOf(node->left);
+      if (i == leftCount)
+         return SeqBlock(node->f, start);
+      start += node->length;
+      i -= leftCount + 1;
+      node = node->right.get();
+   }
+
+   return SeqBlock();
+}
+
+size_t BlockArray::FindBlock(sampleCount pos) const
+{
+   wxASSERT(pos >= 0 && pos < GetNumSamples());
+
+   size_t index = 0;
+   const Node *node = mRoot.get();
+   while (node) {
+      const sampleCount leftTotal = TotalOf(node->left);
+      if (pos < leftTotal) {
+         node = node->left.get();
+         continue;
+      }
+      pos -= leftTotal;
+      index += CountOf(node->left);
+      // Past the end, the last block is the nearest
+      if (pos < node->length || !node->right)
+         break;
+      pos -= node->length;
+      ++index;
+      node = node->right.get();
+   }
+
+   return index;
+}
+
+void BlockArray::push_back(const SeqBlock &block)
+{
+   wxASSERT(block.start == GetNumSamples());
+   Invalidate();
+   mRoot = Join(std::move(mRoot), MakeNode(block.f));
+}
+
+void BlockArray::clear()
+{
+   Invalidate();
+   mRoot.reset();
+}
+
+void BlockArray::SetFile(size_t i, BlockFile *f)
+{
+   wxASSERT(i < size());
+   Invalidate();
+
+   // Unshare the path down to the block, then change it
+   std::vector<Node *> path;
+   NodePtr *pNode = &mRoot;
+   for (;;) {
+      *pNode = Unshare(std::move(*pNode));
+      Node &node = **pNode;
+      path.push_back(&node);
+      const size_t leftCount = CountOf(node.left);
+      if (i < leftCount)
+         pNode = &node.left;
+      else if (i == leftCount)
+         break;
+      else {
+         i -= leftCount + 1;
+         pNode = &node.right;
+      }
+   }
+
+   Node &node = **pNode;
+   BlockFile *const oldFile = node.f;
+   node.f = f;
+   node.length = f ? f->GetLength() : 0;
+   if (mOwner && oldFile)
+      mOwner->Deref(oldFile);
+
+   for (auto it = path.rbegin(); it != path.rend(); ++it)
+      Update(**it);
+}
+
+void BlockArray::Splice(size_t first, size_t last,
+                        const std::vector<SeqBlock> &blocks)
+{
+   wxASSERT(first <= last && last <= size());
+   Invalidate();
+
+   auto before = Split(std::move(mRoot), first);
+   auto removed = Split(std::move(before.second), last - first);
+   // Releases the removed blocks, unless other arrays share them
+   removed.first.reset();
+
+   NodePtr middle;
+   if (!blocks.empty())
+      middle = Build(&blocks[0], blocks.size());
+   mRoot = Join(Join(std::move(before.first), std::move(middle)),
+                std::move(removed.second));
+}
+
+const BlockArray::Index &BlockArray::GetIndex() const
+{
+   IndexPtr index = std::atomic_load(&mIndex);
+   if (!index) {
+      auto made = std::make_shared<Index>();
+      made->reserve(size());
+      for (const auto &block : *this)
+         made->push_back(block);
+      // If another thread laid one out first, use that, so that no
+      // reference handed out already is left dangling
+      IndexPtr expected;
+      index = std::move(made);
+      if (!std::atomic_compare_exchange_strong(&mIndex, &expected, index))
+         index = std::move(expected);
+   }
+   // mIndex holds it until the next edit
+   return *index;
+}
+
+void BlockArray::Invalidate()
+{
+   std::atomic_store(&mIndex, IndexPtr{});
+}
+
+BlockArray::NodePtr BlockArray::MakeNode(BlockFile *f) const
+{
+   return std::make_shared<Node>(f, mOwner);
+}
+
+// A balanced tree of the given blocks
+BlockArray::NodePtr BlockArray::Build(const SeqBlock *blocks, size_t count) const
+{
+   if (count == 0)
+      return NodePtr{};
+   const size_t mid = count / 2;
+   NodePtr node = MakeNode(blocks[mid].f);
+   node->left = Build(blocks, mid);
+   node->right = Build(blocks + mid + 1, count - mid - 1);
+   Update(*node);
+   return node;
+}
+
+// The node itself if nothing else holds it, else a copy that may be
+// changed.  Pass the only pointer this array has to it.
+BlockArray::NodePtr BlockArray::Unshare(NodePtr node) const
+{
+   if (node.use_count() == 1) {
+      // Another array may just have let go of the node on another
+      // thread; see its reads before this one changes the node
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return node;
+   }
+
+   NodePtr copy = std::make_shared<Node>(node->f, node->owner);
+   copy->left = node->left;
+   copy->right = node->right;
+   copy->length = node->length;
+   Update(*copy);
+   // The copy holds its own reference to the file
+   if (copy->owner && copy->f)
+      copy->owner->Ref(copy->f);
+   return copy;
+}
+
+// The first count blocks, and the rest
+std::pair<BlockArray::NodePtr, BlockArray::NodePtr>
+BlockArray::Split(NodePtr node, size_t count) const
+{
+   if (!node)
+      return std::make_pair(NodePtr{}, NodePtr{});
+   if (count == 0)
+      return std::make_pair(NodePtr{}, std::move(node));
+   if (count >= node->count)
+      return std::make_pair(std::move(node), NodePtr{});
+
+   node = Unshare(std::move(node));
+   const size_t leftCount = CountOf(node->left);
+   if (count <= leftCount) {
+      auto parts = Split(std::move(node->left), count);
+      node->left = std::move(parts.second);
+      Update(*node);
+      return std::make_pair(std::move(parts.first), std::move(node));
+   }
+   else {
+      auto parts = Split(std::move(node->right), count - leftCount - 1);
+      node->right = std::move(parts.first);
+      Update(*node);
+      return std::make_pair(std::move(node), std::move(parts.second));
+   }
+}
+
+// All the blocks of left, then all those of right
+BlockArray::NodePtr BlockArray::Join(NodePtr left, NodePtr right) const
+{
+   if (!left)
+      return right;
+   if (!right)
+      return left;
+
+   if (ChooseLeft(left->count, right->count)) {
+      left = Unshare(std::move(left));
+      left->right = Join(std::move(left->right), std::move(right));
+      Update(*left);
+      return left;
+   }
+   else {
+      right = Unshare(std::move(right));
+      right->left = Join(std::move(left), std::move(right->left));
+      Update(*right);
+      return right;
+   }
+}
+
+BlockArray::const_iterator BlockArray::begin() const
+{
+   const_iterator result;
+   result.Descend(mRoot.get());
+   return result;
+}
+
+void BlockArray::const_iterator::Descend(const Node *node)
+{
+   for (; node; node = node->left.get())
+      mPath.push_back(node);
+   if (!mPath.empty())
+      mBlock.f = mPath.back()->f;
+}
+
+BlockArray::const_iterator &BlockArray::const_iterator::operator++ ()
+{
+   const Node *node = mPath.back();
+   mPath.pop_back();
+   mBlock.start += node->length;
+   Descend(node->right.get());
+   return *this;
+}
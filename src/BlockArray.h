@@ -0,0 +1,166 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  BlockArray.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_BLOCK_ARRAY__
+#define __AUDACITY_BLOCK_ARRAY__
+
+#include "Audacity.h"
+#include "MemoryX.h"
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "audacity/Types.h"
+
+class BlockFile;
+class DirManager;
+
+// This is an internal data structure!  For advanced use only.
+class SeqBlock {
+ public:
+   BlockFile * f;
+   ///the sample in the global wavetrack that this block starts at.
+   sampleCount start;
+
+   SeqBlock()
+      : f(NULL), start(0)
+   {}
+
+   SeqBlock(BlockFile *f_, sampleCount start_)
+      : f(f_), start(start_)
+   {}
+
+   // Construct a SeqBlock with changed start, same file
+   SeqBlock Plus(sampleCount delta) const
+   {
+      return SeqBlock(f, start + delta);
+   }
+};
+
+/// The blocks of a Sequence, in order.  Lookup by sample, insertion,
+/// removal and replacement all take O(log n) time.  Lookup by index
+/// takes O(1), as it did when the blocks were a vector; see operator[].
+///
+/// The blocks are the nodes of a randomized binary search tree.  Each
+/// node keeps the number of blocks and samples in its subtree, so that
+/// a block's start is relative to its subtree and is found on the way
+/// down; no edit ever has to move the starts of the later blocks.
+///
+/// The nodes are never changed while anything else uses them.  Copying
+/// an array shares its whole tree in O(1), and an edit copies only the
+/// O(log n) nodes on its path, so undo states cost little however long
+/// the track.
+///
+/// An array made with a DirManager holds one reference to the block file
+/// of each block, through the nodes: a node takes one when it is made and
+/// gives it back when the last array using the node lets go.  So the
+/// array takes over a reference from whoever adds a block, and releases
+/// the references of the blocks it removes.  An array made without a
+/// DirManager just holds the pointers.
+class PROFILE_DLL_API BlockArray {
+   struct Node;
+   using NodePtr = std::shared_ptr<Node>;
+
+ public:
+   explicit BlockArray(DirManager *owner = NULL);
+   /// Takes over a reference to each file.  The starts of blocks are
+   /// ignored; each block starts where the one before it ends.
+   BlockArray(DirManager *owner, const std::vector<SeqBlock> &blocks);
+   BlockArray(const BlockArray &other);
+   BlockArray(BlockArray &&other);
+   BlockArray &operator= (const BlockArray &other);
+   BlockArray &operator= (BlockArray &&other);
+   ~BlockArray();
+
+   DirManager *GetOwner() const { return mOwner; }
+
+   size_t size() const;
+   bool empty() const { return !mRoot; }
+   /// Total of the lengths of the blocks, as they were when added
+   sampleCount GetNumSamples() const;
+
+   /// The block at i, in O(1) time.  The first lookup after an edit
+   /// lays out all the blocks in an index, in O(n) time; copies of the
+   /// array share the index, and the next edit drops it.  The reference
+   /// is good until then.  Safe on several threads at once.
+   const SeqBlock &operator[] (size_t i) const;
+   /// The block at i, in O(log n) time, without the index.  For code
+   /// that edits between lookups, which would lay out the index anew
+   /// each time.
+   SeqBlock Lookup(size_t i) const;
+   SeqBlock back() const { return Lookup(size() - 1); }
+
+   /// The index of the block holding sample pos, which must be less
+   /// than GetNumSamples()
+   size_t FindBlock(sampleCount pos) const;
+
+   /// Adds a block at the end.  Its start must be GetNumSamples().
+   void push_back(const SeqBlock &block);
+   /// Drops all the blocks
+   void clear();
+
+   /// Puts f in place of the file of block i, which may change its
+   /// length and so the starts of the blocks after it
+   void SetFile(size_t i, BlockFile *f);
+   /// Puts blocks in place of blocks first up to but excluding last.
+   /// As for the constructor, their starts are ignored.
+   void Splice(size_t first, size_t last, const std::vector<SeqBlock> &blocks);
+   /// Removes blocks first up to but excluding last
+   void Erase(size_t first, size_t last)
+   { Splice(first, last, std::vector<SeqBlock>{}); }
+
+   /// Visits the blocks in order, each in O(1) amortized time
+   class PROFILE_DLL_API const_iterator
+      : public std::iterator<std::forward_iterator_tag, const SeqBlock>
+   {
+    public:
+      const_iterator() {}
+
+      const SeqBlock &operator* () const { return mBlock; }
+      const SeqBlock *operator-> () const { return &mBlock; }
+      const_iterator &operator++ ();
+      const_iterator operator++ (int)
+      { const_iterator result(*this); ++*this; return result; }
+
+      bool operator== (const const_iterator &other) const
+      { return mPath == other.mPath; }
+      bool operator!= (const const_iterator &other) const
+      { return !(*this == other); }
+
+    private:
+      friend class BlockArray;
+      void Descend(const Node *node);
+
+      // The nodes still to visit, the current one last
+      std::vector<const Node *> mPath;
+      SeqBlock mBlock;
+   };
+
+   const_iterator begin() const;
+   const_iterator end() const { return const_iterator(); }
+
+ private:
+   NodePtr MakeNode(BlockFile *f) const;
+   NodePtr Build(const SeqBlock *blocks, size_t count) const;
+   NodePtr Unshare(NodePtr node) const;
+   std::pair<NodePtr, NodePtr> Split(NodePtr node, size_t count) const;
+   NodePtr Join(NodePtr left, NodePtr right) const;
+
+   using Index = std::vector<SeqBlock>;
+   using IndexPtr = std::shared_ptr<const Index>;
+   const Index &GetIndex() const;
+   void Invalidate();
+
+   DirManager *mOwner;
+   NodePtr mRoot;
+   // The blocks with their starts, laid out on demand; null after edits
+   mutable IndexPtr mIndex;
+};
+
+#endif // __AUDACITY_BLOCK_ARRAY__
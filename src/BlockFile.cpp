@@ -40,6 +40,11 @@ counts.
 over multiple samples, which in turn allows rapid drawing when zoomed
 out.
 
+  Only the 256 and 64K sample levels are stored in the file.  The
+  BlockFile keeps a pyramid of coarser levels in memory, each
+  GetSummaryFactor() times coarser than the one below, computed when
+  the block is written or from the first read of its summary.
+
 *//*******************************************************************/
 
 #include "Audacity.h"
@@ -47,6 +52,7 @@ out.
 
 #include <float.h>
 #include <math.h>
+#include <algorithm>
 
 #include <wx/utils.h>
 #include <wx/filefn.h>
@@ -56,6 +62,7 @@ out.
 
 #include "Internat.h"
 #include "MemoryX.h"
+#include "SummaryKernels.h"
 
 // msmeyer: Define this to add debug output via printf()
 //#define DEBUG_BLOCKFILE
@@ -87,7 +94,7 @@ SummaryInfo::SummaryInfo(sampleCount samples)
    totalSummaryBytes = offset256 + (frames256 * bytesPerFrame);
 }
 
-ArrayOf<char> BlockFile::fullSummary;
+int BlockFile::sSummaryFactor = 16;
 
 /// Initializes the base BlockFile data.  The block is initially
 /// unlocked and its reference count is 1.
@@ -102,6 +109,7 @@ ArrayOf<char> BlockFile::fullSummary;
 BlockFile::BlockFile(wxFileNameWrapper &&fileName, sampleCount samples):
    mLockCount(0),
    mRefCount(1),
+   mPyramidFactor(0),
    mFileName(std::move(fileName)),
    mLen(samples),
    mSummaryInfo(samples)
@@ -164,8 +172,8 @@ bool BlockFile::IsLocked()
 /// DirManager should call this method.
 void BlockFile::Ref() const
 {
-   mRefCount++;
-   BLOCKFILE_DEBUG_OUTPUT("Ref", mRefCount);
+   const int count = ++mRefCount;
+   BLOCKFILE_DEBUG_OUTPUT("Ref", count);
 }
 
 /// Decreases the reference count of this block by one.  If this
@@ -173,9 +181,9 @@ void BlockFile::Ref() const
 /// file and deletes this object
 bool BlockFile::Deref() const
 {
-   mRefCount--;
-   BLOCKFILE_DEBUG_OUTPUT("Deref", mRefCount);
-   if (mRefCount <= 0) {
+   const int count = --mRefCount;
+   BLOCKFILE_DEBUG_OUTPUT("Deref", count);
+   if (count <= 0) {
       delete this;
       return true;
    } else
@@ -190,8 +198,8 @@ bool BlockFile::Deref() const
 /// This method also has the side effect of setting the mMin, mMax,
 /// and mRMS members of this class.
 ///
-/// You must not DELETE the returned buffer; it is static to this
-/// method.
+/// The returned buffer belongs to cleanup, so that block files can be
+/// made on several threads at once.
 ///
 /// @param buffer A buffer containing the sample data to be analyzed
 /// @param len    The length of the sample data
@@ -199,51 +207,28 @@ bool BlockFile::Deref() const
 void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
                              sampleFormat format, ArrayOf<char> &cleanup)
 {
-   // Caller has nothing to deallocate
-   cleanup.reset();
-
-   fullSummary.reinit(mSummaryInfo.totalSummaryBytes);
+   cleanup.reinit(mSummaryInfo.totalSummaryBytes);
+   char *const fullSummary = cleanup.get();
 
-   memcpy(fullSummary.get(), headerTag, headerTagLen);
+   memcpy(fullSummary, headerTag, headerTagLen);
 
-   float *summary64K = (float *)(fullSummary.get() + mSummaryInfo.offset64K);
-   float *summary256 = (float *)(fullSummary.get() + mSummaryInfo.offset256);
+   float *summary64K = (float *)(fullSummary + mSummaryInfo.offset64K);
+   float *summary256 = (float *)(fullSummary + mSummaryInfo.offset256);
 
    float *fbuffer = new float[len];
    CopySamples(buffer, format,
                (samplePtr)fbuffer, floatSample, len);
 
    sampleCount sumLen;
-   sampleCount i, j, jcount;
+   sampleCount i, j;
 
    float min, max;
    float sumsq;
 
    // Recalc 256 summaries
    sumLen = (len + 255) / 256;
+   SummaryKernels::SummaryFrames(fbuffer, len, 256, summary256);
 
-   for (i = 0; i < sumLen; i++) {
-      min = fbuffer[i * 256];
-      max = fbuffer[i * 256];
-      sumsq = ((float)min) * ((float)min);
-      jcount = 256;
-      if (i * 256 + jcount > len)
-         jcount = len - i * 256;
-      for (j = 1; j < jcount; j++) {
-         float f1 = fbuffer[i * 256 + j];
-         sumsq += ((float)f1) * ((float)f1);
-         if (f1 < min)
-            min = f1;
-         else if (f1 > max)
-            max = f1;
-      }
-
-      float rms = (float)sqrt(sumsq / jcount);
-
-      summary256[i * 3] = min;
-      summary256[i * 3 + 1] = max;
-      summary256[i * 3 + 2] = rms;
-   }
    for (i = sumLen; i < mSummaryInfo.frames256; i++) {
       // filling in the remaining bits with non-harming/contributing values
       summary256[i * 3] = FLT_MAX;  // min
@@ -301,7 +286,116 @@ void *BlockFile::CalcSummary(samplePtr buffer, sampleCount len,
 
    delete[] fbuffer;
 
-   return fullSummary.get();
+   // The coarser levels come from frames already at hand, so a block
+   // being recorded never has them recomputed from its file
+   BuildSummaryPyramid(summary256);
+
+   return fullSummary;
+}
+
+void BlockFile::SetSummaryFactor(int factor)
+{
+   // Round down to a power of two within range
+   int f = 2;
+   while (f * 2 <= factor && f < 256)
+      f *= 2;
+   sSummaryFactor = f;
+}
+
+sampleCount BlockFile::GetSummaryDivisor(int level)
+{
+   sampleCount divisor = 256;
+   while (level-- > 0)
+      divisor *= sSummaryFactor;
+   return divisor;
+}
+
+void BlockFile::BuildSummaryPyramid(const float *summary256) const
+{
+   const int factor = sSummaryFactor;
+   std::vector< std::vector<float> > pyramid;
+
+   // Weight each frame's rms by the samples it really covers, since the
+   // last frame of a level is usually partial
+   const float *prev = summary256;
+   sampleCount prevFrames = (mLen + 255) / 256;
+   sampleCount prevDivisor = 256;
+   while (prevFrames > 0) {
+      const sampleCount divisor = prevDivisor * factor;
+      const sampleCount frames = (mLen + divisor - 1) / divisor;
+      std::vector<float> level(frames * 3);
+
+      for (sampleCount i = 0; i < frames; i++) {
+         float min = FLT_MAX, max = -FLT_MAX;
+         double sumsq = 0.0;
+         sampleCount count = 0;
+         const sampleCount jend = std::min(prevFrames, (i + 1) * factor);
+         for (sampleCount j = i * factor; j < jend; j++) {
+            const sampleCount samples = std::min(prevDivisor, mLen - j * prevDivisor);
+            min = std::min(min, prev[3 * j]);
+            max = std::max(max, prev[3 * j + 1]);
+            sumsq += (double)prev[3 * j + 2] * prev[3 * j + 2] * samples;
+            count += samples;
+         }
+         level[3 * i] = min;
+         level[3 * i + 1] = max;
+         level[3 * i + 2] = count > 0 ? (float)sqrt(sumsq / count) : 0.0f;
+      }
+
+      pyramid.push_back(std::move(level));
+      prev = &pyramid.back()[0];
+      prevDivisor = divisor;
+      prevFrames = (frames > 1) ? frames : 0;
+   }
+
+   ODLocker locker{ &mPyramidMutex };
+   mPyramid.swap(pyramid);
+   mPyramidFactor = factor;
+}
+
+bool BlockFile::EnsureSummaryPyramid()
+{
+   {
+      ODLocker locker{ &mPyramidMutex };
+      if (mPyramidFactor == sSummaryFactor)
+         return true;
+   }
+
+   if (!IsSummaryAvailable())
+      return false;
+
+   // One read of the 256-sample frames builds every level
+   ArrayOf<float> summary256(mSummaryInfo.frames256 * 3);
+   if (!Read256(summary256.get(), 0, mSummaryInfo.frames256))
+      return false;
+   BuildSummaryPyramid(summary256.get());
+   return true;
+}
+
+bool BlockFile::ReadSummaryLevel(float *buffer, int level,
+                                 sampleCount start, sampleCount len)
+{
+   wxASSERT(start >= 0);
+
+   if (level <= 0)
+      return Read256(buffer, start, len);
+
+   if (!EnsureSummaryPyramid())
+      return false;
+
+   ODLocker locker{ &mPyramidMutex };
+   if (mPyramid.empty())
+      return false;
+
+   const std::vector<float> &frames =
+      mPyramid[std::min<size_t>(level, mPyramid.size()) - 1];
+   const sampleCount count = frames.size() / 3;
+   if (start + len > count)
+      len = count - start;
+   if (len > 0)
+      std::copy(&frames[3 * start], &frames[3 * start] + 3 * len, buffer);
+
+   return true;
 }
 
 static void ComputeMinMax256(float *summary256,
@@ -384,24 +478,62 @@ void BlockFile::FixSummary(void *data)
 void BlockFile::GetMinMax(sampleCount start, sampleCount len,
                   float *outMin, float *outMax, float *outRMS) const
 {
-   // TODO: actually use summaries
-   SampleBuffer blockData(len, floatSample);
-   this->ReadData(blockData.ptr(), floatSample, start, len);
-
    float min = FLT_MAX;
    float max = -FLT_MAX;
-   float sumsq = 0;
+   double sumsq = 0;
 
-   for( int i = 0; i < len; i++ )
-   {
-      float sample = ((float*)blockData.ptr())[i];
+   auto addSamples = [&](sampleCount s0, sampleCount s1) {
+      if (s0 >= s1)
+         return;
+      SampleBuffer blockData(s1 - s0, floatSample);
+      this->ReadData(blockData.ptr(), floatSample, s0, s1 - s0);
+      float partMin, partMax, partSumsq;
+      SummaryKernels::MinMaxSumsq((const float *)blockData.ptr(), s1 - s0,
+                                  &partMin, &partMax, &partSumsq);
+      min = std::min(min, partMin);
+      max = std::max(max, partMax);
+      sumsq += partSumsq;
+   };
+
+   const sampleCount end = start + len;
+   const sampleCount lo = (start + 255) / 256 * 256, hi = end / 256 * 256;
+   if (IsSummaryAvailable() && lo < hi) {
+      // Whole frames of the summary levels cover the middle of the
+      // region, the coarsest possible at each place, so only the ends
+      // are read as samples.  Reading summaries does not change the block.
+      BlockFile *const self = const_cast<BlockFile*>(this);
+      std::vector<float> frames;
+      auto addFrames = [&](int level, sampleCount f0, sampleCount f1) {
+         if (f0 >= f1)
+            return;
+         frames.resize(3 * (f1 - f0));
+         self->ReadSummaryLevel(&frames[0], level, f0, f1 - f0);
+         const sampleCount divisor = GetSummaryDivisor(level);
+         for (size_t i = 0; i < frames.size(); i += 3) {
+            min = std::min(min, frames[i]);
+            max = std::max(max, frames[i + 1]);
+            sumsq += (double)frames[i + 2] * frames[i + 2] * divisor;
+         }
+      };
+
+      const int factor = GetSummaryFactor();
+      sampleCount f0 = lo / 256, f1 = hi / 256;
+      for (int level = 0; ; level++) {
+         const sampleCount g0 = (f0 + factor - 1) / factor, g1 = f1 / factor;
+         if (g0 >= g1) {
+            addFrames(level, f0, f1);
+            break;
+         }
+         addFrames(level, f0, g0 * factor);
+         addFrames(level, g1 * factor, f1);
+         f0 = g0, f1 = g1;
+      }
 
-      if( sample > max )
-         max = sample;
-      if( sample < min )
-         min = sample;
-      sumsq += (sample*sample);
+      addSamples(start, lo);
+      addSamples(hi, end);
    }
+   else
+      addSamples(start, end);
 
    *outMin = min;
    *outMax = max;
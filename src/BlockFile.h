@@ -26,6 +26,9 @@
 
 #include "ondemand/ODTaskThread.h"
 
+#include <atomic>
+#include <vector>
+
 
 class SummaryInfo {
  public:
@@ -58,6 +61,14 @@ class PROFILE_DLL_API BlockFile /* not final, abstract */ {
    virtual int ReadData(samplePtr data, sampleFormat format,
                         sampleCount start, sampleCount len) const = 0;
 
+   /// If the samples are already in memory as floats, returns a pointer
+   /// to them instead of copying, and sets holder to keep them valid
+   /// until it is reset.  Otherwise returns NULL; use ReadData().
+   virtual const float *GetFloatsNoCopy(sampleCount WXUNUSED(start),
+                                        sampleCount WXUNUSED(len),
+                                        std::shared_ptr<const void> &WXUNUSED(holder)) const
+   { return NULL; }
+
    // Other Properties
 
    // Write cache to disk, if it has any
@@ -114,9 +125,27 @@ class PROFILE_DLL_API BlockFile /* not final, abstract */ {
    /// Returns the 64K summary data block
    virtual bool Read64K(float *buffer, sampleCount start, sampleCount len);
 
+   /// Sets how many frames of one summary level make a frame of the next
+   /// coarser level.  A power of two from 2 to 256; the default is 16.
+   static void SetSummaryFactor(int factor);
+   static int GetSummaryFactor() { return sSummaryFactor; }
+   /// Samples per summary frame at the given level: 256 at level 0,
+   /// times the summary factor at each level above
+   static sampleCount GetSummaryDivisor(int level);
+   /// Returns min, max and rms triples for every GetSummaryDivisor(level)
+   /// samples.  Level 0 is read like Read256(); the coarser levels are
+   /// kept in memory.  A level above the coarsest has one frame for the
+   /// whole block.
+   bool ReadSummaryLevel(float *buffer, int level,
+                         sampleCount start, sampleCount len);
+
    /// Returns TRUE if this block references another disk file
    virtual bool IsAlias() const { return false; }
 
+   /// Returns TRUE if this block is a record in a shared pack file
+   /// rather than a disk file of its own
+   virtual bool IsPacked() const { return false; }
+
    /// Returns TRUE if this block's complete summary has been computed and is ready (for OD)
    virtual bool IsSummaryAvailable() const {return true;}
 
@@ -178,11 +207,26 @@ class PROFILE_DLL_API BlockFile /* not final, abstract */ {
    /// on a different platform
    virtual void FixSummary(void *data);
 
+   /// Compute the summary levels coarser than 256 samples from the
+   /// 256-sample frames
+   void BuildSummaryPyramid(const float *summary256) const;
+
  private:
+   /// Build the summary levels from the stored summary if not done yet.
+   /// Returns false if the summary is not available.
+   bool EnsureSummaryPyramid();
+
    int mLockCount;
-   mutable int mRefCount;
+   // Nodes of BlockArrays shared with undo states may let go of the
+   // block on other threads
+   mutable std::atomic<int> mRefCount;
+
+   static int sSummaryFactor;
 
-   static ArrayOf<char> fullSummary;
+   // Level i holds the triples of level i + 1
+   mutable ODLock mPyramidMutex;
+   mutable int mPyramidFactor; // 0 until built
+   mutable std::vector< std::vector<float> > mPyramid;
 
  protected:
    wxFileNameWrapper mFileName;
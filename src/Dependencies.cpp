@@ -55,7 +55,7 @@ WX_DECLARE_HASH_MAP(BlockFile *, bool,
 // in the current set of tracks.  Enumerating that array allows
 // you to process all block files in the current set.
 static void GetAllSeqBlocks(AudacityProject *project,
-                            BlockPtrArray *outBlocks)
+                            std::vector<SeqBlock> *outBlocks)
 {
    TrackList *tracks = project->GetTracks();
    TrackListIterator iter(tracks);
@@ -67,10 +67,8 @@ static void GetAllSeqBlocks(AudacityProject *project,
          while(node) {
             WaveClip *clip = node->GetData();
             Sequence *sequence = clip->GetSequence();
-            BlockArray &blocks = sequence->GetBlockArray();
-            int i;
-            for (i = 0; i < (int)blocks.size(); i++)
-               outBlocks->push_back(&blocks[i]);
+            const BlockArray &blocks = sequence->GetBlockArray();
+            outBlocks->insert(outBlocks->end(), blocks.begin(), blocks.end());
             node = node->GetNext();
          }
       }
@@ -87,20 +85,30 @@ static void ReplaceBlockFiles(AudacityProject *project,
                               ReplacedBlockFileHash &hash)
 {
    DirManager *dirManager = project->GetDirManager();
-   BlockPtrArray blocks;
-   GetAllSeqBlocks(project, &blocks);
-
-   int i;
-   for (i = 0; i < (int)blocks.size(); i++) {
-      if (hash.count(blocks[i]->f) > 0) {
-         BlockFile *src = blocks[i]->f;
-         BlockFile *dst = hash[src];
-
-         dirManager->Deref(src);
-         dirManager->Ref(dst);
-
-         blocks[i]->f = dst;
+   TrackList *tracks = project->GetTracks();
+   TrackListIterator iter(tracks);
+   Track *t = iter.First();
+   while (t) {
+      if (t->GetKind() == Track::Wave) {
+         WaveTrack *waveTrack = (WaveTrack *)t;
+         WaveClipList::compatibility_iterator node = waveTrack->GetClipIterator();
+         while(node) {
+            Sequence *sequence = node->GetData()->GetSequence();
+            BlockArray &blocks = sequence->GetWritableBlockArray();
+            for (size_t i = 0; i < blocks.size(); i++) {
+               BlockFile *src = blocks.Lookup(i).f;
+               if (hash.count(src) > 0) {
+                  BlockFile *dst = hash[src];
+
+                  // The array releases src
+                  dirManager->Ref(dst);
+                  blocks.SetFile(i, dst);
+               }
+            }
+            node = node->GetNext();
+         }
       }
+      t = iter.Next();
    }
 }
 
@@ -109,14 +117,14 @@ void FindDependencies(AudacityProject *project,
 {
    sampleFormat format = project->GetDefaultFormat();
 
-   BlockPtrArray blocks;
+   std::vector<SeqBlock> blocks;
    GetAllSeqBlocks(project, &blocks);
 
    AliasedFileHash aliasedFileHash;
    BoolBlockFileHash blockFileHash;
 
-   for (const auto &blockFile : blocks) {
-      BlockFile *f = blockFile->f;
+   for (const auto &block : blocks) {
+      BlockFile *f = block.f;
       if (f->IsAlias() && (blockFileHash.count(f) == 0))
       {
          // f is an alias block we have not yet counted.
@@ -179,14 +187,14 @@ static void RemoveDependencies(AudacityProject *project,
       aliasedFileHash[fileNameStr] = &aliasedFile;
    }
 
-   BlockPtrArray blocks;
+   std::vector<SeqBlock> blocks;
    GetAllSeqBlocks(project, &blocks);
 
    const sampleFormat format = project->GetDefaultFormat();
    ReplacedBlockFileHash blockFileHash;
    wxLongLong completedBytes = 0;
-   for (const auto blockFile : blocks) {
-      BlockFile *f = blockFile->f;
+   for (const auto &block : blocks) {
+      BlockFile *f = block.f;
       if (f->IsAlias() && (blockFileHash.count(f) == 0))
       {
          // f is an alias block we have not yet processed.
@@ -57,6 +57,11 @@
   On close the blockfiles that are no longer referenced by the project (edited or deleted) are removed,
   along with the consequent empty directories.
 
+  If the preference "/Directories/PackBlockFiles" is set, simple block files are
+  instead written as records of 'packNNNN.aupk' files directly in the data directory
+  (see PackedBlockFile).  Such a block is named 'pXXXXXXXX', which is a key in the
+  hash but not a file on disk.
+
 
 *//*******************************************************************/
 
@@ -65,6 +70,7 @@
 #include "DirManager.h"
 #include "MemoryX.h"
 
+#include <algorithm>
 #include <time.h> // to use time() for srand()
 
 #include <wx/defs.h>
@@ -89,9 +95,11 @@
 
 #include "AudacityApp.h"
 #include "BlockFile.h"
+#include "DisplayCache.h"
 #include "blockfile/LegacyBlockFile.h"
 #include "blockfile/LegacyAliasBlockFile.h"
 #include "blockfile/SimpleBlockFile.h"
+#include "blockfile/PackedBlockFile.h"
 #include "blockfile/SilentBlockFile.h"
 #include "blockfile/PCMAliasBlockFile.h"
 #include "blockfile/ODPCMAliasBlockFile.h"
@@ -347,6 +355,9 @@ DirManager::DirManager()
    mLoadingTargetIdx = 0;
    mMaxSamples = -1;
 
+   mPackBlockFiles = gPrefs->Read(wxT("/Directories/PackBlockFiles"), 0L) != 0;
+   mBlockPacks = make_movable<BlockPackStore>();
+
    // toplevel pool hash is fully populated to begin
    {
       int i;
@@ -439,6 +450,14 @@ bool DirManager::SetProject(wxString& newProjPath, wxString& newProjName, const
       saved version of the old project must not be moved,
       otherwise the old project would not be safe.) */
 
+   if (!RelocateBlockPacks(oldLoc, projFull)) {
+      this->projFull = oldFull;
+      this->projPath = oldPath;
+      this->projName = oldName;
+
+      return false;
+   }
+
    {
       /*i18n-hint: This title appears on a dialog that indicates the progress in doing something.*/
       ProgressDialog progress(_("Progress"),
@@ -474,6 +493,8 @@ bool DirManager::SetProject(wxString& newProjPath, wxString& newProjName, const
 
          projFull = oldLoc;
 
+         RelocateBlockPacks(cleanupLoc2, oldLoc);
+
          BlockHash::iterator iter = mBlockFileHash.begin();
          while (iter != mBlockFileHash.end())
          {
@@ -495,6 +516,21 @@ bool DirManager::SetProject(wxString& newProjPath, wxString& newProjName, const
       }
    }
 
+   // A new project directory has a display cache of its own.  The old
+   // one's columns come from the same block files, so move it along
+   // (Save As), or drop it if that cannot be done.
+   if (mDisplayCache) {
+      mDisplayCache->Flush();
+      mDisplayCache.reset();
+   }
+   if (!oldFull.empty() && oldFull != projFull) {
+      const wxString oldCacheDir = DisplayCache::GetDirFor(oldFull);
+      const wxString newCacheDir = DisplayCache::GetDirFor(projFull);
+      if (wxDirExists(oldCacheDir) &&
+          (wxDirExists(newCacheDir) || !wxRenameFile(oldCacheDir, newCacheDir)))
+         wxFileName::Rmdir(oldCacheDir, wxPATH_RMDIR_RECURSIVE);
+   }
+
    // Some subtlety; SetProject is used both to move a temp project
    // into a permanent home as well as just set up path variables when
    // loading a project; in this latter case, the movement code does
@@ -519,6 +555,60 @@ bool DirManager::SetProject(wxString& newProjPath, wxString& newProjName, const
    return true;
 }
 
+DisplayCache *DirManager::GetDisplayCache()
+{
+   if (!mDisplayCache && !projFull.empty() &&
+       gPrefs->Read(wxT("/Spectrum/PersistentCache"), 0L) != 0) {
+      const long megabytes =
+         gPrefs->Read(wxT("/Spectrum/PersistentCacheSize"), 256L);
+      mDisplayCache = make_movable<DisplayCache>(
+         DisplayCache::GetDirFor(projFull), wxLongLong(megabytes) * 1048576);
+   }
+   return mDisplayCache.get();
+}
+
+void DirManager::FlushDisplayCache()
+{
+   if (mDisplayCache)
+      mDisplayCache->Flush();
+}
+
+bool DirManager::RelocateBlockPacks(const wxString &oldDir, const wxString &dir)
+{
+   // A pack moves as a whole, unless it holds any locked block, which
+   // must stay where the last saved project expects it
+   std::vector<BlockPack*> packs;
+   std::vector<bool> copy;
+   BlockHash::iterator iter = mBlockFileHash.begin();
+   while (iter != mBlockFileHash.end())
+   {
+      BlockFile *b = iter->second;
+      if (b->IsPacked()) {
+         BlockPack *pack = static_cast<PackedBlockFile*>(b)->GetPack();
+         if (pack && wxFileName(pack->GetPath()).GetPath() == oldDir) {
+            size_t i = std::find(packs.begin(), packs.end(), pack) - packs.begin();
+            if (i == packs.size()) {
+               packs.push_back(pack);
+               copy.push_back(false);
+            }
+            if (b->IsLocked())
+               copy[i] = true;
+         }
+      }
+      ++iter;
+   }
+
+   for (size_t i = 0; i < packs.size(); i++) {
+      if (!packs[i]->Relocate(dir, copy[i])) {
+         // Put back the ones already moved
+         while (i-- > 0)
+            packs[i]->Relocate(oldDir, copy[i]);
+         return false;
+      }
+   }
+   return true;
+}
+
 wxString DirManager::GetProjectDataDir()
 {
    return projFull;
@@ -845,7 +935,8 @@ wxFileNameWrapper DirManager::MakeBlockFileName()
 
       baseFileName.Printf(wxT("e%02x%02x%03x"),topnum,midnum,filenum);
 
-      if (mBlockFileHash.find(baseFileName) == mBlockFileHash.end()){
+      if (mBlockFileHash.find(baseFileName) == mBlockFileHash.end() &&
+          mReservedBlockNames.find(baseFileName) == mReservedBlockNames.end()){
          // not in the hash, good.
          if (!this->AssignFile(ret, baseFileName, true))
          {
@@ -867,18 +958,53 @@ wxFileNameWrapper DirManager::MakeBlockFileName()
    return std::move(ret);
 }
 
+wxFileNameWrapper DirManager::MakePackedBlockName()
+{
+   wxFileNameWrapper ret;
+   wxString baseFileName;
+
+   const wxString dir{ GetDataFilesDir() };
+   if (!wxDirExists(dir) && !wxFileName::Mkdir(dir, 0777, wxPATH_MKDIR_FULL))
+      wxLogSysError(_("mkdir in DirManager::MakePackedBlockName failed."));
+
+   // Only a key for the hash; no file of this name is created
+   do {
+      baseFileName.Printf(wxT("p%04x%04x"), rand() & 0xffff, rand() & 0xffff);
+   } while (mBlockFileHash.find(baseFileName) != mBlockFileHash.end() ||
+            mReservedBlockNames.find(baseFileName) != mReservedBlockNames.end());
+
+   this->AssignFile(ret, baseFileName, false);
+   return std::move(ret);
+}
+
 BlockFile *DirManager::NewSimpleBlockFile(
                                  samplePtr sampleData, sampleCount sampleLen,
                                  sampleFormat format,
                                  bool allowDeferredWrite)
 {
-   wxFileNameWrapper filePath{ MakeBlockFileName() };
+   // Only the name is made under the lock, and reserved until the file
+   // is there, so that no other thread takes it.  Writing the file,
+   // which is the slow part, needs no lock.
+   wxFileNameWrapper filePath;
+   {
+      ODLocker locker{ &mNewBlockFileMutex };
+      filePath = mPackBlockFiles ? MakePackedBlockName() : MakeBlockFileName();
+      mReservedBlockNames.insert(filePath.GetName());
+   }
    const wxString fileName{ filePath.GetName() };
 
-   BlockFile *newBlockFile =
-       new SimpleBlockFile(std::move(filePath), sampleData, sampleLen, format,
-                           allowDeferredWrite);
+   BlockFile *newBlockFile;
+   if (mPackBlockFiles)
+      newBlockFile =
+          new PackedBlockFile(std::move(filePath), *mBlockPacks,
+                              GetDataFilesDir(), sampleData, sampleLen, format);
+   else
+      newBlockFile =
+          new SimpleBlockFile(std::move(filePath), sampleData, sampleLen, format,
+                              allowDeferredWrite);
 
+   ODLocker locker{ &mNewBlockFileMutex };
+   mReservedBlockNames.erase(fileName);
    mBlockFileHash[fileName]=newBlockFile;
 
    return newBlockFile;
@@ -961,6 +1087,20 @@ BlockFile *DirManager::CopyBlockFile(BlockFile *b)
    auto result = b->GetFileName();
    const auto &fn = result.name;
 
+   if (b->IsPacked() && static_cast<PackedBlockFile*>(b)->GetPack() &&
+       wxFileName(static_cast<PackedBlockFile*>(b)->GetPack()->GetPath()).GetPath()
+          != GetDataFilesDir()) {
+      // A record in another project's pack: that project may move or
+      // delete the pack, so this one needs a record of its own
+      result.mLocker.reset();
+      wxFileNameWrapper newFile{ MakePackedBlockName() };
+      const wxString newName{ newFile.GetName() };
+      BlockFile *b2 = static_cast<PackedBlockFile*>(b)->CopyTo(
+         std::move(newFile), *mBlockPacks, GetDataFilesDir());
+      mBlockFileHash[newName]=b2;
+      return b2;
+   }
+
    if (!b->IsLocked()) {
       b->Ref();
       //mchinen:July 13 2009 - not sure about this, but it needs to be added to the hash to be able to save if not locked.
@@ -979,6 +1119,15 @@ BlockFile *DirManager::CopyBlockFile(BlockFile *b)
       // Block files with uninitialized filename (i.e. SilentBlockFile)
       // just need an in-memory copy.
       b2 = b->Copy(wxFileNameWrapper{});
+   else if (b->IsPacked())
+   {
+      // Blocks never change, so the copy may share the record
+      result.mLocker.reset();
+      wxFileNameWrapper newFile{ MakePackedBlockName() };
+      const wxString newName{ newFile.GetName() };
+      b2 = b->Copy(std::move(newFile));
+      mBlockFileHash[newName]=b2;
+   }
    else
    {
       wxFileNameWrapper newFile{ MakeBlockFileName() };
@@ -1030,6 +1179,8 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
    }
    else if ( !wxStricmp(tag, wxT("simpleblockfile")) )
       pBlockFile = SimpleBlockFile::BuildFromXML(*this, attrs);
+   else if ( !wxStricmp(tag, wxT("packedblockfile")) )
+      pBlockFile = PackedBlockFile::BuildFromXML(*this, attrs);
    else if( !wxStricmp(tag, wxT("pcmaliasblockfile")) )
       pBlockFile = PCMAliasBlockFile::BuildFromXML(*this, attrs);
    else if( !wxStricmp(tag, wxT("odpcmaliasblockfile")) )
@@ -1082,7 +1233,9 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
    {
       // See http://bugzilla.audacityteam.org/show_bug.cgi?id=451#c13.
       // Lock pBlockFile so that the ~BlockFile() will not DELETE the file on disk.
-      pBlockFile->Lock();
+      // (A packed block only gives back its use of the record.)
+      if (!pBlockFile->IsPacked())
+         pBlockFile->Lock();
       delete pBlockFile;
       return false;
    }
@@ -1100,7 +1253,8 @@ bool DirManager::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
    if (retrieved) {
       // Lock it in order to DELETE it safely, i.e. without having
       // it DELETE the file, too...
-      target->Lock();
+      if (!target->IsPacked())
+         target->Lock();
       delete target;
 
       Ref(retrieved); // Add one to its reference count
@@ -1133,7 +1287,12 @@ bool DirManager::MoveOrCopyToNewProjectDirectory(BlockFile *f, bool copy)
    if (!this->AssignFile(newFileName, oldFileNameRef.GetFullName(), false))
       return false;
 
-   if (newFileName != oldFileNameRef) {
+   if (f->IsPacked()) {
+      // Its pack was relocated already by SetProject()
+      result.mLocker.reset();
+      f->SetFileName(std::move(newFileName));
+   }
+   else if (newFileName != oldFileNameRef) {
       //check to see that summary exists before we copy.
       bool summaryExisted = f->IsSummaryAvailable();
       auto oldPath = oldFileNameRef.GetFullPath();
@@ -1217,14 +1376,17 @@ void DirManager::Deref(BlockFile * f)
    //       f->mRefCount-1,
    //       (const char *)f->mFileName.GetFullPath().mb_str());
 
+   // Blocks made on other threads may be going into the hash, and the
+   // nodes of BlockArrays shared with undo states may let go of blocks
+   // on other threads.  Hold the lock from the count reaching zero until
+   // the block is out of the hash, so nothing finds it there deleted.
+   ODLocker locker{ &mNewBlockFileMutex };
    if (f->Deref()) {
       // If Deref() returned true, the reference count reached zero
       // and this block is no longer needed.  Remove it from the hash
       // table.
-
       mBlockFileHash.erase(theFileName);
       BalanceInfoDel(theFileName);
-
    }
 }
 
@@ -1391,10 +1553,8 @@ void DirManager::Deref()
 {
    wxASSERT(mRef > 0); // MM: If mRef is smaller, it should have been deleted already
 
-   --mRef;
-
    // MM: Automatically DELETE if refcount reaches zero
-   if (mRef == 0)
+   if (--mRef == 0)
       delete this;
 }
 
@@ -1788,7 +1948,18 @@ void DirManager::FindMissingAUs(
    {
       const wxString &key = iter->first;
       BlockFile *b = iter->second;
-      if (!b->IsAlias())
+      if (b->IsPacked())
+      {
+         if (!static_cast<PackedBlockFile*>(b)->IsRecordPresent())
+         {
+            missingAUHash[key] = b;
+            BlockPack *pack = static_cast<PackedBlockFile*>(b)->GetPack();
+            wxLogWarning(_("Missing data block '%s' in pack file '%s'"),
+                           key.c_str(),
+                           pack ? pack->GetPath().c_str() : wxT(""));
+         }
+      }
+      else if (!b->IsAlias())
       {
          wxFileNameWrapper fileName{ MakeBlockFilePath(key) };
          fileName.SetName(key);
@@ -1804,7 +1975,7 @@ void DirManager::FindMissingAUs(
    }
 }
 
-// Find .au and .auf files that are not in the project.
+// Find .au, .auf and .aupk files that are not in the project.
 void DirManager::FindOrphanBlockFiles(
       const wxArrayString& filePathArray,       // input: all files in project directory
       wxArrayString& orphanFilePathArray)       // output: orphan files
@@ -1816,11 +1987,14 @@ void DirManager::FindOrphanBlockFiles(
       const wxFileName &fullname = filePathArray[i];
       wxString basename = fullname.GetName();
       const wxString ext{fullname.GetExt()};
-      if ((mBlockFileHash.find(basename) == mBlockFileHash.end()) && // is orphan
-            // Consider only Audacity data files.
-            // Specifically, ignore <branding> JPG and <import> OGG ("Save Compressed Copy").
-            (ext.IsSameAs(wxT("au")) ||
-               ext.IsSameAs(wxT("auf"))))
+      const bool isPack = ext.IsSameAs(wxT("aupk"));
+      if (isPack
+            ? !mBlockPacks->Contains(fullname.GetFullName())
+            : ((mBlockFileHash.find(basename) == mBlockFileHash.end()) && // is orphan
+               // Consider only Audacity data files.
+               // Specifically, ignore <branding> JPG and <import> OGG ("Save Compressed Copy").
+               (ext.IsSameAs(wxT("au")) ||
+                  ext.IsSameAs(wxT("auf")))))
       {
          if (!clipboardDM) {
             TrackList *clipTracks = AudacityProject::GetClipboardTracks();
@@ -1834,7 +2008,10 @@ void DirManager::FindOrphanBlockFiles(
          }
 
          // Ignore it if it exists in the clipboard (from a previously closed project)
-         if (!(clipboardDM && clipboardDM->ContainsBlockFile(basename)))
+         if (!(clipboardDM &&
+               (isPack
+                  ? clipboardDM->GetBlockPacks().Contains(fullname.GetFullName())
+                  : clipboardDM->ContainsBlockFile(basename))))
             orphanFilePathArray.Add(fullname.GetFullPath());
       }
    }
@@ -12,18 +12,25 @@
 #define _DIRMANAGER_
 
 #include <wx/list.h>
+#include <atomic>
+#include <vector>
 #include <wx/string.h>
 #include <wx/filename.h>
 #include <wx/hashmap.h>
+#include <wx/hashset.h>
 #include <wx/utils.h>
 
 #include "audacity/Types.h"
 #include "xml/XMLTagHandler.h"
 #include "wxFileNameWrapper.h"
+#include "MemoryX.h"
+#include "ondemand/ODTaskThread.h"
 
 class wxHashTable;
-class BlockArray;
 class BlockFile;
+class BlockPackStore;
+class DisplayCache;
+class SeqBlock;
 class SequenceTest;
 
 #define FSCKstatus_CLOSE_REQ 0x1
@@ -32,6 +39,7 @@ class SequenceTest;
 
 WX_DECLARE_HASH_MAP(int, int, wxIntegerHash, wxIntegerEqual, DirHash);
 WX_DECLARE_HASH_MAP(wxString, BlockFile*, wxStringHash, wxStringEqual, BlockHash);
+WX_DECLARE_HASH_SET(wxString, wxStringHash, wxStringEqual, BlockNameSet);
 
 wxMemorySize GetFreeMemory();
 
@@ -60,11 +68,27 @@ class PROFILE_DLL_API DirManager final : public XMLTagHandler {
 
    wxLongLong GetFreeDiskSpace();
 
+   // Several threads may call this at once, and Deref() meanwhile,
+   // which share mNewBlockFileMutex.  The block goes into the hash only
+   // once its file is written, so the hash never holds a NULL block.
    BlockFile *NewSimpleBlockFile(samplePtr sampleData,
                                  sampleCount sampleLen,
                                  sampleFormat format,
                                  bool allowDeferredWrite = false);
 
+   // If set, NEW simple block files are written as records of a few
+   // large pack files (PackedBlockFile) instead of files of their own
+   void SetPackBlockFiles(bool pack) { mPackBlockFiles = pack; }
+   bool GetPackBlockFiles() const { return mPackBlockFiles; }
+   BlockPackStore &GetBlockPacks() { return *mBlockPacks; }
+
+   // The store of computed display data kept next to the project's
+   // data directory, or NULL if the project was never saved or the
+   // store is turned off in preferences
+   DisplayCache *GetDisplayCache();
+   // Writes what the display cache has not yet written; call when idle
+   void FlushDisplayCache();
+
    BlockFile *NewAliasBlockFile( const wxString &aliasedFile, sampleCount aliasStart,
                                  sampleCount aliasLen, int aliasChannel);
 
@@ -103,7 +127,8 @@ class PROFILE_DLL_API DirManager final : public XMLTagHandler {
    // For debugging only
    int GetRefCount(BlockFile * f);
 
-   void SetLoadingTarget(BlockArray *pArray, unsigned idx)
+   // The block whose file HandleXMLTag() is to load
+   void SetLoadingTarget(std::vector<SeqBlock> *pArray, unsigned idx)
    {
       mLoadingTarget = pArray;
       mLoadingTargetIdx = idx;
@@ -138,7 +163,7 @@ class PROFILE_DLL_API DirManager final : public XMLTagHandler {
          BlockHash& missingAUFHash);               // output: missing (.auf) AliasBlockFiles
    void FindMissingAUs(
          BlockHash& missingAUHash);                // missing data (.au) blockfiles
-   // Find .au and .auf files that are not in the project.
+   // Find .au, .auf and .aupk files that are not in the project.
    void FindOrphanBlockFiles(
          const wxArrayString& filePathArray,       // input: all files in project directory
          wxArrayString& orphanFilePathArray);      // output: orphan files
@@ -171,12 +196,18 @@ class PROFILE_DLL_API DirManager final : public XMLTagHandler {
 
    wxFileNameWrapper MakeBlockFileName();
    wxFileNameWrapper MakeBlockFilePath(const wxString &value);
+   wxFileNameWrapper MakePackedBlockName();
+
+   // Move or copy the pack files of this project's blocks into dir
+   bool RelocateBlockPacks(const wxString &oldDir, const wxString &dir);
 
    bool MoveOrCopyToNewProjectDirectory(BlockFile *f, bool copy);
 
-   int mRef; // MM: Current refcount
+   std::atomic<int> mRef; // MM: Current refcount; Sequences may let go on other threads
 
    BlockHash mBlockFileHash; // repository for blockfiles
+   ODLock    mNewBlockFileMutex; // for the hash and balance info, as NewSimpleBlockFile() and Deref() change them
+   BlockNameSet mReservedBlockNames; // names of blocks NewSimpleBlockFile() is writing, guarded by mNewBlockFileMutex
    DirHash   dirTopPool;    // available toplevel dirs
    DirHash   dirTopFull;    // full toplevel dirs
    DirHash   dirMidPool;    // available two-level dirs
@@ -195,13 +226,17 @@ class PROFILE_DLL_API DirManager final : public XMLTagHandler {
 
    wxArrayString aliasList;
 
-   BlockArray *mLoadingTarget;
+   std::vector<SeqBlock> *mLoadingTarget;
    unsigned mLoadingTargetIdx;
    sampleFormat mLoadingFormat;
    sampleCount mLoadingBlockLen;
 
    sampleCount mMaxSamples; // max samples per block
 
+   bool mPackBlockFiles;
+   movable_ptr<BlockPackStore> mBlockPacks;
+   movable_ptr<DisplayCache> mDisplayCache;
+
    static wxString globaltemp;
    wxString mytemp;
    static int numDirManagers;
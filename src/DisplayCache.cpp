@@ -0,0 +1,474 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  DisplayCache.cpp
+
+*******************************************************************//**
+
+\class DisplayCache
+\brief Keeps computed spectrogram columns of a saved project on disk.
+
+  A tile file holds the length of its key and the key itself, which
+  must match what the reader expects in full, so that hash collisions
+  and stale files are harmless; then the number of values in a column,
+  the number of columns, the columns' sample positions and their
+  values.  The files are in native byte order, since they are only a
+  cache of what the samples give.
+
+*//*******************************************************************/
+
+#include "DisplayCache.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <wx/datetime.h>
+#include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+
+#include "BlockFile.h"
+#include "Sequence.h"
+
+namespace {
+
+// Columns of a tile, at the finest samples per pixel of its bucket
+const int TileColumns = 64;
+// Scrolling brings columns at other positions; keep the newest of them
+const size_t MaxTileColumns = 4 * TileColumns;
+// Bytes of columns to keep in memory, besides those not yet written
+const size_t MaxLoadedBytes = 64 * 1048576;
+
+const char TileMagic[] = "AudacitySpectrumTile1";
+
+template<typename T> void AppendKey(std::string &key, const T &value)
+{
+   key.append((const char *)&value, sizeof(T));
+}
+
+// FNV-1a
+wxULongLong_t HashKey(const std::string &key)
+{
+   wxULongLong_t hash = wxULL(14695981039346656037);
+   for (size_t i = 0; i < key.size(); i++) {
+      hash ^= (unsigned char)key[i];
+      hash *= wxULL(1099511628211);
+   }
+   return hash;
+}
+
+}
+
+struct DisplayCache::Tile {
+   std::string key;
+   wxString path;
+   int half{ 0 };
+   // False if a block near the tile is not yet loaded, as by on-demand
+   // import, so that its samples may yet change
+   bool usable{ true };
+   // Has columns that Flush() has yet to write
+   bool changed{ false };
+   unsigned long lastUse{ 0 };
+   // Of this tile, in mLoadedBytes of the cache
+   size_t countedBytes{ 0 };
+   wxLongLong fileBytes{ 0 };
+   std::vector<sampleCount> positions; // oldest first
+   std::vector<float> values;          // half for each position
+   std::map<sampleCount, size_t> index;
+
+   size_t GetBytes() const
+   {
+      return positions.size() * sizeof(sampleCount) +
+         values.size() * sizeof(float);
+   }
+
+   void Load();
+   void Limit();
+   bool Save();
+};
+
+void DisplayCache::Tile::Load()
+{
+   wxFFile file;
+   if (!wxFileExists(path) || !file.Open(path, wxT("rb")))
+      return;
+
+   uint32_t keyLength;
+   if (file.Read(&keyLength, sizeof(keyLength)) != sizeof(keyLength) ||
+       keyLength != key.size())
+      return;
+   std::string stored(keyLength, '\0');
+   int32_t storedHalf, count;
+   if (file.Read(&stored[0], keyLength) != keyLength || stored != key ||
+       file.Read(&storedHalf, sizeof(storedHalf)) != sizeof(storedHalf) ||
+       file.Read(&count, sizeof(count)) != sizeof(count) ||
+       storedHalf != half || count < 0 || (size_t)count > MaxTileColumns)
+      return;
+
+   std::vector<sampleCount> newPositions(count);
+   std::vector<float> newValues(count * half);
+   if (count > 0 &&
+       (file.Read(&newPositions[0], count * sizeof(sampleCount)) !=
+           count * sizeof(sampleCount) ||
+        file.Read(&newValues[0], newValues.size() * sizeof(float)) !=
+           newValues.size() * sizeof(float)))
+      return;
+
+   positions.swap(newPositions);
+   values.swap(newValues);
+   for (size_t i = 0; i < positions.size(); i++)
+      index[positions[i]] = i;
+   fileBytes = file.Length();
+}
+
+// Forgets the oldest columns beyond the limit
+void DisplayCache::Tile::Limit()
+{
+   if (positions.size() > MaxTileColumns) {
+      const size_t excess = positions.size() - MaxTileColumns;
+      positions.erase(positions.begin(), positions.begin() + excess);
+      values.erase(values.begin(), values.begin() + excess * half);
+      index.clear();
+      for (size_t i = 0; i < positions.size(); i++)
+         index[positions[i]] = i;
+   }
+}
+
+bool DisplayCache::Tile::Save()
+{
+   wxFFile file;
+   if (!file.Open(path, wxT("wb")))
+      return false;
+
+   const uint32_t keyLength = key.size();
+   const int32_t storedHalf = half, count = positions.size();
+   bool ok =
+      file.Write(&keyLength, sizeof(keyLength)) == sizeof(keyLength) &&
+      file.Write(key.data(), keyLength) == keyLength &&
+      file.Write(&storedHalf, sizeof(storedHalf)) == sizeof(storedHalf) &&
+      file.Write(&count, sizeof(count)) == sizeof(count);
+   if (ok && count > 0)
+      ok = file.Write(&positions[0], count * sizeof(sampleCount)) ==
+              count * sizeof(sampleCount) &&
+         file.Write(&values[0], values.size() * sizeof(float)) ==
+              values.size() * sizeof(float);
+   ok = file.Close() && ok;
+
+   if (!ok)
+      wxRemoveFile(path);
+   return ok;
+}
+
+DisplayCache::Spectrum::Spectrum
+   (DisplayCache &cache, const SpectrumCacheKey &key,
+    const BlockArray &blocks, sampleCount numSamples,
+    double samplesPerPixel, int half)
+   : mCache(cache)
+   , mKey(key)
+   , mBlocks(blocks)
+   , mNumSamples(numSamples)
+   , mBucket(samplesPerPixel >= 2.0 ? (int)floor(log2(samplesPerPixel)) : 0)
+   , mHalf(half)
+{
+   mSpan = sampleCount(TileColumns) << mBucket;
+}
+
+DisplayCache::Spectrum::~Spectrum()
+{
+}
+
+const std::shared_ptr<DisplayCache::Tile> &
+DisplayCache::Spectrum::GetTile(sampleCount index)
+{
+   auto &pTile = mTiles[index];
+   if (pTile)
+      return pTile;
+
+   // A column's window reaches half its size either way of its position
+   const sampleCount rangeStart = std::max<sampleCount>(0, index * mSpan - mKey.windowSize);
+   const sampleCount rangeEnd =
+      std::min(mNumSamples, (index + 1) * mSpan + mKey.windowSize);
+
+   std::string key;
+   key.append(TileMagic, sizeof(TileMagic));
+   AppendKey(key, mKey.algorithm);
+   AppendKey(key, mKey.windowType);
+   AppendKey(key, mKey.windowSize);
+   AppendKey(key, mKey.zeroPaddingFactor);
+   AppendKey(key, mKey.frequencyGain);
+   AppendKey(key, mKey.rate);
+   AppendKey(key, mKey.offsetFraction);
+   AppendKey(key, mBucket);
+   AppendKey(key, index);
+   AppendKey(key, mHalf);
+   // Columns near the end of the clip see where it ends
+   AppendKey(key, rangeEnd);
+
+   // The blocks the columns read.  A block's file name identifies it,
+   // but names are reused after blocks are freed, so add its length and
+   // summary too.
+   const size_t nBlocks = mBlocks.size();
+   size_t ii = nBlocks;
+   if (nBlocks)
+      ii = mBlocks.FindBlock(
+         std::min(rangeStart, mBlocks.GetNumSamples() - 1));
+   for (; ii < nBlocks; ++ii) {
+      const SeqBlock block = mBlocks[ii];
+      if (block.start >= rangeEnd)
+         break;
+      const BlockFile *const f = block.f;
+      if (!f->IsDataAvailable() || !f->IsSummaryAvailable()) {
+         pTile = std::make_shared<Tile>();
+         pTile->usable = false;
+         return pTile;
+      }
+      const sampleCount len = f->GetLength();
+      float min, max, rms;
+      f->GetMinMax(&min, &max, &rms);
+      const wxCharBuffer name =
+         f->GetFileName().name.GetFullName().mb_str(wxConvUTF8);
+      AppendKey(key, block.start);
+      AppendKey(key, len);
+      AppendKey(key, min);
+      AppendKey(key, max);
+      AppendKey(key, rms);
+      key.append(name.data(), strlen(name.data()) + 1);
+   }
+
+   pTile = mCache.FindTile(key, mHalf);
+   return pTile;
+}
+
+void DisplayCache::Spectrum::Read(const sampleCount *where, int begin, int end,
+                                  float *freq, std::vector<char> &found)
+{
+   for (int xx = begin; xx < end; ++xx) {
+      const sampleCount pos = where[xx];
+      if (pos < 0)
+         continue;
+      const Tile &tile = *GetTile(pos / mSpan);
+      if (!tile.usable)
+         continue;
+      const auto iter = tile.index.find(pos);
+      if (iter != tile.index.end()) {
+         const auto values = tile.values.begin() + iter->second * mHalf;
+         std::copy(values, values + mHalf, &freq[mHalf * xx]);
+         found[xx] = true;
+      }
+   }
+}
+
+void DisplayCache::Spectrum::Write(const sampleCount *where, int begin, int end,
+                                   const float *freq, const std::vector<char> &found)
+{
+   for (int xx = begin; xx < end; ++xx) {
+      const sampleCount pos = where[xx];
+      if (found[xx] || pos < 0)
+         continue;
+      Tile &tile = *GetTile(pos / mSpan);
+      if (!tile.usable || tile.index.count(pos))
+         continue;
+      tile.index[pos] = tile.positions.size();
+      tile.positions.push_back(pos);
+      tile.values.insert(tile.values.end(),
+                         &freq[mHalf * xx], &freq[mHalf * (xx + 1)]);
+      tile.changed = true;
+   }
+
+   for (auto &pair : mTiles) {
+      if (pair.second->changed) {
+         pair.second->Limit();
+         mCache.Changed(pair.second);
+      }
+   }
+}
+
+DisplayCache::DisplayCache(const wxString &dir, wxLongLong maxBytes)
+   : mDir(dir)
+   , mMaxBytes(maxBytes)
+   , mBytes(-1)
+   , mLoadedBytes(0)
+   , mUseCount(0)
+{
+}
+
+DisplayCache::~DisplayCache()
+{
+   Flush();
+}
+
+wxString DisplayCache::GetDirFor(const wxString &dataDir)
+{
+   wxString dir = dataDir;
+   if (dir.EndsWith(wxT("_data")))
+      dir.RemoveLast(5);
+   return dir + wxT("_cache");
+}
+
+void DisplayCache::Flush()
+{
+   int haveDir = -1; // not yet known
+   for (auto &pair : mLoaded) {
+      Tile &tile = *pair.second;
+      if (!tile.changed)
+         continue;
+      // Without the directory, the new columns are kept only in memory
+      tile.changed = false;
+      if (haveDir < 0)
+         haveDir = wxDirExists(mDir) || wxMkdir(mDir);
+      if (!haveDir)
+         continue;
+      const wxLongLong oldBytes = tile.fileBytes;
+      tile.fileBytes = 0;
+      if (tile.Save()) {
+         const wxULongLong size = wxFileName::GetSize(tile.path);
+         if (size != wxInvalidSize)
+            tile.fileBytes = (wxLongLong_t)size.GetValue();
+      }
+      Added(tile.fileBytes - oldBytes);
+   }
+   Evict();
+}
+
+// The tile for key, from memory if it is there, else from its file.
+// Takes key's contents.
+std::shared_ptr<DisplayCache::Tile>
+DisplayCache::FindTile(std::string &key, int half)
+{
+   const wxString path = GetPath(key);
+   auto &pTile = mLoaded[path];
+   if (pTile && pTile->key == key && pTile->half == half) {
+      pTile->lastUse = ++mUseCount;
+      return pTile;
+   }
+
+   // A hash collision puts this tile in place of the other
+   if (pTile) {
+      mLoadedBytes -= pTile->countedBytes;
+      pTile->countedBytes = 0;
+   }
+   const auto tile = std::make_shared<Tile>();
+   tile->key.swap(key);
+   tile->path = path;
+   tile->half = half;
+   tile->lastUse = ++mUseCount;
+   tile->Load();
+   if (!tile->positions.empty())
+      Touch(path);
+   tile->countedBytes = tile->GetBytes();
+   mLoadedBytes += tile->countedBytes;
+   pTile = tile;
+
+   Evict();
+   return tile;
+}
+
+// Keeps a tile with new columns in memory until Flush() writes it
+void DisplayCache::Changed(const std::shared_ptr<Tile> &tile)
+{
+   tile->lastUse = ++mUseCount;
+   auto &pTile = mLoaded[tile->path];
+   if (pTile != tile) {
+      // It was evicted or displaced meanwhile, so counts for nothing
+      if (pTile) {
+         mLoadedBytes -= pTile->countedBytes;
+         pTile->countedBytes = 0;
+      }
+      pTile = tile;
+   }
+   mLoadedBytes -= tile->countedBytes;
+   tile->countedBytes = tile->GetBytes();
+   mLoadedBytes += tile->countedBytes;
+
+   Evict();
+}
+
+// Forgets the least recently used tiles beyond the limit, except those
+// that Flush() has yet to write
+void DisplayCache::Evict()
+{
+   while (mLoadedBytes > MaxLoadedBytes) {
+      auto oldest = mLoaded.end();
+      for (auto iter = mLoaded.begin(); iter != mLoaded.end(); ++iter) {
+         if (!iter->second->changed &&
+             (oldest == mLoaded.end() ||
+              iter->second->lastUse < oldest->second->lastUse))
+            oldest = iter;
+      }
+      if (oldest == mLoaded.end())
+         break;
+      mLoadedBytes -= oldest->second->countedBytes;
+      oldest->second->countedBytes = 0;
+      mLoaded.erase(oldest);
+   }
+}
+
+wxString DisplayCache::GetPath(const std::string &key) const
+{
+   const wxULongLong_t hash = HashKey(key);
+   return mDir + wxFILE_SEP_PATH +
+      wxString::Format(wxT("%08x%08x.spc"),
+                       (unsigned)(hash >> 32), (unsigned)(hash & 0xffffffff));
+}
+
+void DisplayCache::Touch(const wxString &path)
+{
+   // Modification times order the files for Trim()
+   wxFileName(path).Touch();
+}
+
+void DisplayCache::Added(wxLongLong bytes)
+{
+   if (mBytes < 0) {
+      mBytes = 0;
+      wxArrayString files;
+      if (wxDirExists(mDir))
+         wxDir::GetAllFiles(mDir, &files, wxT("*.spc"), wxDIR_FILES);
+      for (size_t i = 0; i < files.size(); i++) {
+         const wxULongLong size = wxFileName::GetSize(files[i]);
+         if (size != wxInvalidSize)
+            mBytes += (wxLongLong_t)size.GetValue();
+      }
+   }
+   else
+      mBytes += bytes;
+
+   if (mBytes > mMaxBytes)
+      Trim();
+}
+
+void DisplayCache::Trim()
+{
+   struct Entry {
+      wxDateTime time;
+      wxLongLong bytes;
+      wxString path;
+   };
+   std::vector<Entry> entries;
+
+   wxArrayString files;
+   wxDir::GetAllFiles(mDir, &files, wxT("*.spc"), wxDIR_FILES);
+   mBytes = 0;
+   for (size_t i = 0; i < files.size(); i++) {
+      const wxFileName fn(files[i]);
+      const wxULongLong size = fn.GetSize();
+      if (size == wxInvalidSize)
+         continue;
+      const wxLongLong bytes = (wxLongLong_t)size.GetValue();
+      entries.push_back({ fn.GetModificationTime(), bytes, files[i] });
+      mBytes += bytes;
+   }
+
+   // Delete the least recently used files, leaving some room
+   std::sort(entries.begin(), entries.end(),
+      [](const Entry &a, const Entry &b) { return a.time < b.time; });
+   const wxLongLong target = mMaxBytes * 3 / 4;
+   for (size_t i = 0; i < entries.size() && mBytes > target; i++) {
+      if (wxRemoveFile(entries[i].path))
+         mBytes -= entries[i].bytes;
+   }
+}
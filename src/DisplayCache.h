@@ -0,0 +1,126 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  DisplayCache.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_DISPLAY_CACHE__
+#define __AUDACITY_DISPLAY_CACHE__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <wx/longlong.h>
+#include <wx/string.h>
+
+#include "Audacity.h"
+#include "MemoryX.h"
+#include "audacity/Types.h"
+
+class BlockArray;
+
+/// What a column of a spectrogram depends on, besides the samples
+struct SpectrumCacheKey {
+   int algorithm;
+   int windowType;
+   int windowSize;
+   int zeroPaddingFactor;
+   int frequencyGain;
+   double rate;
+   /// Fraction of a sample by which the clip is offset in its track
+   double offsetFraction;
+};
+
+/// Keeps spectrogram columns of a saved project in files, in a directory
+/// next to its _data directory, so that they need not be computed again
+/// when the project is reopened or the view comes back to them.
+///
+/// The columns are stored in tiles: the columns of one zoom bucket (a
+/// power of two of samples per pixel) whose positions fall in one span
+/// of the clip's samples.  A tile's file is named for a hash of all its
+/// columns depend on: the settings, the bucket, the span, and the
+/// blocks near it.  An edit makes new blocks, so it makes new tiles
+/// rather than changing old ones; the least recently used files are
+/// deleted when the directory grows beyond its size limit.
+///
+/// Tiles once read stay in memory, up to a limit, and new columns are
+/// only written out by Flush(), so that painting does not wait on the
+/// disk.
+class DisplayCache
+{
+   struct Tile;
+
+public:
+   DisplayCache(const wxString &dir, wxLongLong maxBytes);
+   /// Flushes
+   ~DisplayCache();
+
+   const wxString &GetDir() const { return mDir; }
+
+   /// The directory of the cache of the project whose data directory is
+   /// dataDir: for "name_data", "name_cache"
+   static wxString GetDirFor(const wxString &dataDir);
+
+   /// Writes the tiles that have new columns.  Call it when idle.
+   void Flush();
+
+   /// The columns of one clip's spectrogram, at one zoom, as they are
+   /// read from the cache and written back to it
+   class Spectrum
+   {
+   public:
+      Spectrum(DisplayCache &cache, const SpectrumCacheKey &key,
+               const BlockArray &blocks, sampleCount numSamples,
+               double samplesPerPixel, int half);
+      ~Spectrum();
+
+      /// Copies the stored columns, of those for positions where[x] with
+      /// x in [begin, end), into freq at half * x, and sets found[x] for
+      /// each of them
+      void Read(const sampleCount *where, int begin, int end,
+                float *freq, std::vector<char> &found);
+      /// Stores the columns in [begin, end) that found does not mark.
+      /// They reach the disk at the next Flush().
+      void Write(const sampleCount *where, int begin, int end,
+                 const float *freq, const std::vector<char> &found);
+
+   private:
+      const std::shared_ptr<Tile> &GetTile(sampleCount index);
+
+      DisplayCache &mCache;
+      SpectrumCacheKey mKey;
+      const BlockArray &mBlocks;
+      sampleCount mNumSamples;
+      int mBucket;
+      sampleCount mSpan;
+      int mHalf;
+      std::map<sampleCount, std::shared_ptr<Tile>> mTiles;
+   };
+
+private:
+   std::shared_ptr<Tile> FindTile(std::string &key, int half);
+   void Changed(const std::shared_ptr<Tile> &tile);
+   void Evict();
+   wxString GetPath(const std::string &key) const;
+   void Touch(const wxString &path);
+   void Added(wxLongLong bytes);
+   void Trim();
+
+   wxString mDir;
+   wxLongLong mMaxBytes;
+   // Less than zero until the directory is first measured
+   wxLongLong mBytes;
+
+   // The tiles in memory, by path, and the bytes of their columns
+   std::map<wxString, std::shared_ptr<Tile>> mLoaded;
+   size_t mLoadedBytes;
+   unsigned long mUseCount;
+
+   DisplayCache(const DisplayCache&) PROHIBITED;
+   DisplayCache &operator= (const DisplayCache&) PROHIBITED;
+};
+
+#endif
@@ -27,6 +27,12 @@
   - Triangle dithering
   - Noise-shaped dithering
 
+Samples are converted in blocks, by kernels that use SSE2 where the
+CPU has it.  The SSE2 and scalar kernels give identical results, and
+both give the same results as converting one sample at a time would,
+except that the dither noise comes from a generator of our own rather
+than from rand().
+
 Dither class. You must construct an instance because it keeps
 state. Call Dither::Apply() to apply the dither. You can call
 Reset() between subsequent dithers to reset the dither state
@@ -43,6 +49,7 @@ and get deterministic behaviour.
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <algorithm>
 //#include <sys/types.h>
 //#include <memory.h>
 //#include <assert.h>
@@ -51,163 +58,405 @@ and get deterministic behaviour.
 
 #include "Dither.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DITHER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(DITHER_SSE2) && defined(__GNUC__)
+// Compile the SSE2 kernels for SSE2, whatever the rest of the program
+// is compiled for
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_SSE2
+#endif
+
+
 //////////////////////////////////////////////////////////////////////////
 
 // Constants for the noise shaping buffer
 const int Dither::BUF_MASK = 7;
 const int Dither::BUF_SIZE = 8;
 
+// Samples are converted in blocks of this many
+const unsigned int Dither::BLOCK_SIZE = 1024;
+
 // Lipshitz's minimally audible FIR
 const float Dither::SHAPED_BS[] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
 
-// This is supposed to produce white noise and no dc
-#define DITHER_NOISE (rand() / (float)RAND_MAX - 0.5f)
-
-// The following is a rather ugly, but fast implementation
-// of a dither loop. The macro "DITHER" is expanded to an implementation
-// of a dithering algorithm, which contains no branches in the inner loop
-// except the branches for clipping the sample, and therefore should
-// be quite fast.
-
-#if 0
-// To assist in understanding what the macros are doing, here's an example of what
-// the result would be for Shaped dither:
-//
-// DITHER(ShapedDither, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
-
-    do {
-        if (sourceFormat == int24Sample && destFormat == int16Sample)
-            do {
-                char *d, *s;
-                unsigned int i;
-                int x;
-                for (d = (char*)dest, s = (char*)source, i = 0; i < len; i++, d += (int16Sample >> 16) * destStride, s += (int24Sample >> 16) * sourceStride)
-                    do {
-                        x = lrintf((ShapedDither((((*(( int*)(s)) / float(1<<23))) * float(1<<15)))));
-                        if (x>(32767))
-                            *((short*)((((d)))))=(32767);
-                        else if (x<(-32768))
-                            *((short*)((((d)))))=(-32768);
-                        else *((short*)((((d)))))=(short)x;
-                    } while (0);
-            } while (0);
-        else if (sourceFormat == floatSample && destFormat == int16Sample)
-            do {
-                char *d, *s;
-                unsigned int i;
-                int x;
-                for (d = (char*)dest, s = (char*)source, i = 0; i < len; i++, d += (int16Sample >> 16) * destStride, s += (floatSample >> 16) * sourceStride)
-                    do {
-                        x = lrintf((ShapedDither((((*((float*)(s)) > 1.0 ? 1.0 : *((float*)(s)) < -1.0 ? -1.0 : *((float*)(s)))) * float(1<<15)))));
-                        if (x>(32767))
-                            *((short*)((((d)))))=(32767);
-                        else if (x<(-32768))
-                            *((short*)((((d)))))=(-32768);
-                        else *((short*)((((d)))))=(short)x;
-                    } while (0);
-            } while (0);
-        else if (sourceFormat == floatSample && destFormat == int24Sample)
-            do {
-                char *d, *s;
-                unsigned int i;
-                int x;
-                for (d = (char*)dest, s = (char*)source, i = 0; i < len; i++, d += (int24Sample >> 16) * destStride, s += (floatSample >> 16) * sourceStride)
-                    do {
-                        x = lrintf((ShapedDither((((*((float*)(s)) > 1.0 ? 1.0 : *((float*)(s)) < -1.0 ? -1.0 : *((float*)(s)))) * float(1<<23)))));
-                        if (x>(8388607))
-                            *((int*)((((d)))))=(8388607);
-                        else if (x<(-8388608))
-                            *((int*)((((d)))))=(-8388608);
-                        else *((int*)((((d)))))=(int)x;
-                    } while (0);
-            } while (0);
-        else {
-            if ( false )
-                ;
-            else wxOnAssert(L"c:\\users\\yam\\documents\\audacity\\mixer\\n\\audacity\\src\\dither.cpp", 348,  __FUNCTION__  , L"false", 0);
-        }
-    } while (0);
-#endif
-
 // Defines for sample conversion
 #define CONVERT_DIV16 float(1<<15)
 #define CONVERT_DIV24 float(1<<23)
 
-// Dereference sample pointer and convert to float sample
-#define FROM_INT16(ptr) (*((short*)(ptr)) / CONVERT_DIV16)
-#define FROM_INT24(ptr) (*((  int*)(ptr)) / CONVERT_DIV24)
+namespace {
+
+// The conversion kernels work on contiguous samples.  Scaling is by
+// powers of two, so multiplying by the reciprocal is exact and gives
+// the same result as dividing.
 
 // For float, we internally allow values greater than 1.0, which
-// would blow up the dithering to int values.  FROM_FLOAT is
-// only used to dither to int, so clip here.
-#define FROM_FLOAT(ptr) (*((float*)(ptr)) >  1.0 ?  1.0 : \
-                         *((float*)(ptr)) < -1.0 ? -1.0 : \
-                         *((float*)(ptr)))
-
-// Promote sample to range of specified type, keep it float, though
-#define PROMOTE_TO_INT16(sample) ((sample) * CONVERT_DIV16)
-#define PROMOTE_TO_INT24(sample) ((sample) * CONVERT_DIV24)
-
-// Store float sample 'sample' into pointer 'ptr', clip it, if necessary
-// Note: This assumes, a variable 'x' of type int is valid which is
-//       used by this macro.
-#define IMPLEMENT_STORE(ptr, sample, ptr_type, min_bound, max_bound) \
-    do { \
-    x = lrintf(sample); \
-    if (x>(max_bound)) *((ptr_type*)(ptr))=(max_bound); \
-    else if (x<(min_bound)) *((ptr_type*)(ptr))=(min_bound); \
-    else *((ptr_type*)(ptr))=(ptr_type)x; } while (0)
-
-#define STORE_INT16(ptr, sample) IMPLEMENT_STORE((ptr), (sample), short, -32768, 32767)
-#define STORE_INT24(ptr, sample) IMPLEMENT_STORE((ptr), (sample), int, -8388608, 8388607)
-
-// Dither single float 'sample' and store it in pointer 'dst', using 'dither' as algorithm
-#define DITHER_TO_INT16(dither, dst, sample) STORE_INT16((dst), dither(PROMOTE_TO_INT16(sample)))
-#define DITHER_TO_INT24(dither, dst, sample) STORE_INT24((dst), dither(PROMOTE_TO_INT24(sample)))
-
-// Implement one single dither step
-#define DITHER_STEP(dither, store, load, dst, src) \
-    store(dither, (dst), load(src))
-
-// Implement a dithering loop
-// Note: The variable 'x' is needed for the STORE_... macros
-#define DITHER_LOOP(dither, store, load, dst, dstFormat, dstStride, src, srcFormat, srcStride, len) \
-    do { \
-       char *d, *s; \
-       unsigned int i; \
-       int x; \
-       for (d = (char*)dst, s = (char*)src, i = 0; \
-            i < len; \
-            i++, d += SAMPLE_SIZE(dstFormat) * dstStride, \
-                 s += SAMPLE_SIZE(srcFormat) * srcStride) \
-          DITHER_STEP(dither, store, load, d, s); \
-   } while (0)
-
-// Shortcuts to dithering loops
-#define DITHER_INT24_TO_INT16(dither, dst, dstStride, src, srcStride, len) \
-    DITHER_LOOP(dither, DITHER_TO_INT16, FROM_INT24, dst, int16Sample, dstStride, src, int24Sample, srcStride, len)
-#define DITHER_FLOAT_TO_INT16(dither, dst, dstStride, src, srcStride, len) \
-    DITHER_LOOP(dither, DITHER_TO_INT16, FROM_FLOAT, dst, int16Sample, dstStride, src, floatSample, srcStride, len)
-#define DITHER_FLOAT_TO_INT24(dither, dst, dstStride, src, srcStride, len) \
-    DITHER_LOOP(dither, DITHER_TO_INT24, FROM_FLOAT, dst, int24Sample, dstStride, src, floatSample, srcStride, len)
-
-// Implement a dither. There are only 3 cases where we must dither,
-// in all other cases, no dithering is necessary.
-#define DITHER(dither, dst, dstFormat, dstStride, src, srcFormat, srcStride, len) \
-    do { if (srcFormat == int24Sample && dstFormat == int16Sample) \
-        DITHER_INT24_TO_INT16(dither, dst, dstStride, src, srcStride, len); \
-    else if (srcFormat == floatSample && dstFormat == int16Sample) \
-        DITHER_FLOAT_TO_INT16(dither, dst, dstStride, src, srcStride, len); \
-    else if (srcFormat == floatSample && dstFormat == int24Sample) \
-        DITHER_FLOAT_TO_INT24(dither, dst, dstStride, src, srcStride, len); \
-    else { wxASSERT(false); } \
-    } while (0)
+// would blow up the dithering to int values.  ClipFloat is only used
+// to dither to int, so clip here.  NaN passes through.
+inline float Clip(float sample)
+{
+   return sample > 1.0f ? 1.0f : sample < -1.0f ? -1.0f : sample;
+}
+
+// Round and store a sample promoted to the range of the integer format,
+// clipping it if necessary.  NaN becomes 0, as it did from lrintf() on
+// 64-bit builds.
+template<typename T>
+inline T Store(float sample, int minBound, int maxBound)
+{
+   if (sample != sample)
+      return 0;
+   const int x = lrintf(sample);
+   if (x > maxBound)
+      return (T)maxBound;
+   else if (x < minBound)
+      return (T)minBound;
+   return (T)x;
+}
+
+struct Kernels
+{
+   void (*int16ToFloat)(const short *src, float *dst, unsigned int len, float scale);
+   void (*int24ToFloat)(const int *src, float *dst, unsigned int len, float scale);
+   void (*int16ToInt24)(const short *src, int *dst, unsigned int len);
+   void (*clipFloat)(const float *src, float *dst, unsigned int len, float scale);
+   void (*storeInt16)(const float *src, short *dst, unsigned int len);
+   void (*storeInt24)(const float *src, int *dst, unsigned int len);
+   // Advances the four generators by (len + 3) / 4 steps each
+   void (*noise)(unsigned int state[4], float *noise, unsigned int len);
+   // samples[i] -= noise[i]
+   void (*subtract)(float *samples, const float *noise, unsigned int len);
+   // samples[i] += noise[i + 1] - noise[i]
+   void (*addDifference)(float *samples, const float *noise, unsigned int len);
+};
+
+void Int16ToFloatScalar(const short *src, float *dst, unsigned int len, float scale)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = src[i] * scale;
+}
+
+void Int24ToFloatScalar(const int *src, float *dst, unsigned int len, float scale)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = src[i] * scale;
+}
+
+void Int16ToInt24Scalar(const short *src, int *dst, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = ((int)src[i]) << 8;
+}
+
+void ClipFloatScalar(const float *src, float *dst, unsigned int len, float scale)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = Clip(src[i]) * scale;
+}
+
+void StoreInt16Scalar(const float *src, short *dst, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = Store<short>(src[i], -32768, 32767);
+}
+
+void StoreInt24Scalar(const float *src, int *dst, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i++)
+      dst[i] = Store<int>(src[i], -8388608, 8388607);
+}
+
+// xorshift32; the top 24 bits make a uniform float in [-0.5, 0.5)
+inline unsigned int NextNoise(unsigned int &state)
+{
+   state ^= state << 13;
+   state ^= state >> 17;
+   state ^= state << 5;
+   return state;
+}
+
+inline float NoiseToFloat(unsigned int bits)
+{
+   return (int)(bits >> 8) * (1.0f / (1 << 24)) - 0.5f;
+}
+
+void NoiseScalar(unsigned int state[4], float *noise, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i += 4)
+      for (int k = 0; k < 4; k++)
+         noise[i + k] = NoiseToFloat(NextNoise(state[k]));
+}
+
+void SubtractScalar(float *samples, const float *noise, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i++)
+      samples[i] = samples[i] - noise[i];
+}
+
+void AddDifferenceScalar(float *samples, const float *noise, unsigned int len)
+{
+   for (unsigned int i = 0; i < len; i++)
+      samples[i] = samples[i] + noise[i + 1] - noise[i];
+}
+
+const Kernels ScalarKernels = {
+   Int16ToFloatScalar,
+   Int24ToFloatScalar,
+   Int16ToInt24Scalar,
+   ClipFloatScalar,
+   StoreInt16Scalar,
+   StoreInt24Scalar,
+   NoiseScalar,
+   SubtractScalar,
+   AddDifferenceScalar,
+};
+
+#ifdef DITHER_SSE2
+
+// Each kernel does groups of four or eight samples and leaves the rest
+// to its scalar counterpart
+
+TARGET_SSE2
+void Int16ToFloatSSE2(const short *src, float *dst, unsigned int len, float scale)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128 vscale = _mm_set1_ps(scale);
+   unsigned int i = 0;
+   for (; i + 8 <= len; i += 8) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      // Put each short in the high half of an int and shift it down to
+      // extend the sign
+      const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16);
+      const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16);
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+      _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+   }
+   Int16ToFloatScalar(src + i, dst + i, len - i, scale);
+}
+
+TARGET_SSE2
+void Int24ToFloatSSE2(const int *src, float *dst, unsigned int len, float scale)
+{
+   const __m128 vscale = _mm_set1_ps(scale);
+   unsigned int i = 0;
+   for (; i + 4 <= len; i += 4) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vscale));
+   }
+   Int24ToFloatScalar(src + i, dst + i, len - i, scale);
+}
+
+TARGET_SSE2
+void Int16ToInt24SSE2(const short *src, int *dst, unsigned int len)
+{
+   const __m128i zero = _mm_setzero_si128();
+   unsigned int i = 0;
+   for (; i + 8 <= len; i += 8) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + i),
+                       _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 8));
+      _mm_storeu_si128((__m128i *)(dst + i + 4),
+                       _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 8));
+   }
+   Int16ToInt24Scalar(src + i, dst + i, len - i);
+}
+
+TARGET_SSE2
+void ClipFloatSSE2(const float *src, float *dst, unsigned int len, float scale)
+{
+   const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+   const __m128 vscale = _mm_set1_ps(scale);
+   unsigned int i = 0;
+   for (; i + 4 <= len; i += 4) {
+      // MINPS and MAXPS return their second operand for NaN, so NaN
+      // passes through, as in Clip()
+      const __m128 v = _mm_loadu_ps(src + i);
+      const __m128 clipped = _mm_max_ps(minusOne, _mm_min_ps(one, v));
+      _mm_storeu_ps(dst + i, _mm_mul_ps(clipped, vscale));
+   }
+   ClipFloatScalar(src + i, dst + i, len - i, scale);
+}
+
+// Clipping before rounding gives the same result as clipping after,
+// since the bounds are integers.  NaN becomes 0, as in Store().
+TARGET_SSE2
+inline __m128i RoundClipped(const float *src, __m128 minBound, __m128 maxBound)
+{
+   __m128 v = _mm_loadu_ps(src);
+   v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+   return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, minBound), maxBound));
+}
+
+TARGET_SSE2
+void StoreInt16SSE2(const float *src, short *dst, unsigned int len)
+{
+   const __m128 minBound = _mm_set1_ps(-32768.0f), maxBound = _mm_set1_ps(32767.0f);
+   unsigned int i = 0;
+   for (; i + 8 <= len; i += 8) {
+      const __m128i lo = RoundClipped(src + i, minBound, maxBound);
+      const __m128i hi = RoundClipped(src + i + 4, minBound, maxBound);
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+   }
+   StoreInt16Scalar(src + i, dst + i, len - i);
+}
+
+TARGET_SSE2
+void StoreInt24SSE2(const float *src, int *dst, unsigned int len)
+{
+   const __m128 minBound = _mm_set1_ps(-8388608.0f), maxBound = _mm_set1_ps(8388607.0f);
+   unsigned int i = 0;
+   for (; i + 4 <= len; i += 4)
+      _mm_storeu_si128((__m128i *)(dst + i), RoundClipped(src + i, minBound, maxBound));
+   StoreInt24Scalar(src + i, dst + i, len - i);
+}
+
+TARGET_SSE2
+void NoiseSSE2(unsigned int state[4], float *noise, unsigned int len)
+{
+   __m128i x = _mm_loadu_si128((const __m128i *)state);
+   const __m128 scale = _mm_set1_ps(1.0f / (1 << 24));
+   const __m128 half = _mm_set1_ps(0.5f);
+   for (unsigned int i = 0; i < len; i += 4) {
+      x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+      x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+      x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+      const __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(x, 8));
+      _mm_storeu_ps(noise + i, _mm_sub_ps(_mm_mul_ps(f, scale), half));
+   }
+   _mm_storeu_si128((__m128i *)state, x);
+}
+
+TARGET_SSE2
+void SubtractSSE2(float *samples, const float *noise, unsigned int len)
+{
+   unsigned int i = 0;
+   for (; i + 4 <= len; i += 4)
+      _mm_storeu_ps(samples + i,
+                    _mm_sub_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(noise + i)));
+   SubtractScalar(samples + i, noise + i, len - i);
+}
+
+TARGET_SSE2
+void AddDifferenceSSE2(float *samples, const float *noise, unsigned int len)
+{
+   unsigned int i = 0;
+   for (; i + 4 <= len; i += 4) {
+      const __m128 sum =
+         _mm_add_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(noise + i + 1));
+      _mm_storeu_ps(samples + i, _mm_sub_ps(sum, _mm_loadu_ps(noise + i)));
+   }
+   AddDifferenceScalar(samples + i, noise + i, len - i);
+}
+
+const Kernels SSE2Kernels = {
+   Int16ToFloatSSE2,
+   Int24ToFloatSSE2,
+   Int16ToInt24SSE2,
+   ClipFloatSSE2,
+   StoreInt16SSE2,
+   StoreInt24SSE2,
+   NoiseSSE2,
+   SubtractSSE2,
+   AddDifferenceSSE2,
+};
+
+bool CPUHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+   return true;
+#elif defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 1);
+   return (info[3] & (1 << 26)) != 0;
+#else
+   return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#else
+
+bool CPUHasSSE2()
+{
+   return false;
+}
 
+#endif
+
+const Kernels *&CurrentKernels()
+{
+#ifdef DITHER_SSE2
+   static const Kernels *kernels = CPUHasSSE2() ? &SSE2Kernels : &ScalarKernels;
+#else
+   static const Kernels *kernels = &ScalarKernels;
+#endif
+   return kernels;
+}
+
+// Copy len samples of the given size, stepping by the strides
+template<typename T>
+void CopyStrided(const char *src, unsigned int srcStride,
+                 char *dst, unsigned int dstStride, unsigned int len)
+{
+   const T *s = (const T *)src;
+   T *d = (T *)dst;
+   for (unsigned int i = 0; i < len; i++, d += dstStride, s += srcStride)
+      *d = *s;
+}
+
+void CopyStrided(const char *src, unsigned int srcStride,
+                 char *dst, unsigned int dstStride,
+                 unsigned int len, sampleFormat format)
+{
+   if (format == int16Sample)
+      CopyStrided<short>(src, srcStride, dst, dstStride, len);
+   else
+      // int24 and float samples are both four bytes
+      CopyStrided<int>(src, srcStride, dst, dstStride, len);
+}
+
+}
+
+bool Dither::SetVectorized(bool vectorized)
+{
+#ifdef DITHER_SSE2
+   if (vectorized && !CPUHasSSE2())
+      return false;
+   CurrentKernels() = vectorized ? &SSE2Kernels : &ScalarKernels;
+   return true;
+#else
+   return !vectorized;
+#endif
+}
+
+bool Dither::IsVectorized()
+{
+   return CurrentKernels() != &ScalarKernels;
+}
 
 Dither::Dither()
 {
     // On startup, initialize dither by resetting values
     Reset();
+
+    // Seed the noise generators, which must not be zero.  Reset() leaves
+    // them alone, so that successive conversions get different noise.
+    for (int k = 0; k < 4; k++)
+        mNoiseState[k] = ((unsigned int)rand() << 1 | 1) * 2654435761u;
+}
+
+Dither::Dither(unsigned int seed)
+{
+    Reset();
+
+    for (int k = 0; k < 4; k++)
+        mNoiseState[k] = ((seed + k * 0x9e3779b9u) << 1 | 1) * 2654435761u;
 }
 
 void Dither::Reset()
@@ -217,8 +466,8 @@ void Dither::Reset()
     memset(mBuffer, 0, sizeof(float) * BUF_SIZE);
 }
 
-// This only decides if we must dither at all, the dithers
-// are all implemented using macros.
+// This only decides if we must dither at all, the conversions and
+// dithers are done a block at a time by ConvertBlock.
 //
 // "source" and "dest" can contain either interleaved or non-interleaved
 // samples.  They do not have to be the same...one can be interleaved while
@@ -231,7 +480,9 @@ void Dither::Reset()
 //
 // If either stride value is greater than 1 then the corresponding buffer
 // contains interleaved samples and they will be processed by skipping every
-// stride number of samples.
+// stride number of samples.  Interleaved samples are gathered into, or
+// scattered from, a contiguous block, so the conversion itself always
+// works on contiguous samples.
 
 void Dither::Apply(enum DitherType ditherType,
                    const samplePtr source, sampleFormat sourceFormat,
@@ -240,8 +491,6 @@ void Dither::Apply(enum DitherType ditherType,
                    unsigned int sourceStride /* = 1 */,
                    unsigned int destStride /* = 1 */)
 {
-    unsigned int i;
-
     // This code is not designed for 16-bit or 64-bit machine
     wxASSERT(sizeof(int) == 4);
     wxASSERT(sizeof(short) == 2);
@@ -263,133 +512,173 @@ void Dither::Apply(enum DitherType ditherType,
         if (destStride == 1 && sourceStride == 1)
             memcpy(dest, source, len * SAMPLE_SIZE(destFormat));
         else
+            CopyStrided(source, sourceStride, dest, destStride, len, sourceFormat);
+        return;
+    }
+
+    if (ditherType == triangle || ditherType == shaped)
+        Reset(); // reset dither filter for this NEW conversion
+
+    // Interleaved samples go through these; four bytes hold any format
+    float sourceBlock[BLOCK_SIZE];
+    float destBlock[BLOCK_SIZE];
+
+    const unsigned int sourceSize = SAMPLE_SIZE(sourceFormat);
+    const unsigned int destSize = SAMPLE_SIZE(destFormat);
+
+    for (unsigned int done = 0; done < len;)
+    {
+        const unsigned int blockLen = std::min(len - done, BLOCK_SIZE);
+        const char *s = source + done * sourceStride * sourceSize;
+        char *d = dest + done * destStride * destSize;
+
+        if (sourceStride != 1)
         {
-            if (sourceFormat == floatSample)
-            {
-                float* d = (float*)dest;
-                float* s = (float*)source;
-
-                for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                    *d = *s;
-            } else
-            if (sourceFormat == int24Sample)
-            {
-                int* d = (int*)dest;
-                int* s = (int*)source;
-
-                for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                    *d = *s;
-            } else
-            if (sourceFormat == int16Sample)
-            {
-                short* d = (short*)dest;
-                short* s = (short*)source;
-
-                for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                    *d = *s;
-            } else {
-                wxASSERT(false); // source format unknown
-            }
+            CopyStrided(s, sourceStride, (char*)sourceBlock, 1,
+                        blockLen, sourceFormat);
+            s = (const char*)sourceBlock;
         }
-    } else
+
+        ConvertBlock(ditherType, s, sourceFormat,
+                     destStride == 1 ? d : (char*)destBlock, destFormat,
+                     blockLen);
+
+        if (destStride != 1)
+            CopyStrided((const char*)destBlock, 1, d, destStride,
+                        blockLen, destFormat);
+
+        done += blockLen;
+    }
+}
+
+void Dither::ConvertBlock(DitherType ditherType,
+                          const char *source, sampleFormat sourceFormat,
+                          char *dest, sampleFormat destFormat,
+                          unsigned int len)
+{
+    const Kernels &kernels = *CurrentKernels();
+
     if (destFormat == floatSample)
     {
         // No need to dither, just convert samples to float.
         // No clipping should be necessary.
-        float* d = (float*)dest;
-
         if (sourceFormat == int16Sample)
-        {
-            short* s = (short*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                *d = FROM_INT16(s);
-        } else
-        if (sourceFormat == int24Sample)
-        {
-            int* s = (int*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-                *d = FROM_INT24(s);
-        } else {
+            kernels.int16ToFloat((const short*)source, (float*)dest, len,
+                                 1.0f / CONVERT_DIV16);
+        else if (sourceFormat == int24Sample)
+            kernels.int24ToFloat((const int*)source, (float*)dest, len,
+                                 1.0f / CONVERT_DIV24);
+        else
             wxASSERT(false); // source format unknown
-        }
-    } else
+        return;
+    }
+
     if (destFormat == int24Sample && sourceFormat == int16Sample)
     {
         // Special case when promoting 16 bit to 24 bit
-        int* d = (int*)dest;
-        short* s = (short*)source;
-        for (i = 0; i < len; i++, d += destStride, s += sourceStride)
-            *d = ((int)*s) << 8;
-    } else
+        kernels.int16ToInt24((const short*)source, (int*)dest, len);
+        return;
+    }
+
+    // We must do dithering.  There are only 3 cases where we must
+    // dither: first promote the samples to the range of the
+    // destination, keeping them float
+    float samples[BLOCK_SIZE];
+    if (sourceFormat == int24Sample && destFormat == int16Sample)
+        kernels.int24ToFloat((const int*)source, samples, len,
+                             CONVERT_DIV16 / CONVERT_DIV24);
+    else if (sourceFormat == floatSample && destFormat == int16Sample)
+        kernels.clipFloat((const float*)source, samples, len, CONVERT_DIV16);
+    else if (sourceFormat == floatSample && destFormat == int24Sample)
+        kernels.clipFloat((const float*)source, samples, len, CONVERT_DIV24);
+    else
     {
-        // We must do dithering
-        switch (ditherType)
-        {
-        case none:
-            DITHER(NoDither, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
-            break;
-        case rectangle:
-            DITHER(RectangleDither, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
-            break;
-        case triangle:
-            Reset(); // reset dither filter for this NEW conversion
-            DITHER(TriangleDither, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
-            break;
-        case shaped:
-            Reset(); // reset dither filter for this NEW conversion
-            DITHER(ShapedDither, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
-            break;
-        default:
-            wxASSERT(false); // unknown dither algorithm
-        }
+        wxASSERT(false);
+        return;
     }
+
+    switch (ditherType)
+    {
+    case none:
+        break;
+    case rectangle:
+        RectangleDither(samples, len);
+        break;
+    case triangle:
+        TriangleDither(samples, len);
+        break;
+    case shaped:
+        ShapedDither(samples, len);
+        break;
+    default:
+        wxASSERT(false); // unknown dither algorithm
+    }
+
+    // Round and clip
+    if (destFormat == int16Sample)
+        kernels.storeInt16(samples, (short*)dest, len);
+    else
+        kernels.storeInt24(samples, (int*)dest, len);
 }
 
 // Dither implementations
 
-// No dither, just return sample
-inline float Dither::NoDither(float sample)
+// The noise generators make four values at a time, so noise buffers
+// have room for three more than asked for
+void Dither::MakeNoise(float *noise, unsigned int len)
 {
-    return sample;
+    CurrentKernels()->noise(mNoiseState, noise, len);
 }
 
 // Rectangle dithering, apply one-step noise
-inline float Dither::RectangleDither(float sample)
+void Dither::RectangleDither(float *samples, unsigned int len)
 {
-    return sample - DITHER_NOISE;
+    float noise[BLOCK_SIZE + 3];
+    MakeNoise(noise, len);
+    CurrentKernels()->subtract(samples, noise, len);
 }
 
 // Triangle dither - high pass filtered
-inline float Dither::TriangleDither(float sample)
+void Dither::TriangleDither(float *samples, unsigned int len)
 {
-    float r = DITHER_NOISE;
-    float result = sample + r - mTriangleState;
-    mTriangleState = r;
-
-    return result;
+    // Each sample gets its noise minus the previous sample's
+    float noise[1 + BLOCK_SIZE + 3];
+    noise[0] = mTriangleState;
+    MakeNoise(noise + 1, len);
+    CurrentKernels()->addDifference(samples, noise, len);
+    mTriangleState = noise[len];
 }
 
-// Shaped dither
-inline float Dither::ShapedDither(float sample)
+// Shaped dither.  The filter feeds back the error of each rounding, so
+// only the noise is made a block at a time.
+void Dither::ShapedDither(float *samples, unsigned int len)
 {
-    // Generate triangular dither, +-1 LSB, flat psd
-    float r = DITHER_NOISE + DITHER_NOISE;
-    if(sample != sample)  // test for NaN
-       sample = 0; // and do the best we can with it
+    float noise[2 * BLOCK_SIZE + 3];
+    MakeNoise(noise, 2 * len);
 
-    // Run FIR
-    float xe = sample + mBuffer[mPhase] * SHAPED_BS[0]
-        + mBuffer[(mPhase - 1) & BUF_MASK] * SHAPED_BS[1]
-        + mBuffer[(mPhase - 2) & BUF_MASK] * SHAPED_BS[2]
-        + mBuffer[(mPhase - 3) & BUF_MASK] * SHAPED_BS[3]
-        + mBuffer[(mPhase - 4) & BUF_MASK] * SHAPED_BS[4];
+    for (unsigned int i = 0; i < len; i++)
+    {
+        float sample = samples[i];
+
+        // Generate triangular dither, +-1 LSB, flat psd
+        float r = noise[2 * i] + noise[2 * i + 1];
+        if(sample != sample)  // test for NaN
+           sample = 0; // and do the best we can with it
 
-    // Accumulate FIR and triangular noise
-    float result = xe + r;
+        // Run FIR
+        float xe = sample + mBuffer[mPhase] * SHAPED_BS[0]
+            + mBuffer[(mPhase - 1) & BUF_MASK] * SHAPED_BS[1]
+            + mBuffer[(mPhase - 2) & BUF_MASK] * SHAPED_BS[2]
+            + mBuffer[(mPhase - 3) & BUF_MASK] * SHAPED_BS[3]
+            + mBuffer[(mPhase - 4) & BUF_MASK] * SHAPED_BS[4];
 
-    // Roll buffer and store last error
-    mPhase = (mPhase + 1) & BUF_MASK;
-    mBuffer[mPhase] = xe - lrintf(result);
+        // Accumulate FIR and triangular noise
+        float result = xe + r;
 
-    return result;
+        // Roll buffer and store last error
+        mPhase = (mPhase + 1) & BUF_MASK;
+        mBuffer[mPhase] = xe - lrintf(result);
+
+        samples[i] = result;
+    }
 }
@@ -16,8 +16,10 @@
 class Dither
 {
 public:
-    /// Default constructor
+    /// Default constructor, seeding the noise from rand()
     Dither();
+    /// Seeds the noise from seed instead, without calling rand()
+    explicit Dither(unsigned int seed);
 
     /// These ditherers are currently available:
     enum DitherType { none = 0, rectangle = 1, triangle = 2, shaped = 3};
@@ -36,14 +38,30 @@ public:
                unsigned int sourceStride = 1,
                unsigned int destStride = 1);
 
+    /// Use the SSE2 conversion kernels if true (the default, where the
+    /// CPU has SSE2), else the scalar ones.  Both give the same results.
+    /// Returns false, changing nothing, if the CPU lacks SSE2.
+    static bool SetVectorized(bool vectorized);
+    static bool IsVectorized();
+
 private:
-    // Dither methods
-    float NoDither(float sample);
-    float RectangleDither(float sample);
-    float TriangleDither(float sample);
-    float ShapedDither(float sample);
+    /// Convert one block of at most BLOCK_SIZE contiguous samples
+    void ConvertBlock(DitherType ditherType,
+                      const char *source, sampleFormat sourceFormat,
+                      char *dest, sampleFormat destFormat,
+                      unsigned int len);
+
+    // Dither methods, applied in place to a block of samples already
+    // promoted to the range of the destination format
+    void RectangleDither(float *samples, unsigned int len);
+    void TriangleDither(float *samples, unsigned int len);
+    void ShapedDither(float *samples, unsigned int len);
+
+    /// Fill noise with len values spread evenly over [-0.5, 0.5)
+    void MakeNoise(float *noise, unsigned int len);
 
     // Dither constants
+    static const unsigned int BLOCK_SIZE; /* = 1024 */
     static const int BUF_SIZE; /* = 8 */
     static const int BUF_MASK; /* = 7 */
     static const float SHAPED_BS[];
@@ -52,6 +70,9 @@ private:
     int mPhase;
     float mTriangleState;
     float mBuffer[8 /* = BUF_SIZE */];
+
+    // Four xorshift generators, one per SSE2 lane
+    unsigned int mNoiseState[4];
 };
 
 #endif /* __AUDACITY_DITHER_H__ */
@@ -65,8 +65,6 @@ Envelope::Envelope()
    mMaxValue = 2.0;
 
    mButton = wxMOUSE_BTN_NONE;
-
-   mSearchGuess = -1;
 }
 
 Envelope::~Envelope()
@@ -1002,7 +1000,8 @@ double Envelope::GetValue(double t) const
 
 /// @param Lo returns last index at or before this time.
 /// @param Hi returns first index after this time.
-void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
+void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t,
+                                    int *searchGuess ) const
 {
    Lo = 0;
    Hi = mEnv.size() - 1;
@@ -1011,22 +1010,24 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
 
    // Optimizations for the usual pattern of repeated calls with
    // small increases of t.
-   {
-      if (mSearchGuess >= 0 && mSearchGuess < int(mEnv.size()) - 1) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-            t < mEnv[1 + mSearchGuess].GetT()) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+   if (searchGuess) {
+      int guess = *searchGuess;
+      if (guess >= 0 && guess < int(mEnv.size()) - 1) {
+         if (t >= mEnv[guess].GetT() &&
+            t < mEnv[1 + guess].GetT()) {
+            Lo = guess;
+            Hi = 1 + guess;
             return;
          }
       }
 
-      ++mSearchGuess;
-      if (mSearchGuess >= 0 && mSearchGuess < int(mEnv.size()) - 1) {
-         if (t >= mEnv[mSearchGuess].GetT() &&
-            t < mEnv[1 + mSearchGuess].GetT()) {
-            Lo = mSearchGuess;
-            Hi = 1 + mSearchGuess;
+      ++guess;
+      if (guess >= 0 && guess < int(mEnv.size()) - 1) {
+         if (t >= mEnv[guess].GetT() &&
+            t < mEnv[1 + guess].GetT()) {
+            Lo = guess;
+            Hi = 1 + guess;
+            *searchGuess = guess;
             return;
          }
       }
@@ -1041,7 +1042,8 @@ void Envelope::BinarySearchForTime( int &Lo, int &Hi, double t ) const
    }
    wxASSERT( Hi == ( Lo+1 ));
 
-   mSearchGuess = Lo;
+   if (searchGuess)
+      *searchGuess = Lo;
 }
 
 /// GetInterpolationStartValueAtPoint() is used to select either the
@@ -1071,6 +1073,7 @@ void Envelope::GetValues(double *buffer, int bufferLen,
 
    double t = t0;
    double tprev, vprev, tnext = 0, vnext, vstep = 0;
+   int searchGuess = -1;
 
    for (int b = 0; b < bufferLen; b++) {
 
@@ -1102,7 +1105,7 @@ void Envelope::GetValues(double *buffer, int bufferLen,
          // points to move over.  That's why we binary search.
 
          int lo,hi;
-         BinarySearchForTime( lo, hi, t );
+         BinarySearchForTime( lo, hi, t, &searchGuess );
          tprev = mEnv[lo].GetT();
          tnext = mEnv[hi].GetT();
 
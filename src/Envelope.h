@@ -197,7 +197,11 @@ private:
    float ValueOfPixel( int y, int height, bool upper,
                        bool dB, double dBRange,
                        float zoomMin, float zoomMax);
-   void BinarySearchForTime( int &Lo, int &Hi, double t ) const;
+   // searchGuess, if given, is the Lo of the caller's last search, and is
+   // updated.  It belongs to the caller, so that several threads may
+   // search the same envelope at once.
+   void BinarySearchForTime( int &Lo, int &Hi, double t,
+                             int *searchGuess = NULL ) const;
    double GetInterpolationStartValueAtPoint( int iPoint ) const;
    void MoveDraggedPoint( wxMouseEvent & event, wxRect & r,
                                const ZoomInfo &zoomInfo, bool dB, double dBRange,
@@ -245,8 +249,6 @@ private:
    double lastIntegral_t1;
    double lastIntegral_result;
 
-   mutable int mSearchGuess;
-
 };
 
 inline EnvPoint::EnvPoint(Envelope *envelope, double t, double val)
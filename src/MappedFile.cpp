@@ -0,0 +1,91 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  MappedFile.cpp
+
+*******************************************************************//**
+
+\class MappedFilePool
+\brief Maps files read-only into memory, keeping a bounded number of
+mappings open.
+
+  Mapping is used only where the operating system lets a mapped file
+  be deleted or renamed, because DirManager does both to block files
+  without knowing who reads them.  Elsewhere Map() always fails and
+  the callers fall back to reading.
+
+*//*******************************************************************/
+
+#include "MappedFile.h"
+
+#if !defined(__WXMSW__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USE_MMAP
+#endif
+
+MappedFile::~MappedFile()
+{
+#ifdef USE_MMAP
+   munmap((void *)mData, mSize);
+#endif
+}
+
+MappedFilePool &MappedFilePool::Instance()
+{
+   static MappedFilePool pool;
+   return pool;
+}
+
+MappedFilePool::MappedFilePool()
+   : mCapacity(0)
+   , mNext(0)
+{
+}
+
+void MappedFilePool::SetCapacity(int capacity)
+{
+   wxMutexLocker locker(mMutex);
+   if (capacity < 0)
+      capacity = 0;
+   mCapacity = capacity;
+   mFiles.clear();
+   mFiles.resize(capacity);
+   mNext = 0;
+}
+
+std::shared_ptr<const MappedFile> MappedFilePool::Map(const wxString &path)
+{
+   if (!IsEnabled())
+      return {};
+
+#ifdef USE_MMAP
+   int fd = open(path.fn_str(), O_RDONLY);
+   if (fd < 0)
+      return {};
+
+   struct stat st;
+   void *data = MAP_FAILED;
+   if (fstat(fd, &st) == 0 && st.st_size > 0)
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   // The mapping keeps the file open by itself
+   close(fd);
+   if (data == MAP_FAILED)
+      return {};
+
+   std::shared_ptr<const MappedFile> file
+      { safenew MappedFile((const char *)data, st.st_size) };
+
+   wxMutexLocker locker(mMutex);
+   if (!mFiles.empty()) {
+      mFiles[mNext] = file;
+      mNext = (mNext + 1) % mFiles.size();
+   }
+   return file;
+#else
+   return {};
+#endif
+}
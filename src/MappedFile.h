@@ -0,0 +1,72 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  MappedFile.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_MAPPED_FILE__
+#define __AUDACITY_MAPPED_FILE__
+
+#include "Audacity.h"
+#include "MemoryX.h"
+
+#include <vector>
+
+#include <wx/string.h>
+#include <wx/thread.h>
+
+/// A whole file mapped read-only into memory.  The mapping stays valid
+/// for as long as the object lives, even if the file is renamed or
+/// deleted meanwhile.
+class AUDACITY_DLL_API MappedFile
+{
+public:
+   ~MappedFile();
+
+   const char *GetData() const { return mData; }
+   size_t GetSize() const { return mSize; }
+
+private:
+   friend class MappedFilePool;
+
+   MappedFile(const char *data, size_t size)
+      : mData(data), mSize(size) {}
+
+   const char *mData;
+   size_t mSize;
+
+   MappedFile(const MappedFile&) PROHIBITED;
+   MappedFile &operator= (const MappedFile&) PROHIBITED;
+};
+
+/// Creates MappedFiles and bounds how many of them are kept open.
+/// The pool holds the most recently created mappings; when it is full
+/// the oldest is dropped, and is unmapped as soon as no reader still
+/// holds it.  Callers keep a std::weak_ptr to their mapping and call
+/// Map() again only when it has expired, so a hit costs no system call
+/// and no lock.
+class AUDACITY_DLL_API MappedFilePool
+{
+public:
+   static MappedFilePool &Instance();
+
+   /// 0 disables mapping: Map() then always fails.
+   void SetCapacity(int capacity);
+   bool IsEnabled() const { return mCapacity > 0; }
+
+   /// Returns NULL if mapping is disabled or fails, in which case the
+   /// caller should read the file in the ordinary way.
+   std::shared_ptr<const MappedFile> Map(const wxString &path);
+
+private:
+   MappedFilePool();
+
+   wxMutex mMutex;
+   volatile int mCapacity;
+   std::vector< std::shared_ptr<const MappedFile> > mFiles;
+   size_t mNext;
+};
+
+#endif
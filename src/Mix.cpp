@@ -39,6 +39,7 @@
 #include "Project.h"
 #include "Resample.h"
 #include "TimeTrack.h"
+#include "WorkerPool.h"
 #include "float_cast.h"
 
 //TODO-MB: wouldn't it make more sense to DELETE the time track after 'mix and render'?
@@ -163,6 +164,7 @@ void MixAndRender(TrackList *tracks, TrackFactory *trackFactory,
       Mixer::WarpOptions(tracks->GetTimeTrack()),
       startTime, endTime, mono ? 1 : 2, maxBlockLen, false,
       rate, format);
+   mixer.SetWorkerThreads(gPrefs->Read(wxT("/Quality/MixerThreads"), 0L));
 
    ::wxSafeYield();
 
@@ -310,38 +312,42 @@ Mixer::Mixer(const WaveTrackConstArray &inputTracks,
    // For each queue, the number of available samples after the queue start.
    mQueueLen = new int[mNumInputTracks];
    mSampleQueue = new float *[mNumInputTracks];
-   mResample = new Resample*[mNumInputTracks];
    for(i=0; i<mNumInputTracks; i++) {
-      double factor = (mRate / mInputTrack[i].GetTrack()->GetRate());
-      double minFactor, maxFactor;
-      if (mTimeTrack) {
-         // variable rate resampling
-         mbVariableRates = true;
-         minFactor = factor / mTimeTrack->GetRangeUpper();
-         maxFactor = factor / mTimeTrack->GetRangeLower();
-      }
-      else if (warpOptions.minSpeed > 0.0 && warpOptions.maxSpeed > 0.0) {
-         // variable rate resampling
-         mbVariableRates = true;
-         minFactor = factor / warpOptions.maxSpeed;
-         maxFactor = factor / warpOptions.minSpeed;
-      }
-      else {
-         // constant rate resampling
-         mbVariableRates = false;
-         minFactor = maxFactor = factor;
-      }
-
-      mResample[i] = new Resample(mHighQuality, minFactor, maxFactor);
       mSampleQueue[i] = new float[mQueueMaxLen];
       mQueueStart[i] = 0;
       mQueueLen[i] = 0;
    }
 
-   int envLen = mInterleavedBufferSize;
-   if (mQueueMaxLen > envLen)
-      envLen = mQueueMaxLen;
-   mEnvValues = new double[envLen];
+   mMinSpeed = warpOptions.minSpeed;
+   mMaxSpeed = warpOptions.maxSpeed;
+   mbVariableRates = mTimeTrack || (mMinSpeed > 0.0 && mMaxSpeed > 0.0);
+
+   mTrackGroup.resize(mNumInputTracks);
+   for(i=0; i<mNumInputTracks; i++) {
+      const WaveTrack *const track = mInputTrack[i].GetTrack();
+      size_t g = 0;
+      if (mbVariableRates || track->GetRate() == mRate)
+         g = mGroups.size();
+      else
+         for (; g < mGroups.size(); g++) {
+            const WaveTrack *const other = mInputTrack[mGroups[g][0]].GetTrack();
+            if (other->GetRate() == track->GetRate() &&
+                other->GetStartTime() == track->GetStartTime() &&
+                other->GetEndTime() == track->GetEndTime())
+               break;
+         }
+      if (g == mGroups.size())
+         mGroups.push_back(std::vector<int>());
+      mGroups[g].push_back(i);
+      mTrackGroup[i] = g;
+   }
+
+   mEnvLen = mInterleavedBufferSize;
+   if (mQueueMaxLen > mEnvLen)
+      mEnvLen = mQueueMaxLen;
+   mEnvValues = new double[mEnvLen];
+
+   SetWorkerThreads(1);
 }
 
 Mixer::~Mixer()
@@ -356,11 +362,8 @@ Mixer::~Mixer()
    delete[] mGains;
    delete[] mSamplePos;
 
-   for(i=0; i<mNumInputTracks; i++) {
-      delete mResample[i];
+   for(i=0; i<mNumInputTracks; i++)
       delete[] mSampleQueue[i];
-   }
-   delete[] mResample;
    delete[] mSampleQueue;
    delete[] mQueueStart;
    delete[] mQueueLen;
@@ -371,6 +374,74 @@ void Mixer::ApplyTrackGains(bool apply)
    mApplyTrackGains = apply;
 }
 
+void Mixer::SetWorkerThreads(int nThreads)
+{
+   mPool.reset();
+   mThreadEnvValues.clear();
+
+   // With only one group there is nothing to overlap, but libsoxr may
+   // spread the channels of the group over threads of its own
+   if (mGroups.size() == 1)
+      MakeResamplers(mGroups[0].size() > 1 ? nThreads : 1);
+   else {
+      MakeResamplers(1);
+      if (nThreads != 1 && mGroups.size() > 1) {
+         mPool = std::make_unique<WorkerPool>(nThreads);
+         if (mPool->GetThreadCount() < 2)
+            mPool.reset();
+      }
+   }
+
+   // Each track needs its own output buffer, because the tracks are
+   // summed only after all of them are fetched; the envelope scratch
+   // is needed only during the fetch, so one per thread is enough.
+   // Without threads, the tracks of a group are fetched together too.
+   mTrackBuffers.resize(mNumInputTracks);
+   for (int i = 0; i < mNumInputTracks; i++) {
+      const bool own = mPool || mGroups[mTrackGroup[i]].size() > 1;
+      std::vector<float>(own ? mInterleavedBufferSize : 0).swap(mTrackBuffers[i]);
+   }
+   mTrackOut.resize(mNumInputTracks);
+   if (mPool) {
+      mThreadEnvValues.resize(mPool->GetThreadCount());
+      for (auto &envValues : mThreadEnvValues)
+         envValues.resize(mEnvLen);
+   }
+}
+
+void Mixer::MakeResamplers(int nThreads)
+{
+   mResample.clear();
+   for (const auto &group : mGroups) {
+      double factor = (mRate / mInputTrack[group[0]].GetTrack()->GetRate());
+      double minFactor, maxFactor;
+      if (mTimeTrack) {
+         // variable rate resampling
+         minFactor = factor / mTimeTrack->GetRangeUpper();
+         maxFactor = factor / mTimeTrack->GetRangeLower();
+      }
+      else if (mbVariableRates) {
+         // variable rate resampling
+         minFactor = factor / mMaxSpeed;
+         maxFactor = factor / mMinSpeed;
+      }
+      else {
+         // constant rate resampling
+         minFactor = maxFactor = factor;
+      }
+
+      mResample.push_back(std::make_unique<Resample>
+         (mHighQuality, minFactor, maxFactor, group.size(), true, nThreads));
+   }
+}
+
+float *Mixer::GetTrackBuffer(int track)
+{
+   if (mTrackBuffers[track].empty())
+      return mFloatBuffer;
+   return &mTrackBuffers[track][0];
+}
+
 void Mixer::Clear()
 {
    for (int c = 0; c < mNumBuffers; c++) {
@@ -407,12 +478,18 @@ void MixBuffers(int numChannels, int *channelFlags, float *gains,
    }
 }
 
-sampleCount Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
-                                    sampleCount *pos, float *queue,
-                                    int *queueStart, int *queueLen,
-                                    Resample * pResample)
+sampleCount Mixer::MixVariableRates(const std::vector<int> &tracks,
+                                    Resample * pResample,
+                                    float **floatBuffers, double *envValues)
 {
-   const WaveTrack *const track = cache.GetTrack();
+   // The tracks of a group have the same positions and queue lengths,
+   // so the first one's stand for all of them
+   const int first = tracks[0];
+   const int nTracks = tracks.size();
+   sampleCount *const pos = &mSamplePos[first];
+   int *const queueStart = &mQueueStart[first];
+   int *const queueLen = &mQueueLen[first];
+   const WaveTrack *const track = mInputTrack[first].GetTrack();
    const double trackRate = track->GetRate();
    const double initialWarp = mRate / mSpeed / trackRate;
    const double tstep = 1.0 / trackRate;
@@ -442,49 +519,46 @@ sampleCount Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
    // Find the time corresponding to the start of the queue, for use with time track
    double t = (*pos + (backwards ? *queueLen : - *queueLen)) / trackRate;
 
+   std::vector<float *> inputs(nTracks), outputs(nTracks);
+
    while (out < mMaxOut) {
       if (*queueLen < mProcessLen) {
-         // Shift pending portion to start of the buffer
-         memmove(queue, &queue[*queueStart], (*queueLen) * sampleSize);
-         *queueStart = 0;
-
          int getLen =
             std::min((backwards ? *pos - endPos : endPos - *pos),
                       sampleCount(mQueueMaxLen - *queueLen));
 
-         // Nothing to do if past end of play interval
-         if (getLen > 0) {
-            if (backwards) {
-               auto results = cache.Get(floatSample, *pos - (getLen - 1), getLen);
-               memcpy(&queue[*queueLen], results, sizeof(float) * getLen);
+         for (int k = 0; k < nTracks; k++) {
+            const int i = tracks[k];
+            float *const queue = mSampleQueue[i];
+            const WaveTrack *const member = mInputTrack[i].GetTrack();
 
-               track->GetEnvelopeValues(mEnvValues,
-                                        getLen,
-                                        (*pos - (getLen- 1)) / trackRate,
-                                        tstep);
+            // Shift pending portion to start of the buffer
+            memmove(queue, &queue[*queueStart], (*queueLen) * sampleSize);
 
-               *pos -= getLen;
-            }
-            else {
-               auto results = cache.Get(floatSample, *pos, getLen);
+            // Nothing to do if past end of play interval
+            if (getLen > 0) {
+               const sampleCount start = backwards ? *pos - (getLen - 1) : *pos;
+               auto results = mInputTrack[i].Get(floatSample, start, getLen);
                memcpy(&queue[*queueLen], results, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues,
-                                        getLen,
-                                        (*pos) / trackRate,
-                                        tstep);
+               member->GetEnvelopeValues(envValues,
+                                         getLen,
+                                         start / trackRate,
+                                         tstep);
 
-               *pos += getLen;
-            }
+               for (int j = 0; j < getLen; j++) {
+                  queue[(*queueLen) + j] *= envValues[j];
+               }
 
-            for (int i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
+               if (backwards)
+                  ReverseSamples((samplePtr)&queue[0], floatSample,
+                                 *queueLen, getLen);
             }
+         }
 
-            if (backwards)
-               ReverseSamples((samplePtr)&queue[0], floatSample,
-                              *queueLen, getLen);
-
+         *queueStart = 0;
+         if (getLen > 0) {
+            *pos += backwards ? -getLen : getLen;
             *queueLen += getLen;
          }
       }
@@ -511,13 +585,18 @@ sampleCount Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
                (t, t + (double)thisProcessLen / trackRate);
       }
 
+      for (int k = 0; k < nTracks; k++) {
+         inputs[k] = &mSampleQueue[tracks[k]][*queueStart];
+         outputs[k] = &floatBuffers[k][out];
+      }
+
       int input_used;
       int outgen = pResample->Process(factor,
-                                      &queue[*queueStart],
+                                      &inputs[0],
                                       thisProcessLen,
                                       last,
                                       &input_used,
-                                      &mFloatBuffer[out],
+                                      &outputs[0],
                                       mMaxOut - out);
 
       if (outgen < 0) {
@@ -534,32 +613,22 @@ sampleCount Mixer::MixVariableRates(int *channelFlags, WaveTrackCache &cache,
       }
    }
 
-   for (int c = 0; c < mNumChannels; c++) {
-      if (mApplyTrackGains) {
-         mGains[c] = track->GetChannelGain(c);
-      }
-      else {
-         mGains[c] = 1.0;
-      }
+   // Keep the other tracks' records in step
+   for (int k = 1; k < nTracks; k++) {
+      const int i = tracks[k];
+      mSamplePos[i] = *pos;
+      mQueueStart[i] = *queueStart;
+      mQueueLen[i] = *queueLen;
    }
 
-   MixBuffers(mNumChannels,
-              channelFlags,
-              mGains,
-              (samplePtr)mFloatBuffer,
-              mTemp,
-              out,
-              mInterleaved);
-
    return out;
 }
 
-sampleCount Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
-                               sampleCount *pos)
+sampleCount Mixer::MixSameRate(WaveTrackCache &cache, sampleCount *pos,
+                               float *floatBuffer, double *envValues)
 {
    const WaveTrack *const track = cache.GetTrack();
    int slen = mMaxOut;
-   int c;
    const double t = *pos / track->GetRate();
    const double trackEndTime = track->GetEndTime();
    const double trackStartTime = track->GetStartTime();
@@ -586,34 +655,88 @@ sampleCount Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
 
    if (backwards) {
       auto results = cache.Get(floatSample, *pos - (slen - 1), slen);
-      memcpy(mFloatBuffer, results, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues, slen, t - (slen - 1) / mRate, 1.0 / mRate);
+      memcpy(floatBuffer, results, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t - (slen - 1) / mRate, 1.0 / mRate);
       for(int i=0; i<slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
-      ReverseSamples((samplePtr)mFloatBuffer, floatSample, 0, slen);
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
+      ReverseSamples((samplePtr)floatBuffer, floatSample, 0, slen);
 
       *pos -= slen;
    }
    else {
       auto results = cache.Get(floatSample, *pos, slen);
-      memcpy(mFloatBuffer, results, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues, slen, t, 1.0 / mRate);
+      memcpy(floatBuffer, results, sizeof(float) * slen);
+      track->GetEnvelopeValues(envValues, slen, t, 1.0 / mRate);
       for(int i=0; i<slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+         floatBuffer[i] *= envValues[i]; // Track gain control will go here?
 
       *pos += slen;
    }
 
-   for(c=0; c<mNumChannels; c++)
+   return slen;
+}
+
+void Mixer::FetchGroup(int g, double *envValues)
+{
+   const std::vector<int> &tracks = mGroups[g];
+   const int first = tracks[0];
+   const WaveTrack *const track = mInputTrack[first].GetTrack();
+   sampleCount out;
+   if (mbVariableRates || track->GetRate() != mRate) {
+      std::vector<float *> buffers(tracks.size());
+      for (size_t k = 0; k < tracks.size(); k++)
+         buffers[k] = GetTrackBuffer(tracks[k]);
+      out = MixVariableRates(tracks, mResample[g].get(), &buffers[0], envValues);
+   }
+   else
+      out = MixSameRate(mInputTrack[first], &mSamplePos[first],
+         GetTrackBuffer(first), envValues);
+
+   for (int i : tracks)
+      mTrackOut[i] = out;
+}
+
+void Mixer::AccumulateTrack(int i, int *channelFlags,
+                            const float *floatBuffer, sampleCount len)
+{
+   const WaveTrack *const track = mInputTrack[i].GetTrack();
+   int j;
+
+   for(j=0; j<mNumChannels; j++)
+      channelFlags[j] = 0;
+
+   if( mMixerSpec ) {
+      //ignore left and right when downmixing is not required
+      for( j = 0; j < mNumChannels; j++ )
+         channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+   }
+   else {
+      switch(track->GetChannel()) {
+      case Track::MonoChannel:
+      default:
+         for(j=0; j<mNumChannels; j++)
+            channelFlags[j] = 1;
+         break;
+      case Track::LeftChannel:
+         channelFlags[0] = 1;
+         break;
+      case Track::RightChannel:
+         if (mNumChannels >= 2)
+            channelFlags[1] = 1;
+         else
+            channelFlags[0] = 1;
+         break;
+      }
+   }
+
+   for(j=0; j<mNumChannels; j++)
       if (mApplyTrackGains)
-         mGains[c] = track->GetChannelGain(c);
+         mGains[j] = track->GetChannelGain(j);
       else
-         mGains[c] = 1.0;
+         mGains[j] = 1.0;
 
    MixBuffers(mNumChannels, channelFlags, mGains,
-              (samplePtr)mFloatBuffer, mTemp, slen, mInterleaved);
-
-   return slen;
+              (samplePtr)floatBuffer, mTemp, len, mInterleaved);
 }
 
 sampleCount Mixer::Process(sampleCount maxToProcess)
@@ -623,49 +746,30 @@ sampleCount Mixer::Process(sampleCount maxToProcess)
    //if (mT >= mT1)
    //   return 0;
 
-   int i, j;
+   int i;
    sampleCount maxOut = 0;
    int *channelFlags = new int[mNumChannels];
 
    mMaxOut = maxToProcess;
 
+   // With worker threads, fetch all the groups at once first.  The sum
+   // below still adds them in track order, so that the floating point
+   // result is the same as without threads.
+   if (mPool)
+      mPool->ParallelFor(mGroups.size(), [this](int g, int thread) {
+         FetchGroup(g, &mThreadEnvValues[thread][0]);
+      });
+
    Clear();
    for(i=0; i<mNumInputTracks; i++) {
       const WaveTrack *const track = mInputTrack[i].GetTrack();
-      for(j=0; j<mNumChannels; j++)
-         channelFlags[j] = 0;
-
-      if( mMixerSpec ) {
-         //ignore left and right when downmixing is not required
-         for( j = 0; j < mNumChannels; j++ )
-            channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
-      }
-      else {
-         switch(track->GetChannel()) {
-         case Track::MonoChannel:
-         default:
-            for(j=0; j<mNumChannels; j++)
-               channelFlags[j] = 1;
-            break;
-         case Track::LeftChannel:
-            channelFlags[0] = 1;
-            break;
-         case Track::RightChannel:
-            if (mNumChannels >= 2)
-               channelFlags[1] = 1;
-            else
-               channelFlags[0] = 1;
-            break;
-         }
-      }
-      if (mbVariableRates || track->GetRate() != mRate)
-         maxOut = std::max(maxOut,
-            MixVariableRates(channelFlags, mInputTrack[i],
-               &mSamplePos[i], mSampleQueue[i],
-               &mQueueStart[i], &mQueueLen[i], mResample[i]));
-      else
-         maxOut = std::max(maxOut,
-            MixSameRate(channelFlags, mInputTrack[i], &mSamplePos[i]));
+      // Without threads, fetch a group when its first track comes
+      const int g = mTrackGroup[i];
+      if (!mPool && mGroups[g][0] == i)
+         FetchGroup(g, mEnvValues);
+      const sampleCount out = mTrackOut[i];
+      AccumulateTrack(i, channelFlags, GetTrackBuffer(i), out);
+      maxOut = std::max(maxOut, out);
 
       double t = (double)mSamplePos[i] / (double)track->GetRate();
       if (mT0 > mT1)
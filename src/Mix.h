@@ -13,6 +13,7 @@
 #define __AUDACITY_MIX__
 
 #include "MemoryX.h"
+#include <vector>
 #include <wx/string.h>
 #include "SampleFormat.h"
 
@@ -24,6 +25,7 @@ class TrackList;
 class WaveTrack;
 class WaveTrackConstArray;
 class WaveTrackCache;
+class WorkerPool;
 
 /** @brief Mixes together all input tracks, applying any envelopes, amplitude
  * gain, panning, and real-time effects in the process.
@@ -107,6 +109,14 @@ class AUDACITY_DLL_API Mixer {
 
    void ApplyTrackGains(bool apply = true); // True by default
 
+   /// Fetch, apply envelopes to and resample the input tracks on this
+   /// many threads (0 means one per CPU, 1 means no extra threads).  The
+   /// tracks are still summed in order, so the output is the same.
+   /// If all the tracks go through one multichannel resampler, the
+   /// threads are libsoxr's instead.  This makes the resamplers again,
+   /// so call it before Process().
+   void SetWorkerThreads(int nThreads);
+
    //
    // Processing
    //
@@ -141,13 +151,25 @@ class AUDACITY_DLL_API Mixer {
  private:
 
    void Clear();
-   sampleCount MixSameRate(int *channelFlags, WaveTrackCache &cache,
-                           sampleCount *pos);
 
-   sampleCount MixVariableRates(int *channelFlags, WaveTrackCache &cache,
-                                sampleCount *pos, float *queue,
-                                int *queueStart, int *queueLen,
-                                Resample * pResample);
+   void MakeResamplers(int nThreads);
+   float *GetTrackBuffer(int track);
+
+   // These touch only the state belonging to one group of input tracks,
+   // and write to the given scratch buffers, so they may run
+   // concurrently for different groups.
+   void FetchGroup(int group, double *envValues);
+   sampleCount MixSameRate(WaveTrackCache &cache, sampleCount *pos,
+                           float *floatBuffer, double *envValues);
+
+   // Resamples the tracks, which stay in step, together
+   sampleCount MixVariableRates(const std::vector<int> &tracks,
+                                Resample * pResample,
+                                float **floatBuffers, double *envValues);
+
+   // Adds one track's fetched samples into the output, with its gains.
+   void AccumulateTrack(int track, int *channelFlags,
+                        const float *floatBuffer, sampleCount len);
 
  private:
    // Input
@@ -156,14 +178,21 @@ class AUDACITY_DLL_API Mixer {
 
    bool             mbVariableRates;
    const TimeTrack *mTimeTrack;
+   double           mMinSpeed, mMaxSpeed;
    sampleCount     *mSamplePos;
    bool             mApplyTrackGains;
    float           *mGains;
    double          *mEnvValues;
+   int              mEnvLen;
    double           mT0; // Start time
    double           mT1; // Stop time (none if mT0==mT1)
    double           mTime;  // Current time (renamed from mT to mTime for consistency with AudioIO - mT represented warped time there)
-   Resample       **mResample;
+   // Tracks of one rate other than the output's, that start and end
+   // together, are resampled in one group; without warping, they stay
+   // in step.  Every other track is a group of its own.
+   std::vector<std::vector<int>> mGroups;
+   std::vector<int> mTrackGroup;
+   std::vector<std::unique_ptr<Resample>> mResample; // one per group
    float          **mSampleQueue;
    int             *mQueueStart;
    int             *mQueueLen;
@@ -171,6 +200,13 @@ class AUDACITY_DLL_API Mixer {
    int              mProcessLen;
    MixerSpec        *mMixerSpec;
 
+   // Worker threads, and the per-track and per-thread buffers they need;
+   // without threads, only the tracks of groups need buffers of their own
+   std::unique_ptr<WorkerPool> mPool;
+   std::vector<std::vector<float>> mTrackBuffers;
+   std::vector<sampleCount> mTrackOut;
+   std::vector<std::vector<double>> mThreadEnvValues;
+
    // Output
    int              mMaxOut;
    int              mNumChannels;
@@ -2022,8 +2022,12 @@ void AudacityProject::OnODTaskUpdate(wxCommandEvent & WXUNUSED(event))
 }
 
 //redraws the task and does other book keeping after the task is complete.
-void AudacityProject::OnODTaskComplete(wxCommandEvent & WXUNUSED(event))
+void AudacityProject::OnODTaskComplete(wxCommandEvent & event)
 {
+  //the task's throughput, which its worker thread could not log
+  if(!event.GetString().IsEmpty())
+     wxLogDebug(wxT("%s"), event.GetString().c_str());
+
   if(mTrackPanel)
       mTrackPanel->Refresh(false);
  }
@@ -3748,10 +3752,10 @@ void AudacityProject::AddImportedTracks(const wxString &fileName,
       if (newTrack->GetKind() == WaveTrack::Wave)
       {
          WaveClip* clip = ((WaveTrack*)newTrack)->GetClipByIndex(0);
-         BlockArray &blocks = clip->GetSequence()->GetBlockArray();
+         const BlockArray &blocks = clip->GetSequence()->GetBlockArray();
          if (clip && blocks.size())
          {
-            SeqBlock& block = blocks[0];
+            const SeqBlock& block = blocks[0];
             if (block.f->IsAlias())
             {
                mImportedDependencies = true;
@@ -4439,6 +4443,9 @@ void AudacityProject::OnTimer(wxTimerEvent& WXUNUSED(event))
    if( mixerToolBar )
       mixerToolBar->UpdateControls();
 
+   // Spectrogram columns computed while painting go to disk from here
+   mDirManager->FlushDisplayCache();
+
    if (::wxGetUTCTime() - mLastStatusUpdateTime < 3)
       return;
 
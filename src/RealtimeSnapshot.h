@@ -0,0 +1,82 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  RealtimeSnapshot.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_REALTIME_SNAPSHOT__
+#define __AUDACITY_REALTIME_SNAPSHOT__
+
+#include "Audacity.h"
+#include "MemoryX.h"
+
+#include <atomic>
+
+#include <wx/utils.h>
+
+/// Holds a value that one realtime thread reads while other threads
+/// replace it, so that the reader never waits for them.
+///
+/// The value is never changed in place.  A writer publishes a new one,
+/// then waits until the reader has left the old one before freeing it.
+/// The reader marks the value it uses, and checks that it is still the
+/// current one after marking, so that no writer can miss the mark.
+/// Writers must exclude one another.
+template<typename T> class RealtimeSnapshot
+{
+public:
+   explicit RealtimeSnapshot(const T &value = T())
+      : mCurrent(safenew T(value))
+      , mInUse(NULL)
+   {}
+
+   ~RealtimeSnapshot()
+   {
+      delete mCurrent.load();
+   }
+
+   /// For the reader: marks the current value as in use and returns it.
+   /// Does not block.
+   const T *Acquire()
+   {
+      T *value;
+      do {
+         value = mCurrent.load();
+         mInUse.store(value);
+      } while (value != mCurrent.load());
+      return value;
+   }
+
+   /// For the reader: done with the value that Acquire() returned
+   void Release()
+   {
+      mInUse.store(NULL);
+   }
+
+   /// For writers: the current value, to copy and change
+   const T &Get() const
+   {
+      return *mCurrent.load();
+   }
+
+   /// For writers: replaces the value, returning once the reader no
+   /// longer uses the old one
+   void Publish(const T &value)
+   {
+      T *old = mCurrent.exchange(safenew T(value));
+      while (mInUse.load() == old)
+         wxMilliSleep(1);
+      delete old;
+   }
+
+private:
+   std::atomic<T*> mCurrent;
+   std::atomic<T*> mInUse;
+
+   RealtimeSnapshot(const RealtimeSnapshot&) PROHIBITED;
+   RealtimeSnapshot &operator= (const RealtimeSnapshot&) PROHIBITED;
+};
+
+#endif
@@ -16,9 +16,11 @@
 
       libsoxr, written by Rob Sykes. LGPL.
 
-   Since Audacity always does resampling on mono streams that are
-   contiguous in memory, this class doesn't support multiple channels
-   or some of the other optional features of some of these resamplers.
+   Channels that are resampled in step, as the input tracks of a mix
+   that have the same rate and extent, may go through one instance,
+   either interleaved or with a buffer for each channel, so that
+   libsoxr can share its filter setup among them and spread them over
+   its threads.  Other optional features of libsoxr are not supported.
 
 *//*******************************************************************/
 
@@ -27,7 +29,10 @@
 
 #include <soxr.h>
 
-Resample::Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor)
+Resample::Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor,
+                   const int numChannels, const bool planar, const int numThreads)
+   : mNumChannels(numChannels)
+   , mbPlanar(planar && numChannels > 1)
 {
    this->SetMethod(useBestMethod);
    soxr_quality_spec_t q_spec;
@@ -41,7 +46,11 @@ Resample::Resample(const bool useBestMethod, const double dMinFactor, const doub
       mbWantConstRateResampling = false; // variable rate resampling
       q_spec = soxr_quality_spec(SOXR_HQ, SOXR_VR);
    }
-   mHandle = (void *)soxr_create(1, dMinFactor, 1, 0, 0, &q_spec, 0);
+   const soxr_datatype_t type = mbPlanar ? SOXR_FLOAT32_S : SOXR_FLOAT32_I;
+   soxr_io_spec_t io_spec = soxr_io_spec(type, type);
+   soxr_runtime_spec_t runtime_spec = soxr_runtime_spec(numThreads);
+   mHandle = (void *)soxr_create(1, dMinFactor, mNumChannels, 0,
+                                 &io_spec, &q_spec, &runtime_spec);
 }
 
 Resample::~Resample()
@@ -81,6 +90,33 @@ int Resample::Process(double  factor,
                         int    *inBufferUsed,
                         float  *outBuffer,
                         int     outBufferLen)
+{
+   wxASSERT(!mbPlanar);
+   return DoProcess(factor, inBuffer, inBufferLen, lastFlag, inBufferUsed,
+                    outBuffer, outBufferLen);
+}
+
+int Resample::Process(double  factor,
+                        float **inBuffers,
+                        int     inBufferLen,
+                        bool    lastFlag,
+                        int    *inBufferUsed,
+                        float **outBuffers,
+                        int     outBufferLen)
+{
+   // libsoxr takes the arrays of buffers in place of the buffers
+   if (mbPlanar)
+      return DoProcess(factor, inBuffers, inBufferLen, lastFlag, inBufferUsed,
+                       outBuffers, outBufferLen);
+
+   wxASSERT(mNumChannels == 1);
+   return DoProcess(factor, inBuffers[0], inBufferLen, lastFlag, inBufferUsed,
+                    outBuffers[0], outBufferLen);
+}
+
+int Resample::DoProcess(double factor, const void *inBuffer, int inBufferLen,
+                        bool lastFlag, int *inBufferUsed,
+                        void *outBuffer, int outBufferLen)
 {
    size_t idone, odone;
    if (mbWantConstRateResampling)
@@ -32,7 +32,14 @@ class Resample final
    /// the fast method.
    // dMinFactor and dMaxFactor specify the range of factors for variable-rate resampling.
    // For constant-rate, pass the same value for both.
-   Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor);
+   /// With more than one channel, the samples given to Process() are
+   /// interleaved, or if planar, each channel has a buffer of its own;
+   /// all go through libsoxr in one call.  numThreads is passed on to
+   /// libsoxr, which can then resample several channels at once if it
+   /// was built with OpenMP; 0 lets it choose.
+   Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor,
+            const int numChannels = 1, const bool planar = false,
+            const int numThreads = 1);
    ~Resample();
 
    static int GetNumMethods();
@@ -54,8 +61,9 @@ class Resample final
     * This function may do nothing if you don't pass a large enough output
     * buffer (i.e. there is no where to put a full block of output data)
     @param factor The scaling factor to resample by.
-    @param inBuffer Buffer of input samples to be processed (mono)
-    @param inBufferLen Length of the input buffer, in samples.
+    @param inBuffer Buffer of input samples to be processed (interleaved,
+    if there is more than one channel)
+    @param inBufferLen Length of the input buffer, in samples of each channel.
     @param lastFlag Flag to indicate this is the last lot of input samples and
     the buffer needs to be emptied out into the rate converter.
     @param inBufferUsed Number of samples from inBuffer that have been used
@@ -73,13 +81,28 @@ class Resample final
                         float  *outBuffer,
                         int     outBufferLen);
 
+   /// The same, for a planar resampler, with a buffer for each channel
+   int Process(double   factor,
+                        float **inBuffers,
+                        int     inBufferLen,
+                        bool    lastFlag,
+                        int    *inBufferUsed,
+                        float **outBuffers,
+                        int     outBufferLen);
+
+   int GetNumChannels() const { return mNumChannels; }
+
  protected:
    void SetMethod(const bool useBestMethod);
+   int DoProcess(double factor, const void *in, int inBufferLen, bool lastFlag,
+                 int *inBufferUsed, void *out, int outBufferLen);
 
  protected:
    int   mMethod; // resampler-specific enum for resampling method
    void* mHandle; // constant-rate or variable-rate resampler (XOR per instance)
    bool mbWantConstRateResampling;
+   int mNumChannels;
+   bool mbPlanar;
 };
 
 #endif // __AUDACITY_RESAMPLE_H__
@@ -16,30 +16,47 @@
   need to read, or both need to write, they need to lock this
   class from outside using their own mutex.
 
+  The writer publishes mEnd with release semantics after copying
+  samples in, and the reader acquires it before copying them out;
+  mStart is handed back the same way.  So neither side ever sees an
+  index move before the samples it covers are in place.
+
   AvailForPut and AvailForGet may underestimate but will never
   overestimate.
 
+  A RingBuffer may carry several channels, stored as interleaved
+  frames.  All counts are then in frames, and one Put or Get moves
+  every channel at once, instead of needing one buffer per channel.
+
 *//*******************************************************************/
 
 
 #include "RingBuffer.h"
 
-RingBuffer::RingBuffer(sampleFormat format, int size)
+#include <algorithm>
+
+RingBuffer::RingBuffer(sampleFormat format, int size, unsigned channels)
    : mFormat(format)
+   , mChannels(channels > 0 ? channels : 1)
    , mBufferSize(size > 64 ? size : 64)
-   , mBuffer(mBufferSize, mFormat)
+   , mBuffer(mBufferSize * mChannels, mFormat)
+   , mStart(0)
+   , mEnd(0)
 {
-   mStart = 0;
-   mEnd = 0;
 }
 
 RingBuffer::~RingBuffer()
 {
 }
 
-int RingBuffer::Len()
+int RingBuffer::Filled(int start, int end) const
+{
+   return (end + mBufferSize - start) % mBufferSize;
+}
+
+int RingBuffer::Free(int start, int end) const
 {
-   return (mEnd + mBufferSize - mStart) % mBufferSize;
+   return (mBufferSize-4) - Filled(start, end);
 }
 
 //
@@ -48,7 +65,8 @@ int RingBuffer::Len()
 
 int RingBuffer::AvailForPut()
 {
-   return (mBufferSize-4) - Len();
+   return Free(mStart.load(std::memory_order_acquire),
+               mEnd.load(std::memory_order_relaxed));
 }
 
 int RingBuffer::Put(samplePtr buffer, sampleFormat format,
@@ -58,31 +76,64 @@ int RingBuffer::Put(samplePtr buffer, sampleFormat format,
    int block;
    int copied;
    int pos;
-   int len = Len();
+   int start = mStart.load(std::memory_order_acquire);
+   int end = mEnd.load(std::memory_order_relaxed);
+   int frameSize = SAMPLE_SIZE(mFormat) * mChannels;
 
-   if (samplesToCopy > (mBufferSize-4) - len)
-      samplesToCopy = (mBufferSize-4) - len;
+   samplesToCopy = std::min(samplesToCopy, Free(start, end));
 
    src = buffer;
    copied = 0;
-   pos = mEnd;
+   pos = end;
 
    while(samplesToCopy) {
-      block = samplesToCopy;
-      if (block > mBufferSize - pos)
-         block = mBufferSize - pos;
+      block = std::min(samplesToCopy, mBufferSize - pos);
 
       CopySamples(src, format,
-                  mBuffer.ptr() + pos * SAMPLE_SIZE(mFormat), mFormat,
-                  block);
+                  mBuffer.ptr() + pos * frameSize, mFormat,
+                  block * mChannels);
 
-      src += block * SAMPLE_SIZE(format);
+      src += block * mChannels * SAMPLE_SIZE(format);
       pos = (pos + block) % mBufferSize;
       samplesToCopy -= block;
       copied += block;
    }
 
-   mEnd = pos;
+   mEnd.store(pos, std::memory_order_release);
+
+   return copied;
+}
+
+int RingBuffer::Put(const samplePtr *buffers, sampleFormat format,
+                    int samplesToCopy)
+{
+   int block;
+   int copied;
+   int pos;
+   int start = mStart.load(std::memory_order_acquire);
+   int end = mEnd.load(std::memory_order_relaxed);
+   int frameSize = SAMPLE_SIZE(mFormat) * mChannels;
+
+   samplesToCopy = std::min(samplesToCopy, Free(start, end));
+
+   copied = 0;
+   pos = end;
+
+   while(samplesToCopy) {
+      block = std::min(samplesToCopy, mBufferSize - pos);
+
+      for (unsigned c = 0; c < mChannels; c++)
+         CopySamples(buffers[c] + copied * SAMPLE_SIZE(format), format,
+                     mBuffer.ptr() + pos * frameSize + c * SAMPLE_SIZE(mFormat),
+                     mFormat,
+                     block, true, 1, mChannels);
+
+      pos = (pos + block) % mBufferSize;
+      samplesToCopy -= block;
+      copied += block;
+   }
+
+   mEnd.store(pos, std::memory_order_release);
 
    return copied;
 }
@@ -93,7 +144,8 @@ int RingBuffer::Put(samplePtr buffer, sampleFormat format,
 
 int RingBuffer::AvailForGet()
 {
-   return Len();
+   return Filled(mStart.load(std::memory_order_relaxed),
+                 mEnd.load(std::memory_order_acquire));
 }
 
 int RingBuffer::Get(samplePtr buffer, sampleFormat format,
@@ -102,40 +154,74 @@ int RingBuffer::Get(samplePtr buffer, sampleFormat format,
    samplePtr dest;
    int block;
    int copied;
-   int len = Len();
+   int start = mStart.load(std::memory_order_relaxed);
+   int end = mEnd.load(std::memory_order_acquire);
+   int frameSize = SAMPLE_SIZE(mFormat) * mChannels;
 
-   if (samplesToCopy > len)
-      samplesToCopy = len;
+   samplesToCopy = std::min(samplesToCopy, Filled(start, end));
 
    dest = buffer;
    copied = 0;
 
    while(samplesToCopy) {
-      block = samplesToCopy;
-      if (block > mBufferSize - mStart)
-         block = mBufferSize - mStart;
+      block = std::min(samplesToCopy, mBufferSize - start);
 
-      CopySamples(mBuffer.ptr() + mStart * SAMPLE_SIZE(mFormat), mFormat,
+      CopySamples(mBuffer.ptr() + start * frameSize, mFormat,
                   dest, format,
-                  block);
+                  block * mChannels);
 
-      dest += block * SAMPLE_SIZE(format);
-      mStart = (mStart + block) % mBufferSize;
+      dest += block * mChannels * SAMPLE_SIZE(format);
+      start = (start + block) % mBufferSize;
       samplesToCopy -= block;
       copied += block;
    }
 
+   mStart.store(start, std::memory_order_release);
+
+   return copied;
+}
+
+int RingBuffer::Get(const samplePtr *buffers, sampleFormat format,
+                    int samplesToCopy)
+{
+   int block;
+   int copied;
+   int start = mStart.load(std::memory_order_relaxed);
+   int end = mEnd.load(std::memory_order_acquire);
+   int frameSize = SAMPLE_SIZE(mFormat) * mChannels;
+
+   samplesToCopy = std::min(samplesToCopy, Filled(start, end));
+
+   copied = 0;
+
+   while(samplesToCopy) {
+      block = std::min(samplesToCopy, mBufferSize - start);
+
+      for (unsigned c = 0; c < mChannels; c++)
+         CopySamples(mBuffer.ptr() + start * frameSize + c * SAMPLE_SIZE(mFormat),
+                     mFormat,
+                     buffers[c] + copied * SAMPLE_SIZE(format), format,
+                     block, true, mChannels, 1);
+
+      start = (start + block) % mBufferSize;
+      samplesToCopy -= block;
+      copied += block;
+   }
+
+   mStart.store(start, std::memory_order_release);
+
    return copied;
 }
 
 int RingBuffer::Discard(int samplesToDiscard)
 {
-   int len = Len();
+   int start = mStart.load(std::memory_order_relaxed);
+   int end = mEnd.load(std::memory_order_acquire);
 
-   if (samplesToDiscard > len)
-      samplesToDiscard = len;
+   samplesToDiscard = std::min(samplesToDiscard, Filled(start, end));
 
-   mStart = (mStart + samplesToDiscard) % mBufferSize;
+   mStart.store((start + samplesToDiscard) % mBufferSize,
+                std::memory_order_release);
 
    return samplesToDiscard;
 }
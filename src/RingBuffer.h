@@ -11,19 +11,32 @@
 #ifndef __AUDACITY_RING_BUFFER__
 #define __AUDACITY_RING_BUFFER__
 
+#include <atomic>
+
 #include "SampleFormat.h"
 
 class RingBuffer {
  public:
-   RingBuffer(sampleFormat format, int size);
+   // size is in frames.  With more than one channel, the samples of a
+   // frame are stored interleaved, and all channels move together in
+   // each Put() and Get().
+   //
+   // AudioIO does not use this yet: it still keeps a buffer for each
+   // channel, so its channels can still run short at different times.
+   RingBuffer(sampleFormat format, int size, unsigned channels = 1);
    ~RingBuffer();
 
+   unsigned GetChannels() const { return mChannels; }
+
    //
    // For the writer only:
    //
 
    int AvailForPut();
+   // buffer holds interleaved frames of GetChannels() samples each
    int Put(samplePtr buffer, sampleFormat format, int samples);
+   // buffers holds GetChannels() non-interleaved channel pointers
+   int Put(const samplePtr *buffers, sampleFormat format, int samples);
 
    //
    // For the reader only:
@@ -31,16 +44,28 @@ class RingBuffer {
 
    int AvailForGet();
    int Get(samplePtr buffer, sampleFormat format, int samples);
+   int Get(const samplePtr *buffers, sampleFormat format, int samples);
    int Discard(int samples);
 
  private:
-   int Len();
+   enum { CacheLineSize = 64 };
+
+   int Filled(int start, int end) const;
+   int Free(int start, int end) const;
 
    sampleFormat  mFormat;
-   int           mStart;
-   int           mEnd;
+   unsigned      mChannels;
    int           mBufferSize;
    SampleBuffer  mBuffer;
+
+   // mStart is written only by the reader and mEnd only by the writer.
+   // Keep each on its own cache line so that the two threads do not
+   // keep stealing the line from each other.
+   char             mPad0[CacheLineSize];
+   std::atomic<int> mStart;
+   char             mPad1[CacheLineSize - sizeof(std::atomic<int>)];
+   std::atomic<int> mEnd;
+   char             mPad2[CacheLineSize - sizeof(std::atomic<int>)];
 };
 
 #endif /*  __AUDACITY_RING_BUFFER__ */
@@ -35,6 +35,7 @@
 *//*******************************************************************/
 
 #include <wx/intl.h>
+#include <atomic>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,7 +47,17 @@
 
 static Dither::DitherType gLowQualityDither = Dither::none;
 static Dither::DitherType gHighQualityDither = Dither::none;
-static Dither gDitherAlgorithm;
+
+// Each conversion gets a Dither of its own, as conversions run on many
+// threads at once.  Apply() resets the shaped filter for every
+// conversion anyway; only the noise went on from one to the next, and
+// now each one is seeded differently instead.
+static std::atomic<unsigned int> gDitherSeed(1);
+
+static unsigned int NextDitherSeed()
+{
+   return gDitherSeed.fetch_add(0x9e3779b9u, std::memory_order_relaxed);
+}
 
 void InitDitherers()
 {
@@ -117,7 +128,8 @@ void CopySamples(samplePtr src, sampleFormat srcFormat,
                  unsigned int srcStride /* = 1 */,
                  unsigned int dstStride /* = 1 */)
 {
-   gDitherAlgorithm.Apply(
+   Dither dither(NextDitherSeed());
+   dither.Apply(
       highQuality ? gHighQualityDither : gLowQualityDither,
       src, srcFormat, dst, dstFormat, len, srcStride, dstStride);
 }
@@ -128,7 +140,9 @@ void CopySamplesNoDither(samplePtr src, sampleFormat srcFormat,
                  unsigned int srcStride /* = 1 */,
                  unsigned int dstStride /* = 1 */)
 {
-   gDitherAlgorithm.Apply(
+   // No noise, so no seed
+   Dither dither(0);
+   dither.Apply(
       Dither::none,
       src, srcFormat, dst, dstFormat, len, srcStride, dstStride);
 }
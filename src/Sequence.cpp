@@ -47,12 +47,40 @@
 
 #include "blockfile/SimpleBlockFile.h"
 #include "blockfile/SilentBlockFile.h"
+#include "SummaryKernels.h"
 
 int Sequence::sMaxDiskBlockSize = 1048576;
 
+SharedBlockArray::SharedBlockArray(DirManager *dirManager)
+   : mDirManager(dirManager)
+   , mArray(std::make_shared<BlockArray>(dirManager))
+{
+}
+
+void SharedBlockArray::Share(const SharedBlockArray &other)
+{
+   wxASSERT(mDirManager == other.mDirManager);
+   mArray = other.mArray;
+}
+
+BlockArray &SharedBlockArray::Write()
+{
+   // The copy shares the tree, and so the block files, of the original
+   if (mArray.use_count() > 1)
+      mArray = std::make_shared<BlockArray>(*mArray);
+   return *mArray;
+}
+
+void SharedBlockArray::Replace(BlockArray &&array)
+{
+   wxASSERT(array.empty() || array.GetOwner() == mDirManager);
+   mArray = std::make_shared<BlockArray>(std::move(array));
+}
+
 // Sequence methods
 Sequence::Sequence(DirManager * projDirManager, sampleFormat format)
    : mDirManager(projDirManager)
+   , mBlock(projDirManager)
    , mSampleFormat(format)
    , mMinSamples(sMaxDiskBlockSize / SAMPLE_SIZE(mSampleFormat) / 2)
    , mMaxSamples(mMinSamples * 2)
@@ -65,12 +93,21 @@ Sequence::Sequence(DirManager * projDirManager, sampleFormat format)
 // from one project to another
 Sequence::Sequence(const Sequence &orig, DirManager *projDirManager)
    : mDirManager(projDirManager)
+   , mBlock(projDirManager)
    , mSampleFormat(orig.mSampleFormat)
    , mMinSamples(orig.mMinSamples)
    , mMaxSamples(orig.mMaxSamples)
 {
    mDirManager->Ref();
 
+   if (projDirManager == orig.mDirManager) {
+      // Block files never change, so the copy can use the same ones
+      // until either sequence is edited
+      mBlock.Share(orig.mBlock);
+      mNumSamples = orig.mNumSamples;
+      return;
+   }
+
    bool bResult = Paste(0, &orig);
    wxASSERT(bResult); // TO DO: Actually handle this.
    (void)bResult;
@@ -78,22 +115,14 @@ Sequence::Sequence(const Sequence &orig, DirManager *projDirManager)
 
 Sequence::~Sequence()
 {
-   DerefAllFiles();
+   // Release the block files while the DirManager is still ours
+   mBlock.Replace(BlockArray{});
+   for (const auto &block : mLoadingBlocks)
+      if (block.f)
+         mDirManager->Deref(block.f);
    mDirManager->Deref();
 }
 
-void Sequence::DerefAllFiles()
-{
-   for (size_t i = 0, nn = mBlock.size(); i < nn; i++)
-   {
-      BlockFile *& pOldFile = mBlock[i].f;
-      if (pOldFile) {
-         mDirManager->Deref(pOldFile);
-         pOldFile = NULL;
-      }
-   }
-}
-
 sampleCount Sequence::GetMaxBlockSize() const
 {
    return mMaxSamples;
@@ -106,24 +135,24 @@ sampleCount Sequence::GetIdealBlockSize() const
 
 bool Sequence::Lock()
 {
-   for (unsigned int i = 0; i < mBlock.size(); i++)
-      mBlock[i].f->Lock();
+   for (const auto &block : mBlock)
+      block.f->Lock();
 
    return true;
 }
 
 bool Sequence::CloseLock()
 {
-   for (unsigned int i = 0; i < mBlock.size(); i++)
-      mBlock[i].f->CloseLock();
+   for (const auto &block : mBlock)
+      block.f->CloseLock();
 
    return true;
 }
 
 bool Sequence::Unlock()
 {
-   for (unsigned int i = 0; i < mBlock.size(); i++)
-      mBlock[i].f->Unlock();
+   for (const auto &block : mBlock)
+      block.f->Unlock();
 
    return true;
 }
@@ -168,7 +197,7 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
    mMinSamples = sMaxDiskBlockSize / SAMPLE_SIZE(mSampleFormat) / 2;
    mMaxSamples = mMinSamples * 2;
 
-   BlockArray newBlockArray;
+   std::vector<SeqBlock> newBlockArray;
    // Use the ratio of old to NEW mMaxSamples to make a reasonable guess at allocation.
    newBlockArray.reserve(1 + mBlock.size() * ((float)oldMaxSamples / (float)mMaxSamples));
 
@@ -179,7 +208,7 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
 
       for (size_t i = 0, nn = mBlock.size(); i < nn && bSuccess; i++)
       {
-         SeqBlock &oldSeqBlock = mBlock[i];
+         const SeqBlock &oldSeqBlock = mBlock[i];
          BlockFile* oldBlockFile = oldSeqBlock.f;
 
          sampleCount len = oldBlockFile->GetLength();
@@ -214,10 +243,9 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
       // Invalidate all the old, non-aliased block files.
       // Aliased files will be converted at save, per comment above.
 
-      DerefAllFiles();
-
-      // Replace with NEW blocks.
-      mBlock.swap(newBlockArray);
+      // Replace with NEW blocks.  Undo states sharing the old ones keep
+      // them.
+      mBlock.Replace(BlockArray(mDirManager, newBlockArray));
    }
    else
    {
@@ -238,7 +266,7 @@ bool Sequence::ConvertToSampleFormat(sampleFormat format, bool* pbChanged)
       *pbChanged = false;  // Revert overall change flag, in case we had some partial success in the loop.
    }
 
-   bSuccess &= ConsistencyCheck(wxT("Sequence::ConvertToSampleFormat()"));
+   bSuccess &= ConsistencyCheck(wxT("Sequence::ConvertToSampleFormat()"), false);
 
    return bSuccess;
 }
@@ -423,7 +451,6 @@ bool Sequence::Copy(sampleCount s0, sampleCount s1, std::unique_ptr<Sequence> &d
    wxASSERT(b0 <= b1);
 
    dest = std::make_unique<Sequence>(mDirManager, mSampleFormat);
-   dest->mBlock.reserve(b1 - b0 + 1);
 
    SampleBuffer buffer(mMaxSamples, mSampleFormat);
 
@@ -462,7 +489,7 @@ bool Sequence::Copy(sampleCount s0, sampleCount s1, std::unique_ptr<Sequence> &d
          dest->AppendBlock(block); // Increase ref count or duplicate file
    }
 
-   return ConsistencyCheck(wxT("Sequence::Copy()"));
+   return ConsistencyCheck(wxT("Sequence::Copy()"), false);
 }
 
 namespace {
@@ -506,7 +533,7 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
       return false;
    }
 
-   const BlockArray &srcBlock = src->mBlock;
+   const BlockArray &srcBlock = src->mBlock.Get();
    sampleCount addedLen = src->mNumSamples;
    const unsigned int srcNumBlocks = srcBlock.size();
    int sampleSize = SAMPLE_SIZE(mSampleFormat);
@@ -525,13 +552,16 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
       for (unsigned int i = 0; i < srcNumBlocks; i++)
          AppendBlock(srcBlock[i]); // Increase ref count or duplicate file
 
-      return ConsistencyCheck(wxT("Paste branch one"));
+      return ConsistencyCheck(wxT("Paste branch one"), false);
    }
 
+   // The other cases change existing blocks
+   BlockArray &blocks = mBlock.Write();
+
    const int b = (s == mNumSamples) ? mBlock.size() - 1 : FindBlock(s);
    wxASSERT((b >= 0) && (b < (int)numBlocks));
-   SeqBlock *const pBlock = &mBlock[b];
-   const sampleCount length = pBlock->f->GetLength();
+   const SeqBlock splitBlock = blocks.Lookup(b);
+   const sampleCount length = splitBlock.f->GetLength();
    const sampleCount largerBlockLen = addedLen + length;
    // PRL: when insertion point is the first sample of a block,
    // and the following test fails, perhaps we could test
@@ -540,40 +570,34 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
       // Special case: we can fit all of the NEW samples inside of
       // one block!
 
-      SeqBlock &block = *pBlock;
       SampleBuffer buffer(largerBlockLen, mSampleFormat);
 
-      int splitPoint = s - block.start;
-      Read(buffer.ptr(), mSampleFormat, block, 0, splitPoint);
+      int splitPoint = s - splitBlock.start;
+      Read(buffer.ptr(), mSampleFormat, splitBlock, 0, splitPoint);
       src->Get(0, buffer.ptr() + splitPoint*sampleSize,
                mSampleFormat, 0, addedLen);
       Read(buffer.ptr() + (splitPoint + addedLen)*sampleSize,
-           mSampleFormat, block,
+           mSampleFormat, splitBlock,
            splitPoint, length - splitPoint);
 
       BlockFile *const file =
          mDirManager->NewSimpleBlockFile(buffer.ptr(), largerBlockLen, mSampleFormat);
 
-      mDirManager->Deref(block.f);
-      block.f = file;
-
-      for (unsigned int i = b + 1; i < numBlocks; i++)
-         mBlock[i].start += addedLen;
+      // The later blocks move along by themselves
+      blocks.SetFile(b, file);
 
       mNumSamples += addedLen;
 
-      return ConsistencyCheck(wxT("Paste branch two"));
+      return ConsistencyCheck(wxT("Paste branch two"), false);
    }
 
    // Case three: if we are inserting four or fewer blocks,
    // it's simplest to just lump all the data together
    // into one big block along with the split block,
    // then resplit it all
-   BlockArray newBlock;
-   newBlock.reserve(numBlocks + srcNumBlocks + 2);
-   newBlock.insert(newBlock.end(), mBlock.begin(), mBlock.begin() + b);
+   std::vector<SeqBlock> newBlock;
+   newBlock.reserve(srcNumBlocks + 2);
 
-   SeqBlock &splitBlock = mBlock[b];
    sampleCount splitLen = splitBlock.f->GetLength();
    int splitPoint = s - splitBlock.start;
 
@@ -639,18 +663,12 @@ bool Sequence::Paste(sampleCount s, const Sequence *src)
       Blockify(newBlock, s + lastStart, sampleBuffer.ptr(), rightLen);
    }
 
-   mDirManager->Deref(splitBlock.f);
-
-   // Copy remaining blocks to NEW block array and
-   // swap the NEW block array in for the old
-   for (i = b + 1; i < numBlocks; i++)
-      newBlock.push_back(mBlock[i].Plus(addedLen));
-
-   mBlock.swap(newBlock);
+   // Put the NEW blocks in place of the split one, which is released
+   blocks.Splice(b, b + 1, newBlock);
 
    mNumSamples += addedLen;
 
-   return ConsistencyCheck(wxT("Paste branch three"));
+   return ConsistencyCheck(wxT("Paste branch three"), false);
 }
 
 bool Sequence::SetSilence(sampleCount s0, sampleCount len)
@@ -678,13 +696,14 @@ bool Sequence::InsertSilence(sampleCount s0, sampleCount len)
 
    sampleCount pos = 0;
 
-   sTrack.mBlock.reserve((len + idealSamples - 1) / idealSamples);
+   std::vector<SeqBlock> silentBlocks;
+   silentBlocks.reserve((len + idealSamples - 1) / idealSamples);
 
    BlockFile *silentFile = 0;
    if (len >= idealSamples)
       silentFile = new SilentBlockFile(idealSamples);
    while (len >= idealSamples) {
-      sTrack.mBlock.push_back(SeqBlock(silentFile, pos));
+      silentBlocks.push_back(SeqBlock(silentFile, pos));
       mDirManager->Ref(silentFile);
 
       pos += idealSamples;
@@ -693,16 +712,17 @@ bool Sequence::InsertSilence(sampleCount s0, sampleCount len)
    if (silentFile)
       mDirManager->Deref(silentFile);
    if (len) {
-      sTrack.mBlock.push_back(SeqBlock(new SilentBlockFile(len), pos));
+      silentBlocks.push_back(SeqBlock(new SilentBlockFile(len), pos));
       pos += len;
    }
 
+   sTrack.mBlock.Replace(BlockArray(mDirManager, silentBlocks));
    sTrack.mNumSamples = pos;
 
    bool bResult = Paste(s0, &sTrack);
    wxASSERT(bResult);
 
-   return bResult && ConsistencyCheck(wxT("InsertSilence"));
+   return bResult && ConsistencyCheck(wxT("InsertSilence"), false);
 }
 
 bool Sequence::AppendAlias(const wxString &fullPath,
@@ -719,7 +739,7 @@ bool Sequence::AppendAlias(const wxString &fullPath,
          mDirManager->NewAliasBlockFile(fullPath, start, len, channel),
       mNumSamples
    );
-   mBlock.push_back(newBlock);
+   mBlock.Write().push_back(newBlock);
    mNumSamples += len;
 
    return true;
@@ -736,7 +756,7 @@ bool Sequence::AppendCoded(const wxString &fName, sampleCount start,
       mDirManager->NewODDecodeBlockFile(fName, start, len, channel, decodeType),
       mNumSamples
    );
-   mBlock.push_back(newBlock);
+   mBlock.Write().push_back(newBlock);
    mNumSamples += len;
 
    return true;
@@ -761,7 +781,7 @@ bool Sequence::AppendBlock(const SeqBlock &b)
    //Don't need to Ref because it was done by CopyBlockFile, above...
    //mDirManager->Ref(newBlock.f);
 
-   mBlock.push_back(newBlock);
+   mBlock.Write().push_back(newBlock);
    mNumSamples += newBlock.f->GetLength();
 
    // Don't do a consistency check here because this
@@ -774,8 +794,8 @@ bool Sequence::AppendBlock(const SeqBlock &b)
 unsigned int Sequence::GetODFlags()
 {
    unsigned int ret = 0;
-   for (unsigned int i = 0; i < mBlock.size(); i++) {
-      BlockFile *const file = mBlock[i].f;
+   for (const auto &block : mBlock) {
+      BlockFile *const file = block.f;
       if(!file->IsDataAvailable())
          ret |= (static_cast<ODDecodeBlockFile*>(file))->GetDecodeType();
       else if(!file->IsSummaryAvailable())
@@ -870,8 +890,8 @@ bool Sequence::HandleXMLTag(const wxChar *tag, const wxChar **attrs)
          }
       } // while
 
-      mBlock.push_back(wb);
-      mDirManager->SetLoadingTarget(&mBlock, mBlock.size() - 1);
+      mLoadingBlocks.push_back(wb);
+      mDirManager->SetLoadingTarget(&mLoadingBlocks, mLoadingBlocks.size() - 1);
 
       return true;
    }
@@ -952,15 +972,17 @@ void Sequence::HandleXMLEndTag(const wxChar *tag)
    if (wxStrcmp(tag, wxT("sequence")) != 0)
       return;
 
+   std::vector<SeqBlock> &blocks = mLoadingBlocks;
+
    // Make sure that the sequence is valid.
    // First, replace missing blockfiles with SilentBlockFiles
-   for (unsigned b = 0, nn = mBlock.size(); b < nn; b++) {
-      SeqBlock &block = mBlock[b];
+   for (unsigned b = 0, nn = blocks.size(); b < nn; b++) {
+      SeqBlock &block = blocks[b];
       if (!block.f) {
          sampleCount len;
 
          if (b < nn - 1)
-            len = mBlock[b+1].start - block.start;
+            len = blocks[b+1].start - block.start;
          else
             len = mNumSamples - block.start;
 
@@ -984,8 +1006,8 @@ void Sequence::HandleXMLEndTag(const wxChar *tag)
 
    // Next, make sure that start times and lengths are consistent
    sampleCount numSamples = 0;
-   for (unsigned b = 0, nn = mBlock.size(); b < nn;  b++) {
-      SeqBlock &block = mBlock[b];
+   for (unsigned b = 0, nn = blocks.size(); b < nn;  b++) {
+      SeqBlock &block = blocks[b];
       if (block.start != numSamples) {
          wxString sFileAndExtension = block.f->GetFileName().name.GetFullName();
          if (sFileAndExtension.IsEmpty())
@@ -1014,6 +1036,11 @@ void Sequence::HandleXMLEndTag(const wxChar *tag)
       mNumSamples = numSamples;
       mErrorOpening = true;
    }
+
+   mBlock.Replace(BlockArray(mDirManager, blocks));
+   blocks.clear();
+
+   ConsistencyCheck(wxT("Sequence::HandleXMLEndTag"));
 }
 
 XMLTagHandler *Sequence::HandleXMLChild(const wxChar *tag)
@@ -1028,16 +1055,13 @@ XMLTagHandler *Sequence::HandleXMLChild(const wxChar *tag)
 
 void Sequence::WriteXML(XMLWriter &xmlFile)
 {
-   unsigned int b;
-
    xmlFile.StartTag(wxT("sequence"));
 
    xmlFile.WriteAttr(wxT("maxsamples"), mMaxSamples);
    xmlFile.WriteAttr(wxT("sampleformat"), mSampleFormat);
    xmlFile.WriteAttr(wxT("numsamples"), mNumSamples);
 
-   for (b = 0; b < mBlock.size(); b++) {
-      SeqBlock &bb = mBlock[b];
+   for (const auto &bb : mBlock) {
 
       // See http://bugzilla.audacityteam.org/show_bug.cgi?id=451.
       // Also, don't check against mMaxSamples for AliasBlockFiles, because if you convert sample format,
@@ -1069,47 +1093,10 @@ int Sequence::FindBlock(sampleCount pos) const
 {
    wxASSERT(pos >= 0 && pos < mNumSamples);
 
-   if (pos == 0)
-      return 0;
-
-   int numBlocks = mBlock.size();
-
-   sampleCount lo = 0, loSamples = 0;
-   sampleCount hi = numBlocks, hiSamples = mNumSamples;
-   sampleCount guess;
-
-   while (true) {
-      //this is not a binary search, but a
-      //dictionary search where we guess something smarter than the binary division
-      //of the unsearched area, since samples are usually proportional to block file number.
-      const double frac = double(pos - loSamples) / (hiSamples - loSamples);
-      guess = std::min(hi - 1, lo + sampleCount(frac * (hi - lo)));
-      const SeqBlock &block = mBlock[guess];
-
-      wxASSERT(block.f->GetLength() > 0);
-      wxASSERT(lo <= guess && guess < hi && lo < hi);
-
-      if (pos < block.start) {
-         wxASSERT(lo != guess);
-         hi = guess;
-         hiSamples = block.start;
-      }
-      else {
-         const sampleCount nextStart = block.start + block.f->GetLength();
-         if (pos < nextStart)
-            break;
-         else {
-            wxASSERT(guess < hi - 1);
-            lo = guess + 1;
-            loSamples = nextStart;
-         }
-      }
-   }
+   // O(log n) descent of the tree; see BlockArray
+   const int rval = mBlock.Get().FindBlock(pos);
 
-   const int rval = guess;
-   wxASSERT(rval >= 0 && rval < numBlocks &&
-            pos >= mBlock[rval].start &&
-            pos < mBlock[rval].start + mBlock[rval].f->GetLength());
+   wxASSERT(rval >= 0 && rval < (int)mBlock.size());
 
    return rval;
 }
@@ -1136,27 +1123,27 @@ bool Sequence::Read(samplePtr buffer, sampleFormat format,
 }
 
 bool Sequence::CopyWrite(SampleBuffer &scratch,
-                         samplePtr buffer, SeqBlock &b,
+                         samplePtr buffer, BlockArray &blocks, size_t b,
                          sampleCount start, sampleCount len)
 {
    // We don't ever write to an existing block; to support Undo,
    // we copy the old block entirely into memory, dereference it,
    // make the change, and then write the NEW block to disk.
 
-   const sampleCount length = b.f->GetLength();
+   const SeqBlock block = blocks.Lookup(b);
+   const sampleCount length = block.f->GetLength();
    wxASSERT(length <= mMaxSamples);
    wxASSERT(start + len <= length);
    wxASSERT(start >= 0);
 
    int sampleSize = SAMPLE_SIZE(mSampleFormat);
 
-   Read(scratch.ptr(), mSampleFormat, b, 0, length);
+   Read(scratch.ptr(), mSampleFormat, block, 0, length);
    memcpy(scratch.ptr() + start*sampleSize, buffer, len*sampleSize);
 
-   BlockFile *const oldBlockFile = b.f;
-   b.f = mDirManager->NewSimpleBlockFile(scratch.ptr(), length, mSampleFormat);
-
-   mDirManager->Deref(oldBlockFile);
+   // The array releases the old file
+   blocks.SetFile(b,
+      mDirManager->NewSimpleBlockFile(scratch.ptr(), length, mSampleFormat));
 
    return true;
 }
@@ -1176,6 +1163,20 @@ bool Sequence::Get(samplePtr buffer, sampleFormat format,
    return Get(b, buffer, format, start, len);
 }
 
+const float *Sequence::GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                      std::shared_ptr<const void> &holder) const
+{
+   if (start < 0 || len <= 0 || start + len > mNumSamples)
+      return NULL;
+
+   const SeqBlock &block = mBlock[FindBlock(start)];
+   const sampleCount bstart = start - block.start;
+   if (bstart + len > block.f->GetLength())
+      return NULL;
+
+   return block.f->GetFloatsNoCopy(bstart, len, holder);
+}
+
 bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
    sampleCount start, sampleCount len) const
 {
@@ -1211,10 +1212,11 @@ bool Sequence::Set(samplePtr buffer, sampleFormat format,
       temp.Allocate(std::min(len, mMaxSamples), mSampleFormat);
    }
 
+   BlockArray &blocks = mBlock.Write();
    int b = FindBlock(start);
 
    while (len) {
-      SeqBlock &block = mBlock[b];
+      const SeqBlock block = blocks.Lookup(b);
       const sampleCount bstart = start - block.start;
       const sampleCount fileLength = block.f->GetLength();
       const int blen =
@@ -1222,11 +1224,11 @@ bool Sequence::Set(samplePtr buffer, sampleFormat format,
 
       if (buffer) {
          if (format == mSampleFormat)
-            CopyWrite(scratch, buffer, block, bstart, blen);
+            CopyWrite(scratch, buffer, blocks, b, bstart, blen);
          else {
             // To do: remove the extra movement.  Can we copy-samples within CopyWrite?
             CopySamples(buffer, format, temp.ptr(), mSampleFormat, blen);
-            CopyWrite(scratch, temp.ptr(), block, bstart, blen);
+            CopyWrite(scratch, temp.ptr(), blocks, b, bstart, blen);
          }
          buffer += (blen * SAMPLE_SIZE(format));
       }
@@ -1235,15 +1237,14 @@ bool Sequence::Set(samplePtr buffer, sampleFormat format,
          if (start == block.start &&
              blen == fileLength) {
 
-            mDirManager->Deref(block.f);
-            block.f = new SilentBlockFile(blen);
+            blocks.SetFile(b, new SilentBlockFile(blen));
          }
          else {
             // Odd partial blocks of silence at start or end.
             temp.Allocate(blen, format);
             ClearSamples(temp.ptr(), format, 0, blen);
             // Otherwise write silence just to the portion of the block
-            CopyWrite(scratch, temp.ptr(), block, bstart, blen);
+            CopyWrite(scratch, temp.ptr(), blocks, b, bstart, blen);
          }
       }
 
@@ -1252,7 +1253,7 @@ bool Sequence::Set(samplePtr buffer, sampleFormat format,
       b++;
    }
 
-   return ConsistencyCheck(wxT("Set"));
+   return ConsistencyCheck(wxT("Set"), false);
 }
 
 namespace {
@@ -1261,33 +1262,24 @@ struct MinMaxSumsq
 {
    MinMaxSumsq(const float *pv, int count, int divisor)
    {
+      if (divisor == 1) {
+         // array holds samples
+         SummaryKernels::MinMaxSumsq(pv, std::max(count, 0), &min, &max, &sumsq);
+         return;
+      }
+
       min = FLT_MAX, max = -FLT_MAX, sumsq = 0.0f;
       while (count--) {
+         // array holds triples of min, max, and rms values
          float v;
-         switch (divisor) {
-         default:
-         case 1:
-            // array holds samples
-            v = *pv++;
-            if (v < min)
-               min = v;
-            if (v > max)
-               max = v;
-            sumsq += v * v;
-            break;
-         case 256:
-         case 65536:
-            // array holds triples of min, max, and rms values
-            v = *pv++;
-            if (v < min)
-               min = v;
-            v = *pv++;
-            if (v > max)
-               max = v;
-            v = *pv++;
-            sumsq += v * v;
-            break;
-         }
+         v = *pv++;
+         if (v < min)
+            min = v;
+         v = *pv++;
+         if (v > max)
+            max = v;
+         v = *pv++;
+         sumsq += v * v;
       }
    }
 
@@ -1317,8 +1309,8 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
 
    sampleCount srcX = s0;
    sampleCount nextSrcX = 0;
-   int lastRmsDenom = 0;
-   int lastDivisor = 0;
+   sampleCount lastRmsDenom = 0;
+   sampleCount lastDivisor = 0;
    sampleCount whereNow = std::min(s1 - 1, where[0]);
    sampleCount whereNext = 0;
    // Loop over block files, opening and reading and closing each
@@ -1333,7 +1325,7 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
 
       // Find the range of sample values for this block that
       // are in the display.
-      SeqBlock &seqBlock = mBlock[b];
+      const SeqBlock &seqBlock = mBlock[b];
       const sampleCount start = seqBlock.start;
       nextSrcX = std::min(s1, start + seqBlock.f->GetLength());
 
@@ -1354,25 +1346,43 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
                 (whereNext = std::min(s1 - 1, where[nextPixel])) < nextSrcX)
             ++nextPixel;
       }
-      if (nextPixel == pixel)
+      if (nextPixel == pixel) {
          // The entire block's samples fall within one pixel column.
          // Either it's a rare odd block at the end, or else,
          // we must be really zoomed out!
-         // Omit the entire block's contents from min/max/rms
-         // calculation, which is not correct, but correctness might not
-         // be worth the compute time if this happens every pixel
-         // column. -- PRL
+         // The block's own min/max/rms are in memory, so fold them
+         // into that column.
+         if (pixel > 0 && seqBlock.f->IsSummaryAvailable()) {
+            float blockMin, blockMax, blockRMS;
+            seqBlock.f->GetMinMax(&blockMin, &blockMax, &blockRMS);
+            const sampleCount blockLen = nextSrcX - srcX;
+            const int lastPixel = pixel - 1;
+            min[lastPixel] = std::min(min[lastPixel], blockMin);
+            max[lastPixel] = std::max(max[lastPixel], blockMax);
+            const sampleCount lastNumSamples = lastRmsDenom * lastDivisor;
+            rms[lastPixel] = sqrt(
+               (rms[lastPixel] * rms[lastPixel] * lastNumSamples +
+                blockRMS * blockRMS * blockLen) /
+               (lastNumSamples + blockLen)
+            );
+            lastDivisor = 1;
+            lastRmsDenom = lastNumSamples + blockLen;
+         }
          continue;
+      }
       if (nextPixel == len)
          whereNext = s1;
 
-      // Decide the summary level
+      // Decide the summary level: the coarsest whose frames are no
+      // wider than a pixel column, so that each column reduces only a
+      // few values (at most the summary factor) whatever the zoom
       const double samplesPerPixel =
          double(whereNext - whereNow) / (nextPixel - pixel);
-      const int divisor =
-           (samplesPerPixel >= 65536) ? 65536
-         : (samplesPerPixel >= 256) ? 256
-         : 1;
+      int level = -1;
+      sampleCount divisor = 1;
+      while (BlockFile::GetSummaryDivisor(level + 1) <= samplesPerPixel &&
+             BlockFile::GetSummaryDivisor(level + 1) <= mMaxSamples)
+         divisor = BlockFile::GetSummaryDivisor(++level);
 
       int blockStatus = b;
 
@@ -1395,32 +1405,19 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
       }
 
       // Read from the block file or its summary
-      switch (divisor) {
-      default:
-      case 1:
+      if (divisor == 1)
          // Read samples
          Read((samplePtr)temp, floatSample, seqBlock, startPosition, num);
-         break;
-      case 256:
-         // Read triples
-         //check to see if summary data has been computed
-         if (seqBlock.f->IsSummaryAvailable())
-            seqBlock.f->Read256(temp, startPosition, num);
-         else
-            //otherwise, mark the display as not yet computed
-            blockStatus = -1 - b;
-         break;
-      case 65536:
+      else {
          // Read triples
          //check to see if summary data has been computed
          if (seqBlock.f->IsSummaryAvailable())
-            seqBlock.f->Read64K(temp, startPosition, num);
+            seqBlock.f->ReadSummaryLevel(temp, level, startPosition, num);
          else
             //otherwise, mark the display as not yet computed
             blockStatus = -1 - b;
-         break;
       }
-      
+
       sampleCount filePosition = startPosition;
 
       // The previous pixel column might straddle blocks.
@@ -1436,7 +1433,7 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
             float &lastMax = max[lastPixel];
             lastMax = std::max(lastMax, values.max);
             float &lastRms = rms[lastPixel];
-            int lastNumSamples = lastRmsDenom * lastDivisor;
+            sampleCount lastNumSamples = lastRmsDenom * lastDivisor;
             lastRms = sqrt(
                (lastRms * lastRms * lastNumSamples + values.sumsq * divisor) /
                (lastNumSamples + diff * divisor)
@@ -1516,15 +1513,16 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
    if (Overflows(((double)mNumSamples) + ((double)len)))
       return false;
 
+   BlockArray &blocks = mBlock.Write();
+
    // If the last block is not full, we need to add samples to it
-   int numBlocks = mBlock.size();
+   int numBlocks = blocks.size();
    sampleCount length;
-   SeqBlock *pLastBlock;
+   SeqBlock lastBlock;
    SampleBuffer buffer2(mMaxSamples, mSampleFormat);
    if (numBlocks > 0 &&
        (length =
-        (pLastBlock = &mBlock.back())->f->GetLength()) < mMinSamples) {
-      SeqBlock &lastBlock = *pLastBlock;
+        (lastBlock = blocks.back()).f->GetLength()) < mMinSamples) {
       const sampleCount addLen = std::min(mMaxSamples - length, len);
 
       Read(buffer2.ptr(), mSampleFormat, lastBlock, 0, length);
@@ -1543,10 +1541,9 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
          lastBlock.start
       );
       if (blockFileLog)
-         static_cast<SimpleBlockFile*>(newLastBlock.f)->SaveXML(*blockFileLog);
+         newLastBlock.f->SaveXML(*blockFileLog);
 
-      mDirManager->Deref(lastBlock.f);
-      lastBlock = newLastBlock;
+      blocks.SetFile(numBlocks - 1, newLastBlock.f);
 
       len -= addLen;
       mNumSamples += addLen;
@@ -1556,21 +1553,13 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
    while (len) {
       const sampleCount idealSamples = GetIdealBlockSize();
       const sampleCount l = std::min(idealSamples, len);
-      BlockFile *pFile;
-      if (format == mSampleFormat) {
-         pFile = mDirManager->NewSimpleBlockFile(buffer, l, mSampleFormat,
-                                                blockFileLog != NULL);
-      }
-      else {
-         CopySamples(buffer, format, buffer2.ptr(), mSampleFormat, l);
-         pFile = mDirManager->NewSimpleBlockFile(buffer2.ptr(), l, mSampleFormat,
-                                                blockFileLog != NULL);
-      }
+      BlockFile *pFile = NewBlockFile(buffer, format, l, buffer2.ptr(),
+                                      blockFileLog != NULL);
 
       if (blockFileLog)
-         static_cast<SimpleBlockFile*>(pFile)->SaveXML(*blockFileLog);
+         pFile->SaveXML(*blockFileLog);
 
-      mBlock.push_back(SeqBlock(pFile, mNumSamples));
+      blocks.push_back(SeqBlock(pFile, mNumSamples));
 
       buffer += l * SAMPLE_SIZE(format);
       mNumSamples += l;
@@ -1581,13 +1570,13 @@ bool Sequence::Append(samplePtr buffer, sampleFormat format,
 // If generating a long sequence this test would give O(n^2)
 // performance - not good!
 #ifdef VERY_SLOW_CHECKING
-   ConsistencyCheck(wxT("Append"));
+   ConsistencyCheck(wxT("Append"), false);
 #endif
 
    return true;
 }
 
-void Sequence::Blockify(BlockArray &list, sampleCount start, samplePtr buffer, sampleCount len)
+void Sequence::Blockify(std::vector<SeqBlock> &list, sampleCount start, samplePtr buffer, sampleCount len)
 {
    if (len <= 0)
       return;
@@ -1621,7 +1610,9 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
    //both functions,
    DeleteUpdateMutexLocker locker(*this);
 
-   const unsigned int numBlocks = mBlock.size();
+   // Undo states sharing the blocks keep the old array
+   BlockArray &blocks = mBlock.Write();
+   const unsigned int numBlocks = blocks.size();
 
    const unsigned int b0 = FindBlock(start);
    unsigned int b1 = FindBlock(start + len - 1);
@@ -1631,7 +1622,7 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
    // Special case: if the samples to DELETE are all within a single
    // block and the resulting length is not too small, perform the
    // deletion within this block:
-   SeqBlock *pBlock;
+   SeqBlock b;
    sampleCount length;
 
    // One buffer for reuse in various branches here
@@ -1639,8 +1630,7 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
    // The maximum size that will ever be needed
    const sampleCount scratchSize = mMaxSamples + mMinSamples;
 
-   if (b0 == b1 && (length = (pBlock = &mBlock[b0])->f->GetLength()) - len >= mMinSamples) {
-      SeqBlock &b = *pBlock;
+   if (b0 == b1 && (length = (b = blocks.Lookup(b0)).f->GetLength()) - len >= mMinSamples) {
       sampleCount pos = start - b.start;
       sampleCount newLen = length - len;
 
@@ -1650,36 +1640,26 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
       Read(scratch.ptr() + (pos * sampleSize), mSampleFormat,
            b, pos + len, newLen - pos);
 
-      BlockFile *const oldFile = b.f;
-      b = SeqBlock(
-         mDirManager->NewSimpleBlockFile(scratch.ptr(), newLen, mSampleFormat),
-         b.start
-      );
-      mDirManager->Deref(oldFile);
-
-      for (unsigned int j = b0 + 1; j < numBlocks; j++)
-         mBlock[j].start -= len;
+      // The array releases the old file, and the later blocks move
+      // back by themselves
+      blocks.SetFile(b0,
+         mDirManager->NewSimpleBlockFile(scratch.ptr(), newLen, mSampleFormat));
 
       mNumSamples -= len;
 
-      return ConsistencyCheck(wxT("Delete - branch one"));
+      return ConsistencyCheck(wxT("Delete - branch one"), false);
    }
 
-   // Create a NEW array of blocks
-   BlockArray newBlock;
-   newBlock.reserve(numBlocks - (b1 - b0) + 2);
-
-   // Copy the blocks before the deletion point over to
-   // the NEW array
-   newBlock.insert(newBlock.end(), mBlock.begin(), mBlock.begin() + b0);
-   unsigned int i;
+   // The NEW blocks to put in place of blocks first through b1
+   std::vector<SeqBlock> newBlock;
+   unsigned int first = b0;
 
    // First grab the samples in block b0 before the deletion point
    // into preBuffer.  If this is enough samples for its own block,
    // or if this would be the first block in the array, write it out.
    // Otherwise combine it with the previous block (splitting them
    // 50/50 if necessary).
-   const SeqBlock &preBlock = mBlock[b0];
+   const SeqBlock preBlock = blocks.Lookup(b0);
    sampleCount preBufferLen = start - preBlock.start;
    if (preBufferLen) {
       if (preBufferLen >= mMinSamples || b0 == 0) {
@@ -1691,7 +1671,7 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
 
          newBlock.push_back(SeqBlock(pFile, preBlock.start));
       } else {
-         const SeqBlock &prepreBlock = mBlock[b0 - 1];
+         const SeqBlock prepreBlock = blocks.Lookup(b0 - 1);
          const sampleCount prepreLen = prepreBlock.f->GetLength();
          const sampleCount sum = prepreLen + preBufferLen;
 
@@ -1702,10 +1682,8 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
          Read(scratch.ptr() + prepreLen*sampleSize, mSampleFormat,
               preBlock, 0, preBufferLen);
 
-         newBlock.erase(newBlock.end() - 1);
          Blockify(newBlock, prepreBlock.start, scratch.ptr(), sum);
-
-         mDirManager->Deref(prepreBlock.f);
+         --first;
       }
    }
    else {
@@ -1713,21 +1691,12 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
       // right on the beginning of a block.
    }
 
-   if (b0 != b1) {
-      mDirManager->Deref(preBlock.f);
-   }
-
-   // Next, DELETE blocks strictly between b0 and b1
-   for (i = b0 + 1; i < b1; i++) {
-      mDirManager->Deref(mBlock[i].f);
-   }
-
    // Now, symmetrically, grab the samples in block b1 after the
    // deletion point into postBuffer.  If this is enough samples
    // for its own block, or if this would be the last block in
    // the array, write it out.  Otherwise combine it with the
    // subsequent block (splitting them 50/50 if necessary).
-   const SeqBlock &postBlock = mBlock[b1];
+   const SeqBlock postBlock = blocks.Lookup(b1);
    sampleCount postBufferLen =
        (postBlock.start + postBlock.f->GetLength()) - (start + len);
    if (postBufferLen) {
@@ -1742,7 +1711,7 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
 
          newBlock.push_back(SeqBlock(file, start));
       } else {
-         SeqBlock &postpostBlock = mBlock[b1 + 1];
+         const SeqBlock postpostBlock = blocks.Lookup(b1 + 1);
          sampleCount postpostLen = postpostBlock.f->GetLength();
          sampleCount sum = postpostLen + postBufferLen;
 
@@ -1756,48 +1725,51 @@ bool Sequence::Delete(sampleCount start, sampleCount len)
 
          Blockify(newBlock, start, scratch.ptr(), sum);
          b1++;
-
-         mDirManager->Deref(postpostBlock.f);
       }
    }
    else {
       // The sample where we begin deletion happens to fall
       // right on the end of a block.
    }
-   mDirManager->Deref(postBlock.f);
-
-   // Copy the remaining blocks over from the old array
-   for (i = b1 + 1; i < numBlocks; i++)
-      newBlock.push_back(mBlock[i].Plus(-len));
-
-   // Substitute our NEW array for the old one
-   mBlock.swap(newBlock);
+   // Put the NEW blocks in place of the old ones, which are released.
+   // The later blocks move back by themselves.
+   blocks.Splice(first, b1 + 1, newBlock);
 
    // Update total number of samples and do a consistency check.
    mNumSamples -= len;
 
-   return ConsistencyCheck(wxT("Delete - branch two"));
+   return ConsistencyCheck(wxT("Delete - branch two"), false);
 }
 
-bool Sequence::ConsistencyCheck(const wxChar *whereStr) const
+bool Sequence::ConsistencyCheck(const wxChar *whereStr, bool walk) const
 {
-   unsigned int i;
-   sampleCount pos = 0;
-   unsigned int numBlocks = mBlock.size();
-   bool bError = false;
+   // The starts of blocks follow from the lengths kept in the tree, so
+   // comparing the totals is enough to catch an edit that lost count of
+   // samples.  Comparing every start with the lengths of the files
+   // themselves would make each edit O(n) again, so the edits do that
+   // only when checking very slowly.
+   bool bError = (mBlock.Get().GetNumSamples() != mNumSamples);
 
-   for (i = 0; !bError && i < numBlocks; i++) {
-      const SeqBlock &seqBlock = mBlock[i];
-      if (pos != seqBlock.start)
-         bError = true;
+#ifdef VERY_SLOW_CHECKING
+   walk = true;
+#endif
 
-      if (seqBlock.f)
-         pos += seqBlock.f->GetLength();
-      else
+   if (walk) {
+      sampleCount pos = 0;
+      for (const auto &seqBlock : mBlock) {
+         if (bError)
+            break;
+         if (pos != seqBlock.start)
+            bError = true;
+
+         if (seqBlock.f)
+            pos += seqBlock.f->GetLength();
+         else
+            bError = true;
+      }
+      if (pos != mNumSamples)
          bError = true;
    }
-   if (pos != mNumSamples)
-      bError = true;
 
    if (bError)
    {
@@ -1815,11 +1787,11 @@ bool Sequence::ConsistencyCheck(const wxChar *whereStr) const
 
 void Sequence::DebugPrintf(wxString *dest) const
 {
-   unsigned int i;
-   int pos = 0;
+   unsigned int i = 0;
+   sampleCount pos = 0;
 
-   for (i = 0; i < mBlock.size(); i++) {
-      const SeqBlock &seqBlock = mBlock[i];
+   for (auto it = mBlock.begin(), end = mBlock.end(); it != end; ++it, ++i) {
+      const SeqBlock &seqBlock = *it;
       *dest += wxString::Format
          (wxT("   Block %3u: start %8lld, len %8lld, refs %d, "),
           i,
@@ -1856,11 +1828,23 @@ int Sequence::GetMaxDiskBlockSize()
    return sMaxDiskBlockSize;
 }
 
+BlockFile *Sequence::NewBlockFile(samplePtr buffer, sampleFormat format,
+                                  sampleCount len, samplePtr scratch,
+                                  bool allowDeferredWrite) const
+{
+   if (format != mSampleFormat) {
+      CopySamples(buffer, format, scratch, mSampleFormat, len);
+      buffer = scratch;
+   }
+   return mDirManager->NewSimpleBlockFile(buffer, len, mSampleFormat,
+                                          allowDeferredWrite);
+}
+
 void Sequence::AppendBlockFile(BlockFile* blockFile)
 {
    // We assume blockFile has the correct ref count already
 
-   mBlock.push_back(SeqBlock(blockFile, mNumSamples));
+   mBlock.Write().push_back(SeqBlock(blockFile, mNumSamples));
    mNumSamples += blockFile->GetLength();
 
    // PRL:  I hoisted the intended consistency check out of the inner loop
@@ -22,6 +22,7 @@
 #include "ondemand/ODTaskThread.h"
 
 #include "audacity/Types.h"
+#include "BlockArray.h"
 
 #if 0
 // Moved to "audacity/types.h"
@@ -32,29 +33,39 @@ typedef wxLongLong_t sampleCount; /** < A native 64-bit integer type, because
 class BlockFile;
 class DirManager;
 
-// This is an internal data structure!  For advanced use only.
-class SeqBlock {
+/// The BlockArray of a Sequence.  Sequences copied from one another in
+/// the same DirManager share it, as undo states do, until one of them
+/// changes it.  Even then they go on sharing the parts of the tree it
+/// did not change; see BlockArray.
+class SharedBlockArray {
  public:
-   BlockFile * f;
-   ///the sample in the global wavetrack that this block starts at.
-   sampleCount start;
-
-   SeqBlock()
-      : f(NULL), start(0)
-   {}
-
-   SeqBlock(BlockFile *f_, sampleCount start_)
-      : f(f_), start(start_)
-   {}
-
-   // Construct a SeqBlock with changed start, same file
-   SeqBlock Plus(sampleCount delta) const
-   {
-      return SeqBlock(f, start + delta);
-   }
+   explicit SharedBlockArray(DirManager *dirManager);
+
+   size_t size() const { return mArray->size(); }
+   bool empty() const { return mArray->empty(); }
+   const SeqBlock &operator[] (size_t i) const { return (*mArray)[i]; }
+   SeqBlock back() const { return mArray->back(); }
+   BlockArray::const_iterator begin() const { return mArray->begin(); }
+   BlockArray::const_iterator end() const { return mArray->end(); }
+
+   const BlockArray &Get() const { return *mArray; }
+   /// Keeps the array alive; compare these to find arrays in common
+   std::shared_ptr<const BlockArray> GetShared() const { return mArray; }
+
+   /// Drop this array and share other's instead
+   void Share(const SharedBlockArray &other);
+   /// The array, copied first (in O(1) time) if anything else shares it
+   BlockArray &Write();
+   /// Drop this array and take over another of the same DirManager
+   void Replace(BlockArray &&array);
+
+ private:
+   DirManager *mDirManager;
+   std::shared_ptr<BlockArray> mArray;
+
+   SharedBlockArray(const SharedBlockArray&) PROHIBITED;
+   SharedBlockArray &operator= (const SharedBlockArray&) PROHIBITED;
 };
-class BlockArray : public std::vector<SeqBlock> {};
-using BlockPtrArray = std::vector<SeqBlock*>; // non-owning pointers
 
 class PROFILE_DLL_API Sequence final : public XMLTagHandler{
  public:
@@ -87,6 +98,10 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
 
    bool Get(samplePtr buffer, sampleFormat format,
             sampleCount start, sampleCount len) const;
+   // Returns NULL unless the samples lie in one block which can lend
+   // them as floats without copying; see BlockFile::GetFloatsNoCopy().
+   const float *GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                std::shared_ptr<const void> &holder) const;
    bool Set(samplePtr buffer, sampleFormat format,
             sampleCount start, sampleCount len);
 
@@ -125,6 +140,14 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    // loaded from an XML file via DirManager::HandleXMLTag
    void AppendBlockFile(BlockFile* blockFile);
 
+   // Make a block file of len samples of the given format, converted
+   // to the format of the sequence as Append() converts them, without
+   // appending it.  scratch must hold len samples of the sequence's
+   // format.  Safe to call on several threads at once.
+   BlockFile *NewBlockFile(samplePtr buffer, sampleFormat format,
+                           sampleCount len, samplePtr scratch,
+                           bool allowDeferredWrite = false) const;
+
    bool SetSilence(sampleCount s0, sampleCount len);
    bool InsertSilence(sampleCount s0, sampleCount len);
 
@@ -185,7 +208,11 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    // you're doing!
    //
 
-   BlockArray &GetBlockArray() {return mBlock;}
+   const BlockArray &GetBlockArray() const {return mBlock.Get();}
+   // Unshares the array first; see SharedBlockArray
+   BlockArray &GetWritableBlockArray() {return mBlock.Write();}
+   std::shared_ptr<const BlockArray> GetSharedBlockArray() const
+   { return mBlock.GetShared(); }
 
    ///
    void LockDeleteUpdateMutex(){mDeleteUpdateMutex.Lock();}
@@ -220,7 +247,10 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
 
    DirManager   *mDirManager;
 
-   BlockArray    mBlock;
+   SharedBlockArray mBlock;
+   // The blocks read so far while loading from XML, put into mBlock
+   // once the starts and files are checked
+   std::vector<SeqBlock> mLoadingBlocks;
    sampleFormat  mSampleFormat;
    sampleCount   mNumSamples{ 0 };
 
@@ -236,8 +266,6 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    // Private methods
    //
 
-   void DerefAllFiles();
-
    int FindBlock(sampleCount pos) const;
 
    bool AppendBlock(const SeqBlock &b);
@@ -247,10 +275,10 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
              sampleCount start, sampleCount len) const;
 
    bool CopyWrite(SampleBuffer &scratch,
-                  samplePtr buffer,    SeqBlock &b,
+                  samplePtr buffer, BlockArray &blocks, size_t b,
                   sampleCount start, sampleCount len);
 
-   void Blockify(BlockArray &list, sampleCount start, samplePtr buffer, sampleCount len);
+   void Blockify(std::vector<SeqBlock> &list, sampleCount start, samplePtr buffer, sampleCount len);
 
    bool Get(int b, samplePtr buffer, sampleFormat format,
       sampleCount start, sampleCount len) const;
@@ -262,8 +290,9 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    //
 
    // This function makes sure that the track isn't messed up
-   // because of inconsistent block starts & lengths
-   bool ConsistencyCheck(const wxChar *whereStr) const;
+   // because of inconsistent block starts & lengths.  Unless walk,
+   // as after an edit, it compares only the total length.
+   bool ConsistencyCheck(const wxChar *whereStr, bool walk = true) const;
 
    // This function prints information to stdout about the blocks in the
    // tracks and indicates if there are inconsistencies.
@@ -0,0 +1,290 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  SummaryKernels.cpp
+
+*******************************************************************//**
+
+\class SummaryKernels
+\brief Vectorized min, max and sum-of-squares reductions, chosen at run
+time according to the CPU.
+
+  Every path keeps eight partial results, lane i taking samples i,
+  i + 8, i + 16 and so on, and combines the lanes in the same fixed
+  order.  The scalar path imitates the min and max instructions
+  exactly, including their treatment of NaN and signed zero, so the
+  results do not depend on the path.  (On 32-bit x86 builds that do
+  scalar float math on the x87 unit, the scalar sums of squares may
+  still differ in the last bit.)
+
+*//*******************************************************************/
+
+#include "SummaryKernels.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SUMMARY_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SUMMARY_KERNELS_X86) && defined(__GNUC__)
+// Compile these functions for the instruction set they use, whatever
+// the rest of the program is compiled for
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX
+#endif
+
+namespace {
+
+const int Lanes = 8;
+
+struct LaneResults
+{
+   float min[Lanes];
+   float max[Lanes];
+   float sumsq[Lanes];
+
+   LaneResults()
+   {
+      for (int k = 0; k < Lanes; k++) {
+         min[k] = FLT_MAX;
+         max[k] = -FLT_MAX;
+         sumsq[k] = 0.0f;
+      }
+   }
+};
+
+// The scalar equivalents of MINPS and MAXPS, which return the second
+// operand unless the first is strictly less (greater)
+inline float Min(float a, float b) { return a < b ? a : b; }
+inline float Max(float a, float b) { return a > b ? a : b; }
+
+// Reduces samples from done up to count, continuing the lane pattern
+void ReduceRest(const float *samples, size_t done, size_t count, LaneResults &r)
+{
+   for (size_t i = done; i < count; i++) {
+      const float v = samples[i];
+      const int k = i % Lanes;
+      r.min[k] = Min(r.min[k], v);
+      r.max[k] = Max(r.max[k], v);
+      r.sumsq[k] += v * v;
+   }
+}
+
+void Combine(const LaneResults &r, float *outMin, float *outMax, float *outSumsq)
+{
+   float min = r.min[0], max = r.max[0], sumsq = r.sumsq[0];
+   for (int k = 1; k < Lanes; k++) {
+      min = Min(min, r.min[k]);
+      max = Max(max, r.max[k]);
+      sumsq += r.sumsq[k];
+   }
+   *outMin = min;
+   *outMax = max;
+   *outSumsq = sumsq;
+}
+
+// Each reducer handles a whole number of lane groups from the start of
+// the samples and returns how many samples that was
+typedef size_t (*Reducer)(const float *samples, size_t count, LaneResults &r);
+
+size_t ReduceScalar(const float *WXUNUSED(samples), size_t WXUNUSED(count),
+                    LaneResults &WXUNUSED(r))
+{
+   return 0;
+}
+
+#ifdef SUMMARY_KERNELS_X86
+
+TARGET_SSE2
+size_t ReduceSSE2(const float *samples, size_t count, LaneResults &r)
+{
+   __m128 min0 = _mm_loadu_ps(r.min), min1 = _mm_loadu_ps(r.min + 4);
+   __m128 max0 = _mm_loadu_ps(r.max), max1 = _mm_loadu_ps(r.max + 4);
+   __m128 sq0 = _mm_loadu_ps(r.sumsq), sq1 = _mm_loadu_ps(r.sumsq + 4);
+
+   size_t i = 0;
+   for (; i + Lanes <= count; i += Lanes) {
+      const __m128 v0 = _mm_loadu_ps(samples + i);
+      const __m128 v1 = _mm_loadu_ps(samples + i + 4);
+      min0 = _mm_min_ps(min0, v0);
+      min1 = _mm_min_ps(min1, v1);
+      max0 = _mm_max_ps(max0, v0);
+      max1 = _mm_max_ps(max1, v1);
+      sq0 = _mm_add_ps(sq0, _mm_mul_ps(v0, v0));
+      sq1 = _mm_add_ps(sq1, _mm_mul_ps(v1, v1));
+   }
+
+   _mm_storeu_ps(r.min, min0), _mm_storeu_ps(r.min + 4, min1);
+   _mm_storeu_ps(r.max, max0), _mm_storeu_ps(r.max + 4, max1);
+   _mm_storeu_ps(r.sumsq, sq0), _mm_storeu_ps(r.sumsq + 4, sq1);
+   return i;
+}
+
+TARGET_AVX
+size_t ReduceAVX(const float *samples, size_t count, LaneResults &r)
+{
+   __m256 min = _mm256_loadu_ps(r.min);
+   __m256 max = _mm256_loadu_ps(r.max);
+   __m256 sq = _mm256_loadu_ps(r.sumsq);
+
+   size_t i = 0;
+   for (; i + Lanes <= count; i += Lanes) {
+      const __m256 v = _mm256_loadu_ps(samples + i);
+      min = _mm256_min_ps(min, v);
+      max = _mm256_max_ps(max, v);
+      // Multiply and add separately, as the other paths do; a fused
+      // multiply-add would round differently
+      sq = _mm256_add_ps(sq, _mm256_mul_ps(v, v));
+   }
+
+   _mm256_storeu_ps(r.min, min);
+   _mm256_storeu_ps(r.max, max);
+   _mm256_storeu_ps(r.sumsq, sq);
+   return i;
+}
+
+bool CPUHas(SummaryKernels::Path path)
+{
+   switch (path) {
+   case SummaryKernels::SSE2:
+#ifdef _MSC_VER
+      {
+         int info[4];
+         __cpuid(info, 1);
+         return (info[3] & (1 << 26)) != 0;
+      }
+#else
+      return __builtin_cpu_supports("sse2");
+#endif
+   case SummaryKernels::AVX:
+#ifdef _MSC_VER
+      {
+         // The operating system must save the YMM registers too
+         int info[4];
+         __cpuid(info, 1);
+         const bool osxsave = (info[2] & (1 << 27)) != 0;
+         const bool avx = (info[2] & (1 << 28)) != 0;
+         return osxsave && avx && (_xgetbv(0) & 6) == 6;
+      }
+#else
+      return __builtin_cpu_supports("avx");
+#endif
+   default:
+      return true;
+   }
+}
+
+#else
+
+bool CPUHas(SummaryKernels::Path path)
+{
+   return path == SummaryKernels::Scalar;
+}
+
+#endif
+
+Reducer ReducerFor(SummaryKernels::Path path)
+{
+   switch (path) {
+#ifdef SUMMARY_KERNELS_X86
+   case SummaryKernels::SSE2:
+      return ReduceSSE2;
+   case SummaryKernels::AVX:
+      return ReduceAVX;
+#endif
+   default:
+      return ReduceScalar;
+   }
+}
+
+struct Dispatch
+{
+   SummaryKernels::Path path;
+   Reducer reduce;
+};
+
+Dispatch &GetDispatch()
+{
+   static Dispatch dispatch = {
+      SummaryKernels::GetBestPath(),
+      ReducerFor(SummaryKernels::GetBestPath())
+   };
+   return dispatch;
+}
+
+}
+
+SummaryKernels::Path SummaryKernels::GetBestPath()
+{
+   if (CPUHas(AVX))
+      return AVX;
+   if (CPUHas(SSE2))
+      return SSE2;
+   return Scalar;
+}
+
+SummaryKernels::Path SummaryKernels::GetPath()
+{
+   return GetDispatch().path;
+}
+
+bool SummaryKernels::SetPath(Path path)
+{
+   if (!CPUHas(path))
+      return false;
+
+   Dispatch &dispatch = GetDispatch();
+   dispatch.path = path;
+   dispatch.reduce = ReducerFor(path);
+   return true;
+}
+
+const wxChar *SummaryKernels::GetPathName(Path path)
+{
+   switch (path) {
+   case SSE2:
+      return wxT("SSE2");
+   case AVX:
+      return wxT("AVX");
+   default:
+      return wxT("scalar");
+   }
+}
+
+void SummaryKernels::MinMaxSumsq(const float *samples, size_t count,
+                                 float *outMin, float *outMax, float *outSumsq)
+{
+   LaneResults r;
+   const size_t done = GetDispatch().reduce(samples, count, r);
+   ReduceRest(samples, done, count, r);
+   Combine(r, outMin, outMax, outSumsq);
+}
+
+void SummaryKernels::SummaryFrames(const float *samples, size_t len,
+                                   size_t frameLen, float *summary)
+{
+   const Reducer reduce = GetDispatch().reduce;
+
+   for (size_t start = 0; start < len; start += frameLen, summary += 3) {
+      const size_t count = std::min(frameLen, len - start);
+      const float *const frame = samples + start;
+
+      LaneResults r;
+      ReduceRest(frame, reduce(frame, count, r), count, r);
+
+      float sumsq;
+      Combine(r, &summary[0], &summary[1], &sumsq);
+      summary[2] = (float)sqrt(sumsq / count);
+   }
+}
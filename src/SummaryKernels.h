@@ -0,0 +1,47 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  SummaryKernels.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SUMMARY_KERNELS__
+#define __AUDACITY_SUMMARY_KERNELS__
+
+#include "Audacity.h"
+
+#include <stddef.h>
+#include <wx/defs.h>
+
+/// Min, max and sum-of-squares reductions of float samples, as used for
+/// block file summaries and waveform display.  The vector paths and the
+/// scalar one accumulate in the same eight lanes and combine them in the
+/// same order, so all paths give bit-identical results.
+class AUDACITY_DLL_API SummaryKernels
+{
+public:
+   enum Path {
+      Scalar,
+      SSE2,
+      AVX
+   };
+
+   /// The fastest path this CPU supports
+   static Path GetBestPath();
+   static Path GetPath();
+   /// Returns false, changing nothing, if the CPU lacks the path
+   static bool SetPath(Path path);
+   static const wxChar *GetPathName(Path path);
+
+   /// Reduces count samples (which may be 0, giving FLT_MAX, -FLT_MAX, 0)
+   static void MinMaxSumsq(const float *samples, size_t count,
+                           float *outMin, float *outMax, float *outSumsq);
+
+   /// Writes min, max and rms triples for every frameLen samples; the
+   /// last frame may be short.
+   static void SummaryFrames(const float *samples, size_t len,
+                             size_t frameLen, float *summary);
+};
+
+#endif
@@ -22,6 +22,8 @@ UndoManager
 
 #include "Audacity.h"
 
+#include <map>
+#include <set>
 #include <wx/hashset.h>
 
 #include "BlockFile.h"
@@ -54,9 +56,65 @@ struct UndoStackElem {
    UndoState state;
    wxString description;
    wxString shortDescription;
+   // Negative until CalculateSpaceUsage() finds it
+   wxLongLong_t spaceUsage{ -1 };
+};
+
+namespace {
+   // The block files of a block array that states share
+   struct BlockFileSet {
+      std::weak_ptr<const BlockArray> array;
+      Set files;
+   };
+
+   using BlockArrays = std::vector< std::shared_ptr<const BlockArray> >;
+
+   void GetBlockArrays(TrackList *tracks, BlockArrays &arrays)
+   {
+      arrays.clear();
+      TrackListOfKindIterator iter(Track::Wave, tracks);
+      for (Track *t = iter.First(); t; t = iter.Next()) {
+         WaveClipList::compatibility_iterator it =
+            static_cast<WaveTrack*>(t)->GetClipIterator();
+         for (; it; it = it->GetNext())
+            arrays.push_back(
+               it->GetData()->GetSequence()->GetSharedBlockArray());
+      }
+   }
+}
+
+// Sets of block files, built as needed for arrays of the states and
+// kept for as long as the arrays live, so that the space of a state is
+// found in time proportional to what it changed
+struct UndoManager::SpaceCache {
+   std::map<const BlockArray*, BlockFileSet> sets;
+
+   const Set &FilesOf(const std::shared_ptr<const BlockArray> &array)
+   {
+      BlockFileSet &set = sets[array.get()];
+      // The address may be that of a dead array
+      if (set.array.lock() != array) {
+         set.array = array;
+         set.files.clear();
+         for (const auto &block : *array)
+            set.files.insert(block.f);
+      }
+      return set.files;
+   }
+
+   void Prune()
+   {
+      for (auto it = sets.begin(); it != sets.end();) {
+         if (it->second.array.expired())
+            it = sets.erase(it);
+         else
+            ++it;
+      }
+   }
 };
 
 UndoManager::UndoManager()
+   : mSpaceCache(std::make_unique<SpaceCache>())
 {
    current = -1;
    saved = -1;
@@ -72,53 +130,59 @@ UndoManager::~UndoManager()
 void UndoManager::CalculateSpaceUsage()
 {
    TIMER_START( "CalculateSpaceUsage", space_calc );
-   TrackListOfKindIterator iter(Track::Wave);
 
-   space.clear();
-   space.resize(stack.size(), 0);
+   mSpaceCache->Prune();
 
-   Set s1, s2;
-   Set *prev = &s1;
-   Set *cur = &s2;
+   BlockArrays prev, cur;
+   std::vector<const Set*> prevSets;
+   std::set<const BlockArray*> prevArrays;
+   Set counted;
 
    for (size_t i = 0, cnt = stack.size(); i < cnt; i++)
    {
-      // Swap map pointers
-      std::swap(cur, prev);
-
-      // And clean out the NEW current map
-      cur->clear();
+      UndoStackElem &elem = *stack[i];
+      if (elem.spaceUsage >= 0)
+         continue;
+
+      GetBlockArrays(elem.state.tracks.get(), cur);
+      if (i > 0)
+         GetBlockArrays(stack[i - 1]->state.tracks.get(), prev);
+      else
+         prev.clear();
+
+      prevSets.clear();
+      prevArrays.clear();
+      for (const auto &array : prev) {
+         prevSets.push_back(&mSpaceCache->FilesOf(array));
+         prevArrays.insert(array.get());
+      }
 
-      // Scan all tracks at current level
-      WaveTrack *wt = (WaveTrack *) iter.First(stack[i]->state.tracks.get());
-      while (wt)
+      counted.clear();
+      wxLongLong_t space = 0;
+      for (const auto &array : cur)
       {
-         // Scan all clips within current track
-         WaveClipList::compatibility_iterator it = wt->GetClipIterator();
-         while (it)
+         // An array shared with the previous level adds nothing
+         if (prevArrays.count(array.get()))
+            continue;
+
+         for (const auto &block : *array)
          {
-            // Scan all blockfiles within current clip
-            BlockArray *blocks = it->GetData()->GetSequenceBlockArray();
-            for (const auto &block : *blocks)
-            {
-               BlockFile *file = block.f;
-
-               // Accumulate space used by the file if the file didn't exist
-               // in the previous level
-               if (prev->count(file) == 0 && cur->count(file) == 0)
-               {
-                  space[i] += file->GetSpaceUsage().GetValue();
-               }
-               
-               // Add file to current set
-               cur->insert(file);
-            }
-            
-            it = it->GetNext();
+            BlockFile *file = block.f;
+            if (counted.count(file))
+               continue;
+            counted.insert(file);
+
+            // Accumulate space used by the file if the file didn't exist
+            // in the previous level
+            bool found = false;
+            for (const Set *set : prevSets)
+               if ((found = (set->count(file) > 0)))
+                  break;
+            if (!found)
+               space += file->GetSpaceUsage().GetValue();
          }
-
-         wt = (WaveTrack *) iter.Next();
       }
+      elem.spaceUsage = space;
    }
 
    TIMER_STOP( space_calc );
@@ -130,13 +194,15 @@ wxLongLong_t UndoManager::GetLongDescription(unsigned int n, wxString *desc,
    n -= 1; // 1 based to zero based
 
    wxASSERT(n < stack.size());
-   wxASSERT(space.size() == stack.size());
+
+   if (stack[n]->spaceUsage < 0)
+      CalculateSpaceUsage();
 
    *desc = stack[n]->description;
 
-   *size = Internat::FormatSize(space[n]);
+   *size = Internat::FormatSize(stack[n]->spaceUsage);
 
-   return space[n];
+   return stack[n]->spaceUsage;
 }
 
 void UndoManager::GetShortDescription(unsigned int n, wxString *desc)
@@ -160,6 +226,10 @@ void UndoManager::SetLongDescription(unsigned int n, const wxString &desc)
 void UndoManager::RemoveStateAt(int n)
 {
    stack.erase(stack.begin() + n);
+
+   // The space of the next state depends on the one before it
+   if (n < (int)stack.size())
+      stack[n]->spaceUsage = -1;
 }
 
 
@@ -224,6 +294,10 @@ void UndoManager::ModifyState(const TrackList * l,
    stack[current]->state.tags = tags;
 
    stack[current]->state.selectedRegion = selectedRegion;
+
+   stack[current]->spaceUsage = -1;
+   if (current + 1 < (int)stack.size())
+      stack[current + 1]->spaceUsage = -1;
    SonifyEndModifyState();
 }
 
@@ -9,8 +9,10 @@
   After each operation, call UndoManager's PushState, pass it
   the entire track hierarchy.  The UndoManager makes a duplicate
   of every single track using its Duplicate method, which should
-  increment reference counts.  If we were not at the top of
-  the stack when this is called, DELETE above first.
+  increment reference counts.  Wave tracks share their block
+  arrays with their duplicates until either is edited, so this
+  costs little.  If we were not at the top of the stack when this
+  is called, DELETE above first.
 
   If a minor change is made, for example changing the visual
   display of a track or changing the selection, you can call
@@ -73,8 +75,6 @@ struct UndoState {
 
 using UndoStack = std::vector <movable_ptr<UndoStackElem>>;
 
-using SpaceArray = std::vector <wxLongLong_t> ;
-
 // These flags control what extra to do on a PushState
 // Default is AUTOSAVE
 // Frequent/faster actions use CONSOLIDATE
@@ -121,6 +121,9 @@ class AUDACITY_DLL_API UndoManager {
    bool UnsavedChanges();
    void StateSaved();
 
+   // Finds the space used by the states changed since the last call.
+   // The space of a state is that of the block files it adds to the
+   // state before it.
    void CalculateSpaceUsage();
 
    // void Debug(); // currently unused
@@ -138,7 +141,8 @@ class AUDACITY_DLL_API UndoManager {
    wxString lastAction;
    int consolidationCount;
 
-   SpaceArray space;
+   struct SpaceCache;
+   std::unique_ptr<SpaceCache> mSpaceCache;
 
    bool mODChanges;
    ODLock mODChangesMutex;//mODChanges is accessed from many threads.
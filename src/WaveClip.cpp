@@ -28,12 +28,15 @@
 #include <wx/log.h>
 
 #include "Sequence.h"
+#include "DirManager.h"
+#include "DisplayCache.h"
 #include "Spectrum.h"
 #include "Prefs.h"
 #include "Envelope.h"
 #include "Resample.h"
 #include "Project.h"
 #include "WaveTrack.h"
+#include "WorkerPool.h"
 
 #include "prefs/SpectrogramSettings.h"
 
@@ -354,6 +357,12 @@ bool WaveClip::GetSamples(samplePtr buffer, sampleFormat format,
    return mSequence->Get(buffer, format, start, len);
 }
 
+const float *WaveClip::GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                       std::shared_ptr<const void> &holder) const
+{
+   return mSequence->GetFloatsNoCopy(start, len, holder);
+}
+
 bool WaveClip::SetSamples(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len)
 {
@@ -362,7 +371,7 @@ bool WaveClip::SetSamples(samplePtr buffer, sampleFormat format,
    return bResult;
 }
 
-BlockArray* WaveClip::GetSequenceBlockArray()
+const BlockArray* WaveClip::GetSequenceBlockArray() const
 {
    return &mSequence->GetBlockArray();
 }
@@ -784,7 +793,8 @@ bool SpecCache::CalculateOneSpectrum
     double offset, double rate, double pixelsPerSecond,
     int lowerBoundX, int upperBoundX,
     const std::vector<float> &gainFactors,
-    float *scratch)
+    float *scratch,
+    std::vector<Reassignment> *reassignments)
 {
    bool result = false;
    const bool reassignment =
@@ -933,9 +943,14 @@ bool SpecCache::CalculateOneSpectrum
                }
 
                int correctedX = (floor(0.5 + xx + timeCorrection * pixelsPerSecond / rate));
-               if (correctedX >= lowerBoundX && correctedX < upperBoundX)
-                  result = true,
-                  freq[half * correctedX + bin] += power;
+               if (correctedX >= lowerBoundX && correctedX < upperBoundX) {
+                  result = true;
+                  const int index = half * correctedX + bin;
+                  if (reassignments)
+                     reassignments->push_back({ index, power });
+                  else
+                     freq[index] += power;
+               }
             }
          }
       }
@@ -966,11 +981,38 @@ bool SpecCache::CalculateOneSpectrum
    return result;
 }
 
+int SpecCache::sWorkerThreads = 0;
+std::unique_ptr<WorkerPool> SpecCache::sWorkerPool;
+
+void SpecCache::SetWorkerThreads(int nThreads)
+{
+   if (nThreads != sWorkerThreads)
+      sWorkerPool.reset();
+   sWorkerThreads = nThreads;
+}
+
+void SpecCache::ReleaseWorkerPool()
+{
+   sWorkerPool.reset();
+}
+
+// The pool, made on first use, so that repaints do not start and end
+// threads each time; NULL if it would have no threads of its own
+WorkerPool *SpecCache::GetWorkerPool()
+{
+   if (!sWorkerPool)
+      sWorkerPool = std::make_unique<WorkerPool>(sWorkerThreads);
+   if (sWorkerPool->GetThreadCount() < 2)
+      return NULL;
+   return sWorkerPool.get();
+}
+
 void SpecCache::Populate
    (const SpectrogramSettings &settings, WaveTrackCache &waveTrackCache,
     int copyBegin, int copyEnd, int numPixels,
     sampleCount numSamples,
-    double offset, double rate, double pixelsPerSecond)
+    double offset, double rate, double pixelsPerSecond,
+    const std::vector<char> *found)
 {
 #ifdef EXPERIMENTAL_USE_REALFFTF
    settings.CacheWindows();
@@ -1001,17 +1043,66 @@ void SpecCache::Populate
    if (!autocorrelation)
       ComputeSpectrogramGainFactors(fftLen, rate, frequencyGain, gainFactors);
 
+   // Columns are handed to the threads in chunks of this many
+   const int chunkSize = 16;
+
+   // Use threads only when there are chunks enough to share; each
+   // thread needs its own scratch and its own cache of samples
+   WorkerPool *pool = NULL;
+   std::vector< std::vector<float> > buffers;
+   std::vector< std::unique_ptr<WaveTrackCache> > caches;
+   if (sWorkerThreads != 1 &&
+       numPixels - (copyEnd - copyBegin) >= 2 * chunkSize) {
+      pool = GetWorkerPool();
+      if (pool) {
+         // Thread 0 is this one, which uses buffer and waveTrackCache
+         buffers.resize(pool->GetThreadCount());
+         caches.resize(pool->GetThreadCount());
+         for (int ii = 1; ii < pool->GetThreadCount(); ++ii) {
+            buffers[ii].resize(buffer.size());
+            caches[ii] = std::make_unique<WaveTrackCache>(waveTrackCache.GetTrack());
+         }
+      }
+   }
+
    // Loop over the ranges before and after the copied portion and compute anew.
    // One of the ranges may be empty.
    for (int jj = 0; jj < 2; ++jj) {
       const int lowerBoundX = jj == 0 ? 0 : copyEnd;
       const int upperBoundX = jj == 0 ? copyBegin : numPixels;
-      for (sampleCount xx = lowerBoundX; xx < upperBoundX; ++xx)
-         CalculateOneSpectrum(
-            settings, waveTrackCache, xx, numSamples,
-            offset, rate, pixelsPerSecond,
-            lowerBoundX, upperBoundX,
-            gainFactors, &buffer[0]);
+      const int nChunks = (upperBoundX - lowerBoundX + chunkSize - 1) / chunkSize;
+      if (pool && nChunks > 1) {
+         std::vector< std::vector<Reassignment> >
+            reassignments(reassignment ? nChunks : 0);
+         pool->ParallelFor(nChunks, [&](int chunk, int thread) {
+            const int begin = lowerBoundX + chunk * chunkSize;
+            const int end = std::min(begin + chunkSize, upperBoundX);
+            for (int xx = begin; xx < end; ++xx)
+               if (!(found && (*found)[xx]))
+                  CalculateOneSpectrum(
+                     settings, thread == 0 ? waveTrackCache : *caches[thread],
+                     xx, numSamples,
+                     offset, rate, pixelsPerSecond,
+                     lowerBoundX, upperBoundX,
+                     gainFactors, thread == 0 ? &buffer[0] : &buffers[thread][0],
+                     reassignment ? &reassignments[chunk] : NULL);
+         });
+
+         // Sum the reassigned powers chunk by chunk, which is the order
+         // of the serial loop
+         for (const auto &list : reassignments)
+            for (const auto &item : list)
+               freq[item.index] += item.power;
+      }
+      else {
+         for (sampleCount xx = lowerBoundX; xx < upperBoundX; ++xx)
+            if (!(found && (*found)[xx]))
+               CalculateOneSpectrum(
+                  settings, waveTrackCache, xx, numSamples,
+                  offset, rate, pixelsPerSecond,
+                  lowerBoundX, upperBoundX,
+                  gainFactors, &buffer[0]);
+      }
 
       if (reassignment) {
          // Need to look beyond the edges of the range to accumulate more
@@ -1153,10 +1244,40 @@ bool WaveClip::GetSpectrogram(WaveTrackCache &waveTrackCache,
          half * (copyEnd - copyBegin) * sizeof(float));
    }
 
+   // Columns not copied may have been stored on disk before, unless
+   // reassignment, which spreads power among neighbors, is in use
+   std::unique_ptr<DisplayCache::Spectrum> stored;
+   std::vector<char> found;
+   DisplayCache *const displayCache = mSequence->GetDirManager()->GetDisplayCache();
+   if (displayCache &&
+       settings.algorithm != SpectrogramSettings::algReassignment) {
+      const double offsetSamples = mOffset * mRate;
+      const SpectrumCacheKey key = {
+         settings.algorithm, windowType, windowSize, zeroPaddingFactor,
+         frequencyGain, double(mRate), offsetSamples - floor(offsetSamples)
+      };
+      stored = std::make_unique<DisplayCache::Spectrum>(
+         *displayCache, key, mSequence->GetBlockArray(),
+         mSequence->GetNumSamples(), samplesPerPixel, half);
+      found.resize(numPixels);
+      stored->Read(&mSpecCache->where[0], 0, copyBegin,
+                   &mSpecCache->freq[0], found);
+      stored->Read(&mSpecCache->where[0], copyEnd, numPixels,
+                   &mSpecCache->freq[0], found);
+   }
+
    mSpecCache->Populate
       (settings, waveTrackCache, copyBegin, copyEnd, numPixels,
        mSequence->GetNumSamples(),
-       mOffset, mRate, pixelsPerSecond);
+       mOffset, mRate, pixelsPerSecond,
+       stored ? &found : NULL);
+
+   if (stored) {
+      stored->Write(&mSpecCache->where[0], 0, copyBegin,
+                    &mSpecCache->freq[0], found);
+      stored->Write(&mSpecCache->where[0], copyEnd, numPixels,
+                    &mSpecCache->freq[0], found);
+   }
 
    mSpecCache->dirty = mDirty;
    spectrogram = &mSpecCache->freq[0];
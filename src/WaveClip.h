@@ -38,6 +38,7 @@ class Sequence;
 class SpectrogramSettings;
 class WaveCache;
 class WaveTrackCache;
+class WorkerPool;
 
 class SpecCache {
 public:
@@ -93,6 +94,16 @@ public:
    bool Matches(int dirty_, double pixelsPerSecond,
       const SpectrogramSettings &settings, double rate) const;
 
+   // Power that the reassignment algorithm adds to an element of freq.
+   // Columns computed in parallel record these, so that the sums can be
+   // made afterward in the same order as in a serial loop.
+   struct Reassignment {
+      int index;
+      double power;
+   };
+
+   // If reassignments is not null, records the reassigned powers there
+   // instead of adding them to freq
    bool CalculateOneSpectrum
       (const SpectrogramSettings &settings,
        WaveTrackCache &waveTrackCache,
@@ -100,13 +111,27 @@ public:
        double offset, double rate, double pixelsPerSecond,
        int lowerBoundX, int upperBoundX,
        const std::vector<float> &gainFactors,
-       float *scratch);
+       float *scratch,
+       std::vector<Reassignment> *reassignments = NULL);
 
+   // Computes the columns outside [copyBegin, copyEnd), on several
+   // threads when there are enough of them.  The results do not depend
+   // on the number of threads.  Columns marked in found, which is only
+   // for algorithms without reassignment, are skipped.
    void Populate
       (const SpectrogramSettings &settings, WaveTrackCache &waveTrackCache,
        int copyBegin, int copyEnd, int numPixels,
        sampleCount numSamples,
-       double offset, double rate, double pixelsPerSecond);
+       double offset, double rate, double pixelsPerSecond,
+       const std::vector<char> *found = NULL);
+
+   /// Total threads Populate() may use, including the caller; 0, the
+   /// default, means one per CPU.  The threads are started when first
+   /// needed and kept for later calls, until the number changes.
+   static void SetWorkerThreads(int nThreads);
+   static int GetWorkerThreads() { return sWorkerThreads; }
+   /// Ends the threads, if any; call before exit
+   static void ReleaseWorkerPool();
 
    const int          len; // counts pixels, not samples
    const int          algorithm;
@@ -120,6 +145,12 @@ public:
    std::vector<sampleCount> where;
 
    int          dirty;
+
+private:
+   static WorkerPool *GetWorkerPool();
+
+   static int sWorkerThreads;
+   static std::unique_ptr<WorkerPool> sWorkerPool;
 };
 
 class SpecPxCache {
@@ -250,12 +281,14 @@ public:
 
    bool GetSamples(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len) const;
+   const float *GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                std::shared_ptr<const void> &holder) const;
    bool SetSamples(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len);
 
    Envelope* GetEnvelope() { return mEnvelope; }
    const Envelope* GetEnvelope() const { return mEnvelope; }
-   BlockArray* GetSequenceBlockArray();
+   const BlockArray* GetSequenceBlockArray() const;
 
    // Get low-level access to the sequence. Whenever possible, don't use this,
    // but use more high-level functions inside WaveClip (or add them if you
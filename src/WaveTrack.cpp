@@ -2082,6 +2082,20 @@ bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
    return true;
 }
 
+const float *WaveTrack::GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                       std::shared_ptr<const void> &holder) const
+{
+   for (WaveClipList::compatibility_iterator it =
+           const_cast<WaveTrack&>(*this).GetClipIterator(); it; it = it->GetNext())
+   {
+      const WaveClip *const clip = it->GetData();
+      const sampleCount clipStart = clip->GetStartSample();
+      if (start >= clipStart && start+len <= clip->GetEndSample())
+         return clip->GetFloatsNoCopy(start - clipStart, len, holder);
+   }
+   return NULL;
+}
+
 bool WaveTrack::Set(samplePtr buffer, sampleFormat format,
                     sampleCount start, sampleCount len)
 {
@@ -2736,10 +2750,8 @@ constSamplePtr WaveTrackCache::Get(sampleFormat format,
          if (start0 >= 0) {
             const sampleCount len0 = mPTrack->GetBestBlockSize(start0);
             wxASSERT(len0 <= mBufferSize);
-            if (!mPTrack->Get(samplePtr(mBuffers[0].data), floatSample, start0, len0))
+            if (!Fill(mBuffers[0], start0, len0))
                return 0;
-            mBuffers[0].start = start0;
-            mBuffers[0].len = len0;
             if (!fillSecond &&
                 mBuffers[0].end() != mBuffers[1].start)
                fillSecond = true;
@@ -2762,10 +2774,8 @@ constSamplePtr WaveTrackCache::Get(sampleFormat format,
             if (start1 == end0) {
                const sampleCount len1 = mPTrack->GetBestBlockSize(start1);
                wxASSERT(len1 <= mBufferSize);
-               if (!mPTrack->Get(samplePtr(mBuffers[1].data), floatSample, start1, len1))
+               if (!Fill(mBuffers[1], start1, len1))
                   return 0;
-               mBuffers[1].start = start1;
-               mBuffers[1].len = len1;
                mNValidBuffers = 2;
             }
          }
@@ -2794,7 +2804,7 @@ constSamplePtr WaveTrackCache::Get(sampleFormat format,
          const sampleCount leni = std::min(remaining, mBuffers[ii].len - starti);
          if (leni == len) {
             // All is contiguous already.  We can completely avoid copying
-            return samplePtr(mBuffers[ii].data + starti);
+            return samplePtr(mBuffers[ii].view + starti);
          }
          else if (leni > 0) {
             if (buffer == 0) {
@@ -2802,7 +2812,7 @@ constSamplePtr WaveTrackCache::Get(sampleFormat format,
                buffer = mOverlapBuffer.ptr();
             }
             const size_t size = sizeof(float) * leni;
-            memcpy(buffer, mBuffers[ii].data + starti, size);
+            memcpy(buffer, mBuffers[ii].view + starti, size);
             remaining -= leni;
             start += leni;
             buffer += size;
@@ -2827,6 +2837,21 @@ constSamplePtr WaveTrackCache::Get(sampleFormat format,
       return 0;
 }
 
+bool WaveTrackCache::Fill(Buffer &buffer, sampleCount start, sampleCount len)
+{
+   // Borrow the samples if the block file has them in memory as floats
+   buffer.view = mPTrack->GetFloatsNoCopy(start, len, buffer.holder);
+   if (!buffer.view) {
+      buffer.holder.reset();
+      if (!mPTrack->Get(samplePtr(buffer.data), floatSample, start, len))
+         return false;
+      buffer.view = buffer.data;
+   }
+   buffer.start = start;
+   buffer.len = len;
+   return true;
+}
+
 void WaveTrackCache::Free()
 {
    mBuffers[0].Free();
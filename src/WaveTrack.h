@@ -237,6 +237,10 @@ class AUDACITY_DLL_API WaveTrack final : public Track {
    ///
    bool Get(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len, fillFormat fill=fillZero) const;
+   /// Returns a pointer to the float samples without copying them, or NULL
+   /// if they are not all in one clip and one block that can lend them.
+   const float *GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                std::shared_ptr<const void> &holder) const;
    bool Set(samplePtr buffer, sampleFormat format,
                    sampleCount start, sampleCount len);
    void GetEnvelopeValues(double *buffer, int bufferLen,
@@ -554,14 +558,20 @@ private:
 
    struct Buffer {
       float *data;
+      // Where the samples are: data, or memory borrowed from the block
+      const float *view;
+      // Keeps borrowed memory valid
+      std::shared_ptr<const void> holder;
       sampleCount start;
       sampleCount len;
 
-      Buffer() : data(0), start(0), len(0) {}
-      void Free() { delete[] data; data = 0; start = 0; len = 0; }
+      Buffer() : data(0), view(0), start(0), len(0) {}
+      void Free() { delete[] data; data = 0; view = 0; holder.reset(); start = 0; len = 0; }
       sampleCount end() const { return start + len; }
    };
 
+   bool Fill(Buffer &buffer, sampleCount start, sampleCount len);
+
    const WaveTrack *mPTrack;
    sampleCount mBufferSize;
    Buffer mBuffers[2];
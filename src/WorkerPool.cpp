@@ -0,0 +1,172 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  WorkerPool.cpp
+
+*******************************************************************//**
+
+\class WorkerPool
+\brief Runs the iterations of a loop on a fixed set of threads.
+
+  The threads sleep on a condition variable between calls to
+  ParallelFor(), so an idle pool costs nothing.
+
+*//*******************************************************************/
+
+#include "WorkerPool.h"
+
+class WorkerPoolThread final : public wxThread
+{
+public:
+   WorkerPoolThread(WorkerPool *pool, int index)
+      : wxThread(wxTHREAD_JOINABLE)
+      , mPool(pool)
+      , mIndex(index)
+   {}
+
+   void *Entry() override
+   {
+      mPool->ThreadLoop(mIndex);
+      return NULL;
+   }
+
+private:
+   WorkerPool *mPool;
+   int mIndex;
+};
+
+WorkerPool::WorkerPool(int nThreads)
+   : mStartCondition(mMutex)
+   , mDoneCondition(mMutex)
+   , mGeneration(0)
+   , mBusy(0)
+   , mExiting(false)
+   , mFunction(NULL)
+   , mCount(0)
+   , mNext(0)
+{
+   if (nThreads <= 0)
+      nThreads = GetDefaultThreadCount();
+
+   for (int i = 1; i < nThreads; i++) {
+      WorkerPoolThread *thread = new WorkerPoolThread(this, i);
+      if (thread->Create() != wxTHREAD_NO_ERROR) {
+         delete thread;
+         break;
+      }
+      thread->Run();
+      mThreads.push_back(thread);
+   }
+}
+
+WorkerPool::~WorkerPool()
+{
+   {
+      wxMutexLocker locker(mMutex);
+      mExiting = true;
+      mStartCondition.Broadcast();
+   }
+
+   for (size_t i = 0; i < mThreads.size(); i++) {
+      mThreads[i]->Wait();
+      delete mThreads[i];
+   }
+}
+
+int WorkerPool::GetDefaultThreadCount()
+{
+   int count = wxThread::GetCPUCount();
+   return count > 0 ? count : 1;
+}
+
+void WorkerPool::ParallelFor(int count, const Function &fn)
+{
+   if (count <= 0)
+      return;
+
+   // Not worth waking anyone for a single iteration
+   if (mThreads.empty() || count == 1) {
+      for (int i = 0; i < count; i++)
+         fn(i, 0);
+      return;
+   }
+
+   {
+      wxMutexLocker locker(mMutex);
+      mFunction = &fn;
+      mCount = count;
+      mNext.store(0);
+      mBusy = (int)mThreads.size();
+      mGeneration++;
+      mStartCondition.Broadcast();
+   }
+
+   RunIterations(0);
+
+   wxMutexLocker locker(mMutex);
+   while (mBusy > 0)
+      mDoneCondition.Wait();
+   mFunction = NULL;
+}
+
+void WorkerPool::ParallelFor(int count, const Function &fn,
+                             const IdleFunction &idle, int intervalMs)
+{
+   if (count <= 0)
+      return;
+
+   if (mThreads.empty()) {
+      for (int i = 0; i < count; i++) {
+         fn(i, 0);
+         idle();
+      }
+      return;
+   }
+
+   wxMutexLocker locker(mMutex);
+   mFunction = &fn;
+   mCount = count;
+   mNext.store(0);
+   mBusy = (int)mThreads.size();
+   mGeneration++;
+   mStartCondition.Broadcast();
+
+   while (mBusy > 0) {
+      if (mDoneCondition.WaitTimeout(intervalMs) == wxCOND_TIMEOUT && mBusy > 0) {
+         mMutex.Unlock();
+         idle();
+         mMutex.Lock();
+      }
+   }
+   mFunction = NULL;
+}
+
+void WorkerPool::RunIterations(int thread)
+{
+   int i;
+   while ((i = mNext.fetch_add(1)) < mCount)
+      (*mFunction)(i, thread);
+}
+
+void WorkerPool::ThreadLoop(int thread)
+{
+   unsigned seen = 0;
+
+   mMutex.Lock();
+   while (true) {
+      while (!mExiting && mGeneration == seen)
+         mStartCondition.Wait();
+      if (mExiting)
+         break;
+      seen = mGeneration;
+
+      mMutex.Unlock();
+      RunIterations(thread);
+      mMutex.Lock();
+
+      if (--mBusy == 0)
+         mDoneCondition.Signal();
+   }
+   mMutex.Unlock();
+}
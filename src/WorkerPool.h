@@ -0,0 +1,85 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  WorkerPool.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_WORKER_POOL__
+#define __AUDACITY_WORKER_POOL__
+
+#include "Audacity.h"
+#include "MemoryX.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <wx/thread.h>
+
+class WorkerPoolThread;
+
+/// A small fixed set of threads that run the iterations of a loop in
+/// parallel.  ParallelFor() hands out the indices one at a time, so
+/// the work is balanced even when iterations differ in cost; the
+/// calling thread takes part too, and the call returns only when every
+/// iteration has finished.  Any combining of results that must be
+/// deterministic is left to the caller, after ParallelFor() returns.
+class AUDACITY_DLL_API WorkerPool
+{
+public:
+   /// @param nThreads total threads to use, including the caller;
+   /// 0 means one per CPU.
+   explicit WorkerPool(int nThreads = 0);
+   ~WorkerPool();
+
+   /// Total number of threads that run iterations, including the caller.
+   int GetThreadCount() const { return (int)mThreads.size() + 1; }
+
+   /// Calls fn(i, thread) once for every i in [0, count).  thread is in
+   /// [0, GetThreadCount()) and identifies the thread making the call, so
+   /// that fn can use scratch space belonging to that thread.  Must not
+   /// be called from inside fn, nor from two threads at once.
+   using Function = std::function<void(int i, int thread)>;
+   void ParallelFor(int count, const Function &fn);
+
+   /// Like ParallelFor(), except that the calling thread runs no
+   /// iterations, but calls idle() every intervalMs milliseconds until
+   /// they have all finished, as to update a progress dialog.  If the
+   /// pool has no threads of its own, the caller runs the iterations
+   /// itself, and calls idle() between them.
+   using IdleFunction = std::function<void()>;
+   void ParallelFor(int count, const Function &fn,
+                    const IdleFunction &idle, int intervalMs);
+
+   /// Number of threads to use when the user asks for "automatic".
+   static int GetDefaultThreadCount();
+
+private:
+   friend class WorkerPoolThread;
+
+   void RunIterations(int thread);
+   void ThreadLoop(int thread);
+
+   std::vector<WorkerPoolThread *> mThreads;
+
+   wxMutex mMutex;
+   wxCondition mStartCondition;
+   wxCondition mDoneCondition;
+
+   // These are guarded by mMutex
+   unsigned mGeneration;
+   int mBusy;
+   bool mExiting;
+
+   // These are set before waking the threads, and read by them after
+   const Function *mFunction;
+   int mCount;
+   std::atomic<int> mNext;
+
+   WorkerPool(const WorkerPool&) PROHIBITED;
+   WorkerPool &operator= (const WorkerPool&) PROHIBITED;
+};
+
+#endif
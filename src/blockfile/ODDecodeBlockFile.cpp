@@ -29,6 +29,7 @@ The summary is eventually computed and written to a file in a background thread.
 
 #include "../FileFormats.h"
 #include "../Internat.h"
+#include "../SummaryKernels.h"
 
 const int bheaderTagLen = 20;
 char bheaderTag[bheaderTagLen + 1] = "AudacityBlockFile112";
@@ -416,37 +417,14 @@ void *ODDecodeBlockFile::CalcSummary(samplePtr buffer, sampleCount len,
                (samplePtr)fbuffer, floatSample, len);
    }
    sampleCount sumLen;
-   sampleCount i, j, jcount;
+   sampleCount i, j;
 
    float min, max;
    float sumsq;
 
    // Recalc 256 summaries
    sumLen = (len + 255) / 256;
-
-
-   for (i = 0; i < sumLen; i++) {
-      min = fbuffer[i * 256];
-      max = fbuffer[i * 256];
-      sumsq = ((float)min) * ((float)min);
-      jcount = 256;
-      if (i * 256 + jcount > len)
-         jcount = len - i * 256;
-      for (j = 1; j < jcount; j++) {
-         float f1 = fbuffer[i * 256 + j];
-         sumsq += ((float)f1) * ((float)f1);
-         if (f1 < min)
-            min = f1;
-         else if (f1 > max)
-            max = f1;
-      }
-
-      float rms = (float)sqrt(sumsq / jcount);
-
-      summary256[i * 3] = min;
-      summary256[i * 3 + 1] = max;
-      summary256[i * 3 + 2] = rms;
-   }
+   SummaryKernels::SummaryFrames(fbuffer, len, 256, summary256);
 
    for (i = sumLen; i < mSummaryInfo.frames256; i++) {
       // filling in the remaining bits with non-harming/contributing values
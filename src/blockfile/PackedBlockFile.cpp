@@ -0,0 +1,546 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  PackedBlockFile.cpp
+
+*******************************************************************//**
+
+\class PackedBlockFile
+\brief A BlockFile stored as a record in a BlockPack instead of a file
+of its own.
+
+  A long project in separate .au files needs hundreds of thousands of
+  files, and saving, copying and checking the project then spend most
+  of their time on directory entries.  Packed block files are written
+  one after another into a few large pack files in the project data
+  directory.
+
+  The project XML is the index: each <packedblockfile> tag names its
+  pack and the offset of its record.  While the project is open each
+  BlockPack also counts the block files using each record, so that the
+  space of deleted blocks is reused.  Records of a saved project stay
+  in use for as long as the project keeps its last saved tracks, just
+  as their .au files would stay on disk.
+
+*//****************************************************************//**
+
+\class BlockPack
+\brief One pack file of PackedBlockFile records, with an index of the
+records in use.
+
+*//****************************************************************//**
+
+\class BlockPackStore
+\brief The BlockPacks a DirManager adds new records to.
+
+  Packs are shared by path between all stores, so that two projects
+  using the same pack (through the clipboard, for instance) also share
+  its index.
+
+*//*******************************************************************/
+
+#include "../Audacity.h"
+#include "PackedBlockFile.h"
+
+#include <algorithm>
+#include <wx/filefn.h>
+#include <wx/log.h>
+
+#include "SimpleBlockFile.h"
+#include "../FileFormats.h"
+#include "../Internat.h"
+
+namespace {
+   // Every live pack, whichever store found or created it
+   ODLock &PacksLock()
+   {
+      static ODLock lock;
+      return lock;
+   }
+   std::vector< std::weak_ptr<BlockPack> > &OpenPacks()
+   {
+      static std::vector< std::weak_ptr<BlockPack> > packs;
+      return packs;
+   }
+
+   // Returns the live pack with the given path, if any.
+   // The caller holds PacksLock().
+   std::shared_ptr<BlockPack> FindOpenPack(const wxString &path)
+   {
+      std::vector< std::weak_ptr<BlockPack> > &packs = OpenPacks();
+      for (size_t i = 0; i < packs.size(); i++) {
+         std::shared_ptr<BlockPack> pack = packs[i].lock();
+         if (!pack) {
+            packs.erase(packs.begin() + i--);
+            continue;
+         }
+         if (pack->GetPath() == path)
+            return pack;
+      }
+      return {};
+   }
+}
+
+BlockPack::BlockPack(const wxString &path)
+   : mPath(path)
+{
+}
+
+BlockPack::~BlockPack()
+{
+   Close();
+}
+
+wxString BlockPack::GetPath()
+{
+   ODLocker locker{ &mLock };
+   return mPath;
+}
+
+wxString BlockPack::GetName()
+{
+   ODLocker locker{ &mLock };
+   return wxFileName(mPath).GetFullName();
+}
+
+bool BlockPack::Open()
+{
+   if (mFile.IsOpened())
+      return true;
+
+   if (!wxFileExists(mPath)) {
+      wxFile create;
+      if (!create.Create(mPath))
+         return false;
+   }
+   return mFile.Open(mPath, wxFile::read_write);
+}
+
+void BlockPack::Close()
+{
+   if (mFile.IsOpened())
+      mFile.Close();
+}
+
+bool BlockPack::Reserve(size_t bytes, wxFileOffset limit, wxFileOffset &offset)
+{
+   ODLocker locker{ &mLock };
+
+   // First fit, so that the file grows only when no freed record
+   // has room
+   wxFileOffset end = 0;
+   for (auto it = mExtents.begin(); it != mExtents.end(); ++it) {
+      if (it->first - end >= (wxFileOffset)bytes)
+         break;
+      end = it->first + it->second.bytes;
+   }
+   auto next = mExtents.lower_bound(end);
+   if (next == mExtents.end() && end + (wxFileOffset)bytes > limit)
+      return false;
+
+   offset = end;
+   Extent extent = { bytes, 1 };
+   mExtents[offset] = extent;
+   return true;
+}
+
+void BlockPack::AddRef(wxFileOffset offset, size_t bytes)
+{
+   ODLocker locker{ &mLock };
+
+   auto it = mExtents.find(offset);
+   if (it != mExtents.end())
+      it->second.refs++;
+   else {
+      Extent extent = { bytes, 1 };
+      mExtents[offset] = extent;
+   }
+}
+
+void BlockPack::Release(wxFileOffset offset)
+{
+   ODLocker locker{ &mLock };
+
+   auto it = mExtents.find(offset);
+   wxASSERT(it != mExtents.end());
+   if (it == mExtents.end() || --it->second.refs > 0)
+      return;
+
+   mExtents.erase(it);
+   if (mExtents.empty()) {
+      // Like the last .au file of a directory, the pack goes
+      Close();
+      wxRemoveFile(mPath);
+   }
+}
+
+bool BlockPack::Write(wxFileOffset offset, const void *data, size_t bytes)
+{
+   ODLocker locker{ &mLock };
+
+   return Open() &&
+      mFile.Seek(offset) == offset &&
+      mFile.Write(data, bytes) == bytes;
+}
+
+bool BlockPack::Read(wxFileOffset offset, void *data, size_t bytes)
+{
+   ODLocker locker{ &mLock };
+
+   return Open() &&
+      mFile.Seek(offset) == offset &&
+      mFile.Read(data, bytes) == (ssize_t)bytes;
+}
+
+bool BlockPack::HasRecord(wxFileOffset offset, size_t bytes)
+{
+   ODLocker locker{ &mLock };
+
+   if (!wxFileExists(mPath))
+      return false;
+   wxFileName fn(mPath);
+   return fn.GetSize() >= wxULongLong(offset + bytes);
+}
+
+bool BlockPack::Relocate(const wxString &dir, bool copy)
+{
+   ODLocker locker{ &mLock };
+
+   wxFileName newPath(mPath);
+   newPath.SetPath(dir);
+   if (newPath.GetFullPath() == mPath)
+      return true;
+
+   Close();
+   if (wxFileExists(mPath)) {
+      bool success = copy
+         ? wxCopyFile(mPath, newPath.GetFullPath())
+         : wxRenameFile(mPath, newPath.GetFullPath());
+      if (!success)
+         return false;
+   }
+   mPath = newPath.GetFullPath();
+   return true;
+}
+
+const wxFileOffset BlockPackStore::MaxPackSize = 256 * 1024 * 1024;
+
+BlockPackStore::BlockPackStore()
+   : mNextPackNumber(0)
+{
+}
+
+BlockPackStore::~BlockPackStore()
+{
+}
+
+std::shared_ptr<BlockPack> BlockPackStore::Reserve(const wxString &dir,
+                                                   size_t bytes,
+                                                   wxFileOffset &offset)
+{
+   ODLocker locker{ &mLock };
+
+   for (size_t i = 0; i < mPacks.size(); i++) {
+      BlockPack *pack = mPacks[i].get();
+      if (wxFileName(pack->GetPath()).GetPath() == dir &&
+          pack->Reserve(bytes, MaxPackSize, offset))
+         return mPacks[i];
+   }
+
+   // Start a NEW pack, with a name nobody uses
+   std::shared_ptr<BlockPack> pack;
+   {
+      ODLocker packsLocker{ &PacksLock() };
+      wxFileName path;
+      do {
+         path.Assign(dir, wxString::Format(wxT("pack%04d.aupk"), mNextPackNumber++));
+      } while (path.FileExists() || FindOpenPack(path.GetFullPath()));
+
+      pack = std::make_shared<BlockPack>(path.GetFullPath());
+      OpenPacks().push_back(pack);
+   }
+   mPacks.push_back(pack);
+
+   pack->Reserve(bytes, std::max(MaxPackSize, (wxFileOffset)bytes), offset);
+   return pack;
+}
+
+std::shared_ptr<BlockPack> BlockPackStore::Find(const wxString &dir,
+                                                const wxString &name)
+{
+   ODLocker locker{ &mLock };
+
+   const wxString path = wxFileName(dir, name).GetFullPath();
+   std::shared_ptr<BlockPack> pack;
+   {
+      ODLocker packsLocker{ &PacksLock() };
+      pack = FindOpenPack(path);
+      if (!pack) {
+         pack = std::make_shared<BlockPack>(path);
+         OpenPacks().push_back(pack);
+      }
+   }
+
+   if (std::find(mPacks.begin(), mPacks.end(), pack) == mPacks.end())
+      mPacks.push_back(pack);
+   return pack;
+}
+
+bool BlockPackStore::Contains(const wxString &name)
+{
+   ODLocker locker{ &mLock };
+
+   for (size_t i = 0; i < mPacks.size(); i++)
+      if (mPacks[i]->GetName() == name)
+         return true;
+   return false;
+}
+
+/// Constructs a PackedBlockFile based on sample data and writes it
+/// into a pack.
+///
+/// @param name         The unique name of the block, from
+///                     DirManager::MakePackedBlockName()
+/// @param store        Chooses the pack
+/// @param dir          The project data directory
+/// @param sampleData   The sample data to be written to this block.
+/// @param sampleLen    The number of samples to be written to this block.
+/// @param format       The format of the given samples.
+PackedBlockFile::PackedBlockFile(wxFileNameWrapper &&name, BlockPackStore &store,
+                                 const wxString &dir,
+                                 samplePtr sampleData, sampleCount sampleLen,
+                                 sampleFormat format):
+   BlockFile(std::move(name), sampleLen),
+   mOffset(0),
+   mFormat(format)
+{
+   ArrayOf<char> cleanup;
+   void *summaryData = CalcSummary(sampleData, sampleLen, format, cleanup);
+
+   ArrayOf<char> image;
+   size_t bytes = SimpleBlockFile::MakeBlockImage(image, sampleData, sampleLen,
+      format, summaryData, mSummaryInfo.totalSummaryBytes);
+
+   mPack = store.Reserve(dir, bytes, mOffset);
+   bool bSuccess = mPack->Write(mOffset, image.get(), bytes);
+   wxASSERT(bSuccess); // TODO: Handle failure here by alert to user and undo partial op.
+   wxUnusedVar(bSuccess);
+}
+
+/// Construct a PackedBlockFile that refers to an existing record.
+PackedBlockFile::PackedBlockFile(wxFileNameWrapper &&name,
+                                 const std::shared_ptr<BlockPack> &pack,
+                                 wxFileOffset offset,
+                                 sampleCount len, sampleFormat format,
+                                 float min, float max, float rms):
+   BlockFile(std::move(name), len),
+   mPack(pack),
+   mOffset(offset),
+   mFormat(format)
+{
+   mMin = min;
+   mMax = max;
+   mRMS = rms;
+
+   if (mPack)
+      mPack->AddRef(mOffset, GetRecordSize());
+}
+
+PackedBlockFile::~PackedBlockFile()
+{
+   // A locked block belongs to a saved project, so its record must stay
+   if (mPack && !IsLocked())
+      mPack->Release(mOffset);
+
+   // There is no file of our name for ~BlockFile() to remove
+   Lock();
+}
+
+size_t PackedBlockFile::GetRecordSize() const
+{
+   const int bytesPerSample = (mFormat == int24Sample) ? 3 : SAMPLE_SIZE(mFormat);
+   return GetDataOffset() + mLen * bytesPerSample;
+}
+
+wxFileOffset PackedBlockFile::GetDataOffset() const
+{
+   return sizeof(auHeader) + mSummaryInfo.totalSummaryBytes;
+}
+
+bool PackedBlockFile::IsRecordPresent() const
+{
+   return mPack && mPack->HasRecord(mOffset, GetRecordSize());
+}
+
+/// Read the summary section of the record.
+///
+/// @param *data The buffer to write the data to.  It must be at least
+/// mSummaryinfo.totalSummaryBytes long.
+bool PackedBlockFile::ReadSummary(void *data)
+{
+   if (!mPack ||
+       !mPack->Read(mOffset + sizeof(auHeader), data, mSummaryInfo.totalSummaryBytes)) {
+      memset(data, 0, (size_t)mSummaryInfo.totalSummaryBytes);
+      // Leave it to ProjectFSCK() to report
+      return true;
+   }
+
+   FixSummary(data);
+   return true;
+}
+
+/// Read the data portion of the record, converting it to the given
+/// format as SimpleBlockFile does.
+///
+/// @param data   The buffer where the data will be stored
+/// @param format The format the data will be stored in
+/// @param start  The offset in this block file
+/// @param len    The number of samples to read
+int PackedBlockFile::ReadData(samplePtr data, sampleFormat format,
+                              sampleCount start, sampleCount len) const
+{
+   const int bytesPerSample = (mFormat == int24Sample) ? 3 : SAMPLE_SIZE(mFormat);
+   ArrayOf<char> stored(len * bytesPerSample);
+
+   if (!mPack ||
+       !mPack->Read(mOffset + GetDataOffset() + start * bytesPerSample,
+                    stored.get(), len * bytesPerSample)) {
+      if (!mSilentLog)
+         wxLogWarning(wxT("Could not read block %s from %s."),
+                      mFileName.GetName().c_str(),
+                      mPack ? mPack->GetPath().c_str() : wxT(""));
+      mSilentLog = TRUE;
+      ClearSamples(data, format, 0, len);
+      return len;
+   }
+   mSilentLog = FALSE;
+
+   SimpleBlockFile::ConvertStoredSamples(stored.get(), mFormat, data, format, len);
+   return len;
+}
+
+void PackedBlockFile::SaveXML(XMLWriter &xmlFile)
+{
+   xmlFile.StartTag(wxT("packedblockfile"));
+
+   xmlFile.WriteAttr(wxT("filename"), mFileName.GetFullName());
+   xmlFile.WriteAttr(wxT("pack"), mPack ? mPack->GetName() : wxString());
+   xmlFile.WriteAttr(wxT("offset"), (long long)mOffset);
+   xmlFile.WriteAttr(wxT("format"), (int)mFormat);
+   xmlFile.WriteAttr(wxT("len"), mLen);
+   xmlFile.WriteAttr(wxT("min"), mMin);
+   xmlFile.WriteAttr(wxT("max"), mMax);
+   xmlFile.WriteAttr(wxT("rms"), mRMS);
+
+   xmlFile.EndTag(wxT("packedblockfile"));
+}
+
+// BuildFromXML methods should always return a BlockFile, not NULL,
+// even if the result is flawed (e.g., refers to nonexistent file),
+// as testing will be done in DirManager::ProjectFSCK().
+/// static
+BlockFile *PackedBlockFile::BuildFromXML(DirManager &dm, const wxChar **attrs)
+{
+   wxFileNameWrapper fileName;
+   wxString packName;
+   wxLongLong_t offset = 0;
+   sampleFormat format = floatSample;
+   float min = 0.0f, max = 0.0f, rms = 0.0f;
+   sampleCount len = 0;
+   double dblValue;
+   long nValue;
+
+   while(*attrs)
+   {
+      const wxChar *attr =  *attrs++;
+      const wxChar *value = *attrs++;
+      if (!value)
+         break;
+
+      const wxString strValue = value;
+      if (!wxStricmp(attr, wxT("filename")) &&
+            // Can't use XMLValueChecker::IsGoodFileName here, but do part of its test.
+            XMLValueChecker::IsGoodFileString(strValue) &&
+            (strValue.Length() + 1 + dm.GetProjectDataDir().Length() <= PLATFORM_MAX_PATH))
+      {
+         if (!dm.AssignFile(fileName, strValue, false))
+            // Make sure fileName is back to uninitialized state so we can detect problem later.
+            fileName.Clear();
+      }
+      else if (!wxStricmp(attr, wxT("pack")) &&
+               XMLValueChecker::IsGoodFileName(strValue, dm.GetDataFilesDir()))
+         packName = strValue;
+      else if (!wxStrcmp(attr, wxT("offset")) &&
+               XMLValueChecker::IsGoodInt64(strValue) && strValue.ToLongLong(&offset) &&
+               offset >= 0)
+         ;
+      else if (!wxStrcmp(attr, wxT("format")) &&
+               XMLValueChecker::IsGoodInt(strValue) && strValue.ToLong(&nValue) &&
+               XMLValueChecker::IsValidSampleFormat(nValue))
+         format = (sampleFormat)nValue;
+      else if (!wxStrcmp(attr, wxT("len")) &&
+               XMLValueChecker::IsGoodInt(strValue) && strValue.ToLong(&nValue) &&
+               nValue > 0)
+         len = nValue;
+      else if (XMLValueChecker::IsGoodString(strValue) && Internat::CompatibleToDouble(strValue, &dblValue))
+      {  // double parameters
+         if (!wxStricmp(attr, wxT("min")))
+            min = dblValue;
+         else if (!wxStricmp(attr, wxT("max")))
+            max = dblValue;
+         else if (!wxStricmp(attr, wxT("rms")) && (dblValue >= 0.0))
+            rms = dblValue;
+      }
+   }
+
+   std::shared_ptr<BlockPack> pack;
+   if (!packName.IsEmpty())
+      pack = dm.GetBlockPacks().Find(dm.GetDataFilesDir(), packName);
+
+   return new PackedBlockFile(std::move(fileName), pack, offset, len, format,
+                              min, max, rms);
+}
+
+/// Create a copy of this BlockFile, sharing its record.
+///
+/// @param newFileName The unique name of the NEW block.
+BlockFile *PackedBlockFile::Copy(wxFileNameWrapper &&newFileName)
+{
+   return new PackedBlockFile(std::move(newFileName), mPack, mOffset,
+                              mLen, mFormat, mMin, mMax, mRMS);
+}
+
+PackedBlockFile *PackedBlockFile::CopyTo(wxFileNameWrapper &&newFileName,
+                                         BlockPackStore &store,
+                                         const wxString &dir) const
+{
+   SampleBuffer samples(mLen, mFormat);
+   ReadData(samples.ptr(), mFormat, 0, mLen);
+
+   return new PackedBlockFile(std::move(newFileName), store, dir,
+                              samples.ptr(), mLen, mFormat);
+}
+
+wxLongLong PackedBlockFile::GetSpaceUsage() const
+{
+   return GetRecordSize();
+}
+
+/// Write silence in place of a record missing from its pack, keeping its
+/// place so that the project XML stays valid.
+void PackedBlockFile::Recover()
+{
+   if (!mPack)
+      return;
+
+   SampleBuffer silence(mLen, mFormat);
+   ClearSamples(silence.ptr(), mFormat, 0, mLen);
+
+   ArrayOf<char> summary(mSummaryInfo.totalSummaryBytes, true);
+   ArrayOf<char> image;
+   size_t bytes = SimpleBlockFile::MakeBlockImage(image, silence.ptr(), mLen,
+      mFormat, summary.get(), mSummaryInfo.totalSummaryBytes);
+
+   mPack->Write(mOffset, image.get(), bytes);
+}
@@ -0,0 +1,153 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  PackedBlockFile.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PACKED_BLOCKFILE__
+#define __AUDACITY_PACKED_BLOCKFILE__
+
+#include <map>
+#include <vector>
+
+#include <wx/string.h>
+#include <wx/filename.h>
+#include <wx/file.h>
+
+#include "../BlockFile.h"
+#include "../DirManager.h"
+
+/// One large file holding the records of many PackedBlockFiles.  It
+/// keeps an index of the records in use, with the number of block files
+/// that share each; the space of a record nobody uses any more is
+/// reused for new ones.  All methods are thread-safe.
+class BlockPack
+{
+public:
+   explicit BlockPack(const wxString &path);
+   ~BlockPack();
+
+   wxString GetPath();
+   wxString GetName();
+
+   /// Claim room for a record at the first gap that fits, or at the end
+   /// if the file would stay within limit.  Returns false if neither.
+   bool Reserve(size_t bytes, wxFileOffset limit, wxFileOffset &offset);
+   /// Add a user to the record at offset, which must be of the given size
+   void AddRef(wxFileOffset offset, size_t bytes);
+   /// Remove a user; the space is free when none remain, and the file
+   /// is deleted when it holds no records at all.
+   void Release(wxFileOffset offset);
+
+   bool Write(wxFileOffset offset, const void *data, size_t bytes);
+   bool Read(wxFileOffset offset, void *data, size_t bytes);
+
+   /// True if the file is long enough to hold the record
+   bool HasRecord(wxFileOffset offset, size_t bytes);
+
+   /// Move or copy the file into another directory
+   bool Relocate(const wxString &dir, bool copy);
+
+private:
+   bool Open();
+   void Close();
+
+   struct Extent {
+      size_t bytes;
+      int refs;
+   };
+
+   ODLock mLock;
+   wxString mPath;
+   wxFile mFile;
+   std::map<wxFileOffset, Extent> mExtents;
+
+   BlockPack(const BlockPack&) PROHIBITED;
+   BlockPack &operator= (const BlockPack&) PROHIBITED;
+};
+
+/// The BlockPacks that one DirManager writes new records into.
+class BlockPackStore
+{
+public:
+   BlockPackStore();
+   ~BlockPackStore();
+
+   /// Find room for a record of the given size, starting a new pack in
+   /// dir if no existing pack has room
+   std::shared_ptr<BlockPack> Reserve(const wxString &dir, size_t bytes,
+                                      wxFileOffset &offset);
+   /// The pack of the given name in dir, when loading a project
+   std::shared_ptr<BlockPack> Find(const wxString &dir, const wxString &name);
+
+   bool Contains(const wxString &name);
+
+   static const wxFileOffset MaxPackSize;
+
+private:
+   ODLock mLock;
+   std::vector< std::shared_ptr<BlockPack> > mPacks;
+   int mNextPackNumber;
+};
+
+/// A BlockFile whose header, summary and samples are stored, in the
+/// same layout a SimpleBlockFile uses, as one record of a BlockPack.
+/// Its file name is only a unique key for the DirManager; no file of
+/// that name exists.
+class PackedBlockFile final : public BlockFile {
+ public:
+
+   // Constructor / Destructor
+
+   /// Store the samples in a pack chosen by store
+   PackedBlockFile(wxFileNameWrapper &&name, BlockPackStore &store,
+                   const wxString &dir,
+                   samplePtr sampleData, sampleCount sampleLen,
+                   sampleFormat format);
+   /// Refer to a record already in a pack
+   PackedBlockFile(wxFileNameWrapper &&name,
+                   const std::shared_ptr<BlockPack> &pack, wxFileOffset offset,
+                   sampleCount len, sampleFormat format,
+                   float min, float max, float rms);
+
+   virtual ~PackedBlockFile();
+
+   // Reading
+
+   /// Read the summary section of the record
+   bool ReadSummary(void *data) override;
+   /// Read the data section of the record
+   int ReadData(samplePtr data, sampleFormat format,
+                        sampleCount start, sampleCount len) const override;
+
+   /// Create a NEW block file sharing this one's record
+   BlockFile *Copy(wxFileNameWrapper &&newFileName) override;
+   /// Create a NEW block file with a record of its own in a pack chosen
+   /// by store
+   PackedBlockFile *CopyTo(wxFileNameWrapper &&newFileName,
+                           BlockPackStore &store, const wxString &dir) const;
+   /// Write an XML representation of this file
+   void SaveXML(XMLWriter &xmlFile) override;
+   wxLongLong GetSpaceUsage() const override;
+   void Recover() override;
+
+   bool IsPacked() const override { return true; }
+
+   BlockPack *GetPack() const { return mPack.get(); }
+   /// True if the pack on disk holds this block's record
+   bool IsRecordPresent() const;
+
+   static BlockFile *BuildFromXML(DirManager &dm, const wxChar **attrs);
+
+ private:
+   size_t GetRecordSize() const;
+   wxFileOffset GetDataOffset() const;
+
+   std::shared_ptr<BlockPack> mPack;
+   wxFileOffset mOffset;
+   sampleFormat mFormat;
+};
+
+#endif
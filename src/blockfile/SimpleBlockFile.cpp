@@ -48,6 +48,11 @@ default is to disable caching.
   manual auto recovery, because the files are never written physically to
   disk).
 
+If MappedFilePool is enabled (preference "/Directories/MappedBlockFiles"
+is the number of files to keep mapped), block files are read from
+memory-mapped pages instead of through libsndfile, and float blocks are
+lent to WaveTrackCache without copying.
+
 *//****************************************************************//**
 
 \class auHeader
@@ -63,6 +68,8 @@ to get its definition, rather than rolling our own.
 #include <wx/utils.h>
 #include <wx/log.h>
 
+#include <algorithm>
+
 #include "../Prefs.h"
 
 #include "SimpleBlockFile.h"
@@ -85,6 +92,30 @@ static wxUint32 SwapUintEndianess(wxUint32 in)
   return out;
 }
 
+// Where to write a block file that may already exist.  A reader may
+// still have the old file mapped (see MappedFilePool), and truncating a
+// mapped file makes reading the mapping fault.  So write a new file
+// beside it, and FinishWrite() renames it over the old one; the mapping
+// keeps the old contents until it is dropped.
+static wxString GetWritePath(const wxString &path)
+{
+   if (MappedFilePool::Instance().IsEnabled() && wxFileExists(path))
+      return path + wxT(".new");
+   return path;
+}
+
+// Puts the file written at writePath, now closed, in place of path
+static bool FinishWrite(const wxString &writePath, const wxString &path,
+                        bool ok)
+{
+   if (writePath == path)
+      return ok;
+   if (ok && wxRenameFile(writePath, path, true))
+      return true;
+   wxRemoveFile(writePath);
+   return false;
+}
+
 /// Constructs a SimpleBlockFile based on sample data and writes
 /// it to disk.
 ///
@@ -162,18 +193,22 @@ SimpleBlockFile::~SimpleBlockFile()
    }
 }
 
-bool SimpleBlockFile::WriteSimpleBlockFile(
-    samplePtr sampleData,
-    sampleCount sampleLen,
-    sampleFormat format,
-    void* summaryData)
+/// Lay out a complete block file in memory: the .au header, the summary,
+/// then the samples.
+///
+/// @param image        Receives the bytes
+/// @param sampleData   The samples to store
+/// @param sampleLen    The number of samples
+/// @param format       The format of the samples, which is also the
+///                     format stored
+/// @param summaryData  The summary, of summaryBytes bytes
+/// @return The number of bytes in image
+/// static
+size_t SimpleBlockFile::MakeBlockImage(ArrayOf<char> &image,
+                                       samplePtr sampleData, sampleCount sampleLen,
+                                       sampleFormat format,
+                                       const void *summaryData, int summaryBytes)
 {
-   wxFFile file(mFileName.GetFullPath(), wxT("wb"));
-   if( !file.IsOpened() ){
-      // Can't do anything else.
-      return false;
-   }
-
    auHeader header;
 
    // AU files can be either big or little endian.  Which it is is
@@ -185,7 +220,7 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
 
    // We store the summary data at the end of the header, so the data
    // offset is the length of the summary data plus the length of the header
-   header.dataOffset = sizeof(auHeader) + mSummaryInfo.totalSummaryBytes;
+   header.dataOffset = sizeof(auHeader) + summaryBytes;
 
    // dataSize is optional, and we opt out
    header.dataSize = 0xffffffff;
@@ -210,66 +245,76 @@ bool SimpleBlockFile::WriteSimpleBlockFile(
    // BlockFiles are always mono
    header.channels = 1;
 
-   // Write the file
-   ArrayOf<char> cleanup;
-   if (!summaryData)
-      summaryData = /*BlockFile::*/CalcSummary(sampleData, sampleLen, format, cleanup);
-      //mchinen:allowing virtual override of calc summary for ODDecodeBlockFile.
-      // PRL: cleanup fixes a possible memory leak!
+   // 24-bit samples on disk need to be packed, not padded to 32 bits
+   // like they are in memory
+   const int bytesPerSample = (format == int24Sample) ? 3 : SAMPLE_SIZE(format);
+   const size_t size = header.dataOffset + sampleLen * bytesPerSample;
+   image.reinit(size);
 
-   size_t nBytesToWrite = sizeof(header);
-   size_t nBytesWritten = file.Write(&header, nBytesToWrite);
-   if (nBytesWritten != nBytesToWrite)
-   {
-      wxLogDebug(wxT("Wrote %lld bytes, expected %lld."), (long long) nBytesWritten, (long long) nBytesToWrite);
-      return false;
-   }
-
-   nBytesToWrite = mSummaryInfo.totalSummaryBytes;
-   nBytesWritten = file.Write(summaryData, nBytesToWrite);
-   if (nBytesWritten != nBytesToWrite)
-   {
-      wxLogDebug(wxT("Wrote %lld bytes, expected %lld."), (long long) nBytesWritten, (long long) nBytesToWrite);
-      return false;
-   }
+   char *dest = image.get();
+   memcpy(dest, &header, sizeof(header));
+   dest += sizeof(header);
+   memcpy(dest, summaryData, summaryBytes);
+   dest += summaryBytes;
 
    if( format == int24Sample )
    {
-      // we can't write the buffer directly to disk, because 24-bit samples
-      // on disk need to be packed, not padded to 32 bits like they are in
-      // memory
       int *int24sampleData = (int*)sampleData;
 
-      for( int i = 0; i < sampleLen; i++ )
+      for( int i = 0; i < sampleLen; i++, dest += 3 )
       {
-         nBytesToWrite = 3;
-         nBytesWritten =
-            #if wxBYTE_ORDER == wxBIG_ENDIAN
-               file.Write((char*)&int24sampleData[i] + 1, nBytesToWrite);
-            #else
-               file.Write((char*)&int24sampleData[i], nBytesToWrite);
-            #endif
-         if (nBytesWritten != nBytesToWrite)
-         {
-            wxLogDebug(wxT("Wrote %lld bytes, expected %lld."), (long long) nBytesWritten, (long long) nBytesToWrite);
-            return false;
-         }
+         #if wxBYTE_ORDER == wxBIG_ENDIAN
+            memcpy(dest, (char*)&int24sampleData[i] + 1, 3);
+         #else
+            memcpy(dest, (char*)&int24sampleData[i], 3);
+         #endif
       }
    }
    else
    {
-      // for all other sample formats we can write straight from the buffer
-      // to disk
-      nBytesToWrite = sampleLen * SAMPLE_SIZE(format);
-      nBytesWritten = file.Write(sampleData, nBytesToWrite);
-      if (nBytesWritten != nBytesToWrite)
-      {
-         wxLogDebug(wxT("Wrote %lld bytes, expected %lld."), (long long) nBytesWritten, (long long) nBytesToWrite);
-         return false;
-      }
+      // for all other sample formats we can copy straight from the buffer
+      memcpy(dest, sampleData, sampleLen * bytesPerSample);
+   }
+
+   return size;
+}
+
+bool SimpleBlockFile::WriteSimpleBlockFile(
+    samplePtr sampleData,
+    sampleCount sampleLen,
+    sampleFormat format,
+    void* summaryData)
+{
+   ForgetMapping();
+
+   const wxString path = mFileName.GetFullPath();
+   const wxString writePath = GetWritePath(path);
+   wxFFile file(writePath, wxT("wb"));
+   if( !file.IsOpened() ){
+      // Can't do anything else.
+      return false;
+   }
+
+   // Write the file
+   ArrayOf<char> cleanup;
+   if (!summaryData)
+      summaryData = /*BlockFile::*/CalcSummary(sampleData, sampleLen, format, cleanup);
+      //mchinen:allowing virtual override of calc summary for ODDecodeBlockFile.
+      // PRL: cleanup fixes a possible memory leak!
+
+   ArrayOf<char> image;
+   size_t nBytesToWrite = MakeBlockImage(image, sampleData, sampleLen, format,
+                                         summaryData, mSummaryInfo.totalSummaryBytes);
+   size_t nBytesWritten = file.Write(image.get(), nBytesToWrite);
+   file.Close();
+   if (nBytesWritten != nBytesToWrite)
+   {
+      wxLogDebug(wxT("Wrote %lld bytes, expected %lld."), (long long) nBytesWritten, (long long) nBytesToWrite);
+      FinishWrite(writePath, path, false);
+      return false;
    }
 
-    return true;
+   return FinishWrite(writePath, path, true);
 }
 
 void SimpleBlockFile::FillCache()
@@ -352,6 +397,15 @@ bool SimpleBlockFile::ReadSummary(void *data)
    {
       //wxLogDebug("SimpleBlockFile::ReadSummary(): Reading summary from disk.");
 
+      std::shared_ptr<const MappedFile> mapped = GetMapping();
+      if (mapped &&
+          mapped->GetSize() >= sizeof(auHeader) + mSummaryInfo.totalSummaryBytes) {
+         memcpy(data, mapped->GetData() + sizeof(auHeader),
+                (size_t)mSummaryInfo.totalSummaryBytes);
+         FixSummary(data);
+         return true;
+      }
+
       wxFFile file(mFileName.GetFullPath(), wxT("rb"));
 
       {
@@ -383,6 +437,152 @@ bool SimpleBlockFile::ReadSummary(void *data)
    }
 }
 
+std::shared_ptr<const MappedFile> SimpleBlockFile::GetMapping() const
+{
+   MappedFilePool &pool = MappedFilePool::Instance();
+   if (!pool.IsEnabled())
+      return {};
+
+   ODLocker locker{ &mMappingMutex };
+   std::shared_ptr<const MappedFile> mapped = mMapping.lock();
+   if (!mapped) {
+      mapped = pool.Map(GetFileName().name.GetFullPath());
+      mMapping = mapped;
+   }
+   return mapped;
+}
+
+void SimpleBlockFile::ForgetMapping()
+{
+   ODLocker locker{ &mMappingMutex };
+   mMapping.reset();
+}
+
+/// Locate the samples in a mapped file written by WriteSimpleBlockFile().
+/// Returns NULL for anything else, such as a file written with the
+/// other byte order, which libsndfile must then read.
+const char *SimpleBlockFile::FindMappedSamples(const MappedFile &file,
+                                               sampleFormat &fileFormat,
+                                               sampleCount &available) const
+{
+   if (file.GetSize() < sizeof(auHeader))
+      return NULL;
+
+   auHeader header;
+   memcpy(&header, file.GetData(), sizeof(header));
+   if (header.magic != 0x2e736e64 || header.channels != 1 ||
+       header.dataOffset > file.GetSize())
+      return NULL;
+
+   int bytesPerSample;
+   switch (header.encoding)
+   {
+   case AU_SAMPLE_FORMAT_16:
+      fileFormat = int16Sample;
+      bytesPerSample = 2;
+      break;
+   case AU_SAMPLE_FORMAT_24:
+      fileFormat = int24Sample;
+      bytesPerSample = 3;
+      break;
+   case AU_SAMPLE_FORMAT_FLOAT:
+      fileFormat = floatSample;
+      bytesPerSample = 4;
+      break;
+   default:
+      return NULL;
+   }
+
+   available = (file.GetSize() - header.dataOffset) / bytesPerSample;
+   return file.GetData() + header.dataOffset;
+}
+
+/// Convert samples straight from the mapped pages, giving the same
+/// results as the libsndfile path of ReadData().  Returns -1 if the
+/// file must be read by libsndfile instead.
+int SimpleBlockFile::ReadMappedData(const MappedFile &file,
+                                    samplePtr data, sampleFormat format,
+                                    sampleCount start, sampleCount len) const
+{
+   sampleFormat fileFormat;
+   sampleCount available;
+   const char *samples = FindMappedSamples(file, fileFormat, available);
+   if (!samples)
+      return -1;
+
+   if (start >= available)
+      return 0;
+   len = std::min(len, available - start);
+
+   const int bytesPerSample = (fileFormat == int24Sample) ? 3 : SAMPLE_SIZE(fileFormat);
+   ConvertStoredSamples(samples + start * bytesPerSample, fileFormat,
+                        data, format, len);
+   return len;
+}
+
+/// Convert samples as stored in a block file, giving the same results
+/// as the libsndfile path of ReadData().
+/// static
+void SimpleBlockFile::ConvertStoredSamples(const char *stored,
+                                           sampleFormat storedFormat,
+                                           samplePtr data, sampleFormat format,
+                                           sampleCount len)
+{
+   if (storedFormat != int24Sample) {
+      CopySamples((samplePtr)stored, storedFormat, data, format, len);
+      return;
+   }
+
+   // 24-bit samples are packed on disk; see MakeBlockImage()
+   SampleBuffer unpacked;
+   int *intPtr = (int *)data;
+   if (format != int24Sample) {
+      unpacked.Allocate(len, int24Sample);
+      intPtr = (int *)unpacked.ptr();
+   }
+   const unsigned char *src = (const unsigned char *)stored;
+   for (int i = 0; i < len; i++, src += 3) {
+      // Shift the sample into the top three bytes, then back down, to
+      // extend the sign
+#if wxBYTE_ORDER == wxBIG_ENDIAN
+      intPtr[i] = (int)(((unsigned)src[0] << 24) | (src[1] << 16) | (src[2] << 8)) >> 8;
+#else
+      intPtr[i] = (int)(((unsigned)src[2] << 24) | (src[1] << 16) | (src[0] << 8)) >> 8;
+#endif
+   }
+
+   if (format == int16Sample) {
+      // libsndfile truncates rather than dithers
+      short *shortPtr = (short *)data;
+      for (int i = 0; i < len; i++)
+         shortPtr[i] = (short)(intPtr[i] >> 8);
+   }
+   else if (format != int24Sample)
+      CopySamples((samplePtr)intPtr, int24Sample, data, format, len);
+}
+
+const float *SimpleBlockFile::GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                              std::shared_ptr<const void> &holder) const
+{
+   // A file still being written by an on-demand task must not be mapped
+   if (mCache.active || !IsDataAvailable())
+      return NULL;
+
+   std::shared_ptr<const MappedFile> mapped = GetMapping();
+   if (!mapped)
+      return NULL;
+
+   sampleFormat fileFormat;
+   sampleCount available;
+   const char *samples = FindMappedSamples(*mapped, fileFormat, available);
+   if (!samples || fileFormat != floatSample || start + len > available ||
+       (samples - mapped->GetData()) % sizeof(float) != 0)
+      return NULL;
+
+   holder = mapped;
+   return (const float *)samples + start;
+}
+
 /// Read the data portion of the block file using libsndfile.  Convert it
 /// to the given format if it is not already.
 ///
@@ -408,6 +608,13 @@ int SimpleBlockFile::ReadData(samplePtr data, sampleFormat format,
    {
       //wxLogDebug("SimpleBlockFile::ReadData(): Reading data from disk.");
 
+      std::shared_ptr<const MappedFile> mapped = GetMapping();
+      if (mapped) {
+         int framesRead = ReadMappedData(*mapped, data, format, start, len);
+         if (framesRead >= 0)
+            return framesRead;
+      }
+
       SF_INFO info;
       wxFile f;   // will be closed when it goes out of scope
       SFFile sf;
@@ -602,7 +809,11 @@ wxLongLong SimpleBlockFile::GetSpaceUsage() const
 }
 
 void SimpleBlockFile::Recover(){
-   wxFFile file(mFileName.GetFullPath(), wxT("wb"));
+   ForgetMapping();
+
+   const wxString path = mFileName.GetFullPath();
+   const wxString writePath = GetWritePath(path);
+   wxFFile file(writePath, wxT("wb"));
    int i;
 
    if( !file.IsOpened() ){
@@ -627,6 +838,8 @@ void SimpleBlockFile::Recover(){
    for(i=0;i<mLen*2;i++)
       file.Write(wxT("\0"),1);
 
+   file.Close();
+   FinishWrite(writePath, path, true);
 }
 
 void SimpleBlockFile::WriteCacheToDisk()
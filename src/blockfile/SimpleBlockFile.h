@@ -16,6 +16,7 @@
 
 #include "../BlockFile.h"
 #include "../DirManager.h"
+#include "../MappedFile.h"
 #include "../xml/XMLWriter.h"
 
 struct SimpleBlockFileCache {
@@ -66,6 +67,9 @@ class PROFILE_DLL_API SimpleBlockFile /* not final */ : public BlockFile {
    /// Read the data section of the disk file
    int ReadData(samplePtr data, sampleFormat format,
                         sampleCount start, sampleCount len) const override;
+   /// Lend float samples straight from the mapped file
+   const float *GetFloatsNoCopy(sampleCount start, sampleCount len,
+                                std::shared_ptr<const void> &holder) const override;
 
    /// Create a NEW block file identical to this one
    BlockFile *Copy(wxFileNameWrapper &&newFileName) override;
@@ -83,6 +87,18 @@ class PROFILE_DLL_API SimpleBlockFile /* not final */ : public BlockFile {
    bool GetNeedFillCache() override { return !mCache.active; }
    void FillCache() override;
 
+   // The layout of the disk file, shared with PackedBlockFile
+
+   /// Lay out header, summary and samples as they are written to disk
+   static size_t MakeBlockImage(ArrayOf<char> &image,
+                                samplePtr sampleData, sampleCount sampleLen,
+                                sampleFormat format,
+                                const void *summaryData, int summaryBytes);
+   /// Convert samples as stored on disk to the requested format
+   static void ConvertStoredSamples(const char *stored, sampleFormat storedFormat,
+                                    samplePtr data, sampleFormat format,
+                                    sampleCount len);
+
  protected:
 
    bool WriteSimpleBlockFile(samplePtr sampleData, sampleCount sampleLen,
@@ -93,7 +109,20 @@ class PROFILE_DLL_API SimpleBlockFile /* not final */ : public BlockFile {
    SimpleBlockFileCache mCache;
 
  private:
+   std::shared_ptr<const MappedFile> GetMapping() const;
+   void ForgetMapping();
+   const char *FindMappedSamples(const MappedFile &file,
+                                 sampleFormat &fileFormat,
+                                 sampleCount &available) const;
+   int ReadMappedData(const MappedFile &file,
+                      samplePtr data, sampleFormat format,
+                      sampleCount start, sampleCount len) const;
+
    mutable sampleFormat mFormat; // may be found lazily
+
+   // The pool owns mappings; we only remember ours while it is open
+   mutable ODLock mMappingMutex;
+   mutable std::weak_ptr<const MappedFile> mMapping;
 };
 
 #endif
@@ -0,0 +1,272 @@
+/**********************************************************************
+
+   Audacity - A Digital Audio Editor
+   Copyright 1999-2009 Audacity Team
+   File License: wxWidgets
+
+******************************************************************//**
+
+\file AudioDataCommands.cpp
+\brief Contains definitions for the GetAudioDataCommand and
+SetAudioDataCommand classes
+
+These let a script hand samples to another program, and take them back,
+through a named POSIX shared memory object instead of a file.  The object
+holds the samples of one track as 32-bit floats in native byte order and
+nothing else, so its size gives the number of samples.
+
+GetAudioData creates the object and leaves it for the script to open,
+map and, when done, shm_unlink.  SetAudioData maps an object the script
+has filled and writes its samples into a track, over what is there.
+
+*//*******************************************************************/
+
+#include "AudioDataCommands.h"
+#include "../Project.h"
+#include "../WaveTrack.h"
+
+#if defined(__WXMSW__)
+   #define HAVE_POSIX_SHM 0
+#else
+   #define HAVE_POSIX_SHM 1
+   #include <sys/mman.h>
+   #include <sys/stat.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+#endif
+
+// Find the wave track with the given index in the project
+// (Note: like GetTrackInfo, this ought to be somewhere else)
+static WaveTrack *GetWaveTrack(AudacityProject *project, long trackIndex)
+{
+   long i = 0;
+   TrackListIterator iter(project->GetTracks());
+   Track *t = iter.First();
+   while (t && i != trackIndex)
+   {
+      t = iter.Next();
+      ++i;
+   }
+   if (i != trackIndex || !t || t->GetKind() != Track::Wave)
+      return NULL;
+   return static_cast<WaveTrack *>(t);
+}
+
+// GetAudioData
+
+wxString GetAudioDataCommandType::BuildName()
+{
+   return wxT("GetAudioData");
+}
+
+void GetAudioDataCommandType::BuildSignature(CommandSignature &signature)
+{
+   IntValidator *trackIndexValidator(new IntValidator());
+   signature.AddParameter(wxT("TrackIndex"), 0, trackIndexValidator);
+
+   DoubleValidator *startTimeValidator(new DoubleValidator());
+   signature.AddParameter(wxT("StartTime"), 0.0, startTimeValidator);
+
+   // An end time before the start time means the end of the track
+   DoubleValidator *endTimeValidator(new DoubleValidator());
+   signature.AddParameter(wxT("EndTime"), -1.0, endTimeValidator);
+
+   // Empty to have a name made up, which is then returned
+   Validator *nameValidator(new DefaultValidator());
+   signature.AddParameter(wxT("SharedMemoryName"), wxT(""), nameValidator);
+}
+
+CommandHolder GetAudioDataCommandType::Create(std::unique_ptr<CommandOutputTarget> &&target)
+{
+   return std::make_shared<GetAudioDataCommand>(*this, std::move(target));
+}
+
+bool GetAudioDataCommand::Apply(CommandExecutionContext context)
+{
+#if HAVE_POSIX_SHM
+   WaveTrack *track = GetWaveTrack(context.GetProject(), GetLong(wxT("TrackIndex")));
+   if (!track)
+   {
+      Error(wxT("TrackIndex was invalid."));
+      return false;
+   }
+
+   double t0 = GetDouble(wxT("StartTime"));
+   double t1 = GetDouble(wxT("EndTime"));
+   if (t1 < t0)
+      t1 = track->GetEndTime();
+
+   sampleCount s0 = track->TimeToLongSamples(t0);
+   sampleCount s1 = track->TimeToLongSamples(t1);
+   if (s1 <= s0)
+   {
+      Error(wxT("There are no samples in that range."));
+      return false;
+   }
+   sampleCount len = s1 - s0;
+
+   wxString name = GetString(wxT("SharedMemoryName"));
+   if (name.IsEmpty())
+   {
+      static int serial = 0;
+      name = wxString::Format(wxT("/audacity.%d.%d"), (int)getpid(), ++serial);
+   }
+
+   // The script is to open the object, so it must not be anyone else's.
+   int fd = shm_open(name.mb_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+   if (fd < 0)
+   {
+      Error(wxT("Could not create shared memory ") + name);
+      return false;
+   }
+
+   size_t size = (size_t)len * sizeof(float);
+   void *data = MAP_FAILED;
+   if (ftruncate(fd, size) == 0)
+      data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED)
+   {
+      shm_unlink(name.mb_str());
+      Error(wxT("Could not map shared memory ") + name);
+      return false;
+   }
+
+   // Straight from the block files into the shared memory, a block at a
+   // time, with no buffer in between.
+   float *samples = (float *)data;
+   bool result = true;
+   sampleCount pos = s0;
+   while (result && pos < s1)
+   {
+      sampleCount block = track->GetBestBlockSize(pos);
+      if (pos + block > s1)
+         block = s1 - pos;
+      result = track->Get((samplePtr)(samples + (pos - s0)), floatSample, pos, block);
+      pos += block;
+      Progress((double)(pos - s0) / len);
+   }
+
+   munmap(data, size);
+
+   if (!result)
+   {
+      shm_unlink(name.mb_str());
+      Error(wxT("Could not read the samples of the track."));
+      return false;
+   }
+
+   Status(name);
+   Status(wxString::Format(wxT("%lld"), (long long)len));
+   Status(wxString::Format(wxT("%f"), track->GetRate()));
+   return true;
+#else
+   Error(wxT("Shared memory audio data is not supported on this platform."));
+   return false;
+#endif
+}
+
+GetAudioDataCommand::~GetAudioDataCommand()
+{ }
+
+// SetAudioData
+
+wxString SetAudioDataCommandType::BuildName()
+{
+   return wxT("SetAudioData");
+}
+
+void SetAudioDataCommandType::BuildSignature(CommandSignature &signature)
+{
+   IntValidator *trackIndexValidator(new IntValidator());
+   signature.AddParameter(wxT("TrackIndex"), 0, trackIndexValidator);
+
+   DoubleValidator *startTimeValidator(new DoubleValidator());
+   signature.AddParameter(wxT("StartTime"), 0.0, startTimeValidator);
+
+   Validator *nameValidator(new DefaultValidator());
+   signature.AddParameter(wxT("SharedMemoryName"), wxT(""), nameValidator);
+
+   // Whether to shm_unlink the object once the samples are written
+   BoolValidator *unlinkValidator(new BoolValidator());
+   signature.AddParameter(wxT("Unlink"), true, unlinkValidator);
+}
+
+CommandHolder SetAudioDataCommandType::Create(std::unique_ptr<CommandOutputTarget> &&target)
+{
+   return std::make_shared<SetAudioDataCommand>(*this, std::move(target));
+}
+
+bool SetAudioDataCommand::Apply(CommandExecutionContext context)
+{
+#if HAVE_POSIX_SHM
+   AudacityProject *project = context.GetProject();
+   WaveTrack *track = GetWaveTrack(project, GetLong(wxT("TrackIndex")));
+   if (!track)
+   {
+      Error(wxT("TrackIndex was invalid."));
+      return false;
+   }
+
+   wxString name = GetString(wxT("SharedMemoryName"));
+   int fd = shm_open(name.mb_str(), O_RDONLY, 0);
+   if (fd < 0)
+   {
+      Error(wxT("Could not open shared memory ") + name);
+      return false;
+   }
+
+   struct stat st;
+   void *data = MAP_FAILED;
+   size_t size = 0;
+   if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(float))
+   {
+      size = (size_t)st.st_size;
+      data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (data == MAP_FAILED)
+   {
+      Error(wxT("Could not map shared memory ") + name);
+      return false;
+   }
+
+   // WaveTrack::Set() only overwrites samples that exist, in the clips.
+   const float *samples = (const float *)data;
+   sampleCount len = size / sizeof(float);
+   sampleCount s0 = track->TimeToLongSamples(GetDouble(wxT("StartTime")));
+   bool result = true;
+   sampleCount pos = 0;
+   while (result && pos < len)
+   {
+      sampleCount block = track->GetBestBlockSize(s0 + pos);
+      if (pos + block > len)
+         block = len - pos;
+      result = track->Set((samplePtr)(samples + pos), floatSample, s0 + pos, block);
+      pos += block;
+      Progress((double)pos / len);
+   }
+
+   munmap(data, size);
+   if (GetBool(wxT("Unlink")))
+      shm_unlink(name.mb_str());
+
+   // Even a failure may have written some of the samples.
+   project->PushState(_("Set audio data from a script"), _("Set Audio Data"));
+
+   if (!result)
+   {
+      Error(wxT("Could not write the samples to the track."));
+      return false;
+   }
+
+   Status(wxString::Format(wxT("%lld"), (long long)len));
+   return true;
+#else
+   Error(wxT("Shared memory audio data is not supported on this platform."));
+   return false;
+#endif
+}
+
+SetAudioDataCommand::~SetAudioDataCommand()
+{ }
@@ -0,0 +1,69 @@
+/**********************************************************************
+
+   Audacity: A Digital Audio Editor
+   Audacity(R) is copyright (c) 1999-2009 Audacity Team.
+   File License: wxwidgets
+
+   AudioDataCommands.h
+
+******************************************************************//**
+
+\class GetAudioDataCommand
+\brief Command that copies samples of a track into shared memory
+
+\class SetAudioDataCommand
+\brief Command that writes samples from shared memory into a track
+
+*//*******************************************************************/
+
+#ifndef __AUDIODATACOMMANDS__
+#define __AUDIODATACOMMANDS__
+
+#include "Command.h"
+#include "CommandType.h"
+
+// GetAudioData
+
+class GetAudioDataCommandType final : public CommandType
+{
+public:
+   wxString BuildName() override;
+   void BuildSignature(CommandSignature &signature) override;
+   CommandHolder Create(std::unique_ptr<CommandOutputTarget> &&target) override;
+};
+
+class GetAudioDataCommand final : public CommandImplementation
+{
+public:
+   GetAudioDataCommand(CommandType &type,
+                       std::unique_ptr<CommandOutputTarget> &&target)
+      : CommandImplementation(type, std::move(target))
+   { }
+
+   virtual ~GetAudioDataCommand();
+   bool Apply(CommandExecutionContext context) override;
+};
+
+// SetAudioData
+
+class SetAudioDataCommandType final : public CommandType
+{
+public:
+   wxString BuildName() override;
+   void BuildSignature(CommandSignature &signature) override;
+   CommandHolder Create(std::unique_ptr<CommandOutputTarget> &&target) override;
+};
+
+class SetAudioDataCommand final : public CommandImplementation
+{
+public:
+   SetAudioDataCommand(CommandType &type,
+                       std::unique_ptr<CommandOutputTarget> &&target)
+      : CommandImplementation(type, std::move(target))
+   { }
+
+   virtual ~SetAudioDataCommand();
+   bool Apply(CommandExecutionContext context) override;
+};
+
+#endif /* End of include guard: __AUDIODATACOMMANDS__ */
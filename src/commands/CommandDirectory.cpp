@@ -32,6 +32,7 @@
 #include "PreferenceCommands.h"
 #include "ImportExportCommands.h"
 #include "OpenSaveCommands.h"
+#include "AudioDataCommands.h"
 
 std::unique_ptr<CommandDirectory> CommandDirectory::mInstance;
 
@@ -59,6 +60,8 @@ CommandDirectory::CommandDirectory()
    AddCommand(new ExportCommandType());
    AddCommand(new OpenProjectCommandType());
    AddCommand(new SaveProjectCommandType());
+   AddCommand(new GetAudioDataCommandType());
+   AddCommand(new SetAudioDataCommandType());
 }
 
 CommandDirectory::~CommandDirectory()
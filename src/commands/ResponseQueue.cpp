@@ -35,7 +35,7 @@ void ResponseQueue::AddResponse(Response response)
 Response ResponseQueue::WaitAndGetResponse()
 {
    wxMutexLocker locker(mMutex);
-   if (mResponses.empty())
+   while (mResponses.empty())
    {
       mCondition.Wait();
    }
@@ -81,6 +81,10 @@ int ExecCommand(wxString *pIn, wxString *pOut)
       {
          *pOut = wxT("Syntax error!\n");
          *pOut += builder.GetErrorMessage() + wxT("\n");
+
+         // No command was posted, so no responses are coming.  Waiting
+         // for them would hang the script server for good.
+         return 0;
       }
    }
 
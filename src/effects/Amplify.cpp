@@ -177,6 +177,11 @@ bool EffectAmplify::Init()
    return true;
 }
 
+bool EffectAmplify::IsStateless()
+{
+   return true;
+}
+
 void EffectAmplify::Preview(bool dryOnly)
 {
    double ratio = mRatio;
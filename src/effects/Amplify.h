@@ -54,6 +54,7 @@ public:
    // Effect implementation
 
    bool Init() override;
+   bool IsStateless() override;
    void Preview(bool dryOnly) override;
    void PopulateOrExchange(ShuttleGui & S) override;
    bool TransferDataToWindow() override;
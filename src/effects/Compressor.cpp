@@ -84,9 +84,7 @@ EffectCompressor::EffectCompressor()
    mThreshold = 0.25;
    mNoiseFloor = 0.01;
    mCompression = 0.5;
-   mCircle = NULL;
-   mFollow1 = NULL;
-   mFollow2 = NULL;
+   mCircleSize = 100;
    mFollowLen = 0;
 
    SetLinearEffectFlag(false);
@@ -94,18 +92,6 @@ EffectCompressor::EffectCompressor()
 
 EffectCompressor::~EffectCompressor()
 {
-   if (mCircle) {
-      delete[] mCircle;
-      mCircle = NULL;
-   }
-   if(mFollow1!=NULL) {
-      delete[] mFollow1;
-      mFollow1 = NULL;
-   }
-   if(mFollow2!=NULL) {
-      delete[] mFollow2;
-      mFollow2 = NULL;
-   }
 }
 
 // IdentInterface implementation
@@ -328,32 +314,45 @@ bool EffectCompressor::TransferDataFromWindow()
 
 // EffectTwoPassSimpleMono implementation
 
-bool EffectCompressor::NewTrackPass1()
+movable_ptr<EffectTwoPassSimpleMono::TrackState> EffectCompressor::NewTrackState()
 {
-   mThreshold = DB_TO_LINEAR(mThresholdDB);
-   mNoiseFloor = DB_TO_LINEAR(mNoiseFloorDB);
-   mNoiseCounter = 100;
+   return make_movable<CompressorState>();
+}
 
-   mAttackInverseFactor = exp(log(mThreshold) / (mCurRate * mAttackTime + 0.5));
-   mAttackFactor = 1.0 / mAttackInverseFactor;
-   mDecayFactor = exp(log(mThreshold) / (mCurRate * mDecayTime + 0.5));
+bool EffectCompressor::NewTrackPass1(TrackState &trackState)
+{
+   CompressorState &state = static_cast<CompressorState &>(trackState);
 
-   if(mRatio > 1)
-      mCompression = 1.0-1.0/mRatio;
-   else
-      mCompression = 0.0;
+   state.noiseCounter = 100;
 
-   mLastLevel = mThreshold;
+   state.attackInverseFactor = exp(log(mThreshold) / (state.rate * mAttackTime + 0.5));
+   state.attackFactor = 1.0 / state.attackInverseFactor;
+   state.decayFactor = exp(log(mThreshold) / (state.rate * mDecayTime + 0.5));
 
-   if (mCircle)
-      delete[] mCircle;
-   mCircleSize = 100;
-   mCircle = new double[mCircleSize];
-   for(int j=0; j<mCircleSize; j++) {
-      mCircle[j] = 0.0;
+   state.lastLevel = mThreshold;
+
+   state.circle.reinit(mCircleSize, true);
+   state.circlePos = 0;
+   state.rmsSum = 0.0;
+
+   // Allocate buffers for the envelope
+   if(mFollowLen > 0) {
+      state.follow1.reinit(mFollowLen);
+      state.follow2.reinit(mFollowLen);
    }
-   mCirclePos = 0;
-   mRMSSum = 0.0;
+
+   state.max = 0.0;
+
+   return true;
+}
+
+bool EffectCompressor::EndTrackPass1(TrackState &trackState)
+{
+   CompressorState &state = static_cast<CompressorState &>(trackState);
+
+   // The normalization pass divides every track by the maximum of them all
+   if(mMax < state.max)
+      mMax = state.max;
 
    return true;
 }
@@ -364,6 +363,14 @@ bool EffectCompressor::InitPass1()
    if (!mNormalize)
       DisableSecondPass();
 
+   mThreshold = DB_TO_LINEAR(mThresholdDB);
+   mNoiseFloor = DB_TO_LINEAR(mNoiseFloorDB);
+
+   if(mRatio > 1)
+      mCompression = 1.0-1.0/mRatio;
+   else
+      mCompression = 0.0;
+
    // Find the maximum block length required for any track
    sampleCount maxlen=0;
    SelectedTrackListOfKindIterator iter(Track::Wave, mTracks);
@@ -375,19 +382,6 @@ bool EffectCompressor::InitPass1()
       //Iterate to the next track
       track = (WaveTrack *) iter.Next();
    }
-   if(mFollow1!=NULL) {
-      delete[] mFollow1;
-      mFollow1 = NULL;
-   }
-   if(mFollow2!=NULL) {
-      delete[] mFollow2;
-      mFollow2 = NULL;
-   }
-   // Allocate buffers for the envelope
-   if(maxlen > 0) {
-      mFollow1 = new float[maxlen];
-      mFollow2 = new float[maxlen];
-   }
    mFollowLen = maxlen;
 
    return true;
@@ -403,8 +397,9 @@ bool EffectCompressor::InitPass2()
 // Process the input with 2 buffers available at a time
 // buffer1 will be written upon return
 // buffer2 will be passed as buffer1 on the next call
-bool EffectCompressor::TwoBufferProcessPass1(float *buffer1, sampleCount len1, float *buffer2, sampleCount len2)
+bool EffectCompressor::TwoBufferProcessPass1(TrackState &trackState, float *buffer1, sampleCount len1, float *buffer2, sampleCount len2)
 {
+   CompressorState &state = static_cast<CompressorState &>(trackState);
    int i;
 
    // If buffers are bigger than allocated, then abort
@@ -415,41 +410,39 @@ bool EffectCompressor::TwoBufferProcessPass1(float *buffer1, sampleCount len1, f
    // This makes sure that the initial value is well-chosen
    // buffer1 == NULL on the first and only the first call
    if (buffer1 == NULL) {
-      // Initialize the mLastLevel to the peak level in the first buffer
+      // Initialize the lastLevel to the peak level in the first buffer
       // This avoids problems with large spike events near the beginning of the track
-      mLastLevel = mThreshold;
+      state.lastLevel = mThreshold;
       for(i=0; i<len2; i++) {
-         if(mLastLevel < fabs(buffer2[i]))
-            mLastLevel = fabs(buffer2[i]);
+         if(state.lastLevel < fabs(buffer2[i]))
+            state.lastLevel = fabs(buffer2[i]);
       }
    }
 
    // buffer2 is NULL on the last and only the last call
    if(buffer2 != NULL) {
-      Follow(buffer2, mFollow2, len2, mFollow1, len1);
+      Follow(state, buffer2, state.follow2.get(), len2, state.follow1.get(), len1);
    }
 
    if(buffer1 != NULL) {
       for (i = 0; i < len1; i++) {
-         buffer1[i] = DoCompression(buffer1[i], mFollow1[i]);
+         buffer1[i] = DoCompression(state, buffer1[i], state.follow1[i]);
       }
    }
 
 
 #if 0
    // Copy the envelope over the track data (for debug purposes)
-   memcpy(buffer1, mFollow1, len1*sizeof(float));
+   memcpy(buffer1, state.follow1.get(), len1*sizeof(float));
 #endif
 
    // Rotate the buffer pointers
-   float *tmpfloat = mFollow1;
-   mFollow1 = mFollow2;
-   mFollow2 = tmpfloat;
+   std::swap(state.follow1, state.follow2);
 
    return true;
 }
 
-bool EffectCompressor::ProcessPass2(float *buffer, sampleCount len)
+bool EffectCompressor::ProcessPass2(TrackState & WXUNUSED(state), float *buffer, sampleCount len)
 {
    if (mMax != 0)
    {
@@ -460,31 +453,31 @@ bool EffectCompressor::ProcessPass2(float *buffer, sampleCount len)
    return true;
 }
 
-void EffectCompressor::FreshenCircle()
+void EffectCompressor::FreshenCircle(CompressorState &state)
 {
    // Recompute the RMS sum periodically to prevent accumulation of rounding errors
    // during long waveforms
-   mRMSSum = 0;
+   state.rmsSum = 0;
    for(int i=0; i<mCircleSize; i++)
-      mRMSSum += mCircle[i];
+      state.rmsSum += state.circle[i];
 }
 
-float EffectCompressor::AvgCircle(float value)
+float EffectCompressor::AvgCircle(CompressorState &state, float value)
 {
    float level;
 
    // Calculate current level from root-mean-squared of
    // circular buffer ("RMS")
-   mRMSSum -= mCircle[mCirclePos];
-   mCircle[mCirclePos] = value*value;
-   mRMSSum += mCircle[mCirclePos];
-   level = sqrt(mRMSSum/mCircleSize);
-   mCirclePos = (mCirclePos+1)%mCircleSize;
+   state.rmsSum -= state.circle[state.circlePos];
+   state.circle[state.circlePos] = value*value;
+   state.rmsSum += state.circle[state.circlePos];
+   level = sqrt(state.rmsSum/mCircleSize);
+   state.circlePos = (state.circlePos+1)%mCircleSize;
 
    return level;
 }
 
-void EffectCompressor::Follow(float *buffer, float *env, int len, float *previous, int previous_len)
+void EffectCompressor::Follow(CompressorState &state, float *buffer, float *env, int len, float *previous, int previous_len)
 {
    /*
 
@@ -526,23 +519,23 @@ void EffectCompressor::Follow(float *buffer, float *env, int len, float *previou
    if(!mUsePeak) {
       // Update RMS sum directly from the circle buffer
       // to avoid accumulation of rounding errors
-      FreshenCircle();
+      FreshenCircle(state);
    }
    // First apply a peak detect with the requested decay rate
-   last = mLastLevel;
+   last = state.lastLevel;
    for(i=0; i<len; i++) {
       if(mUsePeak)
          level = fabs(buffer[i]);
       else // use RMS
-         level = AvgCircle(buffer[i]);
+         level = AvgCircle(state, buffer[i]);
       // Don't increase gain when signal is continuously below the noise floor
       if(level < mNoiseFloor) {
-         mNoiseCounter++;
+         state.noiseCounter++;
       } else {
-         mNoiseCounter = 0;
+         state.noiseCounter = 0;
       }
-      if(mNoiseCounter < 100) {
-         last *= mDecayFactor;
+      if(state.noiseCounter < 100) {
+         last *= state.decayFactor;
          if(last < mThreshold)
             last = mThreshold;
          if(level > last)
@@ -550,12 +543,12 @@ void EffectCompressor::Follow(float *buffer, float *env, int len, float *previou
       }
       env[i] = last;
    }
-   mLastLevel = last;
+   state.lastLevel = last;
 
    // Next do the same process in reverse direction to get the requested attack rate
-   last = mLastLevel;
+   last = state.lastLevel;
    for(i=len-1; i>=0; i--) {
-      last *= mAttackInverseFactor;
+      last *= state.attackInverseFactor;
       if(last < mThreshold)
          last = mThreshold;
       if(env[i] < last)
@@ -567,7 +560,7 @@ void EffectCompressor::Follow(float *buffer, float *env, int len, float *previou
    if((previous != NULL) && (previous_len > 0)) {
       // If the previous envelope was passed, propagate the rise back until we intersect
       for(i=previous_len-1; i>0; i--) {
-         last *= mAttackInverseFactor;
+         last *= state.attackInverseFactor;
          if(last < mThreshold)
             last = mThreshold;
          if(previous[i] < last)
@@ -579,7 +572,7 @@ void EffectCompressor::Follow(float *buffer, float *env, int len, float *previou
       // until we intersect the desired envelope
       last = previous[0];
       for(i=1; i<previous_len; i++) {
-         last *= mAttackFactor;
+         last *= state.attackFactor;
          if(previous[i] > last)
             previous[i] = last;
          else // Intersected the desired envelope, so we are finished
@@ -587,18 +580,18 @@ void EffectCompressor::Follow(float *buffer, float *env, int len, float *previou
       }
       // If we still didn't intersect, then continue ramp up into current buffer
       for(i=0; i<len; i++) {
-         last *= mAttackFactor;
+         last *= state.attackFactor;
          if(buffer[i] > last)
             buffer[i] = last;
          else // Finally got an intersect
             return;
       }
-      // If we still didn't intersect, then reset mLastLevel
-      mLastLevel = last;
+      // If we still didn't intersect, then reset lastLevel
+      state.lastLevel = last;
    }
 }
 
-float EffectCompressor::DoCompression(float value, double env)
+float EffectCompressor::DoCompression(CompressorState &state, float value, double env)
 {
    float out;
    if(mUsePeak) {
@@ -610,8 +603,8 @@ float EffectCompressor::DoCompression(float value, double env)
    }
 
    // Retain the maximum value for use in the normalization pass
-   if(mMax < fabs(out))
-      mMax = fabs(out);
+   if(state.max < fabs(out))
+      state.max = fabs(out);
 
    return out;
 }
@@ -61,26 +61,43 @@ protected:
 
    bool InitPass1() override;
    bool InitPass2() override;
-   bool NewTrackPass1() override;
-   bool ProcessPass2(float *buffer, sampleCount len) override;
-   bool TwoBufferProcessPass1(float *buffer1, sampleCount len1, float *buffer2, sampleCount len2) override;
+   movable_ptr<TrackState> NewTrackState() override;
+   bool NewTrackPass1(TrackState &state) override;
+   bool EndTrackPass1(TrackState &state) override;
+   bool ProcessPass2(TrackState &state, float *buffer, sampleCount len) override;
+   bool TwoBufferProcessPass1(TrackState &state, float *buffer1, sampleCount len1, float *buffer2, sampleCount len2) override;
 
 private:
    // EffectCompressor implementation
 
-   void FreshenCircle();
-   float AvgCircle(float x);
-   void Follow(float *buffer, float *env, int len, float *previous, int previous_len);
-   float DoCompression(float x, double env);
+   // The envelope follower of one track
+   struct CompressorState final : TrackState
+   {
+      double    rmsSum;
+      int       circlePos;
+      ArrayOf<double> circle;
+
+      double    attackFactor;
+      double    attackInverseFactor;
+      double    decayFactor;
+      int       noiseCounter;
+      double    lastLevel;
+      ArrayOf<float> follow1;
+      ArrayOf<float> follow2;
+
+      double    max;       // of the compressed samples, for normalizing
+   };
+
+   void FreshenCircle(CompressorState &state);
+   float AvgCircle(CompressorState &state, float x);
+   void Follow(CompressorState &state, float *buffer, float *env, int len, float *previous, int previous_len);
+   float DoCompression(CompressorState &state, float x, double env);
 
    void OnSlider(wxCommandEvent & evt);
    void UpdateUI();
 
 private:
-   double    mRMSSum;
    int       mCircleSize;
-   int       mCirclePos;
-   double   *mCircle;
 
    double    mAttackTime;
    double    mThresholdDB;
@@ -90,17 +107,10 @@ private:
    bool      mUsePeak;
 
    double    mDecayTime;   // The "Release" time.
-   double    mAttackFactor;
-   double    mAttackInverseFactor;
-   double    mDecayFactor;
    double    mThreshold;
    double    mCompression;
    double    mNoiseFloor;
-   int       mNoiseCounter;
    double    mGain;
-   double    mLastLevel;
-   float	   *mFollow1;
-   float	   *mFollow2;
    sampleCount mFollowLen;
 
    double    mMax;			//MJS
@@ -33,6 +33,7 @@ greater use in future.
 #include <wx/stockitem.h>
 #include <wx/string.h>
 #include <wx/tglbtn.h>
+#include <wx/stopwatch.h>
 #include <wx/timer.h>
 #include <wx/utils.h>
 #include <wx/log.h>
@@ -46,10 +47,12 @@ greater use in future.
 #include "../Project.h"
 #include "../ShuttleGui.h"
 #include "../WaveTrack.h"
+#include "../WorkerPool.h"
 #include "../toolbars/ControlToolBar.h"
 #include "../widgets/AButton.h"
 #include "../widgets/ProgressDialog.h"
 #include "../ondemand/ODManager.h"
+#include "EffectPipeline.h"
 #include "TimeWarper.h"
 #include "nyquist/Nyquist.h"
 
@@ -106,6 +109,8 @@ Effect::Effect()
    mNumTracks = 0;
    mNumGroups = 0;
    mProgress = NULL;
+   mJobState = NULL;
+   mJobsConcurrent = false;
 
    mRealtimeSuspendLock.Enter();
    mRealtimeSuspendCount = 1;    // Effects are initially suspended
@@ -117,14 +122,8 @@ Effect::Effect()
    mNumAudioIn = 0;
    mNumAudioOut = 0;
 
-   mInBuffer = NULL;
-   mOutBuffer = NULL;
-   mInBufPos = NULL;
-   mOutBufPos = NULL;
-
    mBufferSize = 0;
    mBlockSize = 0;
-   mNumChannels = 0;
 
    mUIDebug = false;
 
@@ -1323,18 +1322,13 @@ bool Effect::ProcessPass()
    bool editClipCanMove;
    gPrefs->Read(wxT("/GUI/EditClipCanMove"), &editClipCanMove, true);
 
-   mInBuffer = NULL;
-   mOutBuffer = NULL;
-
-   ChannelName map[3];
-
-   sampleCount prevBufferSize = 0;
    mBufferSize = 0;
    mBlockSize = 0;
 
+   // Gather the groups of tracks to process
+   std::vector<ProcessGroup> groups;
+
    TrackListIterator iter(mOutputTracks);
-   int count = 0;
-   bool clear = false;
    Track* t = iter.First();
 
    for (t = iter.First(); t; t = iter.Next())
@@ -1348,26 +1342,23 @@ bool Effect::ProcessPass()
          continue;
       }
 
+      ProcessGroup group;
       WaveTrack *left = (WaveTrack *)t;
-      WaveTrack *right;
-      sampleCount len;
-      sampleCount leftStart;
-      sampleCount rightStart;
+      group.left = left;
 
       if (!isGenerator)
       {
-         GetSamples(left, &leftStart, &len);
-         mSampleCnt = len;
+         GetSamples(left, &group.leftStart, &group.len);
+         group.sampleCnt = group.len;
       }
       else
       {
-         len = 0;
-         leftStart = 0;
-         mSampleCnt = left->TimeToLongSamples(mDuration);
+         group.len = 0;
+         group.leftStart = 0;
+         group.sampleCnt = left->TimeToLongSamples(mDuration);
       }
 
-      mNumChannels = 1;
-
+      ChannelName *map = group.map;
       if (left->GetChannel() == Track::LeftChannel)
       {
          map[0] = ChannelNameFrontLeft;
@@ -1382,17 +1373,16 @@ bool Effect::ProcessPass()
       }
       map[1] = ChannelNameEOL;
 
-      right = NULL;
-      rightStart = 0;
+      group.right = NULL;
+      group.rightStart = 0;
       if (left->GetLinked() && mNumAudioIn > 1)
       {
-         right = (WaveTrack *) iter.Next();
+         WaveTrack *right = (WaveTrack *) iter.Next();
+         group.right = right;
          if (!isGenerator)
          {
-            GetSamples(right, &rightStart, &len);
+            GetSamples(right, &group.rightStart, &group.len);
          }
-         clear = false;
-         mNumChannels = 2;
 
          if (right->GetChannel() == Track::LeftChannel)
          {
@@ -1409,141 +1399,324 @@ bool Effect::ProcessPass()
          map[2] = ChannelNameEOL;
       }
 
-      // Let the client know the sample rate
-      SetSampleRate(left->GetRate());
-
-      // Get the block size the client wants to use
-      sampleCount max = left->GetMaxBlockSize() * 2;
-      mBlockSize = SetBlockSize(max);
+      groups.push_back(group);
+   }
 
-      // Calculate the buffer size to be at least the max rounded up to the clients
-      // selected block size.
-      prevBufferSize = mBufferSize;
-      mBufferSize = ((max + (mBlockSize - 1)) / mBlockSize) * mBlockSize;
+   if (!ProcessGroupsConcurrently(groups, bGoodResult))
+   {
+      std::unique_ptr<ProcessBuffers> buffers;
 
-      // If the buffer size has changed, then (re)allocate the buffers
-      if (prevBufferSize != mBufferSize)
+      for (size_t i = 0; i < groups.size(); i++)
       {
-         // Get rid of any previous buffers
-         if (mInBuffer)
-         {
-            for (int i = 0; i < mNumAudioIn; i++)
-            {
-               if (mInBuffer[i])
-               {
-                  delete [] mInBuffer[i];
-               }
-            }
-            delete [] mInBuffer;
-            delete [] mInBufPos;
-         }
+         const ProcessGroup &group = groups[i];
+         mSampleCnt = group.sampleCnt;
 
-         // Always create the number of input buffers the client expects even if we don't have
-         // the same number of channels.
-         mInBufPos = new float *[mNumAudioIn];
-         mInBuffer = new float *[mNumAudioIn];
-         for (int i = 0; i < mNumAudioIn; i++)
-         {
-            mInBuffer[i] = new float[mBufferSize];
-         }
+         // Let the client know the sample rate
+         SetSampleRate(group.left->GetRate());
+
+         // Get the block size the client wants to use
+         sampleCount max = group.left->GetMaxBlockSize() * 2;
+         mBlockSize = SetBlockSize(max);
 
-         // We won't be using more than the first 2 buffers, so clear the rest (if any)
-         for (int i = 2; i < mNumAudioIn; i++)
+         // Calculate the buffer size to be at least the max rounded up to the clients
+         // selected block size.
+         mBufferSize = ((max + (mBlockSize - 1)) / mBlockSize) * mBlockSize;
+
+         // If the sizes have changed, then (re)allocate the buffers
+         if (!buffers || buffers->bufferSize != mBufferSize || buffers->blockSize != mBlockSize)
          {
-            for (int j = 0; j < mBufferSize; j++)
-            {
-               mInBuffer[i][j] = 0.0;
-            }
+            buffers.reset();
+            buffers = std::make_unique<ProcessBuffers>(mNumAudioIn, mNumAudioOut,
+                                                       mBufferSize, mBlockSize);
          }
 
-         // Get rid of any previous buffers
-         if (mOutBuffer)
+         // Go process the track(s)
+         bGoodResult = ProcessTrack(i, const_cast<ChannelName *>(group.map),
+                                    group.left, group.right,
+                                    group.leftStart, group.rightStart, group.len,
+                                    *buffers);
+         if (!bGoodResult)
          {
-            for (int i = 0; i < mNumAudioOut; i++)
-            {
-               if (mOutBuffer[i])
-               {
-                  delete [] mOutBuffer[i];
-               }
-            }
-            delete [] mOutBuffer;
-            delete [] mOutBufPos;
+            break;
          }
+      }
+   }
 
-         // Always create the number of output buffers the client expects even if we don't have
-         // the same number of channels.
-         mOutBufPos = new float *[mNumAudioOut];
-         mOutBuffer = new float *[mNumAudioOut];
-         for (int i = 0; i < mNumAudioOut; i++)
+   if (bGoodResult && GetType() == EffectTypeGenerate)
+   {
+      mT1 = mT0 + mDuration;
+   }
+
+   return bGoodResult;
+}
+
+bool Effect::ProcessGroupsConcurrently(const std::vector<ProcessGroup> &groups,
+                                       bool &result)
+{
+   // Only effects that keep no state can run on several groups at once,
+   // and they must see one sample rate and block size for all of them
+   if (GetType() != EffectTypeProcess || !IsStateless() || groups.size() < 2)
+   {
+      return false;
+   }
+
+   const double rate = groups[0].left->GetRate();
+   const sampleCount max = groups[0].left->GetMaxBlockSize() * 2;
+   sampleCount total = 0;
+   for (size_t i = 0; i < groups.size(); i++)
+   {
+      const ProcessGroup &group = groups[i];
+      if (group.left->GetRate() != rate || group.left->GetMaxBlockSize() * 2 != max ||
+          (group.right && group.right->GetMaxBlockSize() * 2 != max))
+      {
+         return false;
+      }
+      total += group.len;
+   }
+
+   long threads = GetThreadCount();
+   if (threads == 1)
+   {
+      return false;
+   }
+   // The calling thread only shows progress, so one more may do work
+   threads = wxMin(threads, (long) groups.size()) + 1;
+
+   SetSampleRate(rate);
+   mBlockSize = SetBlockSize(max);
+   mBufferSize = ((max + (mBlockSize - 1)) / mBlockSize) * mBlockSize;
+
+   WorkerPool pool(threads);
+   std::vector< movable_ptr<ProcessBuffers> > buffers(pool.GetThreadCount());
+
+   ConcurrentState state;
+   state.done.resize(groups.size(), 0);
+   state.stop = false;
+
+   pool.ParallelFor(groups.size(), [&](int i, int thread)
+   {
+      {
+         wxMutexLocker locker(state.mutex);
+         if (state.stop)
          {
-            // Output buffers get an extra mBlockSize worth to give extra room if
-            // the plugin adds latency
-            mOutBuffer[i] = new float[mBufferSize + mBlockSize];
+            return;
          }
       }
 
-      // (Re)Set the input buffer positions
-      for (int i = 0; i < mNumAudioIn; i++)
+      auto &threadBuffers = buffers[thread];
+      if (!threadBuffers)
       {
-         mInBufPos[i] = mInBuffer[i];
+         threadBuffers = make_movable<ProcessBuffers>(mNumAudioIn, mNumAudioOut,
+                                                      mBufferSize, mBlockSize);
       }
 
-      // (Re)Set the output buffer positions
-      for (int i = 0; i < mNumAudioOut; i++)
+      const ProcessGroup &group = groups[i];
+      if (!ProcessTrack(i, const_cast<ChannelName *>(group.map),
+                        group.left, group.right,
+                        group.leftStart, group.rightStart, group.len,
+                        *threadBuffers, &state))
       {
-         mOutBufPos[i] = mOutBuffer[i];
+         wxMutexLocker locker(state.mutex);
+         state.stop = true;
       }
+   },
+   [&]
+   {
+      ShowConcurrentProgress(state, total, 0.0, 1.0);
+   },
+   100);
+
+   // Every group was processed as it would have been alone, so the
+   // result is that of the serial loop
+   result = !state.stop;
+   return true;
+}
 
-      // Clear unused input buffers
-      if (!right && !clear && mNumAudioIn > 1)
+long Effect::GetThreadCount()
+{
+   long threads = gPrefs->Read(wxT("/Effects/Threads"), 0L);
+   if (threads <= 0)
+   {
+      threads = WorkerPool::GetDefaultThreadCount();
+   }
+   return threads;
+}
+
+void Effect::ShowConcurrentProgress(ConcurrentState &state, sampleCount total,
+                                    double fracStart, double fracEnd)
+{
+   sampleCount done = 0;
+   {
+      wxMutexLocker locker(state.mutex);
+      if (state.stop)
       {
-         for (int j = 0; j < mBufferSize; j++)
-         {
-            mInBuffer[1][j] = 0.0;
-         }
-         clear = true;
+         return;
       }
-
-      // Go process the track(s)
-      bGoodResult = ProcessTrack(count, map, left, right, leftStart, rightStart, len);
-      if (!bGoodResult)
+      for (size_t i = 0; i < state.done.size(); i++)
       {
-         break;
+         done += state.done[i];
       }
+   }
+
+   // The workers change the tracks, which a repaint during the
+   // progress update would read, so hold off their writes meanwhile
+   bool cancelled;
+   {
+      wxMutexLocker writeLocker(state.writeMutex);
+      cancelled = total > 0 &&
+         TotalProgress(fracStart + (fracEnd - fracStart) * done / (double) total);
+   }
+   if (cancelled)
+   {
+      wxMutexLocker locker(state.mutex);
+      state.stop = true;
+   }
+}
+
+bool Effect::ProcessJobs(const std::vector<sampleCount> &lengths,
+                         const JobFunction &job,
+                         double fracStart, double fracEnd)
+{
+   ConcurrentState state;
+   state.done.resize(lengths.size(), 0);
+   state.stop = false;
 
-      count++;
+   sampleCount total = 0;
+   for (size_t i = 0; i < lengths.size(); i++)
+   {
+      total += lengths[i];
    }
 
-   if (mOutBuffer)
+   long threads = wxMin(GetThreadCount(), (long) lengths.size());
+
+   mJobState = &state;
+   mJobTotal = total;
+   mJobFracStart = fracStart;
+   mJobFracEnd = fracEnd;
+   mJobsConcurrent = threads > 1;
+
+   if (!mJobsConcurrent)
    {
-      for (int i = 0; i < mNumAudioOut; i++)
+      for (size_t i = 0; i < lengths.size() && !state.stop; i++)
       {
-         delete [] mOutBuffer[i];
+         JobProgress progress(*this, i);
+         if (!job(i, progress))
+         {
+            state.stop = true;
+         }
       }
-      delete [] mOutBuffer;
-      delete [] mOutBufPos;
-      mOutBuffer = NULL;
-      mOutBufPos = NULL;
    }
+   else
+   {
+      // The calling thread only shows progress, so one more may do work
+      WorkerPool pool(threads + 1);
+      pool.ParallelFor(lengths.size(), [&](int i, int WXUNUSED(thread))
+      {
+         {
+            wxMutexLocker locker(state.mutex);
+            if (state.stop)
+            {
+               return;
+            }
+         }
+
+         JobProgress progress(*this, i);
+         if (!job(i, progress))
+         {
+            wxMutexLocker locker(state.mutex);
+            state.stop = true;
+         }
+      },
+      [&]
+      {
+         ShowConcurrentProgress(state, total, fracStart, fracEnd);
+      },
+      100);
+   }
+
+   mJobState = NULL;
+   mJobsConcurrent = false;
 
-   if (mInBuffer)
+   return !state.stop;
+}
+
+bool Effect::JobProgress::Update(sampleCount done)
+{
+   ConcurrentState &state = *mEffect.mJobState;
+   {
+      wxMutexLocker locker(state.mutex);
+      state.done[mJob] = done;
+   }
+
+   // Alone, the job shows its progress itself
+   if (!mEffect.mJobsConcurrent)
    {
-      for (int i = 0; i < mNumAudioIn; i++)
+      mEffect.ShowConcurrentProgress(state, mEffect.mJobTotal,
+                                     mEffect.mJobFracStart, mEffect.mJobFracEnd);
+   }
+
+   wxMutexLocker locker(state.mutex);
+   return state.stop;
+}
+
+wxMutex &Effect::JobProgress::GetWriteMutex()
+{
+   return mEffect.mJobState->writeMutex;
+}
+
+Effect::ProcessBuffers::ProcessBuffers(int numAudioIn, int numAudioOut,
+                                       sampleCount bufferSize, sampleCount blockSize)
+   : numAudioIn(numAudioIn)
+   , numAudioOut(numAudioOut)
+   , bufferSize(bufferSize)
+   , blockSize(blockSize)
+   , cleared(false)
+{
+   // Always create the number of input buffers the client expects even if we don't have
+   // the same number of channels.
+   inPos = new float *[numAudioIn];
+   in = new float *[numAudioIn];
+   for (int i = 0; i < numAudioIn; i++)
+   {
+      in[i] = new float[bufferSize];
+   }
+
+   // We won't be using more than the first 2 buffers, so clear the rest (if any)
+   for (int i = 2; i < numAudioIn; i++)
+   {
+      for (int j = 0; j < bufferSize; j++)
       {
-         delete [] mInBuffer[i];
+         in[i][j] = 0.0;
       }
-      delete [] mInBuffer;
-      delete [] mInBufPos;
-      mInBuffer = NULL;
-      mInBufPos = NULL;
    }
 
-   if (bGoodResult && GetType() == EffectTypeGenerate)
+   // Always create the number of output buffers the client expects even if we don't have
+   // the same number of channels.
+   outPos = new float *[numAudioOut];
+   out = new float *[numAudioOut];
+   for (int i = 0; i < numAudioOut; i++)
    {
-      mT1 = mT0 + mDuration;
+      // Output buffers get an extra blockSize worth to give extra room if
+      // the plugin adds latency
+      out[i] = new float[bufferSize + blockSize];
    }
+}
 
-   return bGoodResult;
+Effect::ProcessBuffers::~ProcessBuffers()
+{
+   for (int i = 0; i < numAudioOut; i++)
+   {
+      delete [] out[i];
+   }
+   delete [] out;
+   delete [] outPos;
+
+   for (int i = 0; i < numAudioIn; i++)
+   {
+      delete [] in[i];
+   }
+   delete [] in;
+   delete [] inPos;
 }
 
 bool Effect::ProcessTrack(int count,
@@ -1552,9 +1725,38 @@ bool Effect::ProcessTrack(int count,
                           WaveTrack *right,
                           sampleCount leftStart,
                           sampleCount rightStart,
-                          sampleCount len)
+                          sampleCount len,
+                          ProcessBuffers &buffers,
+                          ConcurrentState *concurrent)
 {
    bool rc = true;
+   const int numChannels = right ? 2 : 1;
+
+   // (Re)Set the input buffer positions
+   for (int i = 0; i < buffers.numAudioIn; i++)
+   {
+      buffers.inPos[i] = buffers.in[i];
+   }
+
+   // (Re)Set the output buffer positions
+   for (int i = 0; i < buffers.numAudioOut; i++)
+   {
+      buffers.outPos[i] = buffers.out[i];
+   }
+
+   // Clear unused input buffers
+   if (right)
+   {
+      buffers.cleared = false;
+   }
+   else if (!buffers.cleared && buffers.numAudioIn > 1)
+   {
+      for (int j = 0; j < buffers.bufferSize; j++)
+      {
+         buffers.in[1][j] = 0.0;
+      }
+      buffers.cleared = true;
+   }
 
    // Give the plugin a chance to initialize
    if (!ProcessInitialize(len, map))
@@ -1589,7 +1791,7 @@ bool Effect::ProcessTrack(int count,
    sampleCount outputBufferCnt = 0;
    bool cleared = false;
 
-   int chans = wxMin(mNumAudioOut, mNumChannels);
+   int chans = wxMin(mNumAudioOut, numChannels);
 
    std::unique_ptr<WaveTrack> genLeft, genRight;
    sampleCount genLength = 0;
@@ -1618,6 +1820,25 @@ bool Effect::ProcessTrack(int count,
       }
    }
 
+   // Given enough samples, read ahead and write behind on other threads,
+   // so that the disk and the effect work at the same time.  Other
+   // groups processed at once keep the disk busy enough.
+   std::unique_ptr<EffectPipeline> pipeline;
+   if (!concurrent && (isProcessor || isGenerator) &&
+       (isGenerator ? genLength : len) > 2 * mBufferSize &&
+       EffectPipeline::IsEnabled())
+   {
+      pipeline = std::make_unique<EffectPipeline>(
+         left, right, leftStart, rightStart, isProcessor ? len : 0, mBufferSize,
+         isGenerator ? genLeft.get() : left, isGenerator ? genRight.get() : right,
+         isGenerator, chans, mBufferSize + mBlockSize);
+      if (!pipeline->IsOk())
+      {
+         pipeline.reset();
+      }
+   }
+   wxStopWatch progressTimer;
+
    // Call the effect until we run out of input or delayed samples
    while (inputRemaining || delayRemaining)
    {
@@ -1635,16 +1856,23 @@ bool Effect::ProcessTrack(int count,
             }
 
             // Fill the input buffers
-            left->Get((samplePtr) mInBuffer[0], floatSample, inLeftPos, inputBufferCnt);
-            if (right)
+            if (pipeline)
             {
-               right->Get((samplePtr) mInBuffer[1], floatSample, inRightPos, inputBufferCnt);
+               pipeline->GetInput(buffers.in);
+            }
+            else
+            {
+               left->Get((samplePtr) buffers.in[0], floatSample, inLeftPos, inputBufferCnt);
+               if (right)
+               {
+                  right->Get((samplePtr) buffers.in[1], floatSample, inRightPos, inputBufferCnt);
+               }
             }
 
             // Reset the input buffer positions
-            for (int i = 0; i < mNumChannels; i++)
+            for (int i = 0; i < numChannels; i++)
             {
-               mInBufPos[i] = mInBuffer[i];
+               buffers.inPos[i] = buffers.in[i];
             }
          }
 
@@ -1659,11 +1887,11 @@ bool Effect::ProcessTrack(int count,
             // Clear the remainder of the buffers so that a full block can be passed
             // to the effect
             sampleCount cnt = mBlockSize - curBlockSize;
-            for (int i = 0; i < mNumChannels; i++)
+            for (int i = 0; i < numChannels; i++)
             {
                for (int j = 0 ; j < cnt; j++)
                {
-                  mInBufPos[i][j + curBlockSize] = 0.0;
+                  buffers.inPos[i][j + curBlockSize] = 0.0;
                }
             }
 
@@ -1695,14 +1923,14 @@ bool Effect::ProcessTrack(int count,
          if (!cleared)
          {
             // Reset the input buffer positions
-            for (int i = 0; i < mNumChannels; i++)
+            for (int i = 0; i < numChannels; i++)
             {
-               mInBufPos[i] = mInBuffer[i];
+               buffers.inPos[i] = buffers.in[i];
 
                // And clear
                for (int j = 0; j < mBlockSize; j++)
                {
-                  mInBuffer[i][j] = 0.0;
+                  buffers.in[i][j] = 0.0;
                }
             }
             cleared = true;
@@ -1713,7 +1941,7 @@ bool Effect::ProcessTrack(int count,
       sampleCount processed;
       try
       {
-         processed = ProcessBlock(mInBufPos, mOutBufPos, curBlockSize);
+         processed = ProcessBlock(buffers.inPos, buffers.outPos, curBlockSize);
       }
       catch(...)
       {
@@ -1725,9 +1953,9 @@ bool Effect::ProcessTrack(int count,
       // Bump to next input buffer position
       if (inputRemaining)
       {
-         for (int i = 0; i < mNumChannels; i++)
+         for (int i = 0; i < numChannels; i++)
          {
-            mInBufPos[i] += curBlockSize;
+            buffers.inPos[i] += curBlockSize;
          }
          inputRemaining -= curBlockSize;
          inputBufferCnt -= curBlockSize;
@@ -1762,7 +1990,7 @@ bool Effect::ProcessTrack(int count,
             curBlockSize -= curDelay;
             for (int i = 0; i < chans; i++)
             {
-               memmove(mOutBufPos[i], mOutBufPos[i] + curDelay, sizeof(float) * curBlockSize);
+               memmove(buffers.outPos[i], buffers.outPos[i] + curDelay, sizeof(float) * curBlockSize);
             }
             curDelay = 0;
          }
@@ -1777,41 +2005,52 @@ bool Effect::ProcessTrack(int count,
          // Bump to next output buffer position
          for (int i = 0; i < chans; i++)
          {
-            mOutBufPos[i] += curBlockSize;
+            buffers.outPos[i] += curBlockSize;
          }
       }
       // Output buffers have filled
       else
       {
-         if (isProcessor)
+         if (pipeline)
+         {
+            // Hand them to the writer, for empty ones
+            pipeline->PutOutput(buffers.out, outputBufferCnt, outLeftPos, outRightPos);
+         }
+         else if (isProcessor)
          {
+            std::unique_ptr<wxMutexLocker> writeLocker;
+            if (concurrent)
+            {
+               writeLocker = std::make_unique<wxMutexLocker>(concurrent->writeMutex);
+            }
+
             // Write them out
-            left->Set((samplePtr) mOutBuffer[0], floatSample, outLeftPos, outputBufferCnt);
+            left->Set((samplePtr) buffers.out[0], floatSample, outLeftPos, outputBufferCnt);
             if (right)
             {
                if (chans >= 2)
                {
-                  right->Set((samplePtr) mOutBuffer[1], floatSample, outRightPos, outputBufferCnt);
+                  right->Set((samplePtr) buffers.out[1], floatSample, outRightPos, outputBufferCnt);
                }
                else
                {
-                  right->Set((samplePtr) mOutBuffer[0], floatSample, outRightPos, outputBufferCnt);
+                  right->Set((samplePtr) buffers.out[0], floatSample, outRightPos, outputBufferCnt);
                }
             }
          }
          else if (isGenerator)
          {
-            genLeft->Append((samplePtr) mOutBuffer[0], floatSample, outputBufferCnt);
+            genLeft->Append((samplePtr) buffers.out[0], floatSample, outputBufferCnt);
             if (genRight)
             {
-               genRight->Append((samplePtr) mOutBuffer[1], floatSample, outputBufferCnt);
+               genRight->Append((samplePtr) buffers.out[1], floatSample, outputBufferCnt);
             }
          }
 
          // Reset the output buffer positions
          for (int i = 0; i < chans; i++)
          {
-            mOutBufPos[i] = mOutBuffer[i];
+            buffers.outPos[i] = buffers.out[i];
          }
 
          // Bump to the next track position
@@ -1820,7 +2059,33 @@ bool Effect::ProcessTrack(int count,
          outputBufferCnt = 0;
       }
 
-      if (mNumChannels > 1)
+      // The writer may be changing the tracks, which a repaint during
+      // the progress update would read, so it must be held off meanwhile.
+      // Update less often, so that waiting for it seldom delays the effect.
+      std::unique_ptr<wxMutexLocker> trackLocker;
+      if (pipeline)
+      {
+         if (progressTimer.Time() < 100)
+         {
+            continue;
+         }
+         progressTimer.Start();
+         trackLocker = std::make_unique<wxMutexLocker>(pipeline->GetTrackMutex());
+      }
+
+      if (concurrent)
+      {
+         // The calling thread of ProcessPass() shows the progress of all
+         // the groups, and tells them when to stop
+         wxMutexLocker locker(concurrent->mutex);
+         concurrent->done[count] = inLeftPos - leftStart;
+         if (concurrent->stop)
+         {
+            rc = false;
+            break;
+         }
+      }
+      else if (numChannels > 1)
       {
          if (TrackGroupProgress(count, (inLeftPos - leftStart) / (double) (isGenerator ? genLength : len)))
          {
@@ -1841,31 +2106,47 @@ bool Effect::ProcessTrack(int count,
    // Put any remaining output
    if (outputBufferCnt)
    {
-      if (isProcessor)
+      if (pipeline)
       {
-         left->Set((samplePtr) mOutBuffer[0], floatSample, outLeftPos, outputBufferCnt);
+         pipeline->PutOutput(buffers.out, outputBufferCnt, outLeftPos, outRightPos);
+      }
+      else if (isProcessor)
+      {
+         std::unique_ptr<wxMutexLocker> writeLocker;
+         if (concurrent)
+         {
+            writeLocker = std::make_unique<wxMutexLocker>(concurrent->writeMutex);
+         }
+
+         left->Set((samplePtr) buffers.out[0], floatSample, outLeftPos, outputBufferCnt);
          if (right)
          {
             if (chans >= 2)
             {
-               right->Set((samplePtr) mOutBuffer[1], floatSample, outRightPos, outputBufferCnt);
+               right->Set((samplePtr) buffers.out[1], floatSample, outRightPos, outputBufferCnt);
             }
             else
             {
-               right->Set((samplePtr) mOutBuffer[0], floatSample, outRightPos, outputBufferCnt);
+               right->Set((samplePtr) buffers.out[0], floatSample, outRightPos, outputBufferCnt);
             }
          }
       }
       else if (isGenerator)
       {
-         genLeft->Append((samplePtr) mOutBuffer[0], floatSample, outputBufferCnt);
+         genLeft->Append((samplePtr) buffers.out[0], floatSample, outputBufferCnt);
          if (genRight)
          {
-            genRight->Append((samplePtr) mOutBuffer[1], floatSample, outputBufferCnt);
+            genRight->Append((samplePtr) buffers.out[1], floatSample, outputBufferCnt);
          }
       }
    }
 
+   // Let the writer finish
+   if (pipeline)
+   {
+      pipeline->Finish();
+   }
+
    if (isGenerator)
    {
       AudacityProject *p = GetActiveProject();
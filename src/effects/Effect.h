@@ -14,7 +14,9 @@
 
 #include "../Audacity.h"
 #include "../MemoryX.h"
+#include <functional>
 #include <set>
+#include <vector>
 
 #include "../MemoryX.h"
 #include <wx/bmpbuttn.h>
@@ -22,6 +24,7 @@
 #include <wx/intl.h>
 #include <wx/string.h>
 #include <wx/tglbtn.h>
+#include <wx/thread.h>
 
 class wxCheckBox;
 class wxChoice;
@@ -282,6 +285,12 @@ protected:
    // or amplitude modification
    virtual bool CheckWhetherSkipEffect() { return false; }
 
+   // Return true if ProcessBlock() keeps nothing from one call to the
+   // next, and ProcessInitialize() and ProcessFinalize() do nothing
+   // that depends on the track.  Then ProcessPass() may process several
+   // track groups at once, calling these from several threads.
+   virtual bool IsStateless() { return false; }
+
    // Actually do the effect here.
    virtual bool Process();
    virtual bool ProcessPass();
@@ -331,6 +340,32 @@ protected:
    // Calculates the start time and selection length in samples
    void GetSamples(WaveTrack *track, sampleCount *start, sampleCount *len);
 
+   // For effects that loop over their tracks themselves.  Calls
+   // job(i, progress) for each i in [0, lengths.size()), several at once
+   // if /Effects/Threads allows, so a job must keep its state apart from
+   // the others', and change its tracks only while holding
+   // progress.GetWriteMutex().  A job tells how many of its lengths[i]
+   // samples it has done by progress.Update(), which returns true if it
+   // should stop.  The progress shown runs from fracStart to fracEnd.
+   // Returns false if a job did, or the user cancelled.
+   class JobProgress
+   {
+   public:
+      bool Update(sampleCount done);
+      wxMutex &GetWriteMutex();
+
+   private:
+      friend class Effect;
+      JobProgress(Effect &effect, int job) : mEffect(effect), mJob(job) {}
+
+      Effect &mEffect;
+      int mJob;
+   };
+   using JobFunction = std::function<bool(int job, JobProgress &progress)>;
+   bool ProcessJobs(const std::vector<sampleCount> &lengths,
+                    const JobFunction &job,
+                    double fracStart = 0.0, double fracEnd = 1.0);
+
    void SetTimeWarper(TimeWarper *warper);
    TimeWarper *GetTimeWarper();
 
@@ -468,6 +503,69 @@ protected:
    void CommonInit();
    void CountWaveTracks();
 
+   // The buffers ProcessTrack() works in.  Each thread of a concurrent
+   // ProcessPass() has its own.
+   struct ProcessBuffers
+   {
+      ProcessBuffers(int numAudioIn, int numAudioOut,
+                     sampleCount bufferSize, sampleCount blockSize);
+      ~ProcessBuffers();
+
+      int numAudioIn;
+      int numAudioOut;
+      sampleCount bufferSize;
+      sampleCount blockSize;
+
+      float **in;
+      float **out;
+      float **inPos;
+      float **outPos;
+
+      // Whether in[1] holds zeros, for a mono track
+      bool cleared;
+
+      ProcessBuffers(const ProcessBuffers&) PROHIBITED;
+      ProcessBuffers &operator= (const ProcessBuffers&) PROHIBITED;
+   };
+
+   // Shared by the threads of a concurrent ProcessPass()
+   struct ConcurrentState
+   {
+      wxMutex mutex;
+      // These are guarded by mutex
+      std::vector<sampleCount> done; // samples processed of each group
+      bool stop;
+
+      // Held while writing to a track, since the tracks share the
+      // DirManager, and may share blocks
+      wxMutex writeMutex;
+   };
+
+   // A track, or a pair of linked tracks, for ProcessTrack()
+   struct ProcessGroup
+   {
+      WaveTrack *left;
+      WaveTrack *right;
+      sampleCount leftStart;
+      sampleCount rightStart;
+      sampleCount len;
+      sampleCount sampleCnt;
+      ChannelName map[3];
+   };
+
+   // Processes the groups at once if the effect and the tracks allow,
+   // setting result; returns false if they do not
+   bool ProcessGroupsConcurrently(const std::vector<ProcessGroup> &groups,
+                                  bool &result);
+
+   // The thread count /Effects/Threads asks for
+   static long GetThreadCount();
+
+   // Shows how much of total the workers have done, from the calling
+   // thread, stopping them if the user cancels
+   void ShowConcurrentProgress(ConcurrentState &state, sampleCount total,
+                               double fracStart, double fracEnd);
+
    // Driver for client effects
    bool ProcessTrack(int count,
                      ChannelNames map,
@@ -475,7 +573,9 @@ protected:
                      WaveTrack *right,
                      sampleCount leftStart,
                      sampleCount rightStart,
-                     sampleCount len);
+                     sampleCount len,
+                     ProcessBuffers &buffers,
+                     ConcurrentState *concurrent = NULL);
  
  //
  // private data
@@ -510,18 +610,19 @@ private:
    int mNumAudioIn;
    int mNumAudioOut;
 
-   float **mInBuffer;
-   float **mOutBuffer;
-   float **mInBufPos;
-   float **mOutBufPos;
-
    sampleCount mBufferSize;
    sampleCount mBlockSize;
-   int mNumChannels;
 
    wxArrayInt mGroupProcessor;
    int mCurrentProcessor;
 
+   // Set during ProcessJobs()
+   ConcurrentState *mJobState;
+   sampleCount mJobTotal;
+   double mJobFracStart;
+   double mJobFracEnd;
+   bool mJobsConcurrent;
+
    wxCriticalSection mRealtimeSuspendLock;
    int mRealtimeSuspendCount;
 
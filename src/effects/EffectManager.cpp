@@ -42,6 +42,7 @@ EffectManager::EffectManager()
    mRealtimeSuspended = true;
    mRealtimeLatency = 0;
    mRealtimeLock.Leave();
+   mRealtimeInUse = NULL;
    mSkipStateFlag = false;
 
 #if defined(EXPERIMENTAL_EFFECTS_RACK)
@@ -424,10 +425,10 @@ bool EffectManager::RealtimeIsSuspended()
 
 void EffectManager::RealtimeAddEffect(Effect *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
+   wxCriticalSectionLocker locker(mRealtimeLock);
 
-   // Initialize effect if realtime is already active
+   // Initialize effect if realtime is already active.  The audio thread
+   // does not see it yet, so it may take its time.
    if (mRealtimeActive)
    {
       // Initialize realtime processing
@@ -439,30 +440,39 @@ void EffectManager::RealtimeAddEffect(Effect *effect)
          effect->RealtimeAddProcessor(i, mRealtimeChans[i], mRealtimeRates[i]);
       }
    }
+
+   // Effects start out suspended; resume it along with the others
+   if (!mRealtimeSuspended)
+   {
+      effect->RealtimeResume();
+   }
    
    // Add to list of active effects
    mRealtimeEffects.Add(effect);
 
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
+   // And let the audio thread have it
+   RealtimePublish();
 }
 
 void EffectManager::RealtimeRemoveEffect(Effect *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
+   wxCriticalSectionLocker locker(mRealtimeLock);
+
+   // Remove from list of active effects, and wait for the audio thread
+   // to be done with it
+   mRealtimeEffects.Remove(effect);
+   RealtimePublish();
+
+   if (!mRealtimeSuspended)
+   {
+      effect->RealtimeSuspend();
+   }
 
    if (mRealtimeActive)
    {
       // Cleanup realtime processing
       effect->RealtimeFinalize();
    }
-      
-   // Remove from list of active effects
-   mRealtimeEffects.Remove(effect);
-
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
 }
 
 void EffectManager::RealtimeInitialize()
@@ -523,35 +533,33 @@ void EffectManager::RealtimeFinalize()
 
 void EffectManager::RealtimeSuspend()
 {
-   mRealtimeLock.Enter();
+   wxCriticalSectionLocker locker(mRealtimeLock);
 
    // Already suspended...bail
    if (mRealtimeSuspended)
    {
-      mRealtimeLock.Leave();
       return;
    }
 
-   // Show that we aren't going to be doing anything
+   // Show that we aren't going to be doing anything, and wait for the
+   // audio thread to be done with the effects
    mRealtimeSuspended = true;
+   RealtimePublish();
 
    // And make sure the effects don't either
    for (int i = 0, cnt = mRealtimeEffects.GetCount(); i < cnt; i++)
    {
       mRealtimeEffects[i]->RealtimeSuspend();
    }
-
-   mRealtimeLock.Leave();
 }
 
 void EffectManager::RealtimeResume()
 {
-   mRealtimeLock.Enter();
+   wxCriticalSectionLocker locker(mRealtimeLock);
 
    // Already running...bail
    if (!mRealtimeSuspended)
    {
-      mRealtimeLock.Leave();
       return;
    }
 
@@ -563,8 +571,18 @@ void EffectManager::RealtimeResume()
 
    // And we should too
    mRealtimeSuspended = false;
+   RealtimePublish();
+}
 
-   mRealtimeLock.Leave();
+void EffectManager::RealtimePublish()
+{
+   RealtimeChain chain;
+   if (!mRealtimeSuspended)
+   {
+      chain.assign(mRealtimeEffects.begin(), mRealtimeEffects.end());
+   }
+
+   mRealtimeChain.Publish(chain);
 }
 
 //
@@ -572,23 +590,20 @@ void EffectManager::RealtimeResume()
 //
 void EffectManager::RealtimeProcessStart()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   // Take the current chain, until RealtimeProcessEnd().  The main thread
+   // publishes a new chain rather than change this one, so we need not
+   // wait for it.  The chain is empty while suspended, either because of
+   // the audio stream being paused or because effects have been suspended.
+   mRealtimeInUse = mRealtimeChain.Acquire();
+   const RealtimeChain &chain = *mRealtimeInUse;
 
-   // Can be suspended because of the audio stream being paused or because effects
-   // have been suspended.
-   if (!mRealtimeSuspended)
+   for (size_t i = 0, cnt = chain.size(); i < cnt; i++)
    {
-      for (size_t i = 0, cnt = mRealtimeEffects.GetCount(); i < cnt; i++)
+      if (chain[i]->IsRealtimeActive())
       {
-         if (mRealtimeEffects[i]->IsRealtimeActive())
-         {
-            mRealtimeEffects[i]->RealtimeProcessStart();
-         }
+         chain[i]->RealtimeProcessStart();
       }
    }
-
-   mRealtimeLock.Leave();
 }
 
 //
@@ -596,14 +611,18 @@ void EffectManager::RealtimeProcessStart()
 //
 sampleCount EffectManager::RealtimeProcess(int group, int chans, float **buffers, sampleCount numSamples)
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   // Should be between RealtimeProcessStart() and RealtimeProcessEnd()
+   const bool acquired = !mRealtimeInUse;
+   const RealtimeChain &chain = acquired ? *mRealtimeChain.Acquire() : *mRealtimeInUse;
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended, so allow the samples to pass as-is.
-   if (mRealtimeSuspended || mRealtimeEffects.IsEmpty())
+   if (chain.empty())
    {
-      mRealtimeLock.Leave();
+      if (acquired)
+      {
+         mRealtimeChain.Release();
+      }
       return numSamples;
    }
 
@@ -626,11 +645,11 @@ sampleCount EffectManager::RealtimeProcess(int group, int chans, float **buffers
    // Now call each effect in the chain while swapping buffer pointers to feed the
    // output of one effect as the input to the next effect
    size_t called = 0;
-   for (size_t i = 0, cnt = mRealtimeEffects.GetCount(); i < cnt; i++)
+   for (size_t i = 0, cnt = chain.size(); i < cnt; i++)
    {
-      if (mRealtimeEffects[i]->IsRealtimeActive())
+      if (chain[i]->IsRealtimeActive())
       {
-         mRealtimeEffects[i]->RealtimeProcess(group, chans, ibuf, obuf, numSamples);
+         chain[i]->RealtimeProcess(group, chans, ibuf, obuf, numSamples);
          called++;
       }
 
@@ -658,7 +677,10 @@ sampleCount EffectManager::RealtimeProcess(int group, int chans, float **buffers
    // Remember the latency
    mRealtimeLatency = (int) (wxGetLocalTimeMillis() - start).GetValue();
 
-   mRealtimeLock.Leave();
+   if (acquired)
+   {
+      mRealtimeChain.Release();
+   }
 
    //
    // This is wrong...needs to handle tails
@@ -671,23 +693,23 @@ sampleCount EffectManager::RealtimeProcess(int group, int chans, float **buffers
 //
 void EffectManager::RealtimeProcessEnd()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   if (!mRealtimeInUse)
+   {
+      return;
+   }
 
-   // Can be suspended because of the audio stream being paused or because effects
-   // have been suspended.
-   if (!mRealtimeSuspended)
+   const RealtimeChain &chain = *mRealtimeInUse;
+   for (size_t i = 0, cnt = chain.size(); i < cnt; i++)
    {
-      for (size_t i = 0, cnt = mRealtimeEffects.GetCount(); i < cnt; i++)
+      if (chain[i]->IsRealtimeActive())
       {
-         if (mRealtimeEffects[i]->IsRealtimeActive())
-         {
-            mRealtimeEffects[i]->RealtimeProcessEnd();
-         }
+         chain[i]->RealtimeProcessEnd();
       }
    }
 
-   mRealtimeLock.Leave();
+   // Let the main thread change the effects
+   mRealtimeInUse = NULL;
+   mRealtimeChain.Release();
 }
 
 int EffectManager::GetRealtimeLatency()
@@ -32,6 +32,10 @@ effects.
 #include "audacity/EffectInterface.h"
 #include "../PluginManager.h"
 #include "Effect.h"
+#include "../RealtimeSnapshot.h"
+
+#include <atomic>
+#include <vector>
 
 WX_DEFINE_USER_EXPORTED_ARRAY(Effect *, EffectArray, class AUDACITY_DLL_API);
 WX_DECLARE_STRING_HASH_MAP_WITH_DECL(Effect *, EffectMap, class AUDACITY_DLL_API);
@@ -131,14 +135,25 @@ private:
 
    int mNumEffects;
 
+   // Publishes the chain the audio thread runs: the active effects, or
+   // none while suspended
+   void RealtimePublish();
+
+   // Only the main thread takes this, to change the chain; the audio
+   // thread reads mRealtimeChain without waiting
    wxCriticalSection mRealtimeLock;
    EffectArray mRealtimeEffects;
-   int mRealtimeLatency;
+   std::atomic<int> mRealtimeLatency;
    bool mRealtimeSuspended;
    bool mRealtimeActive;
    wxArrayInt mRealtimeChans;
    wxArrayDouble mRealtimeRates;
 
+   typedef std::vector<Effect *> RealtimeChain;
+   RealtimeSnapshot<RealtimeChain> mRealtimeChain;
+   // The chain the audio thread acquired in RealtimeProcessStart()
+   const RealtimeChain *mRealtimeInUse;
+
    // Set true if we want to skip pushing state 
    // after processing at effect run time.
    bool mSkipStateFlag;
@@ -0,0 +1,267 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  EffectPipeline.cpp
+
+*******************************************************************//**
+
+\class EffectPipeline
+\brief Reads and writes track samples on threads of their own while an
+effect processes them.
+
+  The reader reads from duplicates of the input tracks made at the
+  start.  Those share the input's block arrays, so a Set() on the
+  input track gives it new arrays and leaves the reader's alone.  Only
+  the writer changes the output tracks, holding the track mutex.
+
+*//*******************************************************************/
+
+#include "EffectPipeline.h"
+
+#include <algorithm>
+
+#include "../Prefs.h"
+#include "../WaveTrack.h"
+
+class EffectPipelineThread final : public wxThread
+{
+public:
+   EffectPipelineThread(EffectPipeline *pipeline,
+                        void (EffectPipeline::*loop)())
+      : wxThread(wxTHREAD_JOINABLE)
+      , mPipeline(pipeline)
+      , mLoop(loop)
+   {}
+
+   void *Entry() override
+   {
+      (mPipeline->*mLoop)();
+      return NULL;
+   }
+
+private:
+   EffectPipeline *mPipeline;
+   void (EffectPipeline::*mLoop)();
+};
+
+namespace {
+
+// Buffers in each direction, besides the ones the caller holds
+const int NumSlots = 3;
+
+EffectPipelineThread *StartThread(EffectPipeline *pipeline,
+                                  void (EffectPipeline::*loop)())
+{
+   EffectPipelineThread *thread = new EffectPipelineThread(pipeline, loop);
+   if (thread->Create() != wxTHREAD_NO_ERROR) {
+      delete thread;
+      return NULL;
+   }
+   thread->Run();
+   return thread;
+}
+
+}
+
+EffectPipeline::EffectPipeline
+   (const WaveTrack *left, const WaveTrack *right,
+    sampleCount leftStart, sampleCount rightStart,
+    sampleCount len, int bufferSize,
+    WaveTrack *outLeft, WaveTrack *outRight, bool append,
+    int outChannels, int outBufferSize)
+   : mLen(len)
+   , mBufferSize(bufferSize)
+   , mInChannels(right ? 2 : 1)
+   , mOutLeft(outLeft)
+   , mOutRight(outRight)
+   , mAppend(append)
+   , mOutChannels(outChannels)
+   , mInSlots(len > 0 ? NumSlots : 0)
+   , mOutSlots(NumSlots)
+   , mChanged(mMutex)
+   , mStopping(false)
+   , mFinishing(false)
+   , mReader(NULL)
+   , mWriter(NULL)
+{
+   mStart[0] = leftStart;
+   mStart[1] = rightStart;
+
+   for (auto &slot : mInSlots) {
+      for (int i = 0; i < 2; i++)
+         slot.channels[i] = i < mInChannels ? new float[bufferSize] : NULL;
+      mFreeIn.push_back(&slot);
+   }
+   for (auto &slot : mOutSlots) {
+      for (int i = 0; i < 2; i++)
+         slot.channels[i] = i < mOutChannels ? new float[outBufferSize] : NULL;
+      mFreeOut.push_back(&slot);
+   }
+
+   if (len > 0) {
+      // The duplicates share the blocks, so this is cheap
+      mLeft = static_cast<const Track*>(left)->Duplicate();
+      if (right)
+         mRight = static_cast<const Track*>(right)->Duplicate();
+      mReader = StartThread(this, &EffectPipeline::ReaderLoop);
+   }
+   mWriter = StartThread(this, &EffectPipeline::WriterLoop);
+}
+
+EffectPipeline::~EffectPipeline()
+{
+   Finish();
+
+   for (auto &slot : mInSlots)
+      for (int i = 0; i < 2; i++)
+         delete [] slot.channels[i];
+   for (auto &slot : mOutSlots)
+      for (int i = 0; i < 2; i++)
+         delete [] slot.channels[i];
+}
+
+bool EffectPipeline::IsEnabled()
+{
+   return gPrefs->Read(wxT("/Effects/PipelinedProcessing"), 1L) != 0;
+}
+
+void EffectPipeline::Exchange(Slot *slot, float **buffers, int nChannels)
+{
+   for (int i = 0; i < nChannels; i++)
+      std::swap(slot->channels[i], buffers[i]);
+}
+
+void EffectPipeline::GetInput(float **buffers)
+{
+   Slot *slot;
+   {
+      wxMutexLocker locker(mMutex);
+      while (mFullIn.empty())
+         mChanged.Wait();
+      slot = mFullIn.front();
+      mFullIn.pop_front();
+   }
+
+   // The slot takes the buffers the caller is done with
+   Exchange(slot, buffers, mInChannels);
+
+   wxMutexLocker locker(mMutex);
+   mFreeIn.push_back(slot);
+   mChanged.Broadcast();
+}
+
+void EffectPipeline::PutOutput(float **buffers, sampleCount count,
+                               sampleCount leftPos, sampleCount rightPos)
+{
+   Slot *slot;
+   {
+      wxMutexLocker locker(mMutex);
+      while (mFreeOut.empty())
+         mChanged.Wait();
+      slot = mFreeOut.front();
+      mFreeOut.pop_front();
+   }
+
+   Exchange(slot, buffers, mOutChannels);
+   slot->count = count;
+   slot->pos[0] = leftPos;
+   slot->pos[1] = rightPos;
+
+   wxMutexLocker locker(mMutex);
+   mFullOut.push_back(slot);
+   mChanged.Broadcast();
+}
+
+void EffectPipeline::Finish()
+{
+   {
+      wxMutexLocker locker(mMutex);
+      mFinishing = true;
+      mStopping = true;
+      mChanged.Broadcast();
+   }
+
+   // The writer empties the queue before it stops
+   if (mWriter) {
+      mWriter->Wait();
+      delete mWriter;
+      mWriter = NULL;
+   }
+   if (mReader) {
+      mReader->Wait();
+      delete mReader;
+      mReader = NULL;
+   }
+}
+
+void EffectPipeline::ReaderLoop()
+{
+   // Read in the same pieces as Effect::ProcessTrack() would
+   for (sampleCount pos = 0; pos < mLen; pos += mBufferSize) {
+      Slot *slot;
+      {
+         wxMutexLocker locker(mMutex);
+         while (!mStopping && mFreeIn.empty())
+            mChanged.Wait();
+         if (mStopping)
+            return;
+         slot = mFreeIn.front();
+         mFreeIn.pop_front();
+      }
+
+      slot->count = std::min<sampleCount>(mBufferSize, mLen - pos);
+      static_cast<WaveTrack*>(mLeft.get())->Get((samplePtr) slot->channels[0],
+         floatSample, mStart[0] + pos, slot->count);
+      if (mRight)
+         static_cast<WaveTrack*>(mRight.get())->Get((samplePtr) slot->channels[1],
+            floatSample, mStart[1] + pos, slot->count);
+
+      wxMutexLocker locker(mMutex);
+      mFullIn.push_back(slot);
+      mChanged.Broadcast();
+   }
+}
+
+void EffectPipeline::WriterLoop()
+{
+   while (true) {
+      Slot *slot;
+      {
+         wxMutexLocker locker(mMutex);
+         while (!mFinishing && mFullOut.empty())
+            mChanged.Wait();
+         if (mFullOut.empty())
+            return;
+         slot = mFullOut.front();
+         mFullOut.pop_front();
+      }
+
+      {
+         wxMutexLocker locker(mTrackMutex);
+         Write(*slot);
+      }
+
+      wxMutexLocker locker(mMutex);
+      mFreeOut.push_back(slot);
+      mChanged.Broadcast();
+   }
+}
+
+void EffectPipeline::Write(const Slot &slot)
+{
+   // A mono output goes to both tracks
+   float *const right = slot.channels[mOutChannels >= 2 ? 1 : 0];
+   if (mAppend) {
+      mOutLeft->Append((samplePtr) slot.channels[0], floatSample, slot.count);
+      if (mOutRight)
+         mOutRight->Append((samplePtr) right, floatSample, slot.count);
+   }
+   else {
+      mOutLeft->Set((samplePtr) slot.channels[0], floatSample,
+                    slot.pos[0], slot.count);
+      if (mOutRight)
+         mOutRight->Set((samplePtr) right, floatSample,
+                        slot.pos[1], slot.count);
+   }
+}
@@ -0,0 +1,115 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  EffectPipeline.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_EFFECT_PIPELINE__
+#define __AUDACITY_EFFECT_PIPELINE__
+
+#include "../Audacity.h"
+#include "../MemoryX.h"
+
+#include <deque>
+#include <vector>
+
+#include <wx/thread.h>
+
+#include "../Track.h"
+
+class WaveTrack;
+class EffectPipelineThread;
+
+/// Overlaps the reading of input samples and the writing of output
+/// samples with the processing in Effect::ProcessTrack().
+///
+/// A reader thread fills buffers from copies of the input tracks, which
+/// share their blocks, so that no one else sees it; a writer thread
+/// puts processed buffers into the output tracks.  There are a few
+/// buffers in each direction, so neither thread gets far ahead.
+/// Buffers are exchanged with the caller's rather than copied, so the
+/// caller's must be allocated with new[] in the same sizes.
+class EffectPipeline
+{
+public:
+   /// Reads len samples from left and right (which may be NULL), in
+   /// buffers of bufferSize samples.  If append, the output is appended
+   /// to outLeft and outRight; otherwise it replaces the samples of
+   /// outLeft and outRight at the positions given to PutOutput().
+   /// Output buffers hold outBufferSize samples.
+   EffectPipeline(const WaveTrack *left, const WaveTrack *right,
+                  sampleCount leftStart, sampleCount rightStart,
+                  sampleCount len, int bufferSize,
+                  WaveTrack *outLeft, WaveTrack *outRight, bool append,
+                  int outChannels, int outBufferSize);
+   /// Calls Finish()
+   ~EffectPipeline();
+
+   /// False if the threads could not be started
+   bool IsOk() const { return (mLen == 0 || mReader) && mWriter; }
+
+   /// Exchanges buffers[0], and buffers[1] if there is a right track,
+   /// for the next filled input buffers, waiting for them if need be
+   void GetInput(float **buffers);
+
+   /// Exchanges the first outChannels of buffers, holding count samples
+   /// for the given positions, for empty ones, waiting for them if the
+   /// writer is behind
+   void PutOutput(float **buffers, sampleCount count,
+                  sampleCount leftPos, sampleCount rightPos);
+
+   /// Lock this to look at the output tracks while the writer runs,
+   /// as a repaint during a progress update may
+   wxMutex &GetTrackMutex() { return mTrackMutex; }
+
+   /// Writes all output given so far, and stops the threads
+   void Finish();
+
+   /// Whether pipelining is turned on in preferences
+   static bool IsEnabled();
+
+private:
+   friend class EffectPipelineThread;
+
+   struct Slot {
+      float *channels[2];
+      sampleCount count;
+      sampleCount pos[2];
+   };
+
+   void ReaderLoop();
+   void WriterLoop();
+   void Exchange(Slot *slot, float **buffers, int nChannels);
+   void Write(const Slot &slot);
+
+   Track::Holder mLeft, mRight;
+   sampleCount mStart[2];
+   sampleCount mLen;
+   int mBufferSize;
+   int mInChannels;
+
+   WaveTrack *mOutLeft, *mOutRight;
+   bool mAppend;
+   int mOutChannels;
+
+   std::vector<Slot> mInSlots, mOutSlots;
+
+   wxMutex mMutex;
+   wxCondition mChanged;
+   // These are guarded by mMutex
+   std::deque<Slot*> mFreeIn, mFullIn, mFreeOut, mFullOut;
+   bool mStopping;
+   bool mFinishing;
+
+   wxMutex mTrackMutex;
+
+   EffectPipelineThread *mReader;
+   EffectPipelineThread *mWriter;
+
+   EffectPipeline(const EffectPipeline&) PROHIBITED;
+   EffectPipeline &operator= (const EffectPipeline&) PROHIBITED;
+};
+
+#endif
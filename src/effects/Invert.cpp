@@ -76,3 +76,10 @@ sampleCount EffectInvert::ProcessBlock(float **inBlock, float **outBlock, sample
 
    return blockLen;
 }
+
+// Effect implementation
+
+bool EffectInvert::IsStateless()
+{
+   return true;
+}
@@ -40,6 +40,10 @@ public:
    int GetAudioInCount() override;
    int GetAudioOutCount() override;
    sampleCount ProcessBlock(float **inBlock, float **outBlock, sampleCount blockLen) override;
+
+   // Effect implementation
+
+   bool IsStateless() override;
 };
 
 #endif
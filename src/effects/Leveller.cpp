@@ -196,6 +196,11 @@ bool EffectLeveller::Startup()
    return true;
 }
 
+bool EffectLeveller::IsStateless()
+{
+   return true;
+}
+
 void EffectLeveller::PopulateOrExchange(ShuttleGui & S)
 {
    wxASSERT(kNumPasses == WXSIZEOF(kPassStrings));
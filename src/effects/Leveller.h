@@ -46,6 +46,7 @@ public:
    // Effect implementation
 
    bool Startup() override;
+   bool IsStateless() override;
    void PopulateOrExchange(ShuttleGui & S) override;
    bool TransferDataToWindow() override;
    bool TransferDataFromWindow() override;
@@ -156,24 +156,13 @@ bool EffectNormalize::Process()
    else
       ratio = 1.0;
 
-   //Iterate over each track
+   //Gather the tracks into groups, each a mono track, or a stereo pair
+   //that shares one multiplier
    this->CopyInputTracks(); // Set up mOutputTracks.
-   bool bGoodResult = true;
+   std::vector<Group> groups;
+   std::vector<sampleCount> lengths;
    SelectedTrackListOfKindIterator iter(Track::Wave, mOutputTracks);
    WaveTrack *track = (WaveTrack *) iter.First();
-   WaveTrack *prevTrack;
-   prevTrack = track;
-   mCurTrackNum = 0;
-   wxString topMsg;
-   if(mDC && mGain)
-      topMsg = _("Removing DC offset and Normalizing...\n");
-   else if(mDC && !mGain)
-      topMsg = _("Removing DC offset...\n");
-   else if(!mDC && mGain)
-      topMsg = _("Normalizing without removing DC offset...\n");
-   else if(!mDC && !mGain)
-      topMsg = wxT("Not doing anything)...\n");   // shouldn't get here
-
    while (track) {
       //Get start and end times from track
       double trackStart = track->GetStartTime();
@@ -181,84 +170,71 @@ bool EffectNormalize::Process()
 
       //Set the current bounds to whichever left marker is
       //greater and whichever right marker is less:
-      mCurT0 = mT0 < trackStart? trackStart: mT0;
-      mCurT1 = mT1 > trackEnd? trackEnd: mT1;
+      Group group;
+      group.t0 = mT0 < trackStart? trackStart: mT0;
+      group.t1 = mT1 > trackEnd? trackEnd: mT1;
 
       // Process only if the right marker is to the right of the left marker
-      if (mCurT1 > mCurT0) {
-         wxString msg;
-         wxString trackName = track->GetName();
-
-         if(!track->GetLinked() || mStereoInd)
-            msg = topMsg + _("Analyzing: ") + trackName;
-         else
-            msg = topMsg + _("Analyzing first track of stereo pair: ") + trackName;
-         AnalyseTrack(track, msg);  // sets mOffset and offset-adjusted mMin and mMax
-         if(!track->GetLinked() || mStereoInd) {   // mono or 'stereo tracks independently'
-            float extent = wxMax(fabs(mMax), fabs(mMin));
-            if( (extent > 0) && mGain )
-               mMult = ratio / extent;
-            else
-               mMult = 1.0;
-            msg = topMsg + _("Processing: ") + trackName;
-            if(track->GetLinked() || prevTrack->GetLinked())  // only get here if there is a linked track but we are processing independently
-               msg = topMsg + _("Processing stereo channels independently: ") + trackName;
-
-            if (!ProcessOne(track, msg))
-            {
-               bGoodResult = false;
-               break;
-            }
+      if (group.t1 > group.t0) {
+         group.tracks[0] = track;
+         group.numTracks = 1;
+         if (track->GetLinked() && !mStereoInd) {
+            // the multiplier of a linked stereo track depends on both
+            // channels, so they go together
+            track = (WaveTrack *) iter.Next();
+            if (track)
+               group.tracks[group.numTracks++] = track;
          }
-         else
-         {
-            // we have a linked stereo track
-            // so we need to find it's min, max and offset
-            // as they are needed to calc the multiplier for both tracks
-            float offset1 = mOffset;   // remember ones from first track
-            float min1 = mMin;
-            float max1 = mMax;
-            track = (WaveTrack *) iter.Next();  // get the next one
-            mCurTrackNum++;   // keeps progress bar correct
-            msg = topMsg + _("Analyzing second track of stereo pair: ") + trackName;
-            AnalyseTrack(track, msg);  // sets mOffset and offset-adjusted mMin and mMax
-            float offset2 = mOffset;   // ones for second track
-            float min2 = mMin;
-            float max2 = mMax;
-            float extent = wxMax(fabs(min1), fabs(max1));
-            extent = wxMax(extent, fabs(min2));
-            extent = wxMax(extent, fabs(max2));
-            if( (extent > 0) && mGain )
-               mMult = ratio / extent; // we need to use this for both linked tracks
-            else
-               mMult = 1.0;
-            mOffset = offset1;
-            track = (WaveTrack *) iter.Prev();  // go back to the first linked one
-            mCurTrackNum--;   // keeps progress bar correct
-            msg = topMsg + _("Processing first track of stereo pair: ") + trackName;
-            if (!ProcessOne(track, msg))
-            {
-               bGoodResult = false;
-               break;
-            }
-            mOffset = offset2;
-            track = (WaveTrack *) iter.Next();  // go to the second linked one
-            mCurTrackNum++;   // keeps progress bar correct
-            msg = topMsg + _("Processing second track of stereo pair: ") + trackName;
-            if (!ProcessOne(track, msg))
-            {
-               bGoodResult = false;
-               break;
-            }
+
+         //Analysing (if removing DC) and processing each count as a pass
+         sampleCount len = 0;
+         for (int i = 0; i < group.numTracks; i++) {
+            WaveTrack *t = group.tracks[i];
+            len += (t->TimeToLongSamples(group.t1) - t->TimeToLongSamples(group.t0)) *
+               (mDC ? 2 : 1);
          }
+
+         groups.push_back(group);
+         lengths.push_back(len);
       }
 
       //Iterate to the next track
-      prevTrack = track;
-      track = (WaveTrack *) iter.Next();
-      mCurTrackNum++;
+      if (track)
+         track = (WaveTrack *) iter.Next();
    }
 
+   if(mGain) {
+      // Since we need complete summary data, we need to block until the OD tasks are done for these tracks.
+      // Wait here, since the groups may be processed on other threads, which must not update the gui.
+      // TODO: should we restrict the flags to just the relevant block files (for selections)
+      for (size_t i = 0; i < groups.size(); i++) {
+         for (int j = 0; j < groups[i].numTracks; j++) {
+            while (groups[i].tracks[j]->GetODFlags()) {
+               // update the gui
+               mProgress->Update(0, wxT("Waiting for waveform to finish computing..."));
+               wxMilliSleep(100);
+            }
+         }
+      }
+   }
+
+   wxString topMsg;
+   if(mDC && mGain)
+      topMsg = _("Removing DC offset and Normalizing...\n");
+   else if(mDC && !mGain)
+      topMsg = _("Removing DC offset...\n");
+   else if(!mDC && mGain)
+      topMsg = _("Normalizing without removing DC offset...\n");
+   else if(!mDC && !mGain)
+      topMsg = wxT("Not doing anything)...\n");   // shouldn't get here
+   if (mProgress)
+      mProgress->Update(0, topMsg);
+
+   bool bGoodResult = ProcessJobs(lengths, [&](int i, JobProgress &progress)
+   {
+      return ProcessGroup(groups[i], ratio, progress);
+   });
+
    this->ReplaceProcessedTracks(bGoodResult);
    return bGoodResult;
 }
@@ -333,59 +309,78 @@ bool EffectNormalize::TransferDataFromWindow()
 
 // EffectNormalize implementation
 
-void EffectNormalize::AnalyseTrack(WaveTrack * track, const wxString &msg)
+// Analyses the tracks of group, then normalizes them.  This may run on
+// a thread of its own, so it keeps what it finds in group.
+bool EffectNormalize::ProcessGroup(Group &group, float ratio, JobProgress &progress)
 {
-   if(mGain) {
-      // Since we need complete summary data, we need to block until the OD tasks are done for this track
-      // TODO: should we restrict the flags to just the relevant block files (for selections)
-      while (track->GetODFlags()) {
-         // update the gui
-         mProgress->Update(0, wxT("Waiting for waveform to finish computing..."));
-         wxMilliSleep(100);
-      }
+   sampleCount done = 0;
+   float extent = 0;
+   for (int i = 0; i < group.numTracks; i++) {
+      float min, max;
+      if (!AnalyseTrack(group, i, min, max, progress, done))  // sets offset-adjusted min and max
+         return false;
+      extent = wxMax(extent, fabs(min));
+      extent = wxMax(extent, fabs(max));
+   }
+
+   // we need to use this for both linked tracks
+   if( (extent > 0) && mGain )
+      group.mult = ratio / extent;
+   else
+      group.mult = 1.0;
+
+   for (int i = 0; i < group.numTracks; i++) {
+      if (!ProcessOne(group, i, progress, done))
+         return false;
+   }
 
-      track->GetMinMax(&mMin, &mMax, mCurT0, mCurT1); // set mMin, mMax.  No progress bar here as it's fast.
+   return true;
+}
+
+// sets group.offsets[channel], and offset-adjusted min and max
+bool EffectNormalize::AnalyseTrack(Group &group, int channel, float &min, float &max,
+                                   JobProgress &progress, sampleCount &done)
+{
+   WaveTrack *track = group.tracks[channel];
+
+   if(mGain) {
+      // Process() waited for the OD tasks to finish computing the summary data
+      track->GetMinMax(&min, &max, group.t0, group.t1); // No progress bar here as it's fast.
    } else {
-      mMin = -1.0, mMax = 1.0;   // sensible defaults?
+      min = -1.0, max = 1.0;   // sensible defaults?
    }
 
+   group.offsets[channel] = 0.0;
    if(mDC) {
-      AnalyseDC(track, msg); // sets mOffset
-      mMin += mOffset;
-      mMax += mOffset;
-   } else {
-      mOffset = 0.0;
+      if (!AnalyseDC(group, channel, progress, done)) // sets offset
+         return false;
+      min += group.offsets[channel];
+      max += group.offsets[channel];
    }
+
+   return true;
 }
 
 //AnalyseDC() takes a track, transforms it to bunch of buffer-blocks,
 //and executes AnalyzeData on it...
-// sets mOffset
-bool EffectNormalize::AnalyseDC(WaveTrack * track, const wxString &msg)
+// sets group.offsets[channel]
+bool EffectNormalize::AnalyseDC(Group &group, int channel,
+                                JobProgress &progress, sampleCount &done)
 {
    bool rc = true;
    sampleCount s;
-
-   mOffset = 0.0; // we might just return
-
-   if(!mDC)  // don't do analysis if not doing dc removal
-      return(rc);
+   WaveTrack *track = group.tracks[channel];
 
    //Transform the marker timepoints to samples
-   sampleCount start = track->TimeToLongSamples(mCurT0);
-   sampleCount end = track->TimeToLongSamples(mCurT1);
-
-   //Get the length of the buffer (as double). len is
-   //used simply to calculate a progress meter, so it is easier
-   //to make it a double now than it is to do it later
-   double len = (double)(end - start);
+   sampleCount start = track->TimeToLongSamples(group.t0);
+   sampleCount end = track->TimeToLongSamples(group.t1);
 
    //Initiate a processing buffer.  This buffer will (most likely)
    //be shorter than the length of the track being processed.
    float *buffer = new float[track->GetMaxBlockSize()];
 
-   mSum = 0.0; // dc offset inits
-   mCount = 0;
+   double sum = 0.0; // dc offset inits
+   sampleCount count = 0;
 
    //Go through the track one buffer at a time. s counts which
    //sample the current buffer starts at.
@@ -402,14 +397,14 @@ bool EffectNormalize::AnalyseDC(WaveTrack * track, const wxString &msg)
       track->Get((samplePtr) buffer, floatSample, s, block);
 
       //Process the buffer.
-      AnalyzeData(buffer, block);
+      AnalyzeData(buffer, block, sum, count);
 
       //Increment s one blockfull of samples
       s += block;
 
       //Update the Progress meter
-      if (TrackProgress(mCurTrackNum,
-                        ((double)(s - start) / len)/2.0, msg)) {
+      done += block;
+      if (progress.Update(done)) {
          rc = false; //lda .. break, not return, so that buffer is deleted
          break;
       }
@@ -418,7 +413,7 @@ bool EffectNormalize::AnalyseDC(WaveTrack * track, const wxString &msg)
    //Clean up the buffer
    delete[] buffer;
 
-   mOffset = (float)(-mSum / mCount);  // calculate actual offset (amount that needs to be added on)
+   group.offsets[channel] = (float)(-sum / count);  // calculate actual offset (amount that needs to be added on)
 
    //Return true because the effect processing succeeded ... unless cancelled
    return rc;
@@ -426,20 +421,17 @@ bool EffectNormalize::AnalyseDC(WaveTrack * track, const wxString &msg)
 
 //ProcessOne() takes a track, transforms it to bunch of buffer-blocks,
 //and executes ProcessData, on it...
-// uses mMult and mOffset to normalize a track.  Needs to have them set before being called
-bool EffectNormalize::ProcessOne(WaveTrack * track, const wxString &msg)
+// uses group.mult and group.offsets[channel] to normalize a track.  Needs to have them set before being called
+bool EffectNormalize::ProcessOne(Group &group, int channel,
+                                 JobProgress &progress, sampleCount &done)
 {
    bool rc = true;
    sampleCount s;
+   WaveTrack *track = group.tracks[channel];
 
    //Transform the marker timepoints to samples
-   sampleCount start = track->TimeToLongSamples(mCurT0);
-   sampleCount end = track->TimeToLongSamples(mCurT1);
-
-   //Get the length of the buffer (as double). len is
-   //used simply to calculate a progress meter, so it is easier
-   //to make it a double now than it is to do it later
-   double len = (double)(end - start);
+   sampleCount start = track->TimeToLongSamples(group.t0);
+   sampleCount end = track->TimeToLongSamples(group.t1);
 
    //Initiate a processing buffer.  This buffer will (most likely)
    //be shorter than the length of the track being processed.
@@ -460,17 +452,20 @@ bool EffectNormalize::ProcessOne(WaveTrack * track, const wxString &msg)
       track->Get((samplePtr) buffer, floatSample, s, block);
 
       //Process the buffer.
-      ProcessData(buffer, block);
+      ProcessData(buffer, block, group.offsets[channel], group.mult);
 
       //Copy the newly-changed samples back onto the track.
-      track->Set((samplePtr) buffer, floatSample, s, block);
+      {
+         wxMutexLocker locker(progress.GetWriteMutex());
+         track->Set((samplePtr) buffer, floatSample, s, block);
+      }
 
       //Increment s one blockfull of samples
       s += block;
 
       //Update the Progress meter
-      if (TrackProgress(mCurTrackNum,
-                        0.5+((double)(s - start) / len)/2.0, msg)) {
+      done += block;
+      if (progress.Update(done)) {
          rc = false; //lda .. break, not return, so that buffer is deleted
          break;
       }
@@ -482,21 +477,21 @@ bool EffectNormalize::ProcessOne(WaveTrack * track, const wxString &msg)
    return rc;
 }
 
-void EffectNormalize::AnalyzeData(float *buffer, sampleCount len)
+void EffectNormalize::AnalyzeData(float *buffer, sampleCount len, double &sum, sampleCount &count)
 {
    sampleCount i;
 
    for(i=0; i<len; i++)
-      mSum += (double)buffer[i];
-   mCount += len;
+      sum += (double)buffer[i];
+   count += len;
 }
 
-void EffectNormalize::ProcessData(float *buffer, sampleCount len)
+void EffectNormalize::ProcessData(float *buffer, sampleCount len, float offset, float mult)
 {
    sampleCount i;
 
    for(i=0; i<len; i++) {
-      float adjFrame = (buffer[i] + mOffset) * mMult;
+      float adjFrame = (buffer[i] + offset) * mult;
       buffer[i] = adjFrame;
    }
 }
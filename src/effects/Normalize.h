@@ -56,11 +56,27 @@ public:
 private:
    // EffectNormalize implementation
 
-   bool ProcessOne(WaveTrack * t, const wxString &msg);
-   void AnalyseTrack(WaveTrack * track, const wxString &msg);
-   void AnalyzeData(float *buffer, sampleCount len);
-   bool AnalyseDC(WaveTrack * track, const wxString &msg);
-   void ProcessData(float *buffer, sampleCount len);
+   // A mono track, or a linked stereo pair unless mStereoInd.  The
+   // groups may be processed at once, so each keeps what it finds here.
+   struct Group
+   {
+      WaveTrack *tracks[2];
+      int numTracks;
+      double t0;
+      double t1;
+      float offsets[2];
+      float mult;
+   };
+
+   bool ProcessGroup(Group &group, float ratio, JobProgress &progress);
+   bool ProcessOne(Group &group, int channel,
+                   JobProgress &progress, sampleCount &done);
+   bool AnalyseTrack(Group &group, int channel, float &min, float &max,
+                     JobProgress &progress, sampleCount &done);
+   void AnalyzeData(float *buffer, sampleCount len, double &sum, sampleCount &count);
+   bool AnalyseDC(Group &group, int channel,
+                  JobProgress &progress, sampleCount &done);
+   void ProcessData(float *buffer, sampleCount len, float offset, float mult);
 
    void OnUpdateUI(wxCommandEvent & evt);
    void UpdateUI();
@@ -71,16 +87,6 @@ private:
    bool   mDC;
    bool   mStereoInd;
 
-   int    mCurTrackNum;
-   double mCurT0;
-   double mCurT1;
-   float  mMult;
-   float  mOffset;
-   float  mMin;
-   float  mMax;
-   double mSum;
-   sampleCount    mCount;
-
    wxCheckBox *mGainCheckBox;
    wxCheckBox *mDCCheckBox;
    wxTextCtrl *mLevelTextCtrl;
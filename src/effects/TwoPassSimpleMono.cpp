@@ -13,7 +13,8 @@ EffectSimpleMono.
 
 Inherit from it if your effect needs to pass twice over the data.
 It does the first pass on all selected tracks before going back and
-doing the second pass over all selected tracks.
+doing the second pass over all selected tracks.  Within a pass the
+tracks may be processed at once, each with a TrackState of its own.
 
 *//*******************************************************************/
 
@@ -46,10 +47,13 @@ bool EffectTwoPassSimpleMono::Process()
 
 bool EffectTwoPassSimpleMono::ProcessPass()
 {
-   //Iterate over each track
+   //Gather the selected tracks, each with a state of its own
+   std::vector<WaveTrack *> tracks;
+   std::vector< movable_ptr<TrackState> > states;
+   std::vector<sampleCount> lengths;
    SelectedTrackListOfKindIterator iter(Track::Wave, mOutputTracks);
    WaveTrack *track = (WaveTrack *) iter.First();
-   mCurTrackNum = 0;
+   int trackNum = 0;
    while (track) {
       //Get start and end times from track
       double trackStart = track->GetStartTime();
@@ -57,37 +61,70 @@ bool EffectTwoPassSimpleMono::ProcessPass()
 
       //Set the current bounds to whichever left marker is
       //greater and whichever right marker is less:
-      mCurT0 = mT0 < trackStart? trackStart: mT0;
-      mCurT1 = mT1 > trackEnd? trackEnd: mT1;
+      double t0 = mT0 < trackStart? trackStart: mT0;
+      double t1 = mT1 > trackEnd? trackEnd: mT1;
 
       // Process only if the right marker is to the right of the left marker
-      if (mCurT1 > mCurT0) {
-
-         //Transform the marker timepoints to samples
-         sampleCount start = track->TimeToLongSamples(mCurT0);
-         sampleCount end = track->TimeToLongSamples(mCurT1);
+      if (t1 > t0) {
+         movable_ptr<TrackState> state = NewTrackState();
+         state->trackNum = trackNum;
+         state->t0 = t0;
+         state->t1 = t1;
 
          //Get the track rate and samples
-         mCurRate = track->GetRate();
-         mCurChannel = track->GetChannel();
-
-         //NewTrackPass1/2() returns true by default
-         bool ret;
-         if (mPass == 0)
-            ret = NewTrackPass1();
-         else
-            ret = NewTrackPass2();
-         if (!ret)
-            return false;
-
-         //ProcessOne() (implemented below) processes a single track
-         if (!ProcessOne(track, start, end))
-            return false;
+         state->rate = track->GetRate();
+         state->channel = track->GetChannel();
+
+         tracks.push_back(track);
+         lengths.push_back(track->TimeToLongSamples(t1) - track->TimeToLongSamples(t0));
+         states.push_back(std::move(state));
       }
 
       //Iterate to the next track
       track = (WaveTrack *) iter.Next();
-      mCurTrackNum++;
+      trackNum++;
+   }
+
+   //The progress bar runs over both passes, unless there is only one
+   double fracStart = 0.0;
+   double fracEnd = 1.0;
+   if (!mSecondPassDisabled) {
+      fracStart = mPass * 0.5;
+      fracEnd = fracStart + 0.5;
+   }
+
+   //The tracks keep apart, so they may be processed at once
+   bool bGoodResult = ProcessJobs(lengths, [&](int i, JobProgress &progress)
+   {
+      TrackState &state = *states[i];
+
+      //NewTrackPass1/2() returns true by default
+      bool ret;
+      if (mPass == 0)
+         ret = NewTrackPass1(state);
+      else
+         ret = NewTrackPass2(state);
+      if (!ret)
+         return false;
+
+      //ProcessOne() (implemented below) processes a single track
+      return ProcessOne(tracks[i], state,
+                        tracks[i]->TimeToLongSamples(state.t0),
+                        tracks[i]->TimeToLongSamples(state.t1),
+                        progress);
+   }, fracStart, fracEnd);
+   if (!bGoodResult)
+      return false;
+
+   for (size_t i = 0; i < states.size(); i++) {
+      //EndTrackPass1/2() returns true by default
+      bool ret;
+      if (mPass == 0)
+         ret = EndTrackPass1(*states[i]);
+      else
+         ret = EndTrackPass2(*states[i]);
+      if (!ret)
+         return false;
    }
 
    return true;
@@ -96,17 +133,14 @@ bool EffectTwoPassSimpleMono::ProcessPass()
 
 //ProcessOne() takes a track, transforms it to bunch of buffer-blocks,
 //and executes ProcessSimpleMono on these blocks
-bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
-                                         sampleCount start, sampleCount end)
+bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track, TrackState &state,
+                                         sampleCount start, sampleCount end,
+                                         JobProgress &progress)
 {
    bool ret;
    sampleCount s, samples1, samples2, tmpcount;
    float *tmpfloat;
 
-   //Get the length of the buffer (as double). len is
-   //used simple to calculate a progress meter, so it is easier
-   //to make it a double now than it is to do it later
-   double len = (double)(end - start);
    sampleCount maxblock = track->GetMaxBlockSize();
 
    //Initiate a processing buffer.  This buffer will (most likely)
@@ -125,9 +159,9 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
 
    // Process the first buffer with a NULL previous buffer
    if (mPass == 0)
-      ret = TwoBufferProcessPass1(NULL, 0, buffer1, samples1);
+      ret = TwoBufferProcessPass1(state, NULL, 0, buffer1, samples1);
    else
-      ret = TwoBufferProcessPass2(NULL, 0, buffer1, samples1);
+      ret = TwoBufferProcessPass2(state, NULL, 0, buffer1, samples1);
    if (!ret) {
       delete[]buffer1;
       delete[]buffer2;
@@ -155,9 +189,9 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
 
       //Process the buffer.  If it fails, clean up and exit.
       if (mPass == 0)
-         ret = TwoBufferProcessPass1(buffer1, samples1, buffer2, samples2);
+         ret = TwoBufferProcessPass1(state, buffer1, samples1, buffer2, samples2);
       else
-         ret = TwoBufferProcessPass2(buffer1, samples1, buffer2, samples2);
+         ret = TwoBufferProcessPass2(state, buffer1, samples1, buffer2, samples2);
       if (!ret) {
          delete[]buffer1;
          delete[]buffer2;
@@ -167,17 +201,16 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
 
       //Processing succeeded. copy the newly-changed samples back
       //onto the track.
-      track->Set((samplePtr) buffer1, floatSample, s-samples1, samples1);
+      {
+         wxMutexLocker locker(progress.GetWriteMutex());
+         track->Set((samplePtr) buffer1, floatSample, s-samples1, samples1);
+      }
 
       //Increment s one blockfull of samples
       s += samples2;
 
       //Update the Progress meter
-      if (mSecondPassDisabled)
-         ret = TotalProgress((mCurTrackNum + (s-start)/len) / GetNumWaveTracks());
-      else
-         ret = TotalProgress((mCurTrackNum + (s-start)/len + GetNumWaveTracks()*mPass)/ (GetNumWaveTracks()*2));
-      if (ret) {
+      if (progress.Update(s - start)) {
          delete[]buffer1;
          delete[]buffer2;
          //Return false because the effect failed.
@@ -196,9 +229,9 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
 
    // Send the last buffer with a NULL pointer for the current buffer
    if (mPass == 0)
-      ret = TwoBufferProcessPass1(buffer1, samples1, NULL, 0);
+      ret = TwoBufferProcessPass1(state, buffer1, samples1, NULL, 0);
    else
-      ret = TwoBufferProcessPass2(buffer1, samples1, NULL, 0);
+      ret = TwoBufferProcessPass2(state, buffer1, samples1, NULL, 0);
 
    if (!ret) {
       delete[]buffer1;
@@ -209,7 +242,10 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
 
    //Processing succeeded. copy the newly-changed samples back
    //onto the track.
-   track->Set((samplePtr) buffer1, floatSample, s-samples1, samples1);
+   {
+      wxMutexLocker locker(progress.GetWriteMutex());
+      track->Set((samplePtr) buffer1, floatSample, s-samples1, samples1);
+   }
 
    //Clean up the buffer
    delete[]buffer1;
@@ -219,12 +255,27 @@ bool EffectTwoPassSimpleMono::ProcessOne(WaveTrack * track,
    return true;
 }
 
-bool EffectTwoPassSimpleMono::NewTrackPass1()
+movable_ptr<EffectTwoPassSimpleMono::TrackState> EffectTwoPassSimpleMono::NewTrackState()
+{
+   return make_movable<TrackState>();
+}
+
+bool EffectTwoPassSimpleMono::NewTrackPass1(TrackState & WXUNUSED(state))
+{
+   return true;
+}
+
+bool EffectTwoPassSimpleMono::NewTrackPass2(TrackState & WXUNUSED(state))
+{
+   return true;
+}
+
+bool EffectTwoPassSimpleMono::EndTrackPass1(TrackState & WXUNUSED(state))
 {
    return true;
 }
 
-bool EffectTwoPassSimpleMono::NewTrackPass2()
+bool EffectTwoPassSimpleMono::EndTrackPass2(TrackState & WXUNUSED(state))
 {
    return true;
 }
@@ -241,4 +292,3 @@ bool EffectTwoPassSimpleMono::InitPass2()
 {
    return true;
 }
-
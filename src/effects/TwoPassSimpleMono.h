@@ -33,25 +33,49 @@ protected:
    bool InitPass1() override;
    bool InitPass2() override;
 
+   // What a pass keeps for the one track it is on.  The tracks of a
+   // pass may be processed at once, on several threads, so whatever
+   // changes from buffer to buffer belongs in a subclass of this, and
+   // not in the effect.
+   struct TrackState
+   {
+      virtual ~TrackState() {}
+
+      int    trackNum;
+      double rate;
+      double t0;
+      double t1;
+      int    channel;
+   };
+
    // NEW virtuals
 
+   // Override this method if you need to keep more for each track
+   virtual movable_ptr<TrackState> NewTrackState();
+
    // Override these methods if you need to do things
    // before every track (including the first one)
-   virtual bool NewTrackPass1();
-   virtual bool NewTrackPass2();
+   virtual bool NewTrackPass1(TrackState &state);
+   virtual bool NewTrackPass2(TrackState &state);
+
+   // Override these methods if you need to gather what the tracks found,
+   // once all of them are done.  They are called on the calling thread,
+   // in the order of the tracks.
+   virtual bool EndTrackPass1(TrackState &state);
+   virtual bool EndTrackPass2(TrackState &state);
 
    // Override this method to actually process audio
-   virtual bool ProcessPass1(float * WXUNUSED(buffer), sampleCount WXUNUSED(len)) { return false; }
-   virtual bool ProcessPass2(float * WXUNUSED(buffer), sampleCount WXUNUSED(len)) { return false; }
+   virtual bool ProcessPass1(TrackState & WXUNUSED(state), float * WXUNUSED(buffer), sampleCount WXUNUSED(len)) { return false; }
+   virtual bool ProcessPass2(TrackState & WXUNUSED(state), float * WXUNUSED(buffer), sampleCount WXUNUSED(len)) { return false; }
 
    // Override this method to actually process audio with access to 2 sequential buffers at a time
    // Either buffer1 or buffer2 may be modified as needed
    // This allows implementation of processing with delays
    // The default just calls the one-buffer-at-a-time method
-   virtual bool TwoBufferProcessPass1(float *buffer1, sampleCount len1, float * WXUNUSED(buffer2), sampleCount WXUNUSED(len2))
-   { if(buffer1 != NULL) return ProcessPass1(buffer1, len1); else return true; }
-   virtual bool TwoBufferProcessPass2(float *buffer1, sampleCount len1, float * WXUNUSED(buffer2), sampleCount WXUNUSED(len2))
-   { if(buffer1 != NULL) return ProcessPass2(buffer1, len1); else return true; }
+   virtual bool TwoBufferProcessPass1(TrackState &state, float *buffer1, sampleCount len1, float * WXUNUSED(buffer2), sampleCount WXUNUSED(len2))
+   { if(buffer1 != NULL) return ProcessPass1(state, buffer1, len1); else return true; }
+   virtual bool TwoBufferProcessPass2(TrackState &state, float *buffer1, sampleCount len1, float * WXUNUSED(buffer2), sampleCount WXUNUSED(len2))
+   { if(buffer1 != NULL) return ProcessPass2(state, buffer1, len1); else return true; }
 
    // End of NEW virtuals
 
@@ -60,17 +84,13 @@ protected:
    void DisableSecondPass() { mSecondPassDisabled = true; }
 
    // Other useful information
-   int    mCurTrackNum;
-   double mCurRate;
-   double mCurT0;
-   double mCurT1;
-   int    mCurChannel;
    int    mPass;
    bool   mSecondPassDisabled;
 
 private:
-   bool ProcessOne(WaveTrack * t,
-                   sampleCount start, sampleCount end);
+   bool ProcessOne(WaveTrack * t, TrackState &state,
+                   sampleCount start, sampleCount end,
+                   JobProgress &progress);
    bool ProcessPass();
 };
 
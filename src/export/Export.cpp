@@ -43,6 +43,7 @@
 #include <wx/string.h>
 #include <wx/textctrl.h>
 #include <wx/timer.h>
+#include <wx/tls.h>
 #include <wx/dcmemory.h>
 #include <wx/window.h>
 
@@ -66,6 +67,7 @@
 #include "../Project.h"
 #include "../ShuttleGui.h"
 #include "../WaveTrack.h"
+#include "../widgets/ProgressDialog.h"
 #include "../widgets/Warning.h"
 #include "../AColor.h"
 #include "../Dependencies.h"
@@ -245,12 +247,109 @@ std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const WaveTrackConstArray &inpu
          bool highQuality, MixerSpec *mixerSpec)
 {
    // MB: the stop time should not be warped, this was a bug.
-   return std::make_unique<Mixer>(inputTracks,
+   auto mixer = std::make_unique<Mixer>(inputTracks,
                   Mixer::WarpOptions(timeTrack),
                   startTime, stopTime,
                   numOutChannels, outBufferSize, outInterleaved,
                   outRate, outFormat,
                   highQuality, mixerSpec);
+   // Concurrent exports already keep the processors busy
+   mixer->SetWorkerThreads(ExportJob::GetCurrent() ? 1 :
+                           gPrefs->Read(wxT("/Quality/MixerThreads"), 0L));
+   return mixer;
+}
+
+WaveTrackConstArray ExportPlugin::GetExportTracks(const TrackList *tracks,
+                                                  bool selectedOnly)
+{
+   ExportJob *job = ExportJob::GetCurrent();
+   if (job && job->GetTracks())
+      return *job->GetTracks();
+   return tracks->GetWaveTrackConstArray(selectedOnly, false);
+}
+
+void ExportPlugin::ShowExportError(const wxString &message)
+{
+   ExportJob *job = ExportJob::GetCurrent();
+   if (job)
+      job->AddError(message);
+   else
+      wxMessageBox(message);
+}
+
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+
+namespace {
+   // The job of each thread
+   wxTLS_TYPE(ExportJob *) sCurrentJob;
+}
+
+ExportJob::ExportJob(const std::atomic<int> &command, wxMutex &setupMutex,
+                     const WaveTrackConstArray *tracks)
+   : mCommand(command)
+   , mSetupMutex(setupMutex)
+   , mInSetup(false)
+   , mTracks(tracks)
+   , mDone(0.0)
+{
+}
+
+ExportJob::~ExportJob()
+{
+}
+
+void ExportJob::Enter()
+{
+   mSetupMutex.Lock();
+   mInSetup = true;
+   wxTLS_VALUE(sCurrentJob) = this;
+}
+
+void ExportJob::Leave()
+{
+   EndSetup();
+   wxTLS_VALUE(sCurrentJob) = NULL;
+}
+
+void ExportJob::EndSetup()
+{
+   if (mInSetup) {
+      mInSetup = false;
+      mSetupMutex.Unlock();
+   }
+}
+
+ExportJob *ExportJob::GetCurrent()
+{
+   return wxTLS_VALUE(sCurrentJob);
+}
+
+//----------------------------------------------------------------------------
+// ExportProgress
+//----------------------------------------------------------------------------
+
+ExportProgress::ExportProgress(const wxString &title, const wxString &message)
+   : mJob(ExportJob::GetCurrent())
+{
+   if (mJob)
+      mJob->EndSetup();
+   else
+      mDialog = std::make_unique<ProgressDialog>(title, message);
+}
+
+ExportProgress::~ExportProgress()
+{
+}
+
+int ExportProgress::Update(double current, double total)
+{
+   if (mDialog)
+      return mDialog->Update(current, total);
+
+   mJob->SetDone(total > 0 ? current / total : 0.0);
+   return mJob->GetCommand();
 }
 
 //----------------------------------------------------------------------------
@@ -12,12 +12,14 @@
 #define __AUDACITY_EXPORT__
 
 #include "../MemoryX.h"
+#include <atomic>
 #include <vector>
 #include <wx/dialog.h>
 #include <wx/dynarray.h>
 #include <wx/filename.h>
 #include <wx/panel.h>
 #include <wx/simplebook.h>
+#include <wx/thread.h>
 #include "../Tags.h"
 #include "../SampleFormat.h"
 
@@ -33,6 +35,7 @@ class MixerSpec;
 class TimeTrack;
 class Mixer;
 class WaveTrackConstArray;
+class ProgressDialog;
 
 class AUDACITY_DLL_API FormatInfo
 {
@@ -118,6 +121,14 @@ public:
                        const Tags *metadata = NULL,
                        int subformat = 0) = 0;
 
+   /** @brief Whether Export() may run on a worker thread doing an
+    * ExportJob, at the same time as other exports with this plug-in.
+    * Such a plug-in keeps no state of an export in its members, gets
+    * its tracks from GetExportTracks(), shows progress with an
+    * ExportProgress and errors with ShowExportError(), and writes the
+    * same bytes wherever and whenever it runs. */
+   virtual bool CanExportConcurrently(int WXUNUSED(format)) { return false; }
+
 protected:
    std::unique_ptr<Mixer> CreateMixer(const WaveTrackConstArray &inputTracks,
          const TimeTrack *timeTrack,
@@ -126,10 +137,98 @@ protected:
          double outRate, sampleFormat outFormat,
          bool highQuality = true, MixerSpec *mixerSpec = NULL);
 
+   /// The unmuted wave tracks to mix, or only the selected ones; but the
+   /// tracks of the ExportJob, if the calling thread does one that names
+   /// them
+   static WaveTrackConstArray GetExportTracks(const TrackList *tracks,
+                                              bool selectedOnly);
+
+   /// Shows the message now, or, on a thread doing an ExportJob, once
+   /// all the jobs are done
+   static void ShowExportError(const wxString &message);
+
 private:
    FormatInfoArray mFormatInfos;
 };
 
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+/// One of the exports that ExportMultiple runs at once, on worker
+/// threads.  While a thread does a job, the plug-in it calls shows no
+/// dialogs, but reports its progress and errors to the job, for
+/// ExportMultiple to show from the main thread.
+///
+/// What an export does before it makes its ExportProgress, such as
+/// reading preferences and making its mixer, is done by one job at a
+/// time, under a mutex that the jobs share; only the mixing and
+/// encoding that follow run at once.
+class AUDACITY_DLL_API ExportJob final
+{
+public:
+   /// command is what the user asks of all the jobs: eProgressSuccess
+   /// to go on, or eProgressCancelled, eProgressStopped or
+   /// eProgressFailed.  If tracks is not NULL, they are mixed in place
+   /// of the project's.
+   ExportJob(const std::atomic<int> &command, wxMutex &setupMutex,
+             const WaveTrackConstArray *tracks = NULL);
+   ~ExportJob();
+
+   /// Makes this the job of the calling thread, until Leave(), and
+   /// waits for the setup mutex
+   void Enter();
+   void Leave();
+   /// Releases the setup mutex, if the job still holds it
+   void EndSetup();
+
+   /// The job of the calling thread, or NULL
+   static ExportJob *GetCurrent();
+
+   const WaveTrackConstArray *GetTracks() const { return mTracks; }
+   int GetCommand() const { return mCommand.load(); }
+
+   /// Fraction of the export done
+   double GetDone() const { return mDone.load(); }
+   void SetDone(double done) { mDone.store(done); }
+
+   /// Only the job's own thread changes these
+   void AddError(const wxString &message) { mErrors.Add(message); }
+   const wxArrayString &GetErrors() const { return mErrors; }
+
+private:
+   const std::atomic<int> &mCommand;
+   wxMutex &mSetupMutex;
+   bool mInSetup;
+   const WaveTrackConstArray *mTracks;
+   std::atomic<double> mDone;
+   wxArrayString mErrors;
+
+   ExportJob(const ExportJob&) PROHIBITED;
+   ExportJob &operator= (const ExportJob&) PROHIBITED;
+};
+
+//----------------------------------------------------------------------------
+// ExportProgress
+//----------------------------------------------------------------------------
+/// Shows the progress of an export in a ProgressDialog of its own, or,
+/// on a thread doing an ExportJob, records it in the job.
+class AUDACITY_DLL_API ExportProgress final
+{
+public:
+   ExportProgress(const wxString &title, const wxString &message);
+   ~ExportProgress();
+
+   /// Returns eProgressSuccess to go on, as ProgressDialog::Update() does
+   int Update(double current, double total);
+
+private:
+   ExportJob *mJob;
+   std::unique_ptr<ProgressDialog> mDialog;
+
+   ExportProgress(const ExportProgress&) PROHIBITED;
+   ExportProgress &operator= (const ExportProgress&) PROHIBITED;
+};
+
 using ExportPluginArray = std::vector < movable_ptr< ExportPlugin > > ;
 WX_DEFINE_USER_EXPORTED_ARRAY_PTR(wxWindow *, WindowPtrArray, class AUDACITY_DLL_API);
 
@@ -42,6 +42,9 @@ and libvorbis examples, Monty <monty@xiph.org>
 #include "../Tags.h"
 
 #include "../Track.h"
+#include "../WorkerPool.h"
+
+#include "ParallelFLACEncoder.h"
 
 //----------------------------------------------------------------------------
 // ExportFLACOptions Class
@@ -191,12 +194,12 @@ public:
                MixerSpec *mixerSpec = NULL,
                const Tags *metadata = NULL,
                int subformat = 0) override;
+   bool CanExportConcurrently(int WXUNUSED(format)) override { return true; }
 
 private:
 
-   bool GetMetadata(AudacityProject *project, const Tags *tags);
-
-   FLAC__StreamMetadata *mMetadata;
+   bool GetMetadata(AudacityProject *project, const Tags *tags,
+                    FLAC__StreamMetadata *&metadata);
 };
 
 //----------------------------------------------------------------------------
@@ -234,77 +237,128 @@ int ExportFLAC::Export(AudacityProject *project,
    wxString bitDepthPref =
       gPrefs->Read(wxT("/FileFormats/FLACBitDepth"), wxT("16"));
 
-   FLAC::Encoder::File encoder;
-
-#ifdef LEGACY_FLAC
-   encoder.set_filename(OSOUTPUT(fName));
-#endif
-   encoder.set_channels(numChannels);
-   encoder.set_sample_rate(lrint(rate));
-
-   // See note in GetMetadata() about a bug in libflac++ 1.1.2
-   if (!GetMetadata(project, metadata)) {
-      return false;
-   }
-
-   if (mMetadata) {
-      encoder.set_metadata(&mMetadata, 1);
-   }
-
    sampleFormat format;
    if (bitDepthPref == wxT("24")) {
       format = int24Sample;
-      encoder.set_bits_per_sample(24);
    } else { //convert float to 16 bits
       format = int16Sample;
-      encoder.set_bits_per_sample(16);
    }
 
    // Duplicate the flac command line compression levels
    if (levelPref < 0 || levelPref > 8) {
       levelPref = 5;
    }
-   encoder.set_do_exhaustive_model_search(flacLevels[levelPref].do_exhaustive_model_search);
-   encoder.set_do_escape_coding(flacLevels[levelPref].do_escape_coding);
-   if (numChannels != 2) {
-      encoder.set_do_mid_side_stereo(false);
-      encoder.set_loose_mid_side_stereo(false);
+
+   // Sets up the encoder of the whole file, or each of the encoders of
+   // its segments when it is encoded on several threads
+   auto configure = [&](FLAC::Encoder::Stream &encoder) {
+      encoder.set_channels(numChannels);
+      encoder.set_sample_rate(lrint(rate));
+      encoder.set_bits_per_sample(format == int24Sample ? 24 : 16);
+      encoder.set_do_exhaustive_model_search(flacLevels[levelPref].do_exhaustive_model_search);
+      encoder.set_do_escape_coding(flacLevels[levelPref].do_escape_coding);
+      if (numChannels != 2) {
+         encoder.set_do_mid_side_stereo(false);
+         encoder.set_loose_mid_side_stereo(false);
+      }
+      else {
+         encoder.set_do_mid_side_stereo(flacLevels[levelPref].do_mid_side_stereo);
+         encoder.set_loose_mid_side_stereo(flacLevels[levelPref].loose_mid_side_stereo);
+      }
+      encoder.set_qlp_coeff_precision(flacLevels[levelPref].qlp_coeff_precision);
+      encoder.set_min_residual_partition_order(flacLevels[levelPref].min_residual_partition_order);
+      encoder.set_max_residual_partition_order(flacLevels[levelPref].max_residual_partition_order);
+      encoder.set_rice_parameter_search_dist(flacLevels[levelPref].rice_parameter_search_dist);
+      encoder.set_max_lpc_order(flacLevels[levelPref].max_lpc_order);
+   };
+
+   // Concurrent exports already keep the processors busy
+   long threads = gPrefs->Read(wxT("/FileFormats/FLACThreads"), 0L);
+   if (threads <= 0) {
+      threads = WorkerPool::GetDefaultThreadCount();
    }
-   else {
-      encoder.set_do_mid_side_stereo(flacLevels[levelPref].do_mid_side_stereo);
-      encoder.set_loose_mid_side_stereo(flacLevels[levelPref].loose_mid_side_stereo);
+   if (ExportJob::GetCurrent()) {
+      threads = 1;
+   }
+   // With loose mid-side stereo, the encoder picks the channel coding of
+   // a frame from what the frames before it chose, so segments begun
+   // afresh would not give the same file as one encoder
+   if (numChannels == 2 && flacLevels[levelPref].loose_mid_side_stereo) {
+      threads = 1;
    }
-   encoder.set_qlp_coeff_precision(flacLevels[levelPref].qlp_coeff_precision);
-   encoder.set_min_residual_partition_order(flacLevels[levelPref].min_residual_partition_order);
-   encoder.set_max_residual_partition_order(flacLevels[levelPref].max_residual_partition_order);
-   encoder.set_rice_parameter_search_dist(flacLevels[levelPref].rice_parameter_search_dist);
-   encoder.set_max_lpc_order(flacLevels[levelPref].max_lpc_order);
+
+   FLAC::Encoder::File encoder;
+   std::unique_ptr<ParallelFLACEncoder> parallel;
 
 #ifdef LEGACY_FLAC
+   encoder.set_filename(OSOUTPUT(fName));
+#endif
+   configure(encoder);
+
+   // See note in GetMetadata() about a bug in libflac++ 1.1.2
+   FLAC__StreamMetadata *comments;
+   if (!GetMetadata(project, metadata, comments)) {
+      return false;
+   }
+
+   // A seek point every ten seconds, as the flac command line tool makes,
+   // so that a player or an importer can go straight to any part of the
+   // file.  The encoder fills in the points as it goes.
+   FLAC__StreamMetadata *seekTable =
+      ::FLAC__metadata_object_new(FLAC__METADATA_TYPE_SEEKTABLE);
+   const FLAC__uint64 totalSamples = (FLAC__uint64)lrint((t1 - t0) * rate);
+   if (totalSamples > 0) {
+      ::FLAC__metadata_object_seektable_template_append_spaced_points_by_samples(
+         seekTable, 10 * lrint(rate), totalSamples);
+   }
+
+   FLAC__StreamMetadata *blocks[2];
+   unsigned numBlocks = 0;
+   if (comments) {
+      blocks[numBlocks++] = comments;
+   }
+   blocks[numBlocks++] = seekTable;
+
+#ifdef LEGACY_FLAC
+   encoder.set_metadata(blocks, numBlocks);
    encoder.init();
 #else
    wxFFile f;     // will be closed when it goes out of scope
    if (!f.Open(fName, wxT("w+b"))) {
-      wxMessageBox(wxString::Format(_("FLAC export couldn't open %s"), fName.c_str()));
+      ShowExportError(wxString::Format(_("FLAC export couldn't open %s"), fName.c_str()));
+      ::FLAC__metadata_object_delete(seekTable);
       return false;
    }
 
-   // Even though there is an init() method that takes a filename, use the one that
-   // takes a file handle because wxWidgets can open a file with a Unicode name and
-   // libflac can't (under Windows).
-   int status = encoder.init(f.fp());
-   if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
-      wxMessageBox(wxString::Format(_("FLAC encoder failed to initialize\nStatus: %d"), status));
-      return false;
+   if (threads > 1) {
+      parallel = std::make_unique<ParallelFLACEncoder>(configure, threads);
+      if (!parallel->Init(f, blocks, numBlocks)) {
+         ShowExportError(wxString::Format(_("FLAC export couldn't write %s"), fName.c_str()));
+         ::FLAC__metadata_object_delete(seekTable);
+         return false;
+      }
+   }
+   else {
+      encoder.set_metadata(blocks, numBlocks);
+
+      // Even though there is an init() method that takes a filename, use the one that
+      // takes a file handle because wxWidgets can open a file with a Unicode name and
+      // libflac can't (under Windows).
+      int status = encoder.init(f.fp());
+      if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+         ShowExportError(wxString::Format(_("FLAC encoder failed to initialize\nStatus: %d"), status));
+         ::FLAC__metadata_object_delete(seekTable);
+         return false;
+      }
    }
 #endif
 
-   if (mMetadata) {
-      ::FLAC__metadata_object_delete(mMetadata);
+   if (comments) {
+      ::FLAC__metadata_object_delete(comments);
    }
 
    const WaveTrackConstArray waveTracks =
-      tracks->GetWaveTrackConstArray(selectionOnly, false);
+      GetExportTracks(tracks, selectionOnly);
    auto mixer = CreateMixer(waveTracks,
                             tracks->GetTimeTrack(),
                             t0, t1,
@@ -318,7 +372,7 @@ int ExportFLAC::Export(AudacityProject *project,
    }
 
    {
-      ProgressDialog progress(wxFileName(fName).GetName(),
+      ExportProgress progress(wxFileName(fName).GetName(),
          selectionOnly ?
          _("Exporting the selected audio as FLAC") :
          _("Exporting the entire project as FLAC"));
@@ -342,14 +396,29 @@ int ExportFLAC::Export(AudacityProject *project,
                   }
                }
             }
-            encoder.process(tmpsmplbuf, samplesThisRun);
+            if (!parallel) {
+               encoder.process(tmpsmplbuf, samplesThisRun);
+            }
+            else if (!parallel->Process(tmpsmplbuf, samplesThisRun)) {
+               updateResult = eProgressFailed;
+               break;
+            }
          }
          updateResult = progress.Update(mixer->MixGetCurrentTime() - t0, t1 - t0);
       }
-      f.Detach(); // libflac closes the file
-      encoder.finish();
+      if (!parallel) {
+         f.Detach(); // libflac closes the file
+         encoder.finish();
+      }
+      else if (updateResult == eProgressFailed || !parallel->Finish()) {
+         ShowExportError(wxString::Format(_("FLAC export couldn't write %s"), fName.c_str()));
+         updateResult = eProgressFailed;
+      }
    }
 
+   // The encoder has filled in the seek points, and is done with them
+   ::FLAC__metadata_object_delete(seekTable);
+
    for (i = 0; i < numChannels; i++) {
       free(tmpsmplbuf[i]);
    }
@@ -371,13 +440,14 @@ wxWindow *ExportFLAC::OptionsCreate(wxWindow *parent, int format)
 //      expects that array to be valid until the stream is initialized.
 //
 //      This has been fixed in 1.1.4.
-bool ExportFLAC::GetMetadata(AudacityProject *project, const Tags *tags)
+bool ExportFLAC::GetMetadata(AudacityProject *project, const Tags *tags,
+                             FLAC__StreamMetadata *&metadata)
 {
    // Retrieve tags if needed
    if (tags == NULL)
       tags = project->GetTags();
 
-   mMetadata = ::FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
+   metadata = ::FLAC__metadata_object_new(FLAC__METADATA_TYPE_VORBIS_COMMENT);
 
    wxString n;
    for (const auto &pair : tags->GetRange()) {
@@ -388,7 +458,7 @@ bool ExportFLAC::GetMetadata(AudacityProject *project, const Tags *tags)
       }
       FLAC::Metadata::VorbisComment::Entry entry(n.mb_str(wxConvUTF8),
                                                  v.mb_str(wxConvUTF8));
-      ::FLAC__metadata_object_vorbiscomment_append_comment(mMetadata,
+      ::FLAC__metadata_object_vorbiscomment_append_comment(metadata,
                                                            entry.get_entry(),
                                                            true);
    }
@@ -49,7 +49,9 @@
 #include "../ShuttleGui.h"
 #include "../Tags.h"
 #include "../WaveTrack.h"
+#include "../WorkerPool.h"
 #include "../widgets/HelpSystem.h"
+#include "../widgets/ProgressDialog.h"
 
 
 /* define our dynamic array of export settings */
@@ -723,12 +725,18 @@ int ExportMultiple::ExportMultipleByLabel(bool byName,
       if (!setting.filetags.ShowEditDialog(mProject,_("Edit Metadata Tags"), tagsPrompt))
          return false;
 
+      setting.channels = channels;
+
       /* add the settings to the array of settings to be used for export */
       exportSettings.Add(setting);
 
       l++;  // next label, count up one
    }
 
+   if (CanExportConcurrently(exportSettings)) {
+      return ExportConcurrently(exportSettings, false);
+   }
+
    int ok = eProgressSuccess;   // did it work?
    int count = 0; // count the number of sucessful runs
    ExportKit activeSetting;  // pointer to the settings in use for this export
@@ -862,11 +870,35 @@ int ExportMultiple::ExportMultipleByTrack(bool byName,
       if (!setting.filetags.ShowEditDialog(mProject,_("Edit Metadata Tags"), tagsPrompt))
          return false;
 
+      /* note the tracks that the export will mix, when they are the
+       * selected ones */
+      tr->SetSelected(true);
+      if (tr2) {
+         tr2->SetSelected(true);
+      }
+      setting.tracks = mTracks->GetWaveTrackConstArray(true, false);
+      tr->SetSelected(false);
+      if (tr2) {
+         tr2->SetSelected(false);
+      }
+
       /* add the settings to the array of settings to be used for export */
       exportSettings.Add(setting);
 
       l++;  // next track, count up one
    }
+
+   if (CanExportConcurrently(exportSettings)) {
+      ok = ExportConcurrently(exportSettings, true);
+
+      // Restore the selection states
+      for (size_t i = 0; i < mSelected.GetCount(); i++) {
+         selected[i]->SetSelected(true);
+      }
+
+      return ok;
+   }
+
    // end of user-interactive data gathering loop, start of export processing
    // loop
    int count = 0; // count the number of sucessful runs
@@ -933,20 +965,8 @@ int ExportMultiple::DoExport(int channels,
    if (selectedOnly) wxLogDebug(wxT("Selected Region Only"));
    else wxLogDebug(wxT("Whole Project"));
 
-   if (mOverwrite->GetValue()) {
-      // Make sure we don't overwrite (corrupt) alias files
-      if (!mProject->GetDirManager()->EnsureSafeFilename(inName)) {
-         return false;
-      }
-      name = inName;
-   }
-   else {
-      name = inName;
-      int i = 2;
-      wxString base(name.GetName());
-      while (name.FileExists()) {
-         name.SetName(wxString::Format(wxT("%s-%d"), base.c_str(), i++));
-      }
+   if (!ChooseFileName(inName, wxArrayString(), name)) {
+      return false;
    }
 
    // Call the format export routine
@@ -971,6 +991,158 @@ int ExportMultiple::DoExport(int channels,
    return success;
 }
 
+bool ExportMultiple::ChooseFileName(const wxFileName &inName,
+                                    const wxArrayString &reserved,
+                                    wxFileName &name)
+{
+   if (mOverwrite->GetValue()) {
+      // Make sure we don't overwrite (corrupt) alias files
+      if (!mProject->GetDirManager()->EnsureSafeFilename(inName)) {
+         return false;
+      }
+      name = inName;
+   }
+   else {
+      name = inName;
+      int i = 2;
+      wxString base(name.GetName());
+      while (name.FileExists() ||
+             reserved.Index(name.GetFullPath()) != wxNOT_FOUND) {
+         name.SetName(wxString::Format(wxT("%s-%d"), base.c_str(), i++));
+      }
+   }
+
+   return true;
+}
+
+bool ExportMultiple::CanExportConcurrently(const ExportKitArray &settings)
+{
+   const size_t numFiles = settings.GetCount();
+   if (numFiles <= 1 ||
+       gPrefs->Read(wxT("/Export/MultipleThreads"), 0L) == 1 ||
+       !mPlugins[mPluginIndex]->CanExportConcurrently(mSubFormatIndex)) {
+      return false;
+   }
+
+   // When overwriting, two files of the same name would be written at
+   // once, where one after another the last would win
+   if (mOverwrite->GetValue()) {
+      for (size_t i = 0; i < numFiles; i++) {
+         for (size_t j = i + 1; j < numFiles; j++) {
+            if (settings[i].destfile.SameAs(settings[j].destfile)) {
+               return false;
+            }
+         }
+      }
+   }
+
+   return true;
+}
+
+int ExportMultiple::ExportConcurrently(const ExportKitArray &settings,
+                                       bool selectedOnly)
+{
+   const int numFiles = settings.GetCount();
+
+   // Choose the names as one export after another would, when the files
+   // before each one exist
+   wxArrayString paths;
+   for (int i = 0; i < numFiles; i++) {
+      wxFileName name;
+      if (!ChooseFileName(settings[i].destfile, paths, name)) {
+         return false;
+      }
+      paths.Add(name.GetFullPath());
+   }
+
+   long threads = gPrefs->Read(wxT("/Export/MultipleThreads"), 0L);
+   if (threads <= 0) {
+      threads = WorkerPool::GetDefaultThreadCount();
+   }
+   // The calling thread only shows progress, so one more may export.
+   // The jobs mix the same tracks at once; that only reads them, and the
+   // envelopes, including the time track's, keep no search state between
+   // calls, so no job disturbs another's mix.
+   WorkerPool pool(wxMin(threads, (long)numFiles) + 1);
+
+   // What the user asks of the exports, or how the first one to fail
+   // ended; any but eProgressSuccess stops them
+   std::atomic<int> command(eProgressSuccess);
+   wxMutex setupMutex;
+   std::vector< movable_ptr<ExportJob> > jobs;
+   double total = 0.0;
+   for (int i = 0; i < numFiles; i++) {
+      const ExportKit &kit = settings[i];
+      jobs.push_back(make_movable<ExportJob>(command, setupMutex,
+                                             selectedOnly ? &kit.tracks : NULL));
+      total += kit.t1 - kit.t0;
+   }
+   std::vector<int> results(numFiles, eProgressSuccess);
+   std::vector<char> started(numFiles, false);
+
+   {
+      ProgressDialog progress(_("Export Multiple"),
+                              wxString::Format(_("Exporting %d files"), numFiles));
+
+      pool.ParallelFor(numFiles, [&](int i, int)
+      {
+         if (command.load() != eProgressSuccess) {
+            return;
+         }
+         started[i] = true;
+
+         const ExportKit &kit = settings[i];
+         ExportJob &job = *jobs[i];
+         job.Enter();
+         results[i] = mPlugins[mPluginIndex]->Export(mProject,
+                                                     kit.channels,
+                                                     paths[i],
+                                                     selectedOnly,
+                                                     kit.t0,
+                                                     kit.t1,
+                                                     NULL,
+                                                     &kit.filetags,
+                                                     mSubFormatIndex);
+         job.Leave();
+
+         if (results[i] != eProgressSuccess && results[i] != eProgressStopped) {
+            int expected = eProgressSuccess;
+            command.compare_exchange_strong(expected, results[i]);
+         }
+      },
+      [&]
+      {
+         double done = 0.0;
+         for (int i = 0; i < numFiles; i++) {
+            done += jobs[i]->GetDone() * (settings[i].t1 - settings[i].t0);
+         }
+         const int result = progress.Update(done, total);
+         if (result != eProgressSuccess) {
+            int expected = eProgressSuccess;
+            command.compare_exchange_strong(expected, result);
+         }
+      },
+      100);
+   }
+
+   // Report in the order of the files, as one export after another would
+   for (int i = 0; i < numFiles; i++) {
+      const wxArrayString &errors = jobs[i]->GetErrors();
+      for (size_t j = 0; j < errors.GetCount(); j++) {
+         wxMessageBox(errors[j]);
+      }
+      if (started[i] &&
+          (results[i] == eProgressSuccess || results[i] == eProgressStopped)) {
+         mExported.Add(paths[i]);
+      }
+   }
+
+   Refresh();
+   Update();
+
+   return command.load();
+}
+
 wxString ExportMultiple::MakeFileName(const wxString &input)
 {
    wxString newname; // name we are generating
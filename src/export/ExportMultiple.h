@@ -19,6 +19,7 @@
 
 #include "Export.h"
 #include "../Tags.h"       // we need to know about the Tags class for metadata
+#include "../Track.h"
 
 class wxButton;
 class wxCheckBox;
@@ -27,6 +28,7 @@ class wxRadioButton;
 class wxTextCtrl;
 
 class AudacityProject;
+class ExportKitArray;
 class LabelTrack;
 class ShuttleGui;
 
@@ -79,6 +81,24 @@ private:
                  double t0,
                  double t1,
                  const Tags &tags);
+
+   /** Picks the name of a file to export to: inName, unless it exists
+    * and is not to be overwritten, or is one of reserved */
+   bool ChooseFileName(const wxFileName &inName,
+                       const wxArrayString &reserved,
+                       wxFileName &name);
+
+   /** Whether the files of settings can be exported at the same time,
+    * on worker threads, as the preferences and the plug-in allow, and
+    * no two of them are to overwrite the same file */
+   bool CanExportConcurrently(const ExportKitArray &settings);
+
+   /** Does the exports of settings at the same time, showing their
+    * progress in one dialog.  The files are the same as DoExport() would
+    * make, one after another.
+    * @param selectedOnly Whether the exports mix the tracks of their
+    * settings, rather than all of the project's */
+   int ExportConcurrently(const ExportKitArray &settings, bool selectedOnly);
    /** \brief Takes an arbitrary text string and converts it to a form that can
     * be used as a file name, if necessary prompting the user to edit the file
     * name produced */
@@ -200,6 +220,8 @@ private:
       double t0;           /**< Start time for the export */
       double t1;           /**< End time for the export */
       int channels;        /**< Number of channels for ExportMultipleByTrack */
+      WaveTrackConstArray tracks; /**< The tracks to mix, for
+                                    ExportMultipleByTrack */
    };  // end of ExportKit declaration
    /* we are going to want an set of these kits, and don't know how many until
     * runtime. I would dearly like to use a std::vector, but it seems that
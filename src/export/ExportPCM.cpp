@@ -325,6 +325,7 @@ public:
    // optional
    wxString GetExtension(int index);
    bool CheckFileName(wxFileName &filename, int format) override;
+   bool CanExportConcurrently(int WXUNUSED(format)) override { return true; }
 
 private:
 
@@ -434,7 +435,7 @@ int ExportPCM::Export(AudacityProject *project,
       if (!sf_format_check(&info))
          info.format = (info.format & SF_FORMAT_TYPEMASK);
       if (!sf_format_check(&info)) {
-         wxMessageBox(_("Cannot export audio in this format."));
+         ShowExportError(_("Cannot export audio in this format."));
          return false;
       }
 
@@ -448,8 +449,8 @@ int ExportPCM::Export(AudacityProject *project,
       }
 
       if (!sf) {
-         wxMessageBox(wxString::Format(_("Cannot export audio to %s"),
-                                       fName.c_str()));
+         ShowExportError(wxString::Format(_("Cannot export audio to %s"),
+                                          fName.c_str()));
          return false;
       }
       // Retrieve tags if not given a set
@@ -474,7 +475,7 @@ int ExportPCM::Export(AudacityProject *project,
       int maxBlockLen = 44100 * 5;
 
       const WaveTrackConstArray waveTracks =
-      tracks->GetWaveTrackConstArray(selectionOnly, false);
+      GetExportTracks(tracks, selectionOnly);
       {
          auto mixer = CreateMixer(waveTracks,
                                   tracks->GetTimeTrack(),
@@ -482,7 +483,7 @@ int ExportPCM::Export(AudacityProject *project,
                                   info.channels, maxBlockLen, true,
                                   rate, format, true, mixerSpec);
 
-         ProgressDialog progress(wxFileName(fName).GetName(),
+         ExportProgress progress(wxFileName(fName).GetName(),
                                  selectionOnly ?
                                  wxString::Format(_("Exporting the selected audio as %s"),
                                                   formatStr.c_str()) :
@@ -506,13 +507,13 @@ int ExportPCM::Export(AudacityProject *project,
             if (samplesWritten != numSamples) {
                char buffer2[1000];
                sf_error_str(sf.get(), buffer2, 1000);
-               wxMessageBox(wxString::Format(
-                                             /* i18n-hint: %s will be the error message from libsndfile, which
-                                              * is usually something unhelpful (and untranslated) like "system
-                                              * error" */
-                                             _("Error while writing %s file (disk full?).\nLibsndfile says \"%s\""),
-                                             formatStr.c_str(),
-                                             wxString::FromAscii(buffer2).c_str()));
+               ShowExportError(wxString::Format(
+                                                /* i18n-hint: %s will be the error message from libsndfile, which
+                                                 * is usually something unhelpful (and untranslated) like "system
+                                                 * error" */
+                                                _("Error while writing %s file (disk full?).\nLibsndfile says \"%s\""),
+                                                formatStr.c_str(),
+                                                wxString::FromAscii(buffer2).c_str()));
                break;
             }
             
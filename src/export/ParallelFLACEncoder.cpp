@@ -0,0 +1,521 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  ParallelFLACEncoder.cpp
+
+*******************************************************************//**
+
+\class ParallelFLACEncoder
+\brief Encodes the segments of a FLAC file on several threads and
+  stitches their frames into one stream.
+
+  A frame header holds the frame's number, in the variable length code
+  of the FLAC format, and is followed by its CRC-8; the frame ends with
+  the CRC-16 of all that comes before in the frame.  Giving a frame
+  another number may change the length of its header, so the header is
+  written anew and both checksums computed again.
+
+  libFLAC does not export its MD5 routines, so the MD5 of the samples,
+  which goes in STREAMINFO, is computed here, over the samples as the
+  format defines it: interleaved, little-endian, in as many bytes as
+  the bits per sample need.
+
+*//*******************************************************************/
+
+#include "ParallelFLACEncoder.h"
+
+#ifdef USE_LIBFLAC
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+// Frames of a segment, which one encoder encodes: enough that starting
+// an encoder costs little, few enough that a segment for each thread
+// does not take much memory
+const unsigned SegmentFrames = 64;
+
+// Writes either the metadata or the frames of a stream to memory
+class MemoryEncoder final : public FLAC::Encoder::Stream
+{
+public:
+   /// Keeps the frames, and their sizes in frameSizes, or if that is
+   /// NULL, the metadata
+   MemoryEncoder(std::vector<FLAC__byte> &data, std::vector<unsigned> *frameSizes)
+      : mData(data)
+      , mFrameSizes(frameSizes)
+   {}
+
+protected:
+   FLAC__StreamEncoderWriteStatus write_callback(const FLAC__byte buffer[],
+                                                 size_t bytes,
+                                                 unsigned samples,
+                                                 unsigned WXUNUSED(current_frame)) override
+   {
+      // Metadata come without samples, and frames whole, one to a call
+      if ((samples > 0) == (mFrameSizes != NULL)) {
+         mData.insert(mData.end(), buffer, buffer + bytes);
+         if (mFrameSizes)
+            mFrameSizes->push_back(bytes);
+      }
+      return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+   }
+
+private:
+   std::vector<FLAC__byte> &mData;
+   std::vector<unsigned> *mFrameSizes;
+};
+
+struct CRCTables {
+   FLAC__byte crc8[256];
+   FLAC__uint16 crc16[256];
+
+   CRCTables()
+   {
+      for (unsigned i = 0; i < 256; i++) {
+         // x^8 + x^2 + x + 1
+         unsigned crc = i;
+         for (int bit = 0; bit < 8; bit++)
+            crc = ((crc << 1) ^ (crc & 0x80 ? 0x07 : 0)) & 0xff;
+         crc8[i] = crc;
+
+         // x^16 + x^15 + x^2 + 1
+         crc = i << 8;
+         for (int bit = 0; bit < 8; bit++)
+            crc = ((crc << 1) ^ (crc & 0x8000 ? 0x8005 : 0)) & 0xffff;
+         crc16[i] = crc;
+      }
+   }
+};
+
+const CRCTables &GetCRCTables()
+{
+   static const CRCTables tables;
+   return tables;
+}
+
+// Copies a frame, which an encoder numbered from zero, to the end of
+// out, as frame number of the whole stream.  False if the frame does
+// not start with a header as libFLAC writes for a fixed block size.
+bool RenumberFrame(const FLAC__byte *frame, size_t size, unsigned number,
+                   std::vector<FLAC__byte> &out)
+{
+   if (size < 8 || frame[0] != 0xff || frame[1] != 0xf8)
+      return false;
+
+   // The first byte of the number tells its length
+   unsigned ones = 0;
+   while (ones < 8 && (frame[4] & (0x80 >> ones)))
+      ones++;
+   if (ones == 1 || ones > 6)
+      return false;
+   size_t headerLength = 4 + (ones == 0 ? 1 : ones);
+
+   // Block size and sample rate that do not fit their codes follow
+   const unsigned blockSizeCode = frame[2] >> 4;
+   const unsigned sampleRateCode = frame[2] & 0x0f;
+   const size_t extraStart = headerLength;
+   headerLength += (blockSizeCode == 6) ? 1 : (blockSizeCode == 7) ? 2 : 0;
+   headerLength += (sampleRateCode == 12) ? 1 :
+      (sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0;
+   const size_t extraEnd = headerLength;
+   // and then the CRC-8
+   headerLength++;
+   if (headerLength + 2 > size)
+      return false;
+
+   const CRCTables &tables = GetCRCTables();
+   const size_t start = out.size();
+   out.insert(out.end(), frame, frame + 4);
+
+   if (number < 0x80)
+      out.push_back(number);
+   else {
+      // As UTF-8, though up to 31 bits
+      int more = number < 0x800 ? 1 : number < 0x10000 ? 2 :
+         number < 0x200000 ? 3 : number < 0x4000000 ? 4 : 5;
+      out.push_back((0xff00 >> (more + 1)) | (number >> (6 * more)));
+      while (more-- > 0)
+         out.push_back(0x80 | ((number >> (6 * more)) & 0x3f));
+   }
+
+   out.insert(out.end(), frame + extraStart, frame + extraEnd);
+
+   FLAC__byte crc8 = 0;
+   for (size_t i = start; i < out.size(); i++)
+      crc8 = tables.crc8[crc8 ^ out[i]];
+   out.push_back(crc8);
+
+   out.insert(out.end(), frame + headerLength, frame + size - 2);
+
+   FLAC__uint16 crc16 = 0;
+   for (size_t i = start; i < out.size(); i++)
+      crc16 = ((crc16 << 8) & 0xffff) ^ tables.crc16[(crc16 >> 8) ^ out[i]];
+   out.push_back(crc16 >> 8);
+   out.push_back(crc16 & 0xff);
+
+   return true;
+}
+
+void PutBigEndian(FLAC__byte *dest, FLAC__uint64 value, int bytes)
+{
+   while (bytes-- > 0) {
+      dest[bytes] = value & 0xff;
+      value >>= 8;
+   }
+}
+
+}
+
+/// MD5 (RFC 1321) of the samples of a FLAC stream
+class ParallelFLACEncoder::MD5
+{
+public:
+   MD5()
+      : mBytes(0)
+   {
+      mState[0] = 0x67452301;
+      mState[1] = 0xefcdab89;
+      mState[2] = 0x98badcfe;
+      mState[3] = 0x10325476;
+   }
+
+   void Accumulate(const FLAC__int32 *const signal[], unsigned channels,
+                   unsigned samples, unsigned bytesPerSample)
+   {
+      mScratch.resize(samples * channels * bytesPerSample);
+      FLAC__byte *dest = mScratch.empty() ? NULL : &mScratch[0];
+      for (unsigned s = 0; s < samples; s++) {
+         for (unsigned c = 0; c < channels; c++) {
+            FLAC__uint32 value = signal[c][s];
+            for (unsigned b = 0; b < bytesPerSample; b++) {
+               *dest++ = value & 0xff;
+               value >>= 8;
+            }
+         }
+      }
+      Update(mScratch.empty() ? NULL : &mScratch[0], mScratch.size());
+   }
+
+   void Final(FLAC__byte digest[16])
+   {
+      const FLAC__uint64 bits = mBytes * 8;
+      FLAC__byte padding[72] = { 0x80 };
+      const size_t used = mBytes % 64;
+      Update(padding, (used < 56 ? 56 : 120) - used);
+      FLAC__byte length[8];
+      for (int i = 0; i < 8; i++)
+         length[i] = (bits >> (8 * i)) & 0xff;
+      Update(length, 8);
+
+      for (int i = 0; i < 4; i++)
+         for (int b = 0; b < 4; b++)
+            digest[4 * i + b] = (mState[i] >> (8 * b)) & 0xff;
+   }
+
+private:
+   void Update(const FLAC__byte *data, size_t length)
+   {
+      size_t used = mBytes % 64;
+      mBytes += length;
+      if (used > 0) {
+         const size_t n = std::min(length, 64 - used);
+         memcpy(mBuffer + used, data, n);
+         data += n, length -= n, used += n;
+         if (used < 64)
+            return;
+         Transform(mBuffer);
+      }
+      for (; length >= 64; data += 64, length -= 64)
+         Transform(data);
+      if (length > 0)
+         memcpy(mBuffer, data, length);
+   }
+
+   void Transform(const FLAC__byte block[64])
+   {
+      static const FLAC__uint32 K[64] = {
+         0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+         0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+         0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+         0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+         0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+         0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+         0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+         0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+         0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+         0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+         0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+         0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+         0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+         0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+         0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+         0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+      };
+      static const int S[16] = {
+         7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21,
+      };
+
+      FLAC__uint32 M[16];
+      for (int i = 0; i < 16; i++)
+         M[i] = block[4 * i] | (block[4 * i + 1] << 8) |
+            (block[4 * i + 2] << 16) | ((FLAC__uint32)block[4 * i + 3] << 24);
+
+      FLAC__uint32 a = mState[0], b = mState[1], c = mState[2], d = mState[3];
+      for (int i = 0; i < 64; i++) {
+         FLAC__uint32 f;
+         int g;
+         switch (i / 16) {
+         case 0: f = (b & c) | (~b & d); g = i; break;
+         case 1: f = (d & b) | (~d & c); g = (5 * i + 1) % 16; break;
+         case 2: f = b ^ c ^ d; g = (3 * i + 5) % 16; break;
+         default: f = c ^ (b | ~d); g = (7 * i) % 16; break;
+         }
+         f += a + K[i] + M[g];
+         const int s = S[4 * (i / 16) + i % 4];
+         a = d;
+         d = c;
+         c = b;
+         b += (f << s) | (f >> (32 - s));
+      }
+      mState[0] += a;
+      mState[1] += b;
+      mState[2] += c;
+      mState[3] += d;
+   }
+
+   FLAC__uint32 mState[4];
+   FLAC__uint64 mBytes;
+   FLAC__byte mBuffer[64];
+   std::vector<FLAC__byte> mScratch;
+};
+
+struct ParallelFLACEncoder::Segment {
+   std::vector<std::vector<FLAC__int32>> samples;
+   unsigned count{ 0 };
+   unsigned firstFrame{ 0 };
+   std::vector<FLAC__byte> data;
+   std::vector<unsigned> frameSizes;
+   bool ok{ false };
+};
+
+ParallelFLACEncoder::ParallelFLACEncoder(const Configure &configure, int nThreads)
+   : mConfigure(configure)
+   , mPool(nThreads)
+   , mFile(NULL)
+   , mChannels(0)
+   , mBytesPerSample(0)
+   , mBlockSize(0)
+   , mStreamInfoOffset(0)
+   , mSeekTableOffset(0)
+   , mNextSeekPoint(0)
+   , mFilled(0)
+   , mNextFrame(0)
+   , mTotalSamples(0)
+   , mFrameBytes(0)
+   , mMinFrameSize(0)
+   , mMaxFrameSize(0)
+   , mMD5(std::make_unique<MD5>())
+{
+}
+
+ParallelFLACEncoder::~ParallelFLACEncoder()
+{
+}
+
+bool ParallelFLACEncoder::Init(wxFFile &file, FLAC__StreamMetadata **metadata,
+                               unsigned numBlocks)
+{
+   mFile = &file;
+
+   // An encoder of no samples writes the metadata as the serial export
+   // would, with the values that Finish() fills in left empty
+   MemoryEncoder encoder(mHeader, NULL);
+   mConfigure(encoder);
+   if (numBlocks > 0)
+      encoder.set_metadata(metadata, numBlocks);
+   if (encoder.init() != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+      return false;
+   mChannels = encoder.get_channels();
+   mBytesPerSample = (encoder.get_bits_per_sample() + 7) / 8;
+   mBlockSize = encoder.get_blocksize();
+   encoder.finish();
+
+   if (mHeader.size() < 8 || memcmp(&mHeader[0], "fLaC", 4) != 0)
+      return false;
+   for (size_t pos = 4; pos + 4 <= mHeader.size();) {
+      const unsigned type = mHeader[pos] & 0x7f;
+      const size_t length =
+         (mHeader[pos + 1] << 16) | (mHeader[pos + 2] << 8) | mHeader[pos + 3];
+      if (type == FLAC__METADATA_TYPE_STREAMINFO)
+         mStreamInfoOffset = pos + 4;
+      else if (type == FLAC__METADATA_TYPE_SEEKTABLE && mSeekTableOffset == 0)
+         mSeekTableOffset = pos + 4;
+      if (mHeader[pos] & 0x80)
+         break;
+      pos += 4 + length;
+   }
+   if (mStreamInfoOffset == 0 ||
+       mStreamInfoOffset + FLAC__STREAM_METADATA_STREAMINFO_LENGTH > mHeader.size())
+      return false;
+
+   for (unsigned i = 0; i < numBlocks; i++) {
+      if (metadata[i]->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+         const FLAC__StreamMetadata_SeekTable &table = metadata[i]->data.seek_table;
+         mSeekPoints.assign(table.points, table.points + table.num_points);
+         break;
+      }
+   }
+   if (mSeekTableOffset == 0 ||
+       mSeekTableOffset + mSeekPoints.size() * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH >
+          mHeader.size())
+      mSeekPoints.clear();
+
+   mSegments.resize(mPool.GetThreadCount());
+   for (auto &segment : mSegments) {
+      segment = make_movable<Segment>();
+      segment->samples.resize(mChannels);
+      for (auto &channel : segment->samples)
+         channel.resize(SegmentFrames * mBlockSize);
+   }
+
+   return mFile->Write(&mHeader[0], mHeader.size()) == mHeader.size();
+}
+
+bool ParallelFLACEncoder::Process(const FLAC__int32 *const buffer[], unsigned samples)
+{
+   const unsigned capacity = SegmentFrames * mBlockSize;
+   for (unsigned done = 0; done < samples;) {
+      Segment &segment = *mSegments[mFilled];
+      if (segment.count == 0) {
+         segment.firstFrame = mNextFrame;
+         mNextFrame += SegmentFrames;
+      }
+
+      const unsigned n = std::min(samples - done, capacity - segment.count);
+      for (unsigned c = 0; c < mChannels; c++)
+         std::copy(buffer[c] + done, buffer[c] + done + n,
+                   segment.samples[c].begin() + segment.count);
+      segment.count += n;
+      done += n;
+
+      if (segment.count == capacity && ++mFilled == mSegments.size() &&
+          !EncodeSegments())
+         return false;
+   }
+
+   mMD5->Accumulate(buffer, mChannels, samples, mBytesPerSample);
+   mTotalSamples += samples;
+   return true;
+}
+
+bool ParallelFLACEncoder::EncodeSegments()
+{
+   mPool.ParallelFor(mFilled, [this](int i, int) {
+      Segment &segment = *mSegments[i];
+      segment.data.clear();
+      segment.frameSizes.clear();
+
+      MemoryEncoder encoder(segment.data, &segment.frameSizes);
+      mConfigure(encoder);
+      std::vector<const FLAC__int32 *> channels(mChannels);
+      for (unsigned c = 0; c < mChannels; c++)
+         channels[c] = &segment.samples[c][0];
+      segment.ok =
+         encoder.init() == FLAC__STREAM_ENCODER_INIT_STATUS_OK &&
+         encoder.process(&channels[0], segment.count) &&
+         encoder.finish();
+      if (!segment.ok || segment.firstFrame == 0)
+         return;
+
+      std::vector<FLAC__byte> renumbered;
+      renumbered.reserve(segment.data.size() + 6 * segment.frameSizes.size());
+      size_t pos = 0;
+      for (size_t f = 0; f < segment.frameSizes.size() && segment.ok; f++) {
+         const size_t oldSize = segment.frameSizes[f];
+         const size_t before = renumbered.size();
+         segment.ok = RenumberFrame(&segment.data[pos], oldSize,
+                                    segment.firstFrame + f, renumbered);
+         segment.frameSizes[f] = renumbered.size() - before;
+         pos += oldSize;
+      }
+      segment.data.swap(renumbered);
+   });
+
+   bool ok = true;
+   for (size_t i = 0; i < mFilled; i++) {
+      Segment &segment = *mSegments[i];
+      ok = ok && segment.ok && WriteSegment(segment);
+      segment.count = 0;
+   }
+   mFilled = 0;
+   return ok;
+}
+
+bool ParallelFLACEncoder::WriteSegment(const Segment &segment)
+{
+   FLAC__uint64 sample = (FLAC__uint64)segment.firstFrame * mBlockSize;
+   unsigned left = segment.count;
+   for (size_t f = 0; f < segment.frameSizes.size(); f++) {
+      const unsigned frameSamples = std::min(left, mBlockSize);
+      const unsigned size = segment.frameSizes[f];
+
+      // Fill in the seek points that fall in the frame, as libFLAC does
+      for (; mNextSeekPoint < mSeekPoints.size() &&
+             mSeekPoints[mNextSeekPoint].sample_number < sample + frameSamples;
+           mNextSeekPoint++) {
+         FLAC__StreamMetadata_SeekPoint &point = mSeekPoints[mNextSeekPoint];
+         point.sample_number = sample;
+         point.stream_offset = mFrameBytes;
+         point.frame_samples = frameSamples;
+      }
+
+      mMinFrameSize = mFrameBytes == 0 ? size : std::min(mMinFrameSize, size);
+      mMaxFrameSize = std::max(mMaxFrameSize, size);
+      mFrameBytes += size;
+      sample += frameSamples;
+      left -= frameSamples;
+   }
+
+   return segment.data.empty() ||
+      mFile->Write(&segment.data[0], segment.data.size()) == segment.data.size();
+}
+
+bool ParallelFLACEncoder::Finish()
+{
+   if (mSegments[mFilled]->count > 0)
+      mFilled++;
+   if (mFilled > 0 && !EncodeSegments())
+      return false;
+
+   FLAC__byte *const info = &mHeader[mStreamInfoOffset];
+   PutBigEndian(info + 4, mMinFrameSize, 3);
+   PutBigEndian(info + 7, mMaxFrameSize, 3);
+   // 36 bits of total samples, after 28 bits of rate, channels and bits
+   info[13] = (info[13] & 0xf0) | ((mTotalSamples >> 32) & 0x0f);
+   PutBigEndian(info + 14, mTotalSamples & 0xffffffff, 4);
+   mMD5->Final(info + 18);
+
+   // Points past the end of the samples become placeholders
+   for (size_t i = 0; i < mSeekPoints.size(); i++) {
+      FLAC__StreamMetadata_SeekPoint point = mSeekPoints[i];
+      if (i >= mNextSeekPoint) {
+         point.sample_number = FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER;
+         point.stream_offset = 0;
+         point.frame_samples = 0;
+      }
+      FLAC__byte *const dest =
+         &mHeader[mSeekTableOffset + i * FLAC__STREAM_METADATA_SEEKPOINT_LENGTH];
+      PutBigEndian(dest, point.sample_number, 8);
+      PutBigEndian(dest + 8, point.stream_offset, 8);
+      PutBigEndian(dest + 16, point.frame_samples, 2);
+   }
+
+   return mFile->Seek(0) &&
+      mFile->Write(&mHeader[0], mHeader.size()) == mHeader.size() &&
+      mFile->SeekEnd();
+}
+
+#endif // USE_LIBFLAC
@@ -0,0 +1,98 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  ParallelFLACEncoder.h
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PARALLEL_FLAC_ENCODER__
+#define __AUDACITY_PARALLEL_FLAC_ENCODER__
+
+#include "../Audacity.h"
+
+#ifdef USE_LIBFLAC
+
+#include "../MemoryX.h"
+
+#include <functional>
+#include <vector>
+
+#include <wx/ffile.h>
+
+#include "FLAC++/encoder.h"
+
+#include "../WorkerPool.h"
+
+/// Encodes a FLAC file on several threads.
+///
+/// The frames of a FLAC stream do not depend on one another, so the
+/// samples are cut into segments of whole frames, and each segment is
+/// encoded by a stream encoder of its own on a worker thread.  Those
+/// encoders number their frames from zero, so the frames are given
+/// their numbers in the whole stream, with their checksums computed
+/// again, and written in order.  The metadata are written first, and
+/// again at the end with the totals, the MD5 of the samples and the
+/// seek points filled in, as libFLAC's own file encoder does.
+class ParallelFLACEncoder
+{
+public:
+   /// configure sets up a new encoder, which is then initialized for
+   /// one segment; it must set it up the same way every time.  It must
+   /// not set loose mid-side stereo, which carries a choice from frame
+   /// to frame, or the file will differ from what one encoder makes.
+   using Configure = std::function<void(FLAC::Encoder::Stream &encoder)>;
+   ParallelFLACEncoder(const Configure &configure, int nThreads);
+   ~ParallelFLACEncoder();
+
+   /// Writes the metadata to file, which must be open for writing and
+   /// seeking.  metadata may hold a SEEKTABLE template, whose points are
+   /// filled in by Finish().  False if the file could not be written.
+   bool Init(wxFFile &file, FLAC__StreamMetadata **metadata, unsigned numBlocks);
+
+   /// Encodes the samples of each channel.  Waits while full segments
+   /// are encoded, once there is one for every thread.
+   bool Process(const FLAC__int32 *const buffer[], unsigned samples);
+
+   /// Encodes and writes what is left, then the final metadata.
+   bool Finish();
+
+private:
+   struct Segment;
+
+   bool EncodeSegments();
+   bool WriteSegment(const Segment &segment);
+
+   Configure mConfigure;
+   WorkerPool mPool;
+
+   wxFFile *mFile;
+   unsigned mChannels;
+   unsigned mBytesPerSample;
+   unsigned mBlockSize;
+
+   std::vector<FLAC__byte> mHeader;
+   size_t mStreamInfoOffset;
+   size_t mSeekTableOffset;
+   std::vector<FLAC__StreamMetadata_SeekPoint> mSeekPoints;
+   size_t mNextSeekPoint;
+
+   std::vector<movable_ptr<Segment>> mSegments;
+   size_t mFilled; // segments in mSegments with samples
+   unsigned mNextFrame;
+
+   FLAC__uint64 mTotalSamples;
+   FLAC__uint64 mFrameBytes;
+   unsigned mMinFrameSize;
+   unsigned mMaxFrameSize;
+
+   class MD5;
+   std::unique_ptr<MD5> mMD5;
+
+   ParallelFLACEncoder(const ParallelFLACEncoder&) PROHIBITED;
+   ParallelFLACEncoder &operator= (const ParallelFLACEncoder&) PROHIBITED;
+};
+
+#endif // USE_LIBFLAC
+
+#endif
@@ -78,6 +78,7 @@ void GetFLACImportPlugin(ImportPluginList *importPluginList,
 #include "../FileFormats.h"
 #include "../Prefs.h"
 #include "../WaveTrack.h"
+#include "../WorkerPool.h"
 #include "ImportPlugin.h"
 #include "../ondemand/ODDecodeFlacTask.h"
 #include "../ondemand/ODManager.h"
@@ -126,6 +127,43 @@ class MyFLACFile final : public FLAC::Decoder::File
 };
 
 
+/// Decodes stretches of a FLAC file for an import on several threads.
+/// Each thread has one, with the file open on its own, and seeks to the
+/// start of every stretch it is given; libFLAC finds it with the seek
+/// table of the file, if there is one, and otherwise by bisection.
+class FLACChunkFile final : public FLAC::Decoder::File
+{
+ public:
+   FLACChunkFile(unsigned channels, sampleFormat format)
+      : mChannels(channels)
+      , mFormat(format)
+   {
+      set_metadata_ignore_all();
+   }
+
+   bool Open(const wxString &fileName);
+
+   /// Decodes len samples from start into buffer, each channel stride
+   /// samples after the one before.  Samples of frames that cannot be
+   /// decoded are left as zeros.
+   bool Decode(sampleCount start, sampleCount len,
+               samplePtr buffer, sampleCount stride);
+
+ private:
+   unsigned              mChannels;
+   sampleFormat          mFormat;
+   sampleCount           mStart;
+   sampleCount           mLen;
+   sampleCount           mDecoded;
+   samplePtr             mBuffer;
+   sampleCount           mStride;
+ protected:
+   FLAC__StreamDecoderWriteStatus write_callback(const FLAC__Frame *frame,
+                                                 const FLAC__int32 * const buffer[]) override;
+   void error_callback(FLAC__StreamDecoderErrorStatus WXUNUSED(status)) override {}
+};
+
+
 class FLACImportPlugin final : public ImportPlugin
 {
  public:
@@ -167,6 +205,8 @@ public:
    void SetStreamUsage(wxInt32 WXUNUSED(StreamID), bool WXUNUSED(Use)){}
 
 private:
+   bool DecodeConcurrently(int nThreads);
+
    sampleFormat          mFormat;
    MyFLACFile           *mFile;
    wxFFile               mHandle;
@@ -281,6 +321,76 @@ FLAC__StreamDecoderWriteStatus MyFLACFile::write_callback(const FLAC__Frame *fra
 }
 
 
+bool FLACChunkFile::Open(const wxString &fileName)
+{
+   wxFFile handle;
+   if (!handle.Open(fileName, wxT("rb"))) {
+      return false;
+   }
+
+   // As in FLACImportFileHandle::Init(), libflac closes the file
+   bool result = init(handle.fp()) == FLAC__STREAM_DECODER_INIT_STATUS_OK;
+   handle.Detach();
+   return result && process_until_end_of_metadata();
+}
+
+bool FLACChunkFile::Decode(sampleCount start, sampleCount len,
+                           samplePtr buffer, sampleCount stride)
+{
+   mStart = start;
+   mLen = len;
+   mDecoded = 0;
+   mBuffer = buffer;
+   mStride = stride;
+
+   for (unsigned c = 0; c < mChannels; c++) {
+      ClearSamples(buffer + c * stride * SAMPLE_SIZE(mFormat), mFormat, 0, len);
+   }
+
+   if (!seek_absolute(start)) {
+      // A failed seek must be followed by a flush
+      flush();
+      return false;
+   }
+
+   while (mDecoded < mLen) {
+      if (!process_single() ||
+          get_state() == FLAC__STREAM_DECODER_END_OF_STREAM) {
+         break;
+      }
+   }
+   return true;
+}
+
+FLAC__StreamDecoderWriteStatus FLACChunkFile::write_callback(const FLAC__Frame *frame,
+                                                             const FLAC__int32 * const buffer[])
+{
+   // Place the samples by the number of the frame, so that a frame lost
+   // to an error leaves a gap rather than moving the rest
+   const sampleCount pos = (sampleCount)frame->header.number.sample_number - mStart;
+   if (pos < 0 || pos >= mLen) {
+      mDecoded = mLen;
+      return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+   }
+   const sampleCount len = std::min<sampleCount>(frame->header.blocksize, mLen - pos);
+
+   for (unsigned c = 0; c < mChannels; c++) {
+      samplePtr dest = mBuffer + (c * mStride + pos) * SAMPLE_SIZE(mFormat);
+      if (mFormat == int16Sample) {
+         for (sampleCount s = 0; s < len; s++) {
+            ((short *)dest)[s] = buffer[c][s];
+         }
+      }
+      else {
+         memcpy(dest, buffer[c], len * sizeof(int));
+      }
+   }
+
+   mDecoded = pos + len;
+   return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+
 void GetFLACImportPlugin(ImportPluginList *importPluginList,
                          UnusableImportPluginList *WXUNUSED(unusableImportPluginList))
 {
@@ -478,8 +588,13 @@ int FLACImportFileHandle::Import(TrackFactory *trackFactory,
       bool res = (mFile->process_until_end_of_file() != 0);
    #else
       bool res = true;
-      if(!useOD)
-         res = (mFile->process_until_end_of_stream() != 0);
+      if(!useOD) {
+         long threads = gPrefs->Read(wxT("/FileFormats/FLACThreads"), 0L);
+         if (threads <= 0)
+            threads = WorkerPool::GetDefaultThreadCount();
+         if (!DecodeConcurrently(threads))
+            res = (mFile->process_until_end_of_stream() != 0);
+      }
    #endif
       wxUnusedVar(res);
 
@@ -547,6 +662,123 @@ int FLACImportFileHandle::Import(TrackFactory *trackFactory,
 }
 
 
+// Samples of a stretch that one thread decodes at a time
+#define SAMPLES_PER_CHUNK (1 << 18)
+
+/// Decodes stretches of the file on worker threads, while this thread
+/// appends them to the tracks in order, as they are done.  False if the
+/// file is too short for that, or its length is not known, in which case
+/// nothing is decoded.
+bool FLACImportFileHandle::DecodeConcurrently(int nThreads)
+{
+   const int count = (int)((mNumSamples + SAMPLES_PER_CHUNK - 1) / SAMPLES_PER_CHUNK);
+   if (nThreads <= 1 || count <= 1) {
+      return false;
+   }
+   nThreads = std::min(nThreads, count);
+
+   // As the serial import appends them
+   const sampleFormat format = (mBitsPerSample == 16) ? int16Sample : int24Sample;
+
+   // The decoded stretches wait in slots until they are appended.  A
+   // thread with a stretch waits for its slot to be free, so that only
+   // so many stretches are in memory at once.
+   struct Slot {
+      SampleBuffer buffer;
+      int chunk = -1;
+   };
+   const int numSlots = 2 * nThreads;
+   std::vector<Slot> slots(numSlots);
+   for (auto &slot : slots) {
+      slot.buffer.Allocate(SAMPLES_PER_CHUNK * mNumChannels, format);
+   }
+
+   // The caller makes no calls of its own, so one more
+   WorkerPool pool(nThreads + 1);
+   std::vector<std::unique_ptr<FLACChunkFile>> files(pool.GetThreadCount());
+
+   wxMutex mutex;
+   wxCondition appendedCondition(mutex);
+   // These are guarded by mutex
+   int appended = 0;
+   bool stop = false;
+   bool failed = false;
+
+   auto chunkLen = [&](int i) {
+      return std::min<sampleCount>(SAMPLES_PER_CHUNK, mNumSamples - (sampleCount)i * SAMPLES_PER_CHUNK);
+   };
+
+   auto appendDecoded = [&] {
+      while (true) {
+         {
+            wxMutexLocker locker(mutex);
+            if (stop || appended == count || slots[appended % numSlots].chunk != appended) {
+               return;
+            }
+         }
+
+         // The slot stays ours until appended moves on
+         const Slot &slot = slots[appended % numSlots];
+         const sampleCount len = chunkLen(appended);
+         auto iter = mChannels.begin();
+         for (unsigned c = 0; c < mNumChannels; ++iter, ++c) {
+            iter->get()->Append(slot.buffer.ptr() + c * SAMPLES_PER_CHUNK * SAMPLE_SIZE(format),
+                                format, len);
+         }
+         mSamplesDone += len;
+         mUpdateResult = mProgress->Update((wxULongLong_t) mSamplesDone, (wxULongLong_t) mNumSamples);
+
+         wxMutexLocker locker(mutex);
+         appended++;
+         stop = mUpdateResult != eProgressSuccess;
+         appendedCondition.Broadcast();
+      }
+   };
+
+   pool.ParallelFor(count,
+      [&](int i, int thread) {
+         Slot &slot = slots[i % numSlots];
+         {
+            wxMutexLocker locker(mutex);
+            while (!stop && i >= appended + numSlots) {
+               appendedCondition.Wait();
+            }
+            if (stop) {
+               return;
+            }
+         }
+
+         bool ok = true;
+         auto &file = files[thread];
+         if (!file) {
+            file = std::make_unique<FLACChunkFile>(mNumChannels, format);
+            ok = file->Open(mFilename);
+         }
+         ok = ok && file->Decode((sampleCount)i * SAMPLES_PER_CHUNK, chunkLen(i),
+                                 slot.buffer.ptr(), SAMPLES_PER_CHUNK);
+
+         wxMutexLocker locker(mutex);
+         slot.chunk = i;
+         if (!ok) {
+            stop = failed = true;
+            appendedCondition.Broadcast();
+         }
+      },
+      appendDecoded, 10);
+
+   appendDecoded();
+
+   if (failed) {
+      mUpdateResult = eProgressFailed;
+   }
+   for (auto &file : files) {
+      if (file) {
+         file->finish();
+      }
+   }
+   return true;
+}
+
 FLACImportFileHandle::~FLACImportFileHandle()
 {
    //don't DELETE mFile if we are using OD.
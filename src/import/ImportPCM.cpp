@@ -48,12 +48,19 @@
 #error Requires libsndfile 1.0 or higher
 #endif
 
+#include "../BlockFile.h"
+#include "../DirManager.h"
 #include "../FileFormats.h"
 #include "../Prefs.h"
+#include "../Sequence.h"
+#include "../WaveClip.h"
 #include "../WaveTrack.h"
+#include "../WorkerPool.h"
 #include "ImportPlugin.h"
 
 #include <algorithm>
+#include <limits>
+#include <wx/thread.h>
 
 #ifdef USE_LIBID3TAG
    #include <id3tag.h>
@@ -322,6 +329,297 @@ How do you want to import the current file(s)?"), oldCopyPref == wxT("copy") ? _
    return oldCopyPref;
 }
 
+namespace {
+
+/// The reader of a concurrent import, on a thread of its own
+class PCMReaderThread final : public wxThread
+{
+public:
+   explicit PCMReaderThread(const std::function<void()> &loop)
+      : wxThread(wxTHREAD_JOINABLE)
+      , mLoop(loop)
+   {}
+
+   void *Entry() override
+   {
+      mLoop();
+      return NULL;
+   }
+
+private:
+   std::function<void()> mLoop;
+};
+
+// Reads the file into a buffer of some blocks of each channel at a time,
+// and appends each channel of it to its track
+int ImportPCMSerially(SNDFILE *file, const SF_INFO &info, TrackHolders &channels,
+                      const PCMImportProgress &progress)
+{
+   const sampleFormat format = channels.begin()->get()->GetSampleFormat();
+   sampleCount fileTotalFrames = (sampleCount)info.frames;
+   sampleCount maxBlockSize = channels.begin()->get()->GetMaxBlockSize();
+   int updateResult = eProgressSuccess;
+
+   // PRL:  guard against excessive memory buffer allocation in case of many channels
+   sampleCount maxBlock = std::min(maxBlockSize,
+      sampleCount(std::numeric_limits<int>::max() /
+              (info.channels * SAMPLE_SIZE(format)))
+   );
+   if (maxBlock < 1)
+      return eProgressFailed;
+
+   SampleBuffer srcbuffer;
+   while (NULL == srcbuffer.Allocate(maxBlock * info.channels, format).ptr())
+   {
+      maxBlock >>= 1;
+      if (maxBlock < 1)
+         return eProgressFailed;
+   }
+
+   SampleBuffer buffer(maxBlock, format);
+
+   unsigned long framescompleted = 0;
+
+   long block;
+   do {
+      block = maxBlock;
+
+      if (format == int16Sample)
+         block = SFCall<sf_count_t>(sf_readf_short, file, (short *)srcbuffer.ptr(), block);
+      //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile works too.
+      else
+         block = SFCall<sf_count_t>(sf_readf_float, file, (float *)srcbuffer.ptr(), block);
+
+      if (block) {
+         auto iter = channels.begin();
+         for(int c=0; c<info.channels; ++iter, ++c) {
+            if (format==int16Sample) {
+               for(int j=0; j<block; j++)
+                  ((short *)buffer.ptr())[j] =
+                     ((short *)srcbuffer.ptr())[info.channels*j+c];
+            }
+            else {
+               for(int j=0; j<block; j++)
+                  ((float *)buffer.ptr())[j] =
+                     ((float *)srcbuffer.ptr())[info.channels*j+c];
+            }
+
+            iter->get()->Append(buffer.ptr(), (format == int16Sample)?int16Sample:floatSample, block);
+         }
+         framescompleted += block;
+      }
+
+      updateResult = progress((sampleCount)framescompleted, fileTotalFrames);
+      if (updateResult != eProgressSuccess)
+         break;
+
+   } while (block > 0);
+
+   return updateResult;
+}
+
+// Blocks of each channel that the reader may be ahead of the writers
+#define PCM_IMPORT_SLOTS 2
+
+// A reader thread reads a block of every channel at a time into one of
+// a few slots.  Each worker takes one channel of a slot at a time,
+// takes it out of the interleaved frames, converts it to the format of
+// the track, and makes a block file of it, which writes it with its
+// summaries.  The calling thread appends the finished block files to
+// the tracks in order, and calls progress.  False, having read nothing,
+// if the length of the file is not known, or it fits in a block anyway,
+// or the threads or buffers cannot be had.
+bool ImportPCMConcurrently(SNDFILE *file, const SF_INFO &info,
+                           TrackHolders &channels, int nThreads,
+                           const PCMImportProgress &progress, int &result)
+{
+   const int nChannels = info.channels;
+   const sampleFormat format = channels.begin()->get()->GetSampleFormat();
+   // As the serial import reads it
+   const sampleFormat readFormat = (format == int16Sample) ? int16Sample : floatSample;
+   const sampleCount total = (sampleCount)info.frames;
+   const sampleCount maxBlock = channels.begin()->get()->GetMaxBlockSize();
+   if (nThreads <= 1 || total <= maxBlock || total >= SF_COUNT_MAX ||
+       maxBlock * nChannels * SAMPLE_SIZE(readFormat) > std::numeric_limits<int>::max())
+      return false;
+   const int count = (int)((total + maxBlock - 1) / maxBlock);
+
+   struct Slot {
+      SampleBuffer buffer;
+      int chunk = -1;
+      sampleCount frames = 0;
+      int pending = 0; // channels not yet made into block files
+   };
+   std::vector<Slot> slots(PCM_IMPORT_SLOTS);
+   for (auto &slot : slots) {
+      if (!slot.buffer.Allocate(maxBlock * nChannels, readFormat).ptr())
+         return false;
+   }
+
+   // The caller makes no calls of its own, so one more
+   WorkerPool pool(nThreads + 1);
+   struct Scratch {
+      GrowableSampleBuffer channel, converted;
+   };
+   std::vector<Scratch> scratch(pool.GetThreadCount());
+
+   std::vector<Sequence *> sequences;
+   for (const auto &channel : channels)
+      sequences.push_back(channel->RightmostOrNewClip()->GetSequence());
+   DirManager *const dirManager = sequences[0]->GetDirManager();
+
+   wxMutex mutex;
+   wxCondition changed(mutex);
+   // These are guarded by mutex
+   std::vector<BlockFile *> blocks(count * nChannels);
+   int endChunk = count; // less if the file is shorter than it says
+   bool stop = false;
+
+   PCMReaderThread reader([&] {
+      for (int k = 0; k < count; k++) {
+         Slot &slot = slots[k % PCM_IMPORT_SLOTS];
+         {
+            wxMutexLocker locker(mutex);
+            while (!stop && slot.pending > 0)
+               changed.Wait();
+            if (stop)
+               return;
+         }
+
+         // The slot stays the reader's until pending is set
+         const sf_count_t want = std::min(maxBlock, total - k * maxBlock);
+         sf_count_t got;
+         if (readFormat == int16Sample)
+            got = SFCall<sf_count_t>(sf_readf_short, file, (short *)slot.buffer.ptr(), want);
+         else
+            got = SFCall<sf_count_t>(sf_readf_float, file, (float *)slot.buffer.ptr(), want);
+
+         wxMutexLocker locker(mutex);
+         if (got > 0) {
+            slot.chunk = k;
+            slot.frames = got;
+            slot.pending = nChannels;
+         }
+         if (got < want) {
+            endChunk = (got > 0) ? k + 1 : k;
+            changed.Broadcast();
+            return;
+         }
+         changed.Broadcast();
+      }
+   });
+   if (reader.Create() != wxTHREAD_NO_ERROR)
+      return false;
+   reader.Run();
+
+   int appended = 0;
+   sampleCount framesDone = 0;
+   result = eProgressSuccess;
+
+   auto appendFinished = [&] {
+      while (result == eProgressSuccess) {
+         {
+            wxMutexLocker locker(mutex);
+            if (appended >= endChunk)
+               return;
+            for (int c = 0; c < nChannels; c++) {
+               if (!blocks[appended * nChannels + c])
+                  return;
+            }
+         }
+
+         // An entry of blocks does not change once it is set
+         for (int c = 0; c < nChannels; c++)
+            sequences[c]->AppendBlockFile(blocks[appended * nChannels + c]);
+         framesDone += blocks[appended * nChannels]->GetLength();
+         appended++;
+
+         result = progress(framesDone, total);
+         if (result != eProgressSuccess) {
+            wxMutexLocker locker(mutex);
+            stop = true;
+            changed.Broadcast();
+         }
+      }
+   };
+
+   pool.ParallelFor(count * nChannels,
+      [&](int i, int thread) {
+         const int k = i / nChannels;
+         const int c = i % nChannels;
+         Slot &slot = slots[k % PCM_IMPORT_SLOTS];
+         {
+            wxMutexLocker locker(mutex);
+            while (!stop && k < endChunk && slot.chunk != k)
+               changed.Wait();
+            if (stop || k >= endChunk)
+               return;
+         }
+
+         const sampleCount frames = slot.frames;
+         Scratch &mine = scratch[thread];
+         samplePtr data = mine.channel.Resize(maxBlock, readFormat).ptr();
+         if (readFormat == int16Sample) {
+            const short *src = (const short *)slot.buffer.ptr() + c;
+            short *dst = (short *)data;
+            for (sampleCount j = 0; j < frames; j++)
+               dst[j] = src[nChannels * j];
+         }
+         else {
+            const float *src = (const float *)slot.buffer.ptr() + c;
+            float *dst = (float *)data;
+            for (sampleCount j = 0; j < frames; j++)
+               dst[j] = src[nChannels * j];
+         }
+
+         {
+            // Done with the slot
+            wxMutexLocker locker(mutex);
+            if (--slot.pending == 0)
+               changed.Broadcast();
+         }
+
+         // Converted and dithered as Sequence::Append() would
+         samplePtr converted = mine.converted.Resize(maxBlock, format).ptr();
+         BlockFile *f = sequences[c]->NewBlockFile(data, readFormat, frames, converted);
+
+         wxMutexLocker locker(mutex);
+         blocks[i] = f;
+      },
+      appendFinished, 10);
+
+   appendFinished();
+
+   {
+      wxMutexLocker locker(mutex);
+      stop = true;
+      changed.Broadcast();
+   }
+   reader.Wait();
+
+   // Any block files made after the import was stopped
+   for (size_t i = appended * nChannels; i < blocks.size(); i++) {
+      if (blocks[i])
+         dirManager->Deref(blocks[i]);
+   }
+
+   for (const auto &channel : channels)
+      channel->RightmostOrNewClip()->UpdateEnvelopeTrackLen();
+
+   return true;
+}
+
+}
+
+int ImportPCMSamples(SNDFILE *file, const SF_INFO &info, TrackHolders &channels,
+                     int nThreads, const PCMImportProgress &progress)
+{
+   int result;
+   if (ImportPCMConcurrently(file, info, channels, nThreads, progress, result))
+      return result;
+   return ImportPCMSerially(file, info, channels, progress);
+}
+
 int PCMImportFileHandle::Import(TrackFactory *trackFactory,
                                 TrackHolders &outTracks,
                                 Tags *tags)
@@ -430,61 +728,15 @@ int PCMImportFileHandle::Import(TrackFactory *trackFactory,
       // samples from the file and store our own local copy of the
       // samples in the tracks.
 
-      // PRL:  guard against excessive memory buffer allocation in case of many channels
-      sampleCount maxBlock = std::min(maxBlockSize,
-         sampleCount(std::numeric_limits<int>::max() /
-                 (mInfo.channels * SAMPLE_SIZE(mFormat)))
-      );
-      if (maxBlock < 1)
-         return eProgressFailed;
-
-      SampleBuffer srcbuffer;
-      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, mFormat).ptr())
-      {
-         maxBlock >>= 1;
-         if (maxBlock < 1)
-            return eProgressFailed;
-      }
-
-      SampleBuffer buffer(maxBlock, mFormat);
-
-      unsigned long framescompleted = 0;
-
-      long block;
-      do {
-         block = maxBlock;
-
-         if (mFormat == int16Sample)
-            block = SFCall<sf_count_t>(sf_readf_short, mFile.get(), (short *)srcbuffer.ptr(), block);
-         //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile works too.
-         else
-            block = SFCall<sf_count_t>(sf_readf_float, mFile.get(), (float *)srcbuffer.ptr(), block);
-
-         if (block) {
-            auto iter = channels.begin();
-            for(int c=0; c<mInfo.channels; ++iter, ++c) {
-               if (mFormat==int16Sample) {
-                  for(int j=0; j<block; j++)
-                     ((short *)buffer.ptr())[j] =
-                        ((short *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-               else {
-                  for(int j=0; j<block; j++)
-                     ((float *)buffer.ptr())[j] =
-                        ((float *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-
-               iter->get()->Append(buffer.ptr(), (mFormat == int16Sample)?int16Sample:floatSample, block);
-            }
-            framescompleted += block;
-         }
-
-         updateResult = mProgress->Update((long long unsigned)framescompleted,
-                                        (long long unsigned)fileTotalFrames);
-         if (updateResult != eProgressSuccess)
-            break;
+      long threads = gPrefs->Read(wxT("/FileFormats/PCMImportThreads"), 0L);
+      if (threads <= 0)
+         threads = WorkerPool::GetDefaultThreadCount();
 
-      } while (block > 0);
+      updateResult = ImportPCMSamples(mFile.get(), mInfo, channels, threads,
+         [&](sampleCount done, sampleCount total) {
+            return mProgress->Update((long long unsigned)done,
+                                     (long long unsigned)total);
+         });
    }
 
    if (updateResult == eProgressFailed || updateResult == eProgressCancelled) {
@@ -11,11 +11,30 @@
 #ifndef __AUDACITY_IMPORT_PCM__
 #define __AUDACITY_IMPORT_PCM__
 
+#include <functional>
+
+#include "sndfile.h"
+
+#include "../SampleFormat.h"
+#include "ImportRaw.h" // defines TrackHolders
+
 class ImportPluginList;
 class UnusableImportPluginList;
 
 void GetPCMImportPlugin(ImportPluginList *importPluginList,
                         UnusableImportPluginList *unusableImportPluginList);
 
+/// Called with the frames imported so far and the total; returns
+/// eProgressSuccess to go on
+using PCMImportProgress = std::function<int(sampleCount done, sampleCount total)>;
+
+/// Reads the rest of file into channels, new empty tracks, one for each
+/// channel of the file, in their sample format, and returns the last
+/// result of progress.  With nThreads above 1, a thread reads the file
+/// while the others make the block files of the channels, and the
+/// calling thread appends them to the tracks.
+int ImportPCMSamples(SNDFILE *file, const SF_INFO &info, TrackHolders &channels,
+                     int nThreads, const PCMImportProgress &progress);
+
 
 #endif
@@ -179,7 +179,7 @@ void ODComputeSummaryTask::Update()
       if(mWaveTracks[j])
       {
          WaveClip *clip;
-         BlockArray *blocks;
+         const BlockArray *blocks;
          Sequence *seq;
 
          //gather all the blockfiles that we should process in the wavetrack.
@@ -205,7 +205,7 @@ void ODComputeSummaryTask::Update()
             for(i=0; i<(int)blocks->size(); i++)
             {
                //if there is data but no summary, this blockfile needs summarizing.
-               SeqBlock &block = (*blocks)[i];
+               const SeqBlock &block = (*blocks)[i];
                BlockFile *const file = block.f;
                if(file->IsDataAvailable() && !file->IsSummaryAvailable())
                {
@@ -137,7 +137,7 @@ void ODDecodeTask::Update()
       if(mWaveTracks[j])
       {
          WaveClip *clip;
-         BlockArray *blocks;
+         const BlockArray *blocks;
          Sequence *seq;
 
          //gather all the blockfiles that we should process in the wavetrack.
@@ -158,7 +158,7 @@ void ODDecodeTask::Update()
             for (i = 0; i<(int)blocks->size(); i++)
             {
                //since we have more than one ODBlockFile, we will need type flags to cast.
-               SeqBlock &block = (*blocks)[i];
+               const SeqBlock &block = (*blocks)[i];
                BlockFile *const file = block.f;
                ODDecodeBlockFile *oddbFile;
                if (!file->IsDataAvailable() &&
@@ -57,9 +57,13 @@ ODManager::ODManager()
    mTerminate = false;
    mTerminated = false;
    mPause = gPause;
+   mNextWorkerQueue = 0;
+   mNumQueuedTasks = 0;
+   mQueueUpdatePending = false;
 
    //must set up the queue condition
    mQueueNotEmptyCond = new ODCondition(&mQueueNotEmptyCondLock);
+   mWorkCond = new ODCondition(&mWorkCondLock);
 }
 
 //private destructor - DELETE with static method Quit()
@@ -70,54 +74,213 @@ ODManager::~ODManager()
    for(unsigned int i=0;i<mQueues.size();i++)
       delete mQueues[i];
 
+   for(unsigned int i=0;i<mWorkerQueues.size();i++)
+      delete mWorkerQueues[i];
+
    delete mQueueNotEmptyCond;
+   delete mWorkCond;
 }
 
 ///Adds a task to running queue.  Thread-safe.
 void ODManager::AddTask(ODTask* task)
 {
+   //deal the tasks out to the workers in turn; stealing evens out the rest.
    mTasksMutex.Lock();
-   mTasks.push_back(task);
+   WorkerQueue* queue = mWorkerQueues[mNextWorkerQueue++ % mWorkerQueues.size()];
    mTasksMutex.Unlock();
-   //signal the queue not empty condition.
-   bool paused;
 
-   mPauseLock.Lock();
-   paused=mPause;
-   mPauseLock.Unlock();
+   queue->lock.Lock();
+   queue->tasks.push_back(task);
+   queue->lock.Unlock();
+
+   mWorkCondLock.Lock();
+   mNumQueuedTasks++;
+   mWorkCondLock.Unlock();
 
-   //don't signal if we are paused since if we wake up the loop it will start processing other tasks while paused
-   if(!paused)
-      mQueueNotEmptyCond->Signal();
+   //don't signal if we are paused since if we wake up a worker it will start processing other tasks while paused
+   if(!IsPaused())
+      SignalWorkers();
 }
 
 void ODManager::SignalTaskQueueLoop()
 {
-   bool paused;
+   //don't signal if we are paused
+   if(IsPaused())
+      return;
+
+   ODLocker locker{ &mQueueNotEmptyCondLock };
+   mQueueUpdatePending = true;
+   mQueueNotEmptyCond->Signal();
+}
+
+void ODManager::SignalWorkers(bool all)
+{
+   //take the lock so that a worker that has just found nothing to do is
+   //either already waiting, or has not yet looked at mNumQueuedTasks.
+   ODLocker locker{ &mWorkCondLock };
+   if(all)
+      mWorkCond->Broadcast();
+   else
+      mWorkCond->Signal();
+}
 
+bool ODManager::IsPaused()
+{
+   bool paused;
    mPauseLock.Lock();
    paused=mPause;
    mPauseLock.Unlock();
-   //don't signal if we are paused
-   if(!paused)
-      mQueueNotEmptyCond->Signal();
+   return paused;
+}
+
+bool ODManager::IsTerminating()
+{
+   bool terminate;
+   mTerminateMutex.Lock();
+   terminate=mTerminate;
+   mTerminateMutex.Unlock();
+   return terminate;
 }
 
 ///removes a task from the active task queue
 void ODManager::RemoveTaskIfInQueue(ODTask* task)
 {
+   bool found = false;
+
    mTasksMutex.Lock();
-   //linear search okay for now, (probably only 1-5 tasks exist at a time.)
-   for(unsigned int i=0;i<mTasks.size();i++)
+   for(unsigned int i=0;i<mPriorityTasks.size() && !found;i++)
    {
-      if(mTasks[i]==task)
+      if(mPriorityTasks[i]==task)
       {
-         mTasks.erase(mTasks.begin()+i);
-         break;
+         mPriorityTasks.erase(mPriorityTasks.begin()+i);
+         found = true;
       }
    }
    mTasksMutex.Unlock();
 
+   for(unsigned int w=0;w<mWorkerQueues.size() && !found;w++)
+   {
+      WorkerQueue* queue = mWorkerQueues[w];
+      queue->lock.Lock();
+      for(unsigned int i=0;i<queue->tasks.size();i++)
+      {
+         if(queue->tasks[i]==task)
+         {
+            queue->tasks.erase(queue->tasks.begin()+i);
+            found = true;
+            break;
+         }
+      }
+      queue->lock.Unlock();
+   }
+
+   if(found)
+   {
+      mWorkCondLock.Lock();
+      mNumQueuedTasks--;
+      mWorkCondLock.Unlock();
+   }
+}
+
+ODTask* ODManager::TakeTask(int worker)
+{
+   ODTask* task = NULL;
+
+   mTasksMutex.Lock();
+   if(mPriorityTasks.size())
+   {
+      task = mPriorityTasks.front();
+      mPriorityTasks.pop_front();
+   }
+   mTasksMutex.Unlock();
+
+   //our own queue first, oldest task first; then steal the newest task from
+   //the next worker along, so that the owner and the thief rarely collide.
+   int numWorkers = (int)mWorkerQueues.size();
+   for(int i=0;i<numWorkers && !task;i++)
+   {
+      WorkerQueue* queue = mWorkerQueues[(worker+i)%numWorkers];
+      queue->lock.Lock();
+      if(queue->tasks.size())
+      {
+         if(i==0)
+         {
+            task = queue->tasks.front();
+            queue->tasks.pop_front();
+         }
+         else
+         {
+            task = queue->tasks.back();
+            queue->tasks.pop_back();
+         }
+      }
+      queue->lock.Unlock();
+   }
+
+   if(task)
+   {
+      mWorkCondLock.Lock();
+      mNumQueuedTasks--;
+      mWorkCondLock.Unlock();
+   }
+   return task;
+}
+
+///Moves the waiting tasks that process the track to the priority queue.
+void ODManager::PrioritizeTrackTasks(WaveTrack* track)
+{
+   std::vector<ODTask*> demanded;
+
+   for(unsigned int w=0;w<mWorkerQueues.size();w++)
+   {
+      WorkerQueue* queue = mWorkerQueues[w];
+      queue->lock.Lock();
+      for(unsigned int i=0;i<queue->tasks.size();i++)
+      {
+         ODTask* task = queue->tasks[i];
+         for(int j=0;j<task->GetNumWaveTracks();j++)
+         {
+            if(task->GetWaveTrack(j)==track)
+            {
+               demanded.push_back(task);
+               queue->tasks.erase(queue->tasks.begin()+i);
+               i--;
+               break;
+            }
+         }
+      }
+      queue->lock.Unlock();
+   }
+
+   mTasksMutex.Lock();
+   mPriorityTasks.insert(mPriorityTasks.begin(), demanded.begin(), demanded.end());
+   mTasksMutex.Unlock();
+}
+
+///Main loop of the worker threads.
+void ODManager::WorkerLoop(int worker)
+{
+   while(true)
+   {
+      {
+         ODLocker locker{ &mWorkCondLock };
+         while(!IsTerminating() && (IsPaused() || mNumQueuedTasks==0))
+            mWorkCond->Wait();
+      }
+      if(IsTerminating())
+         break;
+
+      //Another worker may have got there first.
+      ODTask* task = TakeTask(worker);
+      if(!task)
+         continue;
+
+      //Do at least 5 percent of the task.  If it is not done, DoSome puts it back with AddTask().
+      task->DoSome(0.05f);
+
+      //let the manager thread retire finished tasks and redraw.
+      SignalTaskQueueLoop();
+   }
 }
 
 ///Adds a NEW task to the queue.  Creates a queue if the tracks associated with the task is not in the list
@@ -195,8 +358,20 @@ bool ODManager::IsInstanceCreated()
 ///Launches a thread for the manager and starts accepting Tasks.
 void ODManager::Init()
 {
-   mCurrentThreads = 0;
-   mMaxThreads = 5;
+   //one worker per core.  Tasks for different files and tracks are independent.
+   mMaxThreads = wxThread::GetCPUCount();
+   if(mMaxThreads < 2)
+      mMaxThreads = 2;
+
+   for(int i=0;i<mMaxThreads;i++)
+      mWorkerQueues.push_back(new WorkerQueue);
+   for(int i=0;i<mMaxThreads;i++)
+   {
+      ODTaskThread* worker = new ODTaskThread(i);
+      worker->Create();
+      worker->Run();
+      mWorkers.push_back(worker);
+   }
 
    //   wxLogDebug(wxT("Initializing ODManager...Creating manager thread"));
    ODManagerHelperThread* startThread = new ODManagerHelperThread;
@@ -210,19 +385,10 @@ void ODManager::Init()
    //destruction of thread is taken care of by thread library
 }
 
-void ODManager::DecrementCurrentThreads()
-{
-   mCurrentThreadsMutex.Lock();
-   mCurrentThreads--;
-   mCurrentThreadsMutex.Unlock();
-}
-
-///Main loop for managing threads and tasks.
+///Main loop for managing tasks.  The workers do the tasks; this thread retires
+///finished ones, schedules the next task of each track, and asks for redraws.
 void ODManager::Start()
 {
-   ODTaskThread* thread;
-   bool tasksInArray;
-   bool paused;
    int  numQueues=0;
 
    mNeedsDraw=0;
@@ -240,46 +406,13 @@ void ODManager::Start()
       //we should look at our WaveTrack queues to see if we can process a NEW task to the running queue.
       UpdateQueues();
 
-      //start some threads if necessary
-
-      mTasksMutex.Lock();
-      tasksInArray = mTasks.size()>0;
-      mTasksMutex.Unlock();
-
-      mPauseLock.Lock();
-      paused=mPause;
-      mPauseLock.Unlock();
-
-      mCurrentThreadsMutex.Lock();
-      // keep adding tasks if there is work to do, up to the limit.
-      while(!paused && tasksInArray && (mCurrentThreads < mMaxThreads))
-      {
-         mCurrentThreads++;
-         mCurrentThreadsMutex.Unlock();
-
-         mTasksMutex.Lock();
-         //detach a NEW thread.
-         thread = new ODTaskThread(mTasks[0]);//task);
-         //thread->SetPriority(10);//default is 50.
-         thread->Create();
-         thread->Run();
-
-         mTasks.erase(mTasks.begin());
-         tasksInArray = mTasks.size()>0;
-         mTasksMutex.Unlock();
-
-         mCurrentThreadsMutex.Lock();
-      }
-
-      mCurrentThreadsMutex.Unlock();
       //use a conditon variable to block here instead of a sleep.
-
-      // JKC: If there are no tasks ready to run, or we're paused then
-      // we wait for there to be tasks in the queue.
+      //We are woken when a worker finishes a slice of a task, or on Quit().
       {
          ODLocker locker{ &mQueueNotEmptyCondLock };
-         if( (!tasksInArray) || paused)
+         while(!mQueueUpdatePending && !IsTerminating())
             mQueueNotEmptyCond->Wait();
+         mQueueUpdatePending = false;
       }
 
       //if there is some ODTask running, then there will be something in the queue.  If so then redraw to show progress
@@ -325,8 +458,11 @@ void ODManager::Pauser::Pause(bool pause)
       pMan->mPauseLock.Unlock();
 
       if(!pause)
+      {
          //we should check the queue again.
-         pMan->mQueueNotEmptyCond->Signal();
+         pMan->SignalWorkers(true);
+         pMan->SignalTaskQueueLoop();
+      }
    }
    else
    {
@@ -347,16 +483,32 @@ void ODManager::Quit()
       pMan->mTerminate = true;
       pMan->mTerminateMutex.Unlock();
 
+      //Wake the idle workers, and wait for the busy ones to finish their slice.
+      pMan->SignalWorkers(true);
+      for(unsigned int i=0;i<pMan->mWorkers.size();i++)
+      {
+#ifdef __WXMAC__
+         pMan->mWorkers[i]->Delete();
+#else
+         pMan->mWorkers[i]->Wait();
+#endif
+         delete pMan->mWorkers[i];
+      }
+      pMan->mWorkers.clear();
+
       //This while loop waits for ODTasks to finish and the DELETE removes all tasks from the Queue.
       //This function is called from the main audacity event thread, so there should not be more requests for pMan
       pMan->mTerminatedMutex.Lock();
       while(!pMan->mTerminated)
       {
          pMan->mTerminatedMutex.Unlock();
-         wxThread::Sleep(200);
 
          //signal the queue not empty condition since the ODMan thread will wait on the queue condition
-         pMan->mQueueNotEmptyCond->Signal();
+         {
+            ODLocker locker{ &pMan->mQueueNotEmptyCondLock };
+            pMan->mQueueNotEmptyCond->Signal();
+         }
+         wxThread::Sleep(10);
 
          pMan->mTerminatedMutex.Lock();
       }
@@ -467,6 +619,9 @@ void ODManager::DemandTrackUpdate(WaveTrack* track, double seconds)
       mQueues[i]->DemandTrackUpdate(track,seconds);
    }
    mQueuesMutex.Unlock();
+
+   //and run them before the tasks nobody is looking at.
+   PrioritizeTrackTasks(track);
 }
 
 ///remove tasks from ODWaveTrackTaskQueues that have been done.  Schedules NEW ones if they exist
@@ -14,11 +14,19 @@
 \brief A singleton that manages currently running Tasks on an arbitrary
 number of threads.
 
+Runnable tasks are spread over one queue per worker thread.  A worker
+takes work from the front of its own queue, and when that is empty it
+steals from the back of another worker's queue, so that hundreds of
+small import tasks keep every core busy.  Tasks for a track the user
+has just clicked on go to a shared priority queue that every worker
+checks first.  Idle workers sleep on a condition variable.
+
 *//*******************************************************************/
 
 #ifndef __AUDACITY_ODMANAGER__
 #define __AUDACITY_ODMANAGER__
 
+#include <deque>
 #include <vector>
 #include "ODTask.h"
 #include "ODTaskThread.h"
@@ -58,8 +66,9 @@ class ODManager final
    ///changes the tasks associated with this Waveform to process the task from a different point in the track
    void DemandTrackUpdate(WaveTrack* track, double seconds);
 
-   ///Reduces the count of current threads running.  Meant to be called when ODTaskThreads end in their own threads.  Thread-safe.
-   void DecrementCurrentThreads();
+   ///Main loop of the worker threads.  Runs task slices until Quit().
+   ///@param worker the index of the calling worker.
+   void WorkerLoop(int worker);
 
    ///Adds a wavetrack, creates a queue member.
    void AddNewTask(ODTask* task, bool lockMutex=true);
@@ -135,6 +144,19 @@ class ODManager final
    ///Remove references in our array to Tasks that have been completed/Schedule NEW ones
    void UpdateQueues();
 
+   ///Takes the next task for a worker: a priority task if there is one,
+   ///then the front of the worker's own queue, then the back of another's.
+   ODTask* TakeTask(int worker);
+
+   ///Moves the waiting tasks that process the track to the priority queue.
+   void PrioritizeTrackTasks(WaveTrack* track);
+
+   ///Wakes one idle worker, or all of them.
+   void SignalWorkers(bool all = false);
+
+   bool IsPaused();
+   bool IsTerminating();
+
    //instance
    static ODManager* pMan;
 
@@ -142,23 +164,35 @@ class ODManager final
    std::vector<ODWaveTrackTaskQueue*> mQueues;
    ODLock mQueuesMutex;
 
-   //List of current Task to do.
-   std::vector<ODTask*> mTasks;
-   //mutex for above variable
+   //Tasks that are ready to run, one queue per worker, each with its own lock
+   //so that the workers only contend when one steals from another.
+   struct WorkerQueue
+   {
+      ODLock lock;
+      std::deque<ODTask*> tasks;
+   };
+   std::vector<WorkerQueue*> mWorkerQueues;
+   std::vector<ODTaskThread*> mWorkers;
+   //the worker queue that the next added task goes to
+   unsigned int mNextWorkerQueue;
+
+   //Tasks the user is waiting on, taken before any in mWorkerQueues.
+   //The mutex also guards mNextWorkerQueue.
+   std::deque<ODTask*> mPriorityTasks;
    ODLock mTasksMutex;
 
+   //Number of tasks in all of the above queues, and the condition idle workers wait on.
+   int mNumQueuedTasks;
+   ODLock mWorkCondLock;
+   ODCondition* mWorkCond;
+
    //global pause switch for OD
    volatile bool mPause;
    ODLock mPauseLock;
 
    volatile int mNeedsDraw;
 
-   ///Number of threads currently running.   Accessed thru multiple threads
-   volatile int mCurrentThreads;
-   //mutex for above variable
-   ODLock mCurrentThreadsMutex;
-
-   ///Maximum number of threads allowed out.
+   ///Number of worker threads.
    int mMaxThreads;
 
    volatile bool mTerminate;
@@ -167,9 +201,11 @@ class ODManager final
    volatile bool mTerminated;
    ODLock mTerminatedMutex;
 
-   //for the queue not empty comdition
+   //for the queue not empty comdition, which wakes the manager thread to update
+   //the queues and redraw.  mQueueUpdatePending is guarded by the lock.
    ODLock         mQueueNotEmptyCondLock;
    ODCondition*   mQueueNotEmptyCond;
+   bool           mQueueUpdatePending;
 
 #ifdef __WXMAC__
 
@@ -23,6 +23,7 @@ in a background thread.
 #include "../WaveTrack.h"
 #include "../Project.h"
 #include "../UndoManager.h"
+#include <wx/stopwatch.h>
 //temporarilly commented out till it is added to all projects
 //#include "../Profiler.h"
 
@@ -39,6 +40,8 @@ ODTask::ODTask()
    mTerminate = false;
    mNeedsODUpdate=false;
    mIsRunning = false;
+   mUnitsDone = 0;
+   mSecondsWorked = 0.0;
 
    mTaskNumber=sTaskNumber++;
 
@@ -102,6 +105,8 @@ void ODTask::DoSome(float amountWork)
 
    //Do Some of the task.
 
+   wxStopWatch timer;
+   int units = 0;
    mTerminateMutex.Lock();
    while(PercentComplete() < workUntil && PercentComplete() < 1.0 && !mTerminate)
    {
@@ -109,6 +114,7 @@ void ODTask::DoSome(float amountWork)
       //release within the loop so we can cut the number of iterations short
 
       DoSomeInternal(); //keep the terminate mutex on so we don't remo
+      units++;
       mTerminateMutex.Unlock();
       //check to see if ondemand has been called
       if(GetNeedsODUpdate() && PercentComplete() < 1.0)
@@ -121,6 +127,11 @@ void ODTask::DoSome(float amountWork)
    mTerminateMutex.Unlock();
    mDoingTask=false;
 
+   mThroughputMutex.Lock();
+   mUnitsDone += units;
+   mSecondsWorked += timer.Time() / 1000.0;
+   mThroughputMutex.Unlock();
+
    mTerminateMutex.Lock();
    //if it is not done, put it back onto the ODManager queue.
    if(PercentComplete() < 1.0&& !mTerminate)
@@ -151,7 +162,15 @@ void ODTask::DoSome(float amountWork)
          //END_TASK_PROFILING("On Demand Drag and Drop 5 80 mb files into audacity, 5 wavs per task");
       //END_TASK_PROFILING("On Demand open an 80 mb wav stereo file");
 
+      //the throughput goes with the event, for the main thread to log;
+      //wxLog calls are not threadsafe.
+      const int unitsDone = GetUnitsDone();
+      const double secondsWorked = GetSecondsWorked();
       wxCommandEvent event( EVT_ODTASK_COMPLETE );
+      event.SetString(wxString::Format(wxT("%s %d %s: %d units in %.2f s (%.1f units/s)"),
+                      wxString::FromAscii(GetTaskName()).c_str(), GetTaskNumber(),
+                      mTerminate ? wxT("stopped") : wxT("complete"), unitsDone, secondsWorked,
+                      secondsWorked > 0 ? unitsDone / secondsWorked : 0.0));
       AudacityProject::AllProjectsDeleteLock();
 
       for(unsigned i=0; i<gAudacityProjects.GetCount(); i++)
@@ -159,15 +178,14 @@ void ODTask::DoSome(float amountWork)
          if(IsTaskAssociatedWithProject(gAudacityProjects[i]))
          {
             //this assumes tasks are only associated with one project.
-            gAudacityProjects[i]->GetEventHandler()->AddPendingEvent(event);
+            //QueueEvent, unlike AddPendingEvent, is safe for the string.
+            gAudacityProjects[i]->GetEventHandler()->QueueEvent(event.Clone());
             //mark the changes so that the project can be resaved.
             gAudacityProjects[i]->GetUndoManager()->SetODChangesFlag();
             break;
          }
       }
       AudacityProject::AllProjectsDeleteUnlock();
-
-//      printf("%s %i complete\n", GetTaskName(),GetTaskNumber());
    }
    mTerminateMutex.Unlock();
    SetIsRunning(false);
@@ -227,6 +245,24 @@ bool ODTask::IsRunning()
    return ret;
 }
 
+int ODTask::GetUnitsDone()
+{
+   int ret;
+   mThroughputMutex.Lock();
+   ret = mUnitsDone;
+   mThroughputMutex.Unlock();
+   return ret;
+}
+
+double ODTask::GetSecondsWorked()
+{
+   double ret;
+   mThroughputMutex.Lock();
+   ret = mSecondsWorked;
+   mThroughputMutex.Unlock();
+   return ret;
+}
+
 sampleCount ODTask::GetDemandSample() const
 {
    sampleCount retval;
@@ -123,6 +123,12 @@ class ODTask /* not final */
 
    bool IsRunning();
 
+   ///Throughput counters kept by DoSome(), for profiling the scheduler.  Thread-safe.
+   ///@return the number of units of work (DoSomeInternal() calls) done so far
+   int GetUnitsDone();
+   ///@return the total time spent in DoSome() so far, in seconds
+   double GetSecondsWorked();
+
 
  protected:
 
@@ -165,6 +171,10 @@ class ODTask /* not final */
    volatile bool mIsRunning;
    ODLock mIsRunningMutex;
 
+   int mUnitsDone;
+   double mSecondsWorked;
+   ODLock mThroughputMutex;
+
 
    private:
 
@@ -11,7 +11,7 @@
 ******************************************************************//**
 
 \class ODTaskThread
-\brief A thread that executes a part of the task specfied by an ODTask.
+\brief A worker thread that runs the ODTask slices handed out by the ODManager.
 
 *//*******************************************************************/
 
@@ -21,12 +21,12 @@
 #include "ODManager.h"
 
 
-ODTaskThread::ODTaskThread(ODTask* task)
+ODTaskThread::ODTaskThread(int worker)
 #ifndef __WXMAC__
-: wxThread()
+: wxThread(wxTHREAD_JOINABLE)
 #endif
 {
-   mTask=task;
+   mWorker=worker;
 #ifdef __WXMAC__
    mDestroy = false;
    mThread = NULL;
@@ -44,11 +44,7 @@ void *ODTaskThread::Entry()
 {
    //TODO: Figure out why this has no effect at all.
    //wxThread::This()->SetPriority( 40);
-   //Do at least 5 percent of the task
-   mTask->DoSome(0.05f);
-
-   //release the thread count so that the ODManager knows how many active threads are alive.
-   ODManager::Instance()->DecrementCurrentThreads();
+   ODManager::Instance()->WorkerLoop(mWorker);
 
 
 #ifndef __WXMAC__
@@ -11,7 +11,7 @@
 ******************************************************************//**
 
 \class ODTaskThread
-\brief A thread that executes a part of the task specfied by an ODTask.
+\brief A worker thread that runs the ODTask slices handed out by the ODManager.
 
 *//*******************************************************************/
 
@@ -39,7 +39,7 @@ class ODTask;
 class ODTaskThread {
  public:
    typedef int ExitCode;
-   ODTaskThread(ODTask* task);
+   ODTaskThread(int worker);
    /*ExitCode*/ void Entry();
    void Create() {}
    void Delete() {
@@ -78,7 +78,7 @@ class ODTaskThread {
    bool mDestroy;
    pthread_t mThread;
 
-   ODTask* mTask;
+   int mWorker;
 };
 
 class ODLock {
@@ -134,14 +134,14 @@ class ODTaskThread final : public wxThread
 {
 public:
    ///Constructs a ODTaskThread
-   ///@param task the task to be launched as an
-   ODTaskThread(ODTask* task);
+   ///@param worker the index of the worker, which selects its task queue
+   ODTaskThread(int worker);
 
 
 protected:
-   ///Executes a part of the task
+   ///Runs task slices until the ODManager quits
    void* Entry() override;
-   ODTask* mTask;
+   int mWorker;
 
 };
 
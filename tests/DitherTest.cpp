@@ -0,0 +1,311 @@
+#include <iostream>
+#include <ostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <wx/stopwatch.h>
+
+#include "SampleFormat.h"
+#include "Dither.h"
+
+// The conversions as Dither::Apply() did them before it worked in
+// blocks, one sample at a time with noise from rand()
+class ReferenceDither {
+   float mTriangleState;
+   int mPhase;
+   float mBuffer[8];
+
+   static float Noise() { return rand() / (float)RAND_MAX - 0.5f; }
+
+   float DoDither(Dither::DitherType type, float sample) {
+      switch (type) {
+      case Dither::rectangle:
+         return sample - Noise();
+      case Dither::triangle: {
+         float r = Noise();
+         float result = sample + r - mTriangleState;
+         mTriangleState = r;
+         return result;
+      }
+      case Dither::shaped: {
+         static const float bs[] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
+         float r = Noise() + Noise();
+         if (sample != sample)
+            sample = 0;
+         float xe = sample + mBuffer[mPhase] * bs[0]
+            + mBuffer[(mPhase - 1) & 7] * bs[1]
+            + mBuffer[(mPhase - 2) & 7] * bs[2]
+            + mBuffer[(mPhase - 3) & 7] * bs[3]
+            + mBuffer[(mPhase - 4) & 7] * bs[4];
+         float result = xe + r;
+         mPhase = (mPhase + 1) & 7;
+         mBuffer[mPhase] = xe - lrintf(result);
+         return result;
+      }
+      default:
+         return sample;
+      }
+   }
+
+   static int Store(float sample, int minBound, int maxBound) {
+      // What lrintf() makes of NaN depends on the platform; Dither
+      // settles on what 64-bit builds did
+      if (sample != sample)
+         return 0;
+      int x = lrintf(sample);
+      return x > maxBound ? maxBound : x < minBound ? minBound : x;
+   }
+
+public:
+   void Apply(Dither::DitherType type,
+              const char *src, sampleFormat srcFormat,
+              char *dst, sampleFormat dstFormat,
+              unsigned int len, unsigned int srcStride, unsigned int dstStride) {
+      mTriangleState = 0;
+      mPhase = 0;
+      memset(mBuffer, 0, sizeof(mBuffer));
+
+      for (unsigned int i = 0; i < len; i++) {
+         const char *s = src + i * srcStride * SAMPLE_SIZE(srcFormat);
+         char *d = dst + i * dstStride * SAMPLE_SIZE(dstFormat);
+         if (srcFormat == dstFormat)
+            memcpy(d, s, SAMPLE_SIZE(srcFormat));
+         else if (dstFormat == floatSample)
+            *(float *)d = srcFormat == int16Sample
+               ? *(const short *)s / float(1 << 15)
+               : *(const int *)s / float(1 << 23);
+         else if (dstFormat == int24Sample && srcFormat == int16Sample)
+            *(int *)d = ((int)*(const short *)s) << 8;
+         else {
+            float sample;
+            if (srcFormat == int24Sample)
+               sample = *(const int *)s / float(1 << 23);
+            else {
+               const float f = *(const float *)s;
+               sample = f > 1.0 ? 1.0 : f < -1.0 ? -1.0 : f;
+            }
+            if (dstFormat == int16Sample)
+               *(short *)d = Store(DoDither(type, sample * float(1 << 15)),
+                                   -32768, 32767);
+            else
+               *(int *)d = Store(DoDither(type, sample * float(1 << 23)),
+                                 -8388608, 8388607);
+         }
+      }
+   }
+};
+
+// Checks Dither::Apply() against the reference: the same bits where no
+// noise is added, and noise of the same strength otherwise.
+class DitherTest {
+   std::vector<float> floats;
+   std::vector<int> int24s;
+   std::vector<short> int16s;
+
+   const char *SourceOf(sampleFormat format) {
+      switch (format) {
+      case int16Sample: return (const char *)&int16s[0];
+      case int24Sample: return (const char *)&int24s[0];
+      default: return (const char *)&floats[0];
+      }
+   }
+
+public:
+   DitherTest()
+   {
+      std::cout << "==> Testing Dither\n";
+   }
+
+   void setUp() {
+      const size_t len = 3 * 5000;
+      floats.resize(len);
+      int24s.resize(len);
+      int16s.resize(len);
+      for (size_t i = 0; i < len; i++) {
+         floats[i] = rand() / (float)RAND_MAX * 2.4f - 1.2f;
+         int24s[i] = rand() % (1 << 24) - (1 << 23);
+         int16s[i] = (short)(rand() % (1 << 16) - (1 << 15));
+      }
+
+      // Make some special values turn up
+      const float specials[] = { NAN, INFINITY, -INFINITY, 1.0f, -1.0f,
+                                 0.0f, -0.0f, 32767.5f / 32768, -32768.5f / 32768 };
+      for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); i++)
+         floats[10 * i + 3] = specials[i];
+      int24s[5] = 8388607, int24s[6] = -8388608;
+      int16s[5] = 32767, int16s[6] = -32768;
+   }
+
+   void tearDown() {
+      floats.clear();
+      int24s.clear();
+      int16s.clear();
+      Dither::SetVectorized(true);
+   }
+
+   void testExactConversions() {
+      std::cout << "\tconversions without noise should match the reference..."
+                << std::flush;
+
+      const sampleFormat formats[] = { int16Sample, int24Sample, floatSample };
+      const unsigned int strides[] = { 1, 2, 3 };
+      const unsigned int lens[] = { 0, 1, 7, 1024, 1025, 5000 };
+      const bool vectorized[] = { false, true };
+
+      for (size_t v = 0; v < 2; v++) {
+         if (!Dither::SetVectorized(vectorized[v]))
+            continue;
+         for (size_t f = 0; f < 3; f++)
+         for (size_t g = 0; g < 3; g++)
+         for (size_t s = 0; s < 3; s++)
+         for (size_t t = 0; t < 3; t++)
+         for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+            const unsigned int len = lens[l];
+            const size_t bytes = 3 * len * SAMPLE_SIZE(formats[g]) + 1;
+            std::vector<char> expected(bytes, 0), actual(bytes, 0);
+
+            ReferenceDither reference;
+            reference.Apply(Dither::none, SourceOf(formats[f]), formats[f],
+                            &expected[0], formats[g], len, strides[s], strides[t]);
+            Dither dither;
+            dither.Apply(Dither::none, (samplePtr)SourceOf(formats[f]), formats[f],
+                         &actual[0], formats[g], len, strides[s], strides[t]);
+
+            // Also checks that samples between the strided ones are untouched
+            assert(memcmp(&expected[0], &actual[0], bytes) == 0);
+         }
+      }
+
+      std::cout << "OK\n";
+   }
+
+   void testNoiseStatistics() {
+      std::cout << "\tdither noise should match the reference in mean and power..."
+                << std::flush;
+
+      // A quiet signal, far from clipping, and long enough for the
+      // shaped noise power to settle
+      const unsigned int len = 1 << 18;
+      std::vector<float> signal(len);
+      for (unsigned int i = 0; i < len; i++)
+         signal[i] = 0.01f * sinf(i * 0.01f);
+
+      const Dither::DitherType types[] =
+         { Dither::rectangle, Dither::triangle, Dither::shaped };
+      for (size_t t = 0; t < 3; t++) {
+         std::vector<short> expected(len), actual(len);
+         ReferenceDither reference;
+         reference.Apply(types[t], (const char *)&signal[0], floatSample,
+                         (char *)&expected[0], int16Sample, len, 1, 1);
+         Dither dither;
+         dither.Apply(types[t], (samplePtr)&signal[0], floatSample,
+                      (samplePtr)&actual[0], int16Sample, len, 1, 1);
+
+         double expectedMean = 0, expectedPower = 0, mean = 0, power = 0;
+         for (unsigned int i = 0; i < len; i++) {
+            const double exact = signal[i] * 32768.0;
+            expectedMean += expected[i] - exact;
+            expectedPower += (expected[i] - exact) * (expected[i] - exact);
+            mean += actual[i] - exact;
+            power += (actual[i] - exact) * (actual[i] - exact);
+         }
+         expectedMean /= len, expectedPower /= len, mean /= len, power /= len;
+
+         assert(fabs(mean) < 0.05 && fabs(expectedMean) < 0.05);
+         assert(fabs(power - expectedPower) < 0.05 * expectedPower);
+      }
+
+      // The noise generators give the same sequence on either path
+      if (Dither::SetVectorized(true)) {
+         const unsigned int len = floats.size() / 3;
+         std::vector<short> scalar(len), vector(len);
+         srand(1);
+         Dither first;
+         srand(1);
+         Dither second;
+         Dither::SetVectorized(false);
+         first.Apply(Dither::shaped, (samplePtr)&floats[0], floatSample,
+                     (samplePtr)&scalar[0], int16Sample, len, 3, 1);
+         Dither::SetVectorized(true);
+         second.Apply(Dither::shaped, (samplePtr)&floats[0], floatSample,
+                      (samplePtr)&vector[0], int16Sample, len, 3, 1);
+         assert(scalar == vector);
+      }
+
+      // A seeded Dither, as CopySamples() makes for each conversion,
+      // depends on nothing but its seed
+      {
+         const unsigned int len = floats.size();
+         std::vector<short> first(len), second(len), other(len);
+         Dither(7).Apply(Dither::shaped, (samplePtr)&floats[0], floatSample,
+                         (samplePtr)&first[0], int16Sample, len);
+         rand();
+         Dither(7).Apply(Dither::shaped, (samplePtr)&floats[0], floatSample,
+                         (samplePtr)&second[0], int16Sample, len);
+         Dither(8).Apply(Dither::shaped, (samplePtr)&floats[0], floatSample,
+                         (samplePtr)&other[0], int16Sample, len);
+         assert(first == second);
+         assert(first != other);
+      }
+
+      std::cout << "OK\n";
+   }
+
+   void benchmarkConversions() {
+      std::cout << "\tconverting 64M samples:\n";
+
+      const unsigned int len = 1 << 20;
+      const int repeats = 64;
+      std::vector<float> source(len), back(len);
+      std::vector<short> dest(len);
+      for (unsigned int i = 0; i < len; i++)
+         source[i] = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+
+      const Dither::DitherType types[] =
+         { Dither::none, Dither::triangle, Dither::shaped };
+      const char *names[] = { "float to int16", "triangle dither", "shaped dither" };
+      for (size_t t = 0; t < 3; t++) {
+         ReferenceDither reference;
+         wxStopWatch referenceTimer;
+         for (int r = 0; r < repeats; r++)
+            reference.Apply(types[t], (const char *)&source[0], floatSample,
+                            (char *)&dest[0], int16Sample, len, 1, 1);
+         const long referenceTime = referenceTimer.Time();
+
+         Dither dither;
+         wxStopWatch timer;
+         for (int r = 0; r < repeats; r++)
+            dither.Apply(types[t], (samplePtr)&source[0], floatSample,
+                         (samplePtr)&dest[0], int16Sample, len, 1, 1);
+         const long elapsed = timer.Time();
+
+         std::cout << "\t\t" << names[t] << ": " << referenceTime << " ms before, "
+                   << elapsed << " ms now";
+         if (elapsed > 0)
+            std::cout << ", speedup " << referenceTime / (double)elapsed;
+         std::cout << "\n";
+      }
+   }
+};
+
+int main()
+{
+    DitherTest tester;
+
+    tester.setUp();
+    tester.testExactConversions();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.testNoiseStatistics();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.benchmarkConversions();
+    tester.tearDown();
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <iostream>
+#include <ostream>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RealtimeSnapshot.h"
+
+// Stands for a realtime effect: the audio thread must never run one
+// that has been finalized, nor one not yet initialized
+struct TestEffect {
+   std::atomic<bool> ready{ false };
+   float state{ 0 };
+};
+
+typedef std::vector<TestEffect *> Chain;
+
+// Checks that the audio thread only ever sees a whole, live chain while
+// the main thread adds and removes effects, and reports the worst time
+// an audio callback takes, against a chain guarded by a lock that the
+// main thread holds while it changes the chain, as EffectManager did.
+class RealtimeSnapshotTest {
+   static const int PoolSize = 16;
+   static const int Changes = 400;
+   // What adding and removing an effect costs the main thread, as a
+   // plugin may take that long to get ready or to clean up
+   static const int InitializeMicros = 2000;
+   static const int FinalizeMicros = 1000;
+
+   TestEffect mPool[PoolSize];
+   std::atomic<bool> mDone;
+   long long mWorstMicros;
+   int mCallbacks;
+
+   RealtimeSnapshot<Chain> mSnapshot;
+
+   std::mutex mLock;
+   Chain mLockedChain;
+
+   typedef std::chrono::steady_clock Clock;
+
+   static void Process(const Chain &chain, std::vector<float> &buffer) {
+      for (TestEffect *e : chain) {
+         assert(e->ready.load());
+         for (float &sample : buffer) {
+            e->state = 0.99f * e->state + 0.01f * sample;
+            sample = e->state;
+         }
+      }
+   }
+
+   static void Spend(int micros) {
+      std::this_thread::sleep_for(std::chrono::microseconds(micros));
+   }
+
+   void AudioThread(bool locked) {
+      std::vector<float> buffer(512);
+      while (!mDone.load()) {
+         for (size_t i = 0; i < buffer.size(); i++)
+            buffer[i] = rand() / (float)RAND_MAX - 0.5f;
+
+         Clock::time_point start = Clock::now();
+         if (locked) {
+            std::lock_guard<std::mutex> locker(mLock);
+            Process(mLockedChain, buffer);
+         }
+         else {
+            const Chain *chain = mSnapshot.Acquire();
+            Process(*chain, buffer);
+            mSnapshot.Release();
+         }
+         const long long micros = std::chrono::duration_cast<std::chrono::microseconds>
+            (Clock::now() - start).count();
+         mWorstMicros = std::max(mWorstMicros, micros);
+         mCallbacks++;
+
+         // The period of a small audio buffer
+         Spend(1000);
+      }
+   }
+
+   void Churn(bool locked) {
+      for (int n = 0; n < Changes; n++) {
+         TestEffect *e = &mPool[rand() % PoolSize];
+         if (locked) {
+            std::lock_guard<std::mutex> locker(mLock);
+            Chain::iterator iter = std::find(mLockedChain.begin(), mLockedChain.end(), e);
+            if (iter != mLockedChain.end()) {
+               mLockedChain.erase(iter);
+               Spend(FinalizeMicros);
+               e->ready.store(false);
+            }
+            else {
+               Spend(InitializeMicros);
+               e->ready.store(true);
+               mLockedChain.push_back(e);
+            }
+         }
+         else {
+            Chain chain = mSnapshot.Get();
+            Chain::iterator iter = std::find(chain.begin(), chain.end(), e);
+            if (iter != chain.end()) {
+               // Once published, the audio thread is done with the effect
+               chain.erase(iter);
+               mSnapshot.Publish(chain);
+               Spend(FinalizeMicros);
+               e->ready.store(false);
+            }
+            else {
+               // The audio thread does not see it until it is ready
+               Spend(InitializeMicros);
+               e->ready.store(true);
+               chain.push_back(e);
+               mSnapshot.Publish(chain);
+            }
+         }
+      }
+   }
+
+public:
+   RealtimeSnapshotTest()
+   {
+      std::cout << "==> Testing RealtimeSnapshot\n";
+   }
+
+   void setUp() {
+      mDone.store(false);
+      mWorstMicros = 0;
+      mCallbacks = 0;
+      for (int i = 0; i < PoolSize; i++)
+         mPool[i].ready.store(false);
+      mSnapshot.Publish(Chain());
+      mLockedChain.clear();
+   }
+
+   void tearDown() {
+   }
+
+   void testPublish() {
+      std::cout << "\tthe reader should see what was last published..." << std::flush;
+
+      const Chain *chain = mSnapshot.Acquire();
+      assert(chain->empty());
+      mSnapshot.Release();
+
+      Chain two;
+      two.push_back(&mPool[0]);
+      two.push_back(&mPool[1]);
+      mSnapshot.Publish(two);
+      assert(mSnapshot.Get() == two);
+
+      chain = mSnapshot.Acquire();
+      assert(*chain == two);
+      mSnapshot.Release();
+
+      std::cout << "OK\n";
+   }
+
+   void testChurn(bool locked) {
+      std::cout << "\tadding and removing effects during playback, "
+                << (locked ? "with a lock" : "with snapshots") << "..." << std::flush;
+
+      std::thread audio(&RealtimeSnapshotTest::AudioThread, this, locked);
+      Churn(locked);
+      mDone.store(true);
+      audio.join();
+
+      std::cout << "OK, worst callback " << mWorstMicros << " us in "
+                << mCallbacks << " callbacks\n";
+   }
+};
+
+int main()
+{
+    RealtimeSnapshotTest tester;
+
+    tester.setUp();
+    tester.testPublish();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.testChurn(false);
+    tester.tearDown();
+
+    tester.setUp();
+    tester.testChurn(true);
+    tester.tearDown();
+
+    return 0;
+}
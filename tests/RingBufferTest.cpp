@@ -0,0 +1,169 @@
+#include <iostream>
+#include <ostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+
+
+class RingBufferTest {
+   RingBuffer *mBuffer;
+   unsigned mChannels;
+   int mTotal;
+
+public:
+   RingBufferTest()
+   {
+       std::cout << "==> Testing RingBuffer\n";
+   }
+
+   void setUp(unsigned channels) {
+      mChannels = channels;
+      // Small buffer and odd chunk sizes so that the indices wrap often
+      mBuffer = new RingBuffer(floatSample, 997, mChannels);
+      mTotal = 2000000;
+   }
+
+   void tearDown() {
+      delete mBuffer;
+   }
+
+   // Each sample encodes its frame number and channel, so the reader can
+   // tell whether anything was lost, duplicated, reordered or torn.
+   float Expected(int frame, unsigned channel)
+   {
+      return (float)((frame % 65536) * 64 + channel);
+   }
+
+   void Produce(bool planar)
+   {
+      int chunk = 1;
+      std::vector<float> interleaved(256 * mChannels);
+      std::vector<std::vector<float>> channels(mChannels, std::vector<float>(256));
+      std::vector<samplePtr> ptrs(mChannels);
+      for (unsigned c = 0; c < mChannels; c++)
+         ptrs[c] = (samplePtr)&channels[c][0];
+
+      int written = 0;
+      while (written < mTotal) {
+         int len = std::min(chunk, mTotal - written);
+         for (int i = 0; i < len; i++)
+            for (unsigned c = 0; c < mChannels; c++) {
+               interleaved[i * mChannels + c] = Expected(written + i, c);
+               channels[c][i] = Expected(written + i, c);
+            }
+
+         int put;
+         if (planar)
+            put = mBuffer->Put(&ptrs[0], floatSample, len);
+         else
+            put = mBuffer->Put((samplePtr)&interleaved[0], floatSample, len);
+         assert(put >= 0 && put <= len);
+
+         if (put == 0)
+            std::this_thread::yield();
+         written += put;
+         chunk = chunk % 255 + 1;
+      }
+   }
+
+   void Consume(bool planar)
+   {
+      int chunk = 7;
+      std::vector<float> interleaved(256 * mChannels);
+      std::vector<std::vector<float>> channels(mChannels, std::vector<float>(256));
+      std::vector<samplePtr> ptrs(mChannels);
+      for (unsigned c = 0; c < mChannels; c++)
+         ptrs[c] = (samplePtr)&channels[c][0];
+
+      int read = 0;
+      while (read < mTotal) {
+         int avail = mBuffer->AvailForGet();
+         assert(avail >= 0 && avail <= mTotal - read);
+
+         int got;
+         if (planar)
+            got = mBuffer->Get(&ptrs[0], floatSample, chunk);
+         else
+            got = mBuffer->Get((samplePtr)&interleaved[0], floatSample, chunk);
+         assert(got >= 0 && got <= chunk);
+
+         for (int i = 0; i < got; i++)
+            for (unsigned c = 0; c < mChannels; c++) {
+               float value = planar ? channels[c][i] : interleaved[i * mChannels + c];
+               if (value != Expected(read + i, c)) {
+                  std::cout << value << " != " << Expected(read + i, c)
+                            << " (frame=" << read + i << ", channel=" << c << ")"
+                            << std::endl;
+                  assert(false);
+               }
+            }
+
+         if (got == 0)
+            std::this_thread::yield();
+         read += got;
+         chunk = chunk % 253 + 3;
+      }
+
+      assert(mBuffer->AvailForGet() == 0);
+   }
+
+   void testConcurrent(bool putPlanar, bool getPlanar) {
+      std::cout << "\t" << mChannels << " channel(s), "
+                << (putPlanar ? "planar" : "interleaved") << " put, "
+                << (getPlanar ? "planar" : "interleaved") << " get, "
+                << "concurrent reader and writer should see every frame in order..."
+                << std::flush;
+
+      std::thread producer(&RingBufferTest::Produce, this, putPlanar);
+      std::thread consumer(&RingBufferTest::Consume, this, getPlanar);
+      producer.join();
+      consumer.join();
+
+      std::cout << "OK\n";
+   }
+
+   void testDiscard() {
+      std::cout << "\tDiscard should drop whole frames and never more than is available..."
+                << std::flush;
+
+      std::vector<float> in(100 * mChannels), out(100 * mChannels);
+      for (int i = 0; i < 100; i++)
+         for (unsigned c = 0; c < mChannels; c++)
+            in[i * mChannels + c] = Expected(i, c);
+
+      assert(mBuffer->Put((samplePtr)&in[0], floatSample, 100) == 100);
+      assert(mBuffer->Discard(30) == 30);
+      assert(mBuffer->AvailForGet() == 70);
+      assert(mBuffer->Get((samplePtr)&out[0], floatSample, 10) == 10);
+      for (int i = 0; i < 10; i++)
+         for (unsigned c = 0; c < mChannels; c++)
+            assert(out[i * mChannels + c] == Expected(30 + i, c));
+      assert(mBuffer->Discard(1000) == 60);
+      assert(mBuffer->AvailForGet() == 0);
+      assert(mBuffer->AvailForPut() == 997 - 4);
+
+      std::cout << "OK\n";
+   }
+};
+
+int main()
+{
+    RingBufferTest tester;
+
+    const unsigned channelCounts[] = { 1, 2, 32 };
+    for (unsigned channels : channelCounts) {
+       tester.setUp(channels);
+       tester.testDiscard();
+       tester.tearDown();
+
+       for (int mode = 0; mode < 4; mode++) {
+          tester.setUp(channels);
+          tester.testConcurrent(mode & 1, mode & 2);
+          tester.tearDown();
+       }
+    }
+
+    return 0;
+}
@@ -1,9 +1,19 @@
 
 #include "Sequence.h"
 #include "DirManager.h"
+#include "Dither.h"
+#include "Prefs.h"
 #include <wx/hash.h>
+#include <wx/fileconf.h>
+#include <wx/sstream.h>
 #include <vector>
+#include <thread>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <wx/stopwatch.h>
 
 class SequenceTest
 {
@@ -86,6 +96,262 @@ public:
       std::cout << "ok\n";
    }
 
+   void TestSharing()
+   {
+      /* A copy in the same DirManager, like an undo state, shares the
+       * blocks of the original until one of them is edited.  The
+       * edit must not show through in the other, and the blocks must
+       * still be released when both are gone. */
+
+      std::cout << "\ta copy should share blocks until edited, and the edit should not change the original..." << std::flush;
+
+      int len = (int)(mSequence->GetMaxBlockSize() * 3.5);
+      samplePtr appendBuf = NewSamples(len, floatSample);
+      samplePtr getBuf = NewSamples(len, floatSample);
+      for (int i = 0; i < len; i++)
+         ((float *)appendBuf)[i] = i / (float)len;
+      mSequence->Append(appendBuf, floatSample, len);
+
+      Sequence *copy = new Sequence(*mSequence, mDirManager);
+      assert(copy->GetSharedBlockArray() == mSequence->GetSharedBlockArray());
+
+      copy->Delete(10, mSequence->GetMaxBlockSize());
+      assert(copy->GetSharedBlockArray() != mSequence->GetSharedBlockArray());
+      assert(copy->GetNumSamples() == len - mSequence->GetMaxBlockSize());
+
+      assert(mSequence->Get(getBuf, floatSample, 0, len));
+      assert(memcmp(getBuf, appendBuf, len * sizeof(float)) == 0);
+
+      delete copy;
+      delete mSequence;
+      mSequence = NULL;
+
+      assert(mDirManager->blockFileHash->GetCount() == 0);
+
+      DeleteSamples(appendBuf);
+      DeleteSamples(getBuf);
+
+      std::cout << "ok\n";
+   }
+
+   // Microseconds per edit near the start of a sequence of nBlocks
+   // blocks, each edit leaving an undo copy behind
+   double TimeEdits(int nBlocks, int nEdits)
+   {
+      Sequence sequence(mDirManager, floatSample);
+      const int blockLen = sequence.GetMaxBlockSize();
+      samplePtr buf = NewSamples(blockLen, floatSample);
+      memset(buf, 0, blockLen * sizeof(float));
+      for (int i = 0; i < nBlocks; i++)
+         sequence.Append(buf, floatSample, blockLen);
+
+      std::vector<Sequence *> undo;
+      wxStopWatch watch;
+      for (int i = 0; i < nEdits; i++) {
+         undo.push_back(new Sequence(sequence, mDirManager));
+         sampleCount pos = 10 + i % 100;
+         switch (i % 3) {
+         case 0:
+            assert(sequence.Set(buf, floatSample, pos, 10));
+            break;
+         case 1:
+            assert(sequence.Delete(pos, 10));
+            break;
+         default:
+            assert(sequence.InsertSilence(pos, 10));
+            break;
+         }
+      }
+      const double result = watch.TimeInMicro().ToDouble() / nEdits;
+
+      assert(sequence.ConsistencyCheck(wxT("TimeEdits")));
+      assert(sequence.GetNumSamples() ==
+             (sampleCount)nBlocks * blockLen - (nEdits + 1) / 3 * 10 + nEdits / 3 * 10);
+
+      // The copies share blocks with the edited sequence, but must be
+      // left as they were
+      for (auto copy : undo) {
+         assert(copy->ConsistencyCheck(wxT("TimeEdits undo")));
+         delete copy;
+      }
+      DeleteSamples(buf);
+      return result;
+   }
+
+   void TestEditLatency()
+   {
+      /* The blocks are in a tree, so an edit near the start does not
+       * move the starts of all the blocks after it, and an undo copy
+       * costs no more than the edit.  Edits of a long sequence should
+       * take about as long as those of a short one.  The timings are
+       * only printed, since a loaded machine makes them unreliable;
+       * TimeEdits() checks the structure the edits leave. */
+
+      std::cout << "	edits near the start of short and long sequences..." << std::flush;
+
+      const int oldSize = Sequence::GetMaxDiskBlockSize();
+      // Small blocks, so that there are many of them
+      Sequence::SetMaxDiskBlockSize(1024);
+
+      const double shortTime = TimeEdits(500, 300);
+      const double longTime = TimeEdits(8000, 300);
+
+      Sequence::SetMaxDiskBlockSize(oldSize);
+
+      assert(mDirManager->blockFileHash->GetCount() == 0);
+
+      std::cout << "ok, " << shortTime << " us per edit of 500 blocks, "
+                << longTime << " us of 8000\n";
+   }
+
+   void TestReleaseOnOtherThreads()
+   {
+      /* Undo states share the nodes and blocks of the sequence, and
+       * may be let go of on other threads while it is edited.  Every
+       * block must still be released exactly once, and the index of
+       * blocks must agree with the tree after each edit. */
+
+      std::cout << "\tundo copies released on other threads during edits should release each block once..." << std::flush;
+
+      const int oldSize = Sequence::GetMaxDiskBlockSize();
+      // Small blocks, so that there are many of them
+      Sequence::SetMaxDiskBlockSize(1024);
+      delete mSequence;
+      mSequence = new Sequence(mDirManager, floatSample);
+
+      const int blockLen = mSequence->GetMaxBlockSize();
+      samplePtr buf = NewSamples(blockLen, floatSample);
+      memset(buf, 0, blockLen * sizeof(float));
+      for (int i = 0; i < 200; i++)
+         mSequence->Append(buf, floatSample, blockLen);
+
+      const int nThreads = 4, nEdits = 200;
+      std::vector<std::vector<Sequence *>> undo(nThreads);
+      for (int i = 0; i < nEdits; i++)
+         undo[i % nThreads].push_back(new Sequence(*mSequence, mDirManager));
+
+      std::vector<std::thread> threads;
+      for (auto &copies : undo)
+         threads.push_back(std::thread([&copies] {
+            for (auto copy : copies)
+               delete copy;
+         }));
+      for (int i = 0; i < nEdits; i++) {
+         const sampleCount pos = (sampleCount)rand() % (mSequence->GetNumSamples() - 20);
+         if (i % 2)
+            assert(mSequence->Delete(pos, 10));
+         else
+            assert(mSequence->InsertSilence(pos, 10));
+
+         const BlockArray &blocks = mSequence->GetBlockArray();
+         size_t b = 0;
+         for (const auto &block : blocks) {
+            assert(blocks[b].f == block.f && blocks[b].start == block.start);
+            assert(blocks.Lookup(b).start == block.start);
+            ++b;
+         }
+      }
+      for (auto &thread : threads)
+         thread.join();
+
+      Sequence::SetMaxDiskBlockSize(oldSize);
+      delete mSequence;
+      mSequence = NULL;
+
+      assert(mDirManager->blockFileHash->GetCount() == 0);
+
+      DeleteSamples(buf);
+
+      std::cout << "ok\n";
+   }
+
+   // Fills sequence as the concurrent PCM import does: one block of
+   // the maximum size at a time, each made into a block file on a
+   // thread of its own, then appended in order
+   void AppendAsImport(Sequence &sequence, const std::vector<float> &data)
+   {
+      const sampleCount blockLen = sequence.GetMaxBlockSize();
+      const int count = (int)((data.size() + blockLen - 1) / blockLen);
+      std::vector<BlockFile *> blocks(count);
+      std::vector<std::thread> threads;
+      for (int k = 0; k < count; k++) {
+         threads.push_back(std::thread([&, k] {
+            const sampleCount len =
+               std::min(blockLen, (sampleCount)data.size() - k * blockLen);
+            SampleBuffer scratch(blockLen, sequence.GetSampleFormat());
+            blocks[k] = sequence.NewBlockFile(
+               (samplePtr)&data[k * blockLen], floatSample, len, scratch.ptr());
+         }));
+      }
+      for (auto &thread : threads)
+         thread.join();
+      for (auto block : blocks)
+         sequence.AppendBlockFile(block);
+   }
+
+   void TestImportConversion()
+   {
+      /* Float samples imported into an int24 track are converted a
+       * block at a time on worker threads.  Without dither they must
+       * come out exactly as Append() stores them; with dither both
+       * must be dithered alike, not just rounded. */
+
+      std::cout << "	float samples imported into int24 should match Sequence::Append()..." << std::flush;
+
+      const sampleCount len = (sampleCount)(mSequence->GetMaxBlockSize() * 3.5);
+      std::vector<float> data(len);
+      for (sampleCount i = 0; i < len; i++)
+         data[i] = rand() / (float)RAND_MAX * 1.8f - 0.9f;
+
+      std::vector<int> rounded(len);
+      CopySamplesNoDither((samplePtr)&data[0], floatSample,
+                          (samplePtr)&rounded[0], int24Sample, len);
+
+      // Dither preferences as a fresh install has them
+      wxStringInputStream noPrefs(wxT(""));
+      gPrefs = new wxFileConfig(noPrefs);
+      const Dither::DitherType types[] = { Dither::none, Dither::shaped };
+      for (int t = 0; t < 2; t++) {
+         gPrefs->Write(wxT("/Quality/HQDitherAlgorithm"), (long)types[t]);
+         InitDitherers();
+
+         Sequence serial(mDirManager, int24Sample);
+         serial.Append((samplePtr)&data[0], floatSample, len);
+         Sequence imported(mDirManager, int24Sample);
+         AppendAsImport(imported, data);
+         assert(imported.GetNumSamples() == len);
+         assert(imported.ConsistencyCheck(wxT("TestImportConversion")));
+
+         std::vector<int> expected(len), actual(len);
+         assert(serial.Get((samplePtr)&expected[0], int24Sample, 0, len));
+         assert(imported.Get((samplePtr)&actual[0], int24Sample, 0, len));
+
+         if (types[t] == Dither::none) {
+            assert(expected == rounded);
+            assert(actual == expected);
+            continue;
+         }
+         double serialPower = 0, importedPower = 0;
+         for (sampleCount i = 0; i < len; i++) {
+            const double e = expected[i] - data[i] * 8388608.0;
+            const double a = actual[i] - data[i] * 8388608.0;
+            serialPower += e * e, importedPower += a * a;
+            assert(fabs(a) < 16);
+         }
+         assert(actual != rounded);
+         // The same shaped noise, drawn with other seeds
+         const double ratio = importedPower / serialPower;
+         assert(ratio > 0.9 && ratio < 1.1);
+      }
+
+      gPrefs->Write(wxT("/Quality/HQDitherAlgorithm"), (long)Dither::none);
+      InitDitherers();
+      delete gPrefs;
+      gPrefs = NULL;
+
+      std::cout << "ok\n";
+   }
+
    void TestSetGarbageInput()
    {
       std::cout << "\tSequence::Set() should return false (and not crash) if given garbage input..." << std::flush;
@@ -141,6 +407,22 @@ int main()
    tester.TestReferencing();
    tester.TearDown();
 
+   tester.SetUp();
+   tester.TestSharing();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestEditLatency();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestReleaseOnOtherThreads();
+   tester.TearDown();
+
+   tester.SetUp();
+   tester.TestImportConversion();
+   tester.TearDown();
+
    tester.SetUp();
    tester.TestSetGarbageInput();
    tester.TearDown();
@@ -2,9 +2,14 @@
 #include <iostream>
 #include <ostream>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
 
 #include "sndfile.h"
 #include "blockfile/SimpleBlockFile.h"
+#include "blockfile/PackedBlockFile.h"
+#include "MappedFile.h"
 
 
 class SimpleBlockFileTest {
@@ -186,6 +191,142 @@ public:
 
        std::cout << "OK\n";
    }
+
+   void testMappedReads() {
+      // Reads from mapped files must give exactly what libsndfile gives.
+      // (Conversions that dither are left out, since dither is random.)
+      std::cout << "\tVerifying that mapped reads match libsndfile reads..." << std::flush;
+
+      struct { SimpleBlockFile *file; sampleFormat format; } cases[] = {
+         { int16BlockFile, int16Sample }, { int16BlockFile, int24Sample },
+         { int16BlockFile, floatSample },
+         { int24BlockFile, int16Sample }, { int24BlockFile, int24Sample },
+         { int24BlockFile, floatSample },
+         { floatBlockFile, floatSample },
+      };
+
+      int someOffset = 537;
+      int len = dataLen - 2 * someOffset;
+      samplePtr expected = NewSamples(len, floatSample);
+      samplePtr actual = NewSamples(len, floatSample);
+
+      for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      {
+         sampleFormat format = cases[i].format;
+
+         MappedFilePool::Instance().SetCapacity(0);
+         assert(cases[i].file->ReadData(expected, format, someOffset, len) == len);
+
+         MappedFilePool::Instance().SetCapacity(2);
+         assert(cases[i].file->ReadData(actual, format, someOffset, len) == len);
+
+         assert(memcmp(expected, actual, len * SAMPLE_SIZE(format)) == 0);
+      }
+
+      // Float blocks are lent without copying; the others are not
+      std::shared_ptr<const void> holder;
+      const float *floats = floatBlockFile->GetFloatsNoCopy(someOffset, len, holder);
+      assert(floats && holder);
+      AssertBuffersEqual(floatData + someOffset, (float *)floats, len);
+
+      std::shared_ptr<const void> noHolder;
+      assert(!int16BlockFile->GetFloatsNoCopy(someOffset, len, noHolder));
+      assert(!noHolder);
+
+      // A lent pointer outlives the pool's hold on the mapping
+      MappedFilePool::Instance().SetCapacity(0);
+      AssertBuffersEqual(floatData + someOffset, (float *)floats, len);
+      holder.reset();
+
+      DeleteSamples(expected);
+      DeleteSamples(actual);
+
+      std::cout << "OK\n";
+   }
+
+   void testSummaryLevels() {
+      // Min, max and rms of a region must not depend on how the region
+      // is split between summary levels and samples
+      std::cout << "\tVerifying min/max/rms from summary levels..." << std::flush;
+
+      const int starts[] = { 0, 1, 255, 256, 4097, 70000 };
+      const int lens[] = { 1, 300, 4096, 65536 + 511, 120000 };
+      for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++)
+         for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); j++)
+         {
+            const int start = starts[i];
+            const int len = std::min(lens[j], dataLen - start);
+
+            float min = FLT_MAX, max = -FLT_MAX;
+            double sumsq = 0;
+            for (int k = start; k < start + len; k++) {
+               min = std::min(min, floatData[k]);
+               max = std::max(max, floatData[k]);
+               sumsq += floatData[k] * floatData[k];
+            }
+
+            float outMin, outMax, outRMS;
+            floatBlockFile->GetMinMax(start, len, &outMin, &outMax, &outRMS);
+            assert(outMin == min && outMax == max);
+            assert(fabs(outRMS - sqrt(sumsq / len)) < 1e-4 * (1 + outRMS));
+         }
+
+      // The coarsest level has one frame for the whole block
+      float top[3];
+      assert(floatBlockFile->ReadSummaryLevel(top, 10, 0, 1));
+      float blockMin, blockMax, blockRMS;
+      floatBlockFile->GetMinMax(&blockMin, &blockMax, &blockRMS);
+      assert(top[0] == blockMin && top[1] == blockMax);
+
+      std::cout << "OK\n";
+   }
+
+   void testPackedReads() {
+      // Records in a pack must read back as the same samples as the .au files
+      std::cout << "\tVerifying that packed blocks read back correctly..." << std::flush;
+
+      BlockPackStore store;
+      struct { SimpleBlockFile *file; samplePtr data; sampleFormat format; } cases[] = {
+         { int16BlockFile, (samplePtr)int16Data, int16Sample },
+         { int24BlockFile, (samplePtr)int24Data, int24Sample },
+         { floatBlockFile, (samplePtr)floatData, floatSample },
+      };
+
+      int someOffset = 537;
+      int len = dataLen - 2 * someOffset;
+      samplePtr expected = NewSamples(len, floatSample);
+      samplePtr actual = NewSamples(len, floatSample);
+      PackedBlockFile *packed[3];
+
+      for (int i = 0; i < 3; i++)
+      {
+         packed[i] = new PackedBlockFile(wxFileName("/tmp/packed"), store, "/tmp",
+                                         cases[i].data, dataLen, cases[i].format);
+
+         cases[i].file->ReadData(expected, floatSample, someOffset, len);
+         assert(packed[i]->ReadData(actual, floatSample, someOffset, len) == len);
+         assert(memcmp(expected, actual, len * sizeof(float)) == 0);
+      }
+
+      // All three share one pack, and a freed record's space is reused
+      assert(packed[0]->GetPack() == packed[2]->GetPack());
+      const wxString path = packed[0]->GetPack()->GetPath();
+      wxFileOffset offset;
+      delete packed[0];
+      std::shared_ptr<BlockPack> pack = store.Reserve("/tmp", 1000, offset);
+      assert(pack.get() == packed[1]->GetPack() && offset == 0);
+      pack->Release(offset);
+
+      // The pack goes with its last record
+      delete packed[1];
+      delete packed[2];
+      assert(!wxFileExists(path));
+
+      DeleteSamples(expected);
+      DeleteSamples(actual);
+
+      std::cout << "OK\n";
+   }
 };
 
 int main()
@@ -204,6 +345,18 @@ int main()
     tester.testReads();
     tester.tearDown();
 
+    tester.setUp();
+    tester.testMappedReads();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.testSummaryLevels();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.testPackedReads();
+    tester.tearDown();
+
     return 0;
 }
 
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <ostream>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <wx/stopwatch.h>
+
+#include "SummaryKernels.h"
+
+// Checks that every summary kernel path the CPU supports gives the same
+// bits as the scalar one, and reports how fast each path summarizes.
+class SummaryKernelsTest {
+   std::vector<float> data;
+
+public:
+   SummaryKernelsTest()
+   {
+      std::cout << "==> Testing SummaryKernels\n";
+   }
+
+   void setUp() {
+      data.resize(1 << 20);
+      for (size_t i = 0; i < data.size(); i++)
+         data[i] = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+   }
+
+   void tearDown() {
+      data.clear();
+      SummaryKernels::SetPath(SummaryKernels::GetBestPath());
+   }
+
+   std::vector<SummaryKernels::Path> supportedPaths() {
+      std::vector<SummaryKernels::Path> paths;
+      const SummaryKernels::Path all[] =
+         { SummaryKernels::Scalar, SummaryKernels::SSE2, SummaryKernels::AVX };
+      for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++)
+         if (SummaryKernels::SetPath(all[i]))
+            paths.push_back(all[i]);
+      return paths;
+   }
+
+   void testIdenticalResults() {
+      std::cout << "\tall paths should give identical results..." << std::flush;
+
+      // Odd lengths and offsets exercise the partial lane groups
+      const size_t lens[] = { 0, 1, 7, 8, 9, 255, 256, 1000, 65536 + 3 };
+      const size_t offsets[] = { 0, 1, 5 };
+
+      // Make some special values turn up
+      data[3] = -0.0f;
+      data[4] = 0.0f;
+      data[70] = NAN;
+
+      std::vector<SummaryKernels::Path> paths = supportedPaths();
+      for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+         for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++)
+         {
+            const float *samples = &data[offsets[o]];
+            const size_t len = lens[l];
+            const size_t frames = (len + 255) / 256;
+
+            float expected[3];
+            std::vector<float> expectedFrames(3 * frames + 1);
+            SummaryKernels::SetPath(SummaryKernels::Scalar);
+            SummaryKernels::MinMaxSumsq(samples, len,
+               &expected[0], &expected[1], &expected[2]);
+            SummaryKernels::SummaryFrames(samples, len, 256, &expectedFrames[0]);
+
+            for (size_t p = 1; p < paths.size(); p++) {
+               float actual[3];
+               std::vector<float> actualFrames(3 * frames + 1);
+               SummaryKernels::SetPath(paths[p]);
+               SummaryKernels::MinMaxSumsq(samples, len,
+                  &actual[0], &actual[1], &actual[2]);
+               SummaryKernels::SummaryFrames(samples, len, 256, &actualFrames[0]);
+
+               assert(memcmp(expected, actual, sizeof(expected)) == 0);
+               assert(memcmp(&expectedFrames[0], &actualFrames[0],
+                             3 * frames * sizeof(float)) == 0);
+            }
+         }
+
+      // Without special values, compare with the obvious loop
+      float min = FLT_MAX, max = -FLT_MAX, outMin, outMax, outSumsq;
+      double sumsq = 0;
+      for (size_t i = 100; i < data.size(); i++) {
+         min = std::min(min, data[i]);
+         max = std::max(max, data[i]);
+         sumsq += data[i] * data[i];
+      }
+      SummaryKernels::MinMaxSumsq(&data[100], data.size() - 100,
+                                  &outMin, &outMax, &outSumsq);
+      assert(outMin == min && outMax == max);
+      assert(fabs(outSumsq - sumsq) < 1e-4 * sumsq);
+
+      std::cout << "OK\n";
+   }
+
+   void benchmarkPaths() {
+      std::cout << "\tsummarizing 256 MB of samples:\n";
+
+      const int repeats = 64;
+      std::vector<float> summary(3 * (data.size() / 256));
+      std::vector<SummaryKernels::Path> paths = supportedPaths();
+      long scalarTime = 0;
+      for (size_t p = 0; p < paths.size(); p++) {
+         SummaryKernels::SetPath(paths[p]);
+         wxStopWatch timer;
+         for (int r = 0; r < repeats; r++)
+            SummaryKernels::SummaryFrames(&data[0], data.size(), 256, &summary[0]);
+         long elapsed = timer.Time();
+         if (paths[p] == SummaryKernels::Scalar)
+            scalarTime = elapsed;
+
+         std::cout << "\t\t" << wxString(SummaryKernels::GetPathName(paths[p])).mb_str()
+                   << ": " << elapsed << " ms";
+         if (paths[p] != SummaryKernels::Scalar && elapsed > 0)
+            std::cout << ", speedup " << scalarTime / (double)elapsed;
+         std::cout << "\n";
+      }
+   }
+};
+
+int main()
+{
+    SummaryKernelsTest tester;
+
+    tester.setUp();
+    tester.testIdenticalResults();
+    tester.tearDown();
+
+    tester.setUp();
+    tester.benchmarkPaths();
+    tester.tearDown();
+
+    return 0;
+}